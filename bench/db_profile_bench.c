@@ -0,0 +1,294 @@
+/**
+ * @file db_profile_bench.c  cache DB tuning profile benchmark
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Compares the DB tuning profiles (see src/db_profile.h) on a synthetic
+   items table using the same statement patterns as src/db.c:
+
+   update	items are merged per feed in one transaction each
+   state	single item read state changes in auto-commit mode
+   browse	item set loading, unread counting and item loading per feed
+   flush	time until all queued writes reached the disk (async only)
+
+   Usage: db_profile_bench [--items=N] [--feeds=N] [--profile=async|wal|all] */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <sqlite3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "db_profile.h"
+#include "sqlite3async.h"
+
+static gint itemCount = 20000;
+static gint feedCount = 100;
+static gchar *profileName = "all";
+
+static GOptionEntry entries[] = {
+	{ "items", 0, 0, G_OPTION_ARG_INT, &itemCount, "Number of items", "N" },
+	{ "feeds", 0, 0, G_OPTION_ARG_INT, &feedCount, "Number of feeds", "N" },
+	{ "profile", 0, 0, G_OPTION_ARG_STRING, &profileName, "Profile to run (async, wal or all)", "NAME" },
+	{ NULL }
+};
+
+static void
+bench_exec (sqlite3 *db, const gchar *sql)
+{
+	gchar	*err = NULL;
+
+	if (SQLITE_OK != sqlite3_exec (db, sql, NULL, NULL, &err)) {
+		g_printerr ("SQL failed (%s): %s\n", err, sql);
+		exit (1);
+	}
+}
+
+static sqlite3_stmt *
+bench_prepare (sqlite3 *db, const gchar *sql)
+{
+	sqlite3_stmt	*stmt;
+
+	if (SQLITE_OK != sqlite3_prepare_v2 (db, sql, -1, &stmt, NULL)) {
+		g_printerr ("Preparing failed (%s): %s\n", sqlite3_errmsg (db), sql);
+		exit (1);
+	}
+
+	return stmt;
+}
+
+static sqlite3 *
+bench_open (const gchar *filename, const char *zVfs)
+{
+	sqlite3	*db;
+
+	if (SQLITE_OK != sqlite3_open_v2 (filename, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, zVfs)) {
+		g_printerr ("Could not open %s: %s\n", filename, sqlite3_errmsg (db));
+		exit (1);
+	}
+
+	return db;
+}
+
+static gpointer
+bench_async_thread (gpointer data)
+{
+	sqlite3async_run ();
+	return NULL;
+}
+
+static void
+bench_update (sqlite3 *db)
+{
+	sqlite3_stmt	*stmt;
+	gchar		*text, *nodeId;
+	gint		feed, i, id = 1;
+
+	stmt = bench_prepare (db, "REPLACE INTO items (title,read,updated,popup,marked,source,source_id,"
+	                          "valid_guid,description,date,comment_feed_id,comment,item_id,"
+	                          "parent_item_id,node_id,parent_node_id) "
+	                          "VALUES (?,0,0,1,0,?,?,1,?,?,NULL,0,?,0,?,?)");
+
+	text = g_strnfill (2000, 'x');
+	for (feed = 0; feed < feedCount; feed++) {
+		nodeId = g_strdup_printf ("node%d", feed);
+		bench_exec (db, "BEGIN");
+		for (i = 0; i < itemCount / feedCount; i++, id++) {
+			gchar *guid = g_strdup_printf ("http://localhost/%d/%d", feed, i);
+
+			sqlite3_reset (stmt);
+			sqlite3_bind_text (stmt, 1, guid, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text (stmt, 2, guid, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text (stmt, 3, guid, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text (stmt, 4, text, -1, SQLITE_STATIC);
+			sqlite3_bind_int  (stmt, 5, id);
+			sqlite3_bind_int  (stmt, 6, id);
+			sqlite3_bind_text (stmt, 7, nodeId, -1, SQLITE_TRANSIENT);
+			sqlite3_bind_text (stmt, 8, nodeId, -1, SQLITE_TRANSIENT);
+			if (SQLITE_DONE != sqlite3_step (stmt))
+				g_printerr ("insert failed: %s\n", sqlite3_errmsg (db));
+			g_free (guid);
+		}
+		bench_exec (db, "END");
+		g_free (nodeId);
+	}
+	g_free (text);
+	sqlite3_finalize (stmt);
+}
+
+static void
+bench_state (sqlite3 *db)
+{
+	sqlite3_stmt	*stmt;
+	gint		i;
+
+	stmt = bench_prepare (db, "UPDATE items SET read=?, marked=?, updated=? WHERE item_id=?");
+	for (i = 0; i < itemCount / 10; i++) {
+		sqlite3_reset (stmt);
+		sqlite3_bind_int (stmt, 1, 1);
+		sqlite3_bind_int (stmt, 2, 0);
+		sqlite3_bind_int (stmt, 3, 0);
+		sqlite3_bind_int (stmt, 4, g_random_int_range (1, itemCount + 1));
+		sqlite3_step (stmt);
+	}
+	sqlite3_finalize (stmt);
+}
+
+static void
+bench_browse (sqlite3 *db)
+{
+	sqlite3_stmt	*load, *count, *item;
+	gint		feed, n;
+
+	load = bench_prepare (db, "SELECT item_id FROM items WHERE node_id = ? ORDER BY item_id");
+	count = bench_prepare (db, "SELECT COUNT(*) FROM items WHERE read = 0 AND node_id = ?");
+	item = bench_prepare (db, "SELECT title,read,updated,popup,marked,source,source_id,valid_guid,"
+	                          "description,date FROM items WHERE item_id = ?");
+
+	for (feed = 0; feed < feedCount; feed++) {
+		gchar *nodeId = g_strdup_printf ("node%d", feed);
+
+		sqlite3_reset (count);
+		sqlite3_bind_text (count, 1, nodeId, -1, SQLITE_TRANSIENT);
+		sqlite3_step (count);
+
+		/* load the item set and render the first 20 items */
+		sqlite3_reset (load);
+		sqlite3_bind_text (load, 1, nodeId, -1, SQLITE_TRANSIENT);
+		n = 0;
+		while (SQLITE_ROW == sqlite3_step (load)) {
+			if (n++ < 20) {
+				sqlite3_reset (item);
+				sqlite3_bind_int (item, 1, sqlite3_column_int (load, 0));
+				sqlite3_step (item);
+			}
+		}
+		g_free (nodeId);
+	}
+
+	sqlite3_finalize (load);
+	sqlite3_finalize (count);
+	sqlite3_finalize (item);
+}
+
+static void
+bench_run (dbProfileMode mode)
+{
+	dbProfile	profile;
+	sqlite3		*db;
+	GThread		*thread = NULL;
+	GTimer		*timer;
+	gchar		*filename, *report;
+	gdouble		update, state, browse, flush = 0;
+	sqlite3async_stats	stats;
+
+	filename = g_strdup_printf ("%s/liferea-bench-%d-%s.db", g_get_tmp_dir (), getpid (), db_profile_mode_to_name (mode));
+
+	/* Setup with the default VFS just like db_init() does */
+	db_profile_init (&profile, mode, filename);
+	db = bench_open (filename, NULL);
+	db_profile_set_journal_mode (&profile, db);
+	bench_exec (db, "CREATE TABLE items ("
+	                "   item_id INTEGER, parent_item_id INTEGER, node_id TEXT, parent_node_id TEXT,"
+	                "   title TEXT, read INTEGER, updated INTEGER, popup INTEGER, marked INTEGER,"
+	                "   source TEXT, source_id TEXT, valid_guid INTEGER, description TEXT,"
+	                "   date INTEGER, comment_feed_id TEXT, comment INTEGER,"
+	                "   PRIMARY KEY (item_id))");
+	bench_exec (db, "CREATE INDEX items_idx ON items (source_id)");
+	bench_exec (db, "CREATE INDEX items_idx3 ON items (node_id)");
+	sqlite3_close (db);
+
+	if (DB_PROFILE_ASYNC == profile.mode) {
+		sqlite3async_initialize (NULL, 0);
+		thread = g_thread_create (bench_async_thread, NULL, TRUE, NULL);
+		db = bench_open (filename, SQLITEASYNC_VFSNAME);
+	} else {
+		db = bench_open (filename, NULL);
+	}
+	report = db_profile_apply (&profile, db);
+
+	timer = g_timer_new ();
+	bench_update (db);
+	update = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	bench_state (db);
+	state = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	bench_browse (db);
+	browse = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	sqlite3_close (db);
+	if (thread) {
+		sqlite3async_control (SQLITEASYNC_HALT, SQLITEASYNC_HALT_IDLE);
+		g_thread_join (thread);
+		sqlite3async_control (SQLITEASYNC_GET_STATS, &stats);
+		sqlite3async_shutdown ();
+	}
+	flush = g_timer_elapsed (timer, NULL);
+
+	g_print ("%s\n", report);
+	if (thread)
+		g_print ("async  %" G_GINT64_FORMAT " ops, max queue depth %d, %" G_GINT64_FORMAT " of %" G_GINT64_FORMAT " writes coalesced, latency avg %.1fms max %.1fms\n",
+		         (gint64)stats.nOp, stats.nQueueMax,
+		         (gint64)stats.nCoalesced, (gint64)stats.nWrite,
+		         stats.nOp ? stats.iLatencyTotal / 1000.0 / stats.nOp : 0.0,
+		         stats.iLatencyMax / 1000.0);
+	g_print ("%-6s update %8.1fms  state %8.1fms  browse %8.1fms  close/flush %8.1fms  total %8.1fms\n",
+	         db_profile_mode_to_name (profile.mode),
+	         update * 1000, state * 1000, browse * 1000, flush * 1000,
+	         (update + state + browse + flush) * 1000);
+
+	g_timer_destroy (timer);
+	g_free (report);
+	g_unlink (filename);
+	g_free (filename);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext	*context;
+	GError		*error = NULL;
+
+	g_thread_init (NULL);
+
+	context = g_option_context_new ("- compare cache DB tuning profiles");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (feedCount < 1 || itemCount < feedCount) {
+		g_printerr ("Invalid item or feed count!\n");
+		return 1;
+	}
+
+	g_print ("%d items in %d feeds\n", itemCount, feedCount);
+	if (g_str_equal (profileName, "all") || g_str_equal (profileName, "async"))
+		bench_run (DB_PROFILE_ASYNC);
+	if (g_str_equal (profileName, "all") || g_str_equal (profileName, "wal"))
+		bench_run (DB_PROFILE_WAL);
+
+	return 0;
+}
@@ -0,0 +1,387 @@
+/**
+ * @file feed_bench.c  feed parsing and merging benchmark
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Runs the feed parsers and the item set merging of src/ on every
+   feed of the corpus directory and on two generated pathological
+   feeds using a cache DB in a temporary directory:
+
+   parse		feed_parse() of the feed
+   merge-empty		merging all items into an empty item set
+   merge-unchanged	merging the same items again (no changes)
+   merge-updates	merging the items with changed descriptions
+
+   All results are given in items per second (the best of all
+   iterations) so they can be compared across releases and machines.
+
+   Usage: feed_bench [--corpus=DIR] [--iterations=N] [--no-generated] */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "comments.h"
+#include "common.h"
+#include "conf.h"
+#include "db.h"
+#include "debug.h"
+#include "enclosure_download.h"
+#include "feed.h"
+#include "feed_parser.h"
+#include "item.h"
+#include "itemlist.h"
+#include "itemset.h"
+#include "metadata.h"
+#include "node.h"
+#include "node_type.h"
+#include "rule.h"
+#include "subscription.h"
+#include "update.h"
+#include "vfolder.h"
+#include "xml.h"
+#include "ui/liferea_shell.h"
+#include "ui/ui_prefs.h"
+
+/* the pathological feeds */
+#define BENCH_HUGE_ITEMS		10000
+#define BENCH_HUGE_DESCRIPTION		(5 * 1024 * 1024)
+
+static gchar *corpusDir = "corpus";
+static gint iterations = 3;
+static gboolean noGenerated = FALSE;
+
+static GOptionEntry entries[] = {
+	{ "corpus", 0, 0, G_OPTION_ARG_FILENAME, &corpusDir, "Directory with the feeds to parse", "DIR" },
+	{ "iterations", 0, 0, G_OPTION_ARG_INT, &iterations, "Number of runs per feed", "N" },
+	{ "no-generated", 0, 0, G_OPTION_ARG_NONE, &noGenerated, "Skip the generated pathological feeds", NULL },
+	{ NULL }
+};
+
+/* The benchmark links only the parsing, merging and DB code. The
+   following functions of the remaining program are replaced with
+   minimal versions. There are no nodes, search folders or GUI. */
+
+gboolean conf_get_bool_value (const gchar *key, gboolean *value) { *value = FALSE; return FALSE; }
+gboolean conf_get_int_value (const gchar *key, gint *value) { *value = 0; return FALSE; }
+gboolean conf_get_str_value (const gchar *key, gchar **value) { *value = g_strdup (""); return FALSE; }
+void comments_to_xml (xmlNodePtr parentNode, const gchar *id) { }
+void enclosure_download_queue (const gchar *url, const gchar *filename, const gchar *run) { }
+guint feed_get_max_item_count (nodePtr node) { return G_MAXUINT; }
+nodeTypePtr feed_get_node_type (void) { return NULL; }
+void itemlist_remove_items (itemSetPtr itemSet, GList *items) { }
+void liferea_shell_set_status_bar (const char *format, ...) { }
+nodePtr node_from_id (const gchar *id) { return NULL; }
+const gchar * node_get_base_url (nodePtr node) { return NULL; }
+const gchar * node_get_title (nodePtr node) { return NULL; }
+const gchar * node_type_to_str (nodePtr node) { return "feed"; }
+void node_update_counters (nodePtr node) { }
+struct enclosureDownloadTool * prefs_get_download_tool (void) { return NULL; }
+rulePtr rule_new (const gchar *ruleId, const gchar *value, gboolean additive) { return NULL; }
+void rule_free (rulePtr rule) { }
+void subscription_cancel_update (subscriptionPtr subscription) { }
+void subscription_update (subscriptionPtr subscription, guint flags) { }
+guint subscription_get_default_update_interval (subscriptionPtr subscription) { return subscription->defaultInterval; }
+void subscription_set_default_update_interval (subscriptionPtr subscription, guint interval) { subscription->defaultInterval = interval; }
+const gchar * subscription_get_source (subscriptionPtr subscription) { return subscription->source; }
+void subscription_set_source (subscriptionPtr subscription, const gchar *source) { }
+const gchar * subscription_get_homepage (subscriptionPtr subscription) { return metadata_list_get (subscription->metadata, "homepage"); }
+void subscription_set_homepage (subscriptionPtr subscription, const gchar *url) { metadata_list_set (&subscription->metadata, "homepage", url); }
+updateRequestPtr update_request_new (void) { return g_new0 (struct updateRequest, 1); }
+updateOptionsPtr update_options_copy (updateOptionsPtr options) { return NULL; }
+updateJobPtr update_execute_request (gpointer owner, updateRequestPtr request, update_result_cb callback, gpointer user_data, updateFlags flags) { return NULL; }
+void vfolder_check_item (vfolderPtr vfolder, itemPtr item) { }
+void vfolder_foreach (nodeActionFunc func) { }
+void vfolder_foreach_data (vfolderActionDataFunc func, itemPtr item) { }
+GSList * vfolder_get_all_with_item_id (gulong id) { return NULL; }
+
+typedef struct benchResult {
+	guint		items;
+	gdouble		parse, mergeEmpty, mergeUnchanged, mergeUpdates;	/**< best times in s */
+} benchResult;
+
+/* Parses the feed, returns the items and the parsing time */
+static GList *
+bench_parse (const gchar *name, gchar *data, gsize length, gdouble *time)
+{
+	feedParserCtxtPtr	ctxt;
+	GList			*items;
+	GTimer			*timer;
+
+	ctxt = feed_create_parser_ctxt ();
+	ctxt->feed = g_new0 (struct feed, 1);
+	ctxt->subscription = g_new0 (struct subscription, 1);
+	ctxt->subscription->source = g_strdup_printf ("file://%s", name);
+	ctxt->data = data;
+	ctxt->dataLength = length;
+
+	timer = g_timer_new ();
+	feed_parse (ctxt);
+	*time = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	if (ctxt->failed)
+		g_printerr ("%s: %s\n", name, ctxt->feed->parseErrors->str);
+
+	items = ctxt->items;
+	g_string_free (ctxt->feed->parseErrors, TRUE);
+	g_free (ctxt->feed);
+	metadata_list_free (ctxt->subscription->metadata);
+	g_free (ctxt->subscription->source);
+	g_free (ctxt->subscription);
+	feed_free_parser_ctxt (ctxt);
+
+	return items;
+}
+
+/* Merges the items into the item set of the given node, returns the merging time */
+static gdouble
+bench_merge (const gchar *nodeId, GList *items)
+{
+	itemSetPtr	itemSet;
+	GTimer		*timer;
+	gdouble		time;
+
+	timer = g_timer_new ();
+	itemSet = db_itemset_load (nodeId);
+	itemset_merge_items (itemSet, items, TRUE, FALSE);
+	itemset_free (itemSet);
+	time = g_timer_elapsed (timer, NULL);
+	g_timer_destroy (timer);
+
+	return time;
+}
+
+static void
+bench_change_descriptions (GList *items)
+{
+	GList	*iter;
+
+	for (iter = items; iter; iter = g_list_next (iter)) {
+		itemPtr	item = (itemPtr)iter->data;
+		gchar	*description;
+
+		description = g_strdup_printf ("%s<p>updated</p>", item->description ? item->description : "");
+		g_free (item->description);
+		item->description = description;
+	}
+}
+
+static void
+bench_feed (const gchar *name, gchar *data, gsize length, benchResult *result)
+{
+	GList		*items;
+	gdouble		time;
+	gint		i;
+
+	memset (result, 0, sizeof (benchResult));
+	result->parse = result->mergeEmpty = result->mergeUnchanged = result->mergeUpdates = G_MAXDOUBLE;
+
+	for (i = 0; i < iterations; i++) {
+		gchar	*nodeId = g_strdup_printf ("bench%d-%s", i, name);
+
+		items = bench_parse (name, data, length, &time);
+		result->items = g_list_length (items);
+		result->parse = MIN (result->parse, time);
+
+		result->mergeEmpty = MIN (result->mergeEmpty, bench_merge (nodeId, items));
+
+		items = bench_parse (name, data, length, &time);
+		result->mergeUnchanged = MIN (result->mergeUnchanged, bench_merge (nodeId, items));
+
+		items = bench_parse (name, data, length, &time);
+		bench_change_descriptions (items);
+		result->mergeUpdates = MIN (result->mergeUpdates, bench_merge (nodeId, items));
+
+		g_free (nodeId);
+	}
+}
+
+static void
+bench_print (const gchar *name, gsize length, benchResult *result)
+{
+	g_print ("%-28s %7u %9" G_GSIZE_FORMAT "k %12.0f %12.0f %12.0f %12.0f\n",
+	         name, result->items, length / 1024,
+	         result->items / result->parse,
+	         result->items / result->mergeEmpty,
+	         result->items / result->mergeUnchanged,
+	         result->items / result->mergeUpdates);
+}
+
+/* RSS 2.0 feed with BENCH_HUGE_ITEMS short items */
+static GString *
+bench_generate_many_items (void)
+{
+	GString	*feed;
+	gint	i;
+
+	feed = g_string_new ("<?xml version=\"1.0\"?>\n<rss version=\"2.0\"><channel>"
+	                     "<title>Many items</title><link>http://localhost/</link>"
+	                     "<description>generated</description>\n");
+	for (i = 0; i < BENCH_HUGE_ITEMS; i++)
+		g_string_append_printf (feed, "<item><title>Item %d</title><link>http://localhost/%d</link>"
+		                              "<guid>http://localhost/%d</guid><description>Description of item %d</description>"
+		                              "<pubDate>Mon, 01 Mar 2010 %02d:%02d:%02d GMT</pubDate></item>\n",
+		                        i, i, i, i, (i / 3600) % 24, (i / 60) % 60, i % 60);
+	g_string_append (feed, "</channel></rss>\n");
+
+	return feed;
+}
+
+/* Atom 1.0 feed with few items with a BENCH_HUGE_DESCRIPTION sized content */
+static GString *
+bench_generate_huge_description (void)
+{
+	GString	*feed;
+	gint	i, j;
+
+	feed = g_string_new ("<?xml version=\"1.0\"?>\n<feed xmlns=\"http://www.w3.org/2005/Atom\">"
+	                     "<title>Huge descriptions</title><id>urn:bench:huge</id>"
+	                     "<updated>2010-03-01T00:00:00Z</updated>\n");
+	for (i = 0; i < 3; i++) {
+		g_string_append_printf (feed, "<entry><title>Entry %d</title><id>urn:bench:huge:%d</id>"
+		                              "<updated>2010-03-01T00:00:0%dZ</updated><content type=\"html\">",
+		                        i, i, i);
+		for (j = 0; j < BENCH_HUGE_DESCRIPTION / 64; j++)
+			g_string_append (feed, "&lt;p&gt;Lorem ipsum dolor sit amet, consectetur adip.&lt;/p&gt;\n");
+		g_string_append (feed, "</content></entry>\n");
+	}
+	g_string_append (feed, "</feed>\n");
+
+	return feed;
+}
+
+static void
+bench_generated (const gchar *name, GString *feed)
+{
+	benchResult	result;
+
+	bench_feed (name, feed->str, feed->len, &result);
+	bench_print (name, feed->len, &result);
+	g_string_free (feed, TRUE);
+}
+
+static gint
+bench_compare_names (gconstpointer a, gconstpointer b)
+{
+	return strcmp (*(const gchar **)a, *(const gchar **)b);
+}
+
+static void
+bench_remove_dir (const gchar *path)
+{
+	GDir		*dir;
+	const gchar	*name;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (!dir)
+		return;
+
+	while (NULL != (name = g_dir_read_name (dir))) {
+		gchar *filename = g_build_filename (path, name, NULL);
+		if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+			bench_remove_dir (filename);
+		else
+			g_unlink (filename);
+		g_free (filename);
+	}
+	g_dir_close (dir);
+	g_rmdir (path);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext	*context;
+	GError		*error = NULL;
+	GDir		*dir;
+	GPtrArray	*names;
+	const gchar	*name;
+	gchar		*cachePath;
+	guint		i;
+
+	g_thread_init (NULL);
+	g_type_init ();
+
+	context = g_option_context_new ("- benchmark feed parsing and merging");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (iterations < 1) {
+		g_printerr ("Invalid iteration count!\n");
+		return 1;
+	}
+
+	dir = g_dir_open (corpusDir, 0, &error);
+	if (!dir) {
+		g_printerr ("%s\n", error->message);
+		return 1;
+	}
+
+	names = g_ptr_array_new ();
+	while (NULL != (name = g_dir_read_name (dir)))
+		g_ptr_array_add (names, g_strdup (name));
+	g_dir_close (dir);
+	g_ptr_array_sort (names, bench_compare_names);
+
+	cachePath = g_strdup_printf ("%s/liferea-bench-%d", g_get_tmp_dir (), getpid ());
+	common_set_cache_path (cachePath);
+	db_init ();
+	xml_init ();
+
+	g_print ("%d iterations, best result in items/s\n\n", iterations);
+	g_print ("%-28s %7s %10s %12s %12s %12s %12s\n",
+	         "feed", "items", "size", "parse", "merge-empty", "unchanged", "updates");
+
+	for (i = 0; i < names->len; i++) {
+		benchResult	result;
+		gchar		*filename, *data;
+		gsize		length;
+
+		filename = g_build_filename (corpusDir, g_ptr_array_index (names, i), NULL);
+		if (g_file_get_contents (filename, &data, &length, &error)) {
+			bench_feed (g_ptr_array_index (names, i), data, length, &result);
+			bench_print (g_ptr_array_index (names, i), length, &result);
+			g_free (data);
+		} else {
+			g_printerr ("%s\n", error->message);
+			g_clear_error (&error);
+		}
+		g_free (filename);
+		g_free (g_ptr_array_index (names, i));
+	}
+	g_ptr_array_free (names, TRUE);
+
+	if (!noGenerated) {
+		bench_generated ("generated-10k-items", bench_generate_many_items ());
+		bench_generated ("generated-5mb-descriptions", bench_generate_huge_description ());
+	}
+
+	db_deinit ();
+	bench_remove_dir (cachePath);
+	g_free (cachePath);
+
+	return 0;
+}
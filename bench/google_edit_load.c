@@ -0,0 +1,464 @@
+/**
+ * @file google_edit_load.c  Google Reader edit pipeline test
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* Runs a mock Google Reader server on 127.0.0.1 and a private D-Bus
+   session bus, writes a feed list with a Google Reader source to a
+   temporary cache directory and starts "liferea --daemon" on it with
+   LIFEREA_GOOGLE_READER_URL pointing to the mock server.
+
+   The server offers the login, the subscription list with one feed
+   of --items entries, the token and the edit-tag API. Once Liferea
+   has loaded all items they are marked read with a single D-Bus
+   MarkItemsRead call. This queues one mark-read action per item in
+   src/fl_sources/google_source_edit.c, which must result in exactly
+   one token request and one edit-tag request per 100 items
+   (GOOGLE_READER_EDIT_TAG_MAX_ITEMS).
+
+   Options after "--" are passed to Liferea (e.g. --debug-update).
+
+   Usage: google_edit_load [--items=N] [--latency=MS] [--timeout=S]
+                           [--liferea=PATH] [--keep] [-- LIFEREA OPTIONS] */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+#include <dbus/dbus-glib.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* see GOOGLE_READER_EDIT_TAG_MAX_ITEMS in src/fl_sources/google_source.h */
+#define EDIT_MAX_ITEMS		100
+
+#define EDIT_TOKEN		"benchtoken"
+#define EDIT_ITEM_TITLE		"Edit bench item"
+
+#define LF_DBUS_PATH		"/org/gnome/feed/Reader"
+#define LF_DBUS_SERVICE		"org.gnome.feed.Reader"
+
+static gint itemCount = 250;
+static gint latency = 20;
+static gint timeout = 120;
+static gchar *lifereaPath = "../src/liferea";
+static gboolean keep = FALSE;
+
+static GOptionEntry entries[] = {
+	{ "items", 0, 0, G_OPTION_ARG_INT, &itemCount, "Number of items to mark read", "N" },
+	{ "latency", 0, 0, G_OPTION_ARG_INT, &latency, "Response latency", "MS" },
+	{ "timeout", 0, 0, G_OPTION_ARG_INT, &timeout, "Seconds to wait for Liferea", "S" },
+	{ "liferea", 0, 0, G_OPTION_ARG_FILENAME, &lifereaPath, "Liferea binary to run", "PATH" },
+	{ "keep", 0, 0, G_OPTION_ARG_NONE, &keep, "Keep the cache directory", NULL },
+	{ NULL }
+};
+
+static SoupServer	*server = NULL;
+static GMainLoop	*loop = NULL;
+static DBusGProxy	*proxy = NULL;
+static GPid		lifereaPid = 0;
+static gint		lifereaStatus = -1;
+static gboolean		marked = FALSE;
+static gboolean		timedOut = FALSE;
+
+/* server statistics */
+static guint		loginCount, feedCount, tokenCount, editCount, editItemCount, badTokenCount;
+
+static gchar *
+edit_create_feed (void)
+{
+	GString	*xml = g_string_new (NULL);
+	gint	i;
+
+	g_string_append (xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	                 "<feed xmlns=\"http://www.w3.org/2005/Atom\"><title>Edit Bench</title>"
+	                 "<id>tag:google.com,2005:reader/feed/bench</id>"
+	                 "<updated>2010-01-01T00:00:00Z</updated>\n");
+
+	/* Liferea expects the <id> to be the first child of an entry */
+	for (i = 0; i < itemCount; i++)
+		g_string_append_printf (xml, "<entry><id>tag:google.com,2005:reader/item/%08x</id>"
+		                        "<title>" EDIT_ITEM_TITLE " %d</title>"
+		                        "<link rel=\"alternate\" href=\"http://127.0.0.1/item/%d\"/>"
+		                        "<updated>2010-01-01T00:00:00Z</updated>"
+		                        "<content type=\"html\">Item %d</content></entry>\n",
+		                        i, i, i, i);
+	g_string_append (xml, "</feed>\n");
+
+	return g_string_free (xml, FALSE);
+}
+
+/* counts the "i" parameters of an edit-tag request */
+static guint
+edit_count_items (const gchar *postdata, gboolean *validToken)
+{
+	gchar	**params = g_strsplit (postdata, "&", -1);
+	guint	count = 0, i;
+
+	*validToken = FALSE;
+	for (i = 0; params[i]; i++) {
+		if (g_str_has_prefix (params[i], "i="))
+			count++;
+		else if (g_str_equal (params[i], "T=" EDIT_TOKEN))
+			*validToken = TRUE;
+	}
+	g_strfreev (params);
+
+	return count;
+}
+
+static gboolean
+edit_server_unpause (gpointer msg)
+{
+	soup_server_unpause_message (server, (SoupMessage *)msg);
+	return FALSE;
+}
+
+static void
+edit_server_cb (SoupServer *server, SoupMessage *msg, const char *path,
+                GHashTable *query, SoupClientContext *client, gpointer user_data)
+{
+	const gchar	*text = NULL, *type = "text/plain";
+	gchar		*xml = NULL;
+
+	soup_message_set_status (msg, SOUP_STATUS_OK);
+
+	if (g_str_equal (path, "/accounts/ClientLogin")) {
+		loginCount++;
+		text = "SID=bench\nLSID=bench\nAuth=bench\n";
+	} else if (g_str_equal (path, "/reader/api/0/subscription/list")) {
+		type = "text/xml";
+		xml = g_strdup_printf ("<object><list name=\"subscriptions\"><object>"
+		                       "<string name=\"id\">feed/http://127.0.0.1:%u/feed</string>"
+		                       "<string name=\"title\">Edit Bench</string>"
+		                       "</object></list></object>", soup_server_get_port (server));
+	} else if (g_str_equal (path, "/reader/api/0/unread-count")) {
+		type = "text/xml";
+		text = "<object><list name=\"unreadcounts\"></list></object>";
+	} else if (g_str_has_prefix (path, "/reader/atom/feed/")) {
+		feedCount++;
+		type = "application/atom+xml";
+		xml = edit_create_feed ();
+	} else if (g_str_has_prefix (path, "/reader/atom/user/")) {
+		type = "application/atom+xml";
+		text = "<?xml version=\"1.0\"?>\n<feed xmlns=\"http://www.w3.org/2005/Atom\"><title>Shared</title></feed>\n";
+	} else if (g_str_equal (path, "/reader/api/0/token")) {
+		tokenCount++;
+		text = EDIT_TOKEN;
+	} else if (g_str_equal (path, "/reader/api/0/edit-tag") && msg->request_body->data) {
+		gboolean validToken;
+
+		editCount++;
+		editItemCount += edit_count_items (msg->request_body->data, &validToken);
+		if (!validToken)
+			badTokenCount++;
+		text = "OK";
+	} else {
+		soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);	/* e.g. favicons */
+	}
+
+	if (xml)
+		soup_message_set_response (msg, type, SOUP_MEMORY_TAKE, xml, strlen (xml));
+	else if (text)
+		soup_message_set_response (msg, type, SOUP_MEMORY_STATIC, text, strlen (text));
+
+	if (latency > 0) {
+		soup_server_pause_message (server, msg);
+		g_timeout_add (latency, edit_server_unpause, msg);
+	}
+}
+
+/* Returns the ids of all bench items known to Liferea so far */
+static GArray *
+edit_find_items (void)
+{
+	GType	itemType, itemsType;
+	GArray	*ids = g_array_new (FALSE, FALSE, sizeof (guint));
+	guint	cursor = 0;
+
+	itemType = dbus_g_type_get_struct ("GValueArray", G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING,
+	                                   G_TYPE_STRING, G_TYPE_INT64, G_TYPE_BOOLEAN, G_TYPE_BOOLEAN,
+	                                   G_TYPE_INVALID);
+	itemsType = dbus_g_type_get_collection ("GPtrArray", itemType);
+
+	do {
+		GPtrArray	*items = NULL;
+		guint		i;
+
+		if (!dbus_g_proxy_call (proxy, "SearchItems", NULL,
+		                        G_TYPE_STRING, EDIT_ITEM_TITLE,
+		                        G_TYPE_UINT, cursor,
+		                        G_TYPE_UINT, 0,
+		                        G_TYPE_INVALID,
+		                        itemsType, &items,
+		                        G_TYPE_UINT, &cursor,
+		                        G_TYPE_INVALID))
+			break;	/* not yet started */
+
+		for (i = 0; i < items->len; i++) {
+			GValueArray *item = (GValueArray *)g_ptr_array_index (items, i);
+			guint id = g_value_get_uint (g_value_array_get_nth (item, 0));
+
+			g_array_append_val (ids, id);
+			g_value_array_free (item);
+		}
+		g_ptr_array_free (items, TRUE);
+	} while (cursor);
+
+	return ids;
+}
+
+static gboolean
+edit_poll (gpointer user_data)
+{
+	static guint	settled = 0;
+	GArray		*ids;
+	guint		changed = 0;
+
+	if (marked) {
+		/* once all edits arrived Liferea gets one more poll
+		   interval to send redundant requests */
+		if (editItemCount >= (guint)itemCount && settled++) {
+			kill (lifereaPid, SIGTERM);
+			return FALSE;
+		}
+		return TRUE;
+	}
+
+	ids = edit_find_items ();
+	if (ids->len >= (guint)itemCount) {
+		g_print ("%u items loaded, marking them read\n", ids->len);
+		if (!dbus_g_proxy_call (proxy, "MarkItemsRead", NULL,
+		                        DBUS_TYPE_G_UINT_ARRAY, ids,
+		                        G_TYPE_BOOLEAN, TRUE,
+		                        G_TYPE_INVALID,
+		                        G_TYPE_UINT, &changed,
+		                        G_TYPE_INVALID))
+			g_printerr ("MarkItemsRead failed!\n");
+		g_print ("%u items changed\n", changed);
+		marked = TRUE;
+	}
+	g_array_free (ids, TRUE);
+
+	return TRUE;
+}
+
+static gboolean
+edit_timeout (gpointer user_data)
+{
+	g_printerr ("Timeout after %d seconds!\n", timeout);
+	timedOut = TRUE;
+	kill (lifereaPid, SIGTERM);
+	return FALSE;
+}
+
+/* Starts a private session bus, so no desktop session is needed and
+   no running Liferea instance is contacted */
+static GPid
+edit_start_bus (void)
+{
+	gchar		*argv[] = { "dbus-daemon", "--session", "--nofork", "--print-address=1", NULL };
+	GIOChannel	*channel;
+	gchar		*address = NULL;
+	GPid		pid;
+	gint		out;
+
+	if (!g_spawn_async_with_pipes (NULL, argv, NULL, G_SPAWN_SEARCH_PATH, NULL, NULL, &pid, NULL, &out, NULL, NULL))
+		return 0;
+
+	channel = g_io_channel_unix_new (out);
+	if (G_IO_STATUS_NORMAL == g_io_channel_read_line (channel, &address, NULL, NULL, NULL))
+		g_setenv ("DBUS_SESSION_BUS_ADDRESS", g_strstrip (address), TRUE);
+	g_io_channel_unref (channel);
+	g_free (address);
+
+	return pid;
+}
+
+static gboolean
+edit_write_feedlist (const gchar *cachePath)
+{
+	gchar		*filename, *opml;
+	gboolean	success;
+
+	/* the source gets the feed list from the mock server */
+	opml = g_strdup ("<?xml version=\"1.0\"?>\n<opml version=\"1.0\">\n<head><title>Edit Bench</title></head>\n<body>\n"
+	                 "<outline title=\"Google Reader\" text=\"Google Reader\" type=\"source\" sourceType=\"fl_google\" "
+	                 "id=\"googlebench\" xmlUrl=\"http://www.google.com/reader\" dontUseProxy=\"true\" "
+	                 "username=\"bench\" password=\"bench\"/>\n"
+	                 "</body>\n</opml>\n");
+
+	filename = g_build_filename (cachePath, "feedlist.opml", NULL);
+	success = g_file_set_contents (filename, opml, -1, NULL);
+	g_free (filename);
+	g_free (opml);
+
+	return success;
+}
+
+static void
+edit_remove_dir (const gchar *path)
+{
+	GDir		*dir;
+	const gchar	*name;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (!dir)
+		return;
+
+	while (NULL != (name = g_dir_read_name (dir))) {
+		gchar *filename = g_build_filename (path, name, NULL);
+		if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+			edit_remove_dir (filename);
+		else
+			g_unlink (filename);
+		g_free (filename);
+	}
+	g_dir_close (dir);
+	g_rmdir (path);
+}
+
+static void
+edit_liferea_exited (GPid pid, gint status, gpointer user_data)
+{
+	lifereaStatus = status;
+	g_spawn_close_pid (pid);
+	g_main_loop_quit (loop);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext	*context;
+	GError		*error = NULL;
+	SoupAddress	*address;
+	DBusGConnection	*bus;
+	GPtrArray	*args;
+	GPid		busPid;
+	gchar		*cachePath, *url;
+	guint		expectedEdits;
+	gboolean	success;
+	gint		i;
+
+	g_thread_init (NULL);
+	g_type_init ();
+
+	context = g_option_context_new ("[-- LIFEREA OPTIONS] - Google Reader edit pipeline test");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (itemCount < 1 || latency < 0 || timeout < 1) {
+		g_printerr ("Invalid item count, latency or timeout!\n");
+		return 1;
+	}
+
+	/* only the loopback interface is used */
+	address = soup_address_new ("127.0.0.1", SOUP_ADDRESS_ANY_PORT);
+	if (SOUP_STATUS_OK != soup_address_resolve_sync (address, NULL) ||
+	    !(server = soup_server_new (SOUP_SERVER_INTERFACE, address, NULL))) {
+		g_printerr ("Could not start the HTTP server!\n");
+		return 1;
+	}
+	g_object_unref (address);
+	soup_server_add_handler (server, NULL, edit_server_cb, NULL, NULL);
+	soup_server_run_async (server);
+
+	busPid = edit_start_bus ();
+	if (!busPid || !(bus = dbus_g_bus_get (DBUS_BUS_SESSION, &error))) {
+		g_printerr ("Could not start a D-Bus session bus!\n");
+		return 1;
+	}
+	proxy = dbus_g_proxy_new_for_name (bus, LF_DBUS_SERVICE, LF_DBUS_PATH, LF_DBUS_SERVICE);
+
+	url = g_strdup_printf ("http://127.0.0.1:%u", soup_server_get_port (server));
+	g_setenv ("LIFEREA_GOOGLE_READER_URL", url, TRUE);
+	g_free (url);
+
+	cachePath = g_strdup_printf ("%s/liferea-edit-%d", g_get_tmp_dir (), getpid ());
+	if (0 != g_mkdir_with_parents (cachePath, 0700) || !edit_write_feedlist (cachePath)) {
+		g_printerr ("Could not create the feed list in %s!\n", cachePath);
+		kill (busPid, SIGTERM);
+		return 1;
+	}
+
+	/* remaining arguments after "--" are passed to Liferea */
+	args = g_ptr_array_new ();
+	g_ptr_array_add (args, g_strdup (lifereaPath));
+	g_ptr_array_add (args, g_strdup_printf ("--cache-dir=%s", cachePath));
+	g_ptr_array_add (args, g_strdup ("--daemon"));
+	for (i = 1; i < argc; i++) {
+		if (!g_str_equal (argv[i], "--"))
+			g_ptr_array_add (args, g_strdup (argv[i]));
+	}
+	g_ptr_array_add (args, NULL);
+
+	g_print ("%d items, latency %dms\n", itemCount, latency);
+
+	if (!g_spawn_async (NULL, (gchar **)args->pdata, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &lifereaPid, &error)) {
+		g_printerr ("Could not run %s: %s\n", lifereaPath, error->message);
+		edit_remove_dir (cachePath);
+		kill (busPid, SIGTERM);
+		return 1;
+	}
+	g_strfreev ((gchar **)g_ptr_array_free (args, FALSE));
+
+	loop = g_main_loop_new (NULL, FALSE);
+	g_child_watch_add (lifereaPid, edit_liferea_exited, NULL);
+	g_timeout_add (500, edit_poll, NULL);
+	g_timeout_add_seconds (timeout, edit_timeout, NULL);
+	g_main_loop_run (loop);
+	g_main_loop_unref (loop);
+
+	expectedEdits = (itemCount + EDIT_MAX_ITEMS - 1) / EDIT_MAX_ITEMS;
+	g_print ("server: %u logins, %u feed requests, %u token requests, %u edit-tag requests "
+	         "for %u items (expected 1 token and %u edit-tag requests), %u with a wrong token\n",
+	         loginCount, feedCount, tokenCount, editCount, editItemCount, expectedEdits, badTokenCount);
+
+	if (keep)
+		g_print ("cache directory kept in %s\n", cachePath);
+	else
+		edit_remove_dir (cachePath);
+
+	g_object_unref (proxy);
+	dbus_g_connection_unref (bus);
+	kill (busPid, SIGTERM);
+	g_spawn_close_pid (busPid);
+	soup_server_quit (server);
+	g_object_unref (server);
+	g_free (cachePath);
+
+	success = !timedOut && 1 == tokenCount && expectedEdits == editCount &&
+	          (guint)itemCount == editItemCount && 0 == badTokenCount;
+	if (!success)
+		g_printerr ("The edits were not batched as expected!\n");
+
+	if (!WIFEXITED (lifereaStatus) || WEXITSTATUS (lifereaStatus)) {
+		g_printerr ("Liferea did not exit normally!\n");
+		return 1;
+	}
+
+	return success?0:1;
+}
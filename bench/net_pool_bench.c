@@ -0,0 +1,277 @@
+/**
+ * @file net_pool_bench.c  HTTP connection reuse benchmark
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Runs a local HTTP server simulating network latency and fetches
+   a feed list whose feeds are spread over several hosts (127.0.0.1,
+   127.0.0.2, ...) in feed list order. Every response is delayed by
+   the request latency, the first response on a new connection is
+   additionally delayed by the connect latency (DNS, TCP and TLS
+   handshakes). Like src/update.c at most 5 requests are active and
+   the session uses the connection pool defaults of src/net.c.
+
+   close	every request uses a new connection
+   fifo		requests are started in feed list order
+   grouped	requests are started grouped by host with at most as many
+		active requests per host as connections (src/update_queue.c)
+
+   Usage: net_pool_bench [--hosts=N] [--feeds=N] [--latency=MS] [--connect-latency=MS] [--mode=close|fifo|grouped|all] */
+
+#include <glib.h>
+#include <libsoup/soup.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "update_queue.h"
+
+#define BENCH_MAX_ACTIVE		5	/* MAX_ACTIVE_JOBS of src/update.c */
+#define BENCH_MAX_CONNS			10
+#define BENCH_MAX_CONNS_PER_HOST	2
+
+static gint hostCount = 20;
+static gint feedCount = 10;
+static gint latency = 50;
+static gint connectLatency = 150;
+static gchar *modeName = "all";
+
+static GOptionEntry entries[] = {
+	{ "hosts", 0, 0, G_OPTION_ARG_INT, &hostCount, "Number of hosts (at most 254)", "N" },
+	{ "feeds", 0, 0, G_OPTION_ARG_INT, &feedCount, "Number of feeds per host", "N" },
+	{ "latency", 0, 0, G_OPTION_ARG_INT, &latency, "Response latency", "MS" },
+	{ "connect-latency", 0, 0, G_OPTION_ARG_INT, &connectLatency, "Additional latency of new connections", "MS" },
+	{ "mode", 0, 0, G_OPTION_ARG_STRING, &modeName, "Mode to run (close, fifo, grouped or all)", "NAME" },
+	{ NULL }
+};
+
+static const gchar *feedBody = "<?xml version=\"1.0\"?>\n<rss version=\"2.0\"><channel><title>Bench</title>"
+                               "<item><title>Item</title><guid>http://localhost/item</guid></item></channel></rss>\n";
+
+typedef enum {
+	BENCH_MODE_CLOSE,
+	BENCH_MODE_FIFO,
+	BENCH_MODE_GROUPED
+} benchMode;
+
+static const gchar *modeNames[] = { "close", "fifo", "grouped" };
+
+static SoupServer	*server = NULL;
+static guint		serverConnections = 0;
+
+/* client state of one run */
+static benchMode	mode;
+static SoupSession	*session = NULL;
+static GMainLoop	*loop = NULL;
+static GQueue		*fifo = NULL;
+static updateQueuePtr	grouped = NULL;
+static guint		active, finished, failed, total, reused;
+static gdouble		fetchTime, maxFetchTime;
+
+static gboolean
+bench_server_unpause (gpointer msg)
+{
+	soup_server_unpause_message (server, (SoupMessage *)msg);
+	return FALSE;
+}
+
+static void
+bench_server_cb (SoupServer *server, SoupMessage *msg, const char *path,
+                 GHashTable *query, SoupClientContext *client, gpointer user_data)
+{
+	SoupSocket	*socket = soup_client_context_get_socket (client);
+	guint		delay = latency;
+
+	if (!g_object_get_data (G_OBJECT (socket), "bench-used")) {
+		g_object_set_data (G_OBJECT (socket), "bench-used", GINT_TO_POINTER (1));
+		serverConnections++;
+		delay += connectLatency;
+	}
+
+	soup_message_set_status (msg, SOUP_STATUS_OK);
+	soup_message_set_response (msg, "application/rss+xml", SOUP_MEMORY_STATIC, feedBody, strlen (feedBody));
+
+	soup_server_pause_message (server, msg);
+	g_timeout_add (delay, bench_server_unpause, msg);
+}
+
+static void
+bench_request_started (SoupSession *session, SoupMessage *msg, SoupSocket *socket, gpointer data)
+{
+	if (g_object_get_data (G_OBJECT (socket), "bench-used"))
+		reused++;
+	else
+		g_object_set_data (G_OBJECT (socket), "bench-used", GINT_TO_POINTER (1));
+}
+
+static void bench_dispatch (void);
+
+static void
+bench_client_cb (SoupSession *session, SoupMessage *msg, gpointer user_data)
+{
+	gdouble elapsed = g_timer_elapsed ((GTimer *)g_object_get_data (G_OBJECT (msg), "bench-timer"), NULL);
+
+	if (!SOUP_STATUS_IS_SUCCESSFUL (msg->status_code))
+		failed++;
+
+	fetchTime += elapsed;
+	if (elapsed > maxFetchTime)
+		maxFetchTime = elapsed;
+
+	if (grouped)
+		update_queue_finished (grouped, user_data);
+	g_free (user_data);
+
+	active--;
+	if (++finished == total)
+		g_main_loop_quit (loop);
+	else
+		bench_dispatch ();
+}
+
+static void
+bench_dispatch (void)
+{
+	while (active < BENCH_MAX_ACTIVE) {
+		SoupMessage	*msg;
+		gchar		*url;
+
+		if (grouped)
+			url = update_queue_pop (grouped, BENCH_MAX_CONNS_PER_HOST);
+		else
+			url = g_queue_pop_head (fifo);
+		if (!url)
+			return;
+
+		msg = soup_message_new (SOUP_METHOD_GET, url);
+		if (BENCH_MODE_CLOSE == mode)
+			soup_message_headers_append (msg->request_headers, "Connection", "close");
+		g_object_set_data_full (G_OBJECT (msg), "bench-timer", g_timer_new (), (GDestroyNotify)g_timer_destroy);
+
+		active++;
+		soup_session_queue_message (session, msg, bench_client_cb, url);
+	}
+}
+
+static void
+bench_run (benchMode runMode)
+{
+	GTimer	*timer;
+	gint	feed, host;
+
+	mode = runMode;
+	active = finished = failed = reused = serverConnections = 0;
+	total = hostCount * feedCount;
+	fetchTime = maxFetchTime = 0;
+
+	session = soup_session_async_new_with_options (SOUP_SESSION_MAX_CONNS, BENCH_MAX_CONNS,
+	                                               SOUP_SESSION_MAX_CONNS_PER_HOST, BENCH_MAX_CONNS_PER_HOST,
+	                                               SOUP_SESSION_IDLE_TIMEOUT, 30,
+	                                               NULL);
+	g_signal_connect (session, "request-started", G_CALLBACK (bench_request_started), NULL);
+
+	/* Feed lists are usually sorted by topic, not by host,
+	   so the hosts are interleaved in feed list order. */
+	if (BENCH_MODE_GROUPED == mode)
+		grouped = update_queue_new ();
+	else
+		fifo = g_queue_new ();
+	for (feed = 0; feed < feedCount; feed++) {
+		for (host = 1; host <= hostCount; host++) {
+			gchar *url = g_strdup_printf ("http://127.0.0.%d:%u/feed%d", host, soup_server_get_port (server), feed);
+
+			if (grouped)
+				update_queue_push (grouped, url, url, FALSE);
+			else
+				g_queue_push_tail (fifo, url);
+		}
+	}
+
+	timer = g_timer_new ();
+	bench_dispatch ();
+	g_main_loop_run (loop);
+
+	g_print ("%-8s total %8.1fms  fetch avg %6.1fms max %6.1fms  %u new, %u reused connections (server saw %u)%s\n",
+	         modeNames[mode], g_timer_elapsed (timer, NULL) * 1000,
+	         fetchTime * 1000 / total, maxFetchTime * 1000,
+	         total - reused, reused, serverConnections,
+	         failed ? "  REQUESTS FAILED" : "");
+
+	g_timer_destroy (timer);
+	soup_session_abort (session);
+	g_object_unref (session);
+	session = NULL;
+	if (grouped)
+		update_queue_free (grouped);
+	grouped = NULL;
+	if (fifo)
+		g_queue_free (fifo);
+	fifo = NULL;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext	*context;
+	GError		*error = NULL;
+	SoupAddress	*address;
+
+	g_thread_init (NULL);
+	g_type_init ();
+
+	context = g_option_context_new ("- benchmark HTTP connection reuse");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (hostCount < 1 || hostCount > 254 || feedCount < 1 || latency < 0 || connectLatency < 0) {
+		g_printerr ("Invalid host count, feed count or latency!\n");
+		return 1;
+	}
+
+	/* listen on all IPv4 addresses to serve 127.0.0.x */
+	address = soup_address_new_any (SOUP_ADDRESS_FAMILY_IPV4, SOUP_ADDRESS_ANY_PORT);
+	server = soup_server_new (SOUP_SERVER_INTERFACE, address, NULL);
+	g_object_unref (address);
+	if (!server) {
+		g_printerr ("Could not start the HTTP server!\n");
+		return 1;
+	}
+	soup_server_add_handler (server, NULL, bench_server_cb, NULL, NULL);
+	soup_server_run_async (server);
+
+	loop = g_main_loop_new (NULL, FALSE);
+
+	g_print ("%d hosts with %d feeds each, latency %dms, connect latency %dms\n",
+	         hostCount, feedCount, latency, connectLatency);
+	if (g_str_equal (modeName, "all") || g_str_equal (modeName, "close"))
+		bench_run (BENCH_MODE_CLOSE);
+	if (g_str_equal (modeName, "all") || g_str_equal (modeName, "fifo"))
+		bench_run (BENCH_MODE_FIFO);
+	if (g_str_equal (modeName, "all") || g_str_equal (modeName, "grouped"))
+		bench_run (BENCH_MODE_GROUPED);
+
+	g_main_loop_unref (loop);
+	soup_server_quit (server);
+	g_object_unref (server);
+
+	return 0;
+}
@@ -0,0 +1,237 @@
+/**
+ * @file opml_merge_bench.c  OPML subscription list merge benchmark
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* Generates an old and a new OPML subscription list with the given
+   number of feeds in folders (the new list has some feeds added, removed
+   and moved to other folders) and compares the time needed to find the
+   differences using src/fl_sources/opml_merge.c and using one XPath
+   query per outline like older versions of the OPML source did.
+
+   Usage: opml_merge_bench [--feeds=N] [--folders=N] [--changes=PERCENT] [--xpath=N] */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libxml/parser.h>
+#include <libxml/xpath.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fl_sources/opml_merge.h"
+
+static gint feedCount = 10000;
+static gint folderCount = 50;
+static gint changePercent = 5;
+static gint xpathCount = 1000;
+
+static GOptionEntry entries[] = {
+	{ "feeds", 0, 0, G_OPTION_ARG_INT, &feedCount, "Number of feeds", "N" },
+	{ "folders", 0, 0, G_OPTION_ARG_INT, &folderCount, "Number of folders", "N" },
+	{ "changes", 0, 0, G_OPTION_ARG_INT, &changePercent, "Percentage of added, removed and moved feeds each", "PERCENT" },
+	{ "xpath", 0, 0, G_OPTION_ARG_INT, &xpathCount, "Number of outlines to run XPath queries for (0 to skip)", "N" },
+	{ NULL }
+};
+
+/* Writes an OPML file. Feed i is in folder i % folderCount. For the
+   new list every "changes" feed is dropped, moved to the next folder
+   or added. */
+static gchar *
+bench_write_opml (const gchar *name, gboolean changed)
+{
+	gchar	*filename;
+	FILE	*f;
+	gint	folder, i, step = changePercent ? 100 / changePercent : 0;
+
+	filename = g_strdup_printf ("%s/liferea-bench-%d-%s.opml", g_get_tmp_dir (), getpid (), name);
+	f = fopen (filename, "w");
+	if (!f) {
+		g_printerr ("Could not write %s!\n", filename);
+		exit (1);
+	}
+
+	fprintf (f, "<?xml version=\"1.0\"?>\n<opml version=\"1.0\">\n<head><title>%s</title></head>\n<body>\n", name);
+	for (folder = 0; folder < folderCount; folder++) {
+		fprintf (f, "<outline title=\"Folder '%d'\">\n", folder);
+		for (i = folder; i < feedCount; i += folderCount) {
+			gint target = folder;
+
+			if (changed && step) {
+				if (i % step == 0)
+					continue;			/* removed */
+				if (i % step == 1)
+					target = (folder + 1) % folderCount;	/* moved */
+			}
+			if (target != folder)
+				continue;
+			fprintf (f, "<outline title=\"Feed %d\" xmlUrl=\"http://localhost/feed?id=%d&amp;q='x'\"/>\n", i, i);
+		}
+		if (changed && step) {
+			/* feeds moved here from the previous folder */
+			for (i = (folder + folderCount - 1) % folderCount; i < feedCount; i += folderCount)
+				if (i % step == 1)
+					fprintf (f, "<outline title=\"Feed %d\" xmlUrl=\"http://localhost/feed?id=%d&amp;q='x'\"/>\n", i, i);
+			/* added feeds */
+			for (i = folder; i < feedCount; i += folderCount)
+				if (i % step == 2)
+					fprintf (f, "<outline title=\"New Feed %d\" xmlUrl=\"http://localhost/new?id=%d\"/>\n", i, i);
+		}
+		fprintf (f, "</outline>\n");
+	}
+	fprintf (f, "</body>\n</opml>\n");
+	fclose (f);
+
+	return filename;
+}
+
+static xmlNodePtr
+bench_get_body (xmlDocPtr doc)
+{
+	xmlNodePtr cur;
+
+	for (cur = xmlDocGetRootElement (doc)->children; cur; cur = cur->next)
+		if (cur->type == XML_ELEMENT_NODE && xmlStrEqual (cur->name, BAD_CAST "body"))
+			return cur;
+
+	g_printerr ("OPML document without body!\n");
+	exit (1);
+}
+
+/* Counts the outlines of one document missing in the other document
+   using one XPath query per outline */
+static gint
+bench_xpath (xmlDocPtr doc, xmlDocPtr other, gint limit, gint *checked)
+{
+	xmlXPathContextPtr	ctxt;
+	xmlXPathObjectPtr	outlines;
+	gint			i, missing = 0;
+
+	ctxt = xmlXPathNewContext (doc);
+	outlines = xmlXPathEval (BAD_CAST "//outline[@xmlUrl]", ctxt);
+	xmlXPathFreeContext (ctxt);
+
+	ctxt = xmlXPathNewContext (other);
+	for (i = 0; i < outlines->nodesetval->nodeNr && i < limit; i++) {
+		xmlChar			*url = xmlGetProp (outlines->nodesetval->nodeTab[i], BAD_CAST "xmlUrl");
+		gchar			*expr;
+		xmlXPathObjectPtr	result;
+
+		/* The old code did not escape the URL either. Just skip those
+		   queries that would not compile. */
+		expr = g_strdup_printf ("//outline[@xmlUrl = %s%s%s]",
+		                        strchr ((gchar *)url, '\'') ? "\"" : "'", url,
+		                        strchr ((gchar *)url, '\'') ? "\"" : "'");
+		result = xmlXPathEval (BAD_CAST expr, ctxt);
+		if (result && (!result->nodesetval || !result->nodesetval->nodeNr))
+			missing++;
+		xmlXPathFreeObject (result);
+		g_free (expr);
+		xmlFree (url);
+	}
+	*checked = i;
+	xmlXPathFreeContext (ctxt);
+	xmlXPathFreeObject (outlines);
+
+	return missing;
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext		*context;
+	GError			*error = NULL;
+	GTimer			*timer;
+	gchar			*oldFile, *newFile;
+	xmlDocPtr		oldDoc, newDoc;
+	opmlMergeIndexPtr	oldIndex, newIndex;
+	opmlMergeDiffPtr	diff;
+	gdouble			parse, index, compare;
+
+	context = g_option_context_new ("- benchmark OPML subscription list merging");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (feedCount < 1 || folderCount < 1 || changePercent < 0 || changePercent > 33) {
+		g_printerr ("Invalid feed count, folder count or change percentage!\n");
+		return 1;
+	}
+
+	oldFile = bench_write_opml ("old", FALSE);
+	newFile = bench_write_opml ("new", TRUE);
+
+	timer = g_timer_new ();
+	oldDoc = xmlParseFile (oldFile);
+	newDoc = xmlParseFile (newFile);
+	if (!oldDoc || !newDoc) {
+		g_printerr ("Could not parse generated OPML files!\n");
+		return 1;
+	}
+	parse = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	oldIndex = opml_merge_index_new ();
+	opml_merge_index_add_outlines (oldIndex, "", bench_get_body (oldDoc));
+	newIndex = opml_merge_index_new ();
+	opml_merge_index_add_outlines (newIndex, "", bench_get_body (newDoc));
+	index = g_timer_elapsed (timer, NULL);
+
+	g_timer_start (timer);
+	diff = opml_merge_diff (oldIndex, newIndex);
+	compare = g_timer_elapsed (timer, NULL);
+
+	g_print ("%d feeds in %d folders, %d%% changes\n", feedCount, folderCount, changePercent);
+	g_print ("diff   %d added, %d removed, %d moved, %d kept\n",
+	         g_slist_length (diff->added), g_slist_length (diff->removed),
+	         g_slist_length (diff->moved), g_slist_length (diff->kept));
+	g_print ("index  parse %8.1fms  index %8.1fms  diff %8.1fms  total %8.1fms\n",
+	         parse * 1000, index * 1000, compare * 1000, (index + compare) * 1000);
+
+	opml_merge_diff_free (diff);
+	opml_merge_index_free (oldIndex);
+	opml_merge_index_free (newIndex);
+
+	if (xpathCount > 0) {
+		gint	added, removed, checkedNew, checkedOld;
+		gdouble	elapsed;
+
+		g_timer_start (timer);
+		added = bench_xpath (newDoc, oldDoc, xpathCount, &checkedNew);
+		removed = bench_xpath (oldDoc, newDoc, xpathCount, &checkedOld);
+		elapsed = g_timer_elapsed (timer, NULL);
+
+		g_print ("xpath  %d of %d new and %d of %d old outlines missing, %8.1fms (%.1fms extrapolated to all outlines)\n",
+		         added, checkedNew, removed, checkedOld, elapsed * 1000,
+		         elapsed * 1000 * (feedCount * 2) / (checkedNew + checkedOld));
+	}
+
+	g_timer_destroy (timer);
+	xmlFreeDoc (oldDoc);
+	xmlFreeDoc (newDoc);
+	g_unlink (oldFile);
+	g_unlink (newFile);
+	g_free (oldFile);
+	g_free (newFile);
+
+	return 0;
+}
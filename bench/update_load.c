@@ -0,0 +1,482 @@
+/**
+ * @file update_load.c  end-to-end feed update load test
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+/* Runs a local HTTP server serving synthetic RSS feeds, writes a
+   feed list with all of them to a temporary cache directory and
+   starts "liferea --load-test=ROUNDS" on it. Liferea updates all
+   subscriptions ROUNDS times through src/update.c and src/net.c
+   and prints per round the wall time, the update jobs in flight,
+   the main loop stalls and the DB write volume (see src/load_test.c).
+   Afterwards the server statistics are printed. Nothing but the
+   server on 127.0.0.1 is contacted, the feeds are set to bypass the
+   proxy Liferea reads from GConf.
+
+   The server behaviour is deterministic for a given set of options:
+
+   --change-rate	percentage of requests which see a new feed version
+			(one more item), the first request always sees one
+   --not-modified	ETag and Last-Modified are checked, unchanged feeds
+			get a 304 response
+   --redirect-rate	percentage of feeds which answer with a temporary
+			redirect to their real location
+   --error-rate		percentage of requests which fail with 404, 500 or 503
+   --gzip		responses are gzip encoded if the client accepts it
+			(stored deflate blocks, the size does not change)
+
+   Options after "--" are passed to Liferea (e.g. --debug-perf).
+
+   Usage: update_load [--feeds=N] [--items=N] [--item-size=BYTES] [--latency=MS]
+                      [--change-rate=PERCENT] [--not-modified] [--redirect-rate=PERCENT]
+                      [--error-rate=PERCENT] [--gzip] [--rounds=N] [--liferea=PATH]
+                      [--keep] [-- LIFEREA OPTIONS] */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <libsoup/soup.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Last-Modified of the first version of every feed, each
+   change adds a minute */
+#define LOAD_BASE_TIME		1262304000	/* 2010-01-01 */
+
+static gint feedCount = 100;
+static gint itemCount = 20;
+static gint itemSize = 500;
+static gint latency = 20;
+static gint changeRate = 20;
+static gboolean notModified = FALSE;
+static gint redirectRate = 5;
+static gint errorRate = 2;
+static gboolean gzipEncoding = FALSE;
+static gint rounds = 3;
+static gchar *lifereaPath = "../src/liferea";
+static gboolean keep = FALSE;
+
+static GOptionEntry entries[] = {
+	{ "feeds", 0, 0, G_OPTION_ARG_INT, &feedCount, "Number of feeds", "N" },
+	{ "items", 0, 0, G_OPTION_ARG_INT, &itemCount, "Number of items per feed", "N" },
+	{ "item-size", 0, 0, G_OPTION_ARG_INT, &itemSize, "Size of the item descriptions", "BYTES" },
+	{ "latency", 0, 0, G_OPTION_ARG_INT, &latency, "Response latency", "MS" },
+	{ "change-rate", 0, 0, G_OPTION_ARG_INT, &changeRate, "Percentage of requests seeing a changed feed", "PERCENT" },
+	{ "not-modified", 0, 0, G_OPTION_ARG_NONE, &notModified, "Answer conditional requests for unchanged feeds with 304", NULL },
+	{ "redirect-rate", 0, 0, G_OPTION_ARG_INT, &redirectRate, "Percentage of redirected feeds", "PERCENT" },
+	{ "error-rate", 0, 0, G_OPTION_ARG_INT, &errorRate, "Percentage of failing requests", "PERCENT" },
+	{ "gzip", 0, 0, G_OPTION_ARG_NONE, &gzipEncoding, "Use gzip encoding if accepted by the client", NULL },
+	{ "rounds", 0, 0, G_OPTION_ARG_INT, &rounds, "Number of times all feeds are updated", "N" },
+	{ "liferea", 0, 0, G_OPTION_ARG_FILENAME, &lifereaPath, "Liferea binary to run", "PATH" },
+	{ "keep", 0, 0, G_OPTION_ARG_NONE, &keep, "Keep the cache directory (e.g. for metrics.json)", NULL },
+	{ NULL }
+};
+
+typedef struct loadFeed {
+	guint		requests;	/**< number of feed requests */
+	guint		version;	/**< number of changes */
+} loadFeed;
+
+static SoupServer	*server = NULL;
+static GMainLoop	*loop = NULL;
+static loadFeed		*feeds = NULL;
+static gchar		*filler = NULL;	/**< item description */
+static gint		lifereaStatus = -1;
+
+/* server statistics */
+static guint		responses[6];	/**< by status class (1xx ... 5xx) */
+static guint		notModifiedCount, redirectCount, gzipCount;
+static guint64		bytesSent;
+
+/* Mixes feed number and request number into a value 0...99,
+   so that rates are deterministic but spread over all feeds. */
+static guint
+load_hash (guint feed, guint request, guint salt)
+{
+	guint32 h = feed * 2654435761U ^ (request + 1) * 40503U ^ salt * 2246822519U;
+
+	h ^= h >> 15;
+	h *= 2246822507U;
+	h ^= h >> 13;
+	return h % 100;
+}
+
+static gchar *
+load_date_string (guint minutes)
+{
+	SoupDate	*date = soup_date_new_from_time_t (LOAD_BASE_TIME + minutes * 60);
+	gchar		*result = soup_date_to_string (date, SOUP_DATE_HTTP);
+
+	soup_date_free (date);
+	return result;
+}
+
+static gchar *
+load_create_feed (guint feed, guint version)
+{
+	GString	*xml = g_string_sized_new (itemCount * (itemSize + 200) + 400);
+	gint	i;
+
+	g_string_append_printf (xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	                        "<rss version=\"2.0\"><channel><title>Load Test %u</title>"
+	                        "<link>http://127.0.0.1/</link><description>Feed %u version %u</description>\n",
+	                        feed, feed, version);
+
+	/* every change adds one item and drops the oldest */
+	for (i = itemCount - 1; i >= 0; i--) {
+		guint	item = version + i;
+		gchar	*date = load_date_string (item);
+
+		g_string_append_printf (xml, "<item><title>Item %u of feed %u</title>"
+		                        "<guid isPermaLink=\"false\">load-%u-%u</guid>"
+		                        "<pubDate>%s</pubDate><description>%s</description></item>\n",
+		                        item, feed, feed, item, date, filler);
+		g_free (date);
+	}
+	g_string_append (xml, "</channel></rss>\n");
+
+	return g_string_free (xml, FALSE);
+}
+
+/* gzip with stored (uncompressed) deflate blocks, so no zlib is needed */
+static guint32
+load_crc32 (const guchar *data, gsize length)
+{
+	static guint32	table[256];
+	guint32		crc = 0xffffffff;
+	gsize		i;
+
+	if (!table[1]) {
+		guint32 n, k, c;
+		for (n = 0; n < 256; n++) {
+			for (c = n, k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+	}
+
+	for (i = 0; i < length; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
+}
+
+static void
+load_append_le32 (GByteArray *array, guint32 value)
+{
+	guint8 bytes[4] = { value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24 };
+
+	g_byte_array_append (array, bytes, 4);
+}
+
+static GByteArray *
+load_gzip (const gchar *data, gsize length)
+{
+	static const guint8	header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+	GByteArray		*gzip = g_byte_array_sized_new (length + length / 65535 * 5 + 32);
+	gsize			offset = 0;
+
+	g_byte_array_append (gzip, header, sizeof (header));
+	do {
+		guint16	size = MIN (length - offset, 65535);
+		guint8	block[5] = { (offset + size == length), size & 0xff, size >> 8, ~size & 0xff, (~size >> 8) & 0xff };
+
+		g_byte_array_append (gzip, block, sizeof (block));
+		g_byte_array_append (gzip, (const guint8 *)data + offset, size);
+		offset += size;
+	} while (offset < length);
+	load_append_le32 (gzip, load_crc32 ((const guchar *)data, length));
+	load_append_le32 (gzip, length);
+
+	return gzip;
+}
+
+static gboolean
+load_is_not_modified (SoupMessage *msg, const gchar *etag, guint version)
+{
+	const gchar	*header;
+
+	header = soup_message_headers_get (msg->request_headers, "If-None-Match");
+	if (header)
+		return g_str_equal (header, etag);
+
+	header = soup_message_headers_get (msg->request_headers, "If-Modified-Since");
+	if (header) {
+		SoupDate	*date = soup_date_new_from_string (header);
+		gboolean	result = FALSE;
+
+		if (date) {
+			result = (soup_date_to_time_t (date) >= (time_t)(LOAD_BASE_TIME + version * 60));
+			soup_date_free (date);
+		}
+		return result;
+	}
+
+	return FALSE;
+}
+
+static void
+load_serve_feed (SoupMessage *msg, guint feed)
+{
+	loadFeed	*state = &feeds[feed];
+	const gchar	*encoding;
+	gchar		*etag, *lastModified, *xml;
+
+	if (state->requests > 0 && load_hash (feed, state->requests, 1) < changeRate)
+		state->version++;
+	state->requests++;
+
+	if (load_hash (feed, state->requests, 2) < errorRate) {
+		static const guint codes[] = { SOUP_STATUS_NOT_FOUND, SOUP_STATUS_INTERNAL_SERVER_ERROR, SOUP_STATUS_SERVICE_UNAVAILABLE };
+
+		soup_message_set_status (msg, codes[state->requests % G_N_ELEMENTS (codes)]);
+		return;
+	}
+
+	etag = g_strdup_printf ("\"%u-%u\"", feed, state->version);
+	lastModified = load_date_string (state->version);
+	soup_message_headers_replace (msg->response_headers, "ETag", etag);
+	soup_message_headers_replace (msg->response_headers, "Last-Modified", lastModified);
+
+	if (notModified && load_is_not_modified (msg, etag, state->version)) {
+		soup_message_set_status (msg, SOUP_STATUS_NOT_MODIFIED);
+		notModifiedCount++;
+	} else {
+		xml = load_create_feed (feed, state->version);
+		encoding = soup_message_headers_get (msg->request_headers, "Accept-Encoding");
+		soup_message_set_status (msg, SOUP_STATUS_OK);
+		if (gzipEncoding && encoding && strstr (encoding, "gzip")) {
+			GByteArray *gzip = load_gzip (xml, strlen (xml));
+
+			soup_message_headers_replace (msg->response_headers, "Content-Encoding", "gzip");
+			soup_message_set_response (msg, "application/rss+xml", SOUP_MEMORY_COPY, (const gchar *)gzip->data, gzip->len);
+			bytesSent += gzip->len;
+			gzipCount++;
+			g_byte_array_free (gzip, TRUE);
+			g_free (xml);
+		} else {
+			bytesSent += strlen (xml);
+			soup_message_set_response (msg, "application/rss+xml", SOUP_MEMORY_TAKE, xml, strlen (xml));
+		}
+	}
+
+	g_free (lastModified);
+	g_free (etag);
+}
+
+static gboolean
+load_server_unpause (gpointer msg)
+{
+	soup_server_unpause_message (server, (SoupMessage *)msg);
+	return FALSE;
+}
+
+static void
+load_server_cb (SoupServer *server, SoupMessage *msg, const char *path,
+                GHashTable *query, SoupClientContext *client, gpointer user_data)
+{
+	guint	feed;
+
+	/* /feed/N redirects to /moved/N for some feeds, both serve the feed */
+	if (1 == sscanf (path, "/feed/%u", &feed) && feed < (guint)feedCount) {
+		if (load_hash (feed, 0, 3) < redirectRate) {
+			gchar *location = g_strdup_printf ("/moved/%u", feed);
+
+			soup_message_set_status (msg, SOUP_STATUS_MOVED_TEMPORARILY);
+			soup_message_headers_replace (msg->response_headers, "Location", location);
+			redirectCount++;
+			g_free (location);
+		} else {
+			load_serve_feed (msg, feed);
+		}
+	} else if (1 == sscanf (path, "/moved/%u", &feed) && feed < (guint)feedCount) {
+		load_serve_feed (msg, feed);
+	} else {
+		soup_message_set_status (msg, SOUP_STATUS_NOT_FOUND);	/* e.g. favicons */
+	}
+	responses[MIN (msg->status_code / 100, 5)]++;
+
+	if (latency > 0) {
+		soup_server_pause_message (server, msg);
+		g_timeout_add (latency, load_server_unpause, msg);
+	}
+}
+
+static gboolean
+load_write_feedlist (const gchar *cachePath)
+{
+	GString		*opml = g_string_new (NULL);
+	gchar		*filename;
+	gboolean	success;
+	gint		i;
+
+	g_string_append (opml, "<?xml version=\"1.0\"?>\n<opml version=\"1.0\">\n<head><title>Load Test</title></head>\n<body>\n");
+	for (i = 0; i < feedCount; i++) {
+		/* with an id the feeds are not updated when the feed list is loaded */
+		g_string_append_printf (opml, "<outline title=\"Load Test %d\" text=\"Load Test %d\" type=\"rss\" "
+		                        "id=\"load%d\" dontUseProxy=\"true\" xmlUrl=\"http://127.0.0.1:%u/feed/%d\"/>\n",
+		                        i, i, i, soup_server_get_port (server), i);
+	}
+	g_string_append (opml, "</body>\n</opml>\n");
+
+	filename = g_build_filename (cachePath, "feedlist.opml", NULL);
+	success = g_file_set_contents (filename, opml->str, opml->len, NULL);
+	g_free (filename);
+	g_string_free (opml, TRUE);
+
+	return success;
+}
+
+static void
+load_remove_dir (const gchar *path)
+{
+	GDir		*dir;
+	const gchar	*name;
+
+	dir = g_dir_open (path, 0, NULL);
+	if (!dir)
+		return;
+
+	while (NULL != (name = g_dir_read_name (dir))) {
+		gchar *filename = g_build_filename (path, name, NULL);
+		if (g_file_test (filename, G_FILE_TEST_IS_DIR))
+			load_remove_dir (filename);
+		else
+			g_unlink (filename);
+		g_free (filename);
+	}
+	g_dir_close (dir);
+	g_rmdir (path);
+}
+
+static void
+load_liferea_exited (GPid pid, gint status, gpointer user_data)
+{
+	lifereaStatus = status;
+	g_spawn_close_pid (pid);
+	g_main_loop_quit (loop);
+}
+
+int
+main (int argc, char *argv[])
+{
+	GOptionContext	*context;
+	GError		*error = NULL;
+	SoupAddress	*address;
+	GPtrArray	*args;
+	GPid		pid;
+	gchar		*cachePath;
+	gint		i;
+
+	g_thread_init (NULL);
+	g_type_init ();
+
+	context = g_option_context_new ("[-- LIFEREA OPTIONS] - feed update load test");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	if (feedCount < 1 || itemCount < 1 || itemSize < 0 || latency < 0 || rounds < 1 ||
+	    changeRate < 0 || changeRate > 100 || redirectRate < 0 || redirectRate > 100 ||
+	    errorRate < 0 || errorRate > 100) {
+		g_printerr ("Invalid feed count, item count, item size, latency, round count or rate!\n");
+		return 1;
+	}
+
+	/* only the loopback interface is used */
+	address = soup_address_new ("127.0.0.1", SOUP_ADDRESS_ANY_PORT);
+	if (SOUP_STATUS_OK != soup_address_resolve_sync (address, NULL) ||
+	    !(server = soup_server_new (SOUP_SERVER_INTERFACE, address, NULL))) {
+		g_printerr ("Could not start the HTTP server!\n");
+		return 1;
+	}
+	g_object_unref (address);
+	soup_server_add_handler (server, NULL, load_server_cb, NULL, NULL);
+	soup_server_run_async (server);
+
+	feeds = g_new0 (loadFeed, feedCount);
+	filler = g_malloc (itemSize + 1);
+	for (i = 0; i < itemSize; i++)
+		filler[i] = "lorem ipsum dolor sit amet "[i % 27];
+	filler[itemSize] = 0;
+
+	cachePath = g_strdup_printf ("%s/liferea-load-%d", g_get_tmp_dir (), getpid ());
+	if (0 != g_mkdir_with_parents (cachePath, 0700) || !load_write_feedlist (cachePath)) {
+		g_printerr ("Could not create the feed list in %s!\n", cachePath);
+		return 1;
+	}
+
+	/* remaining arguments after "--" are passed to Liferea */
+	args = g_ptr_array_new ();
+	g_ptr_array_add (args, g_strdup (lifereaPath));
+	g_ptr_array_add (args, g_strdup_printf ("--cache-dir=%s", cachePath));
+	g_ptr_array_add (args, g_strdup_printf ("--load-test=%d", rounds));
+	for (i = 1; i < argc; i++) {
+		if (!g_str_equal (argv[i], "--"))
+			g_ptr_array_add (args, g_strdup (argv[i]));
+	}
+	g_ptr_array_add (args, NULL);
+
+	g_print ("%d feeds with %d items of %d bytes, latency %dms, change rate %d%%, "
+	         "redirect rate %d%%, error rate %d%%%s%s\n",
+	         feedCount, itemCount, itemSize, latency, changeRate, redirectRate, errorRate,
+	         notModified?", 304 responses":"", gzipEncoding?", gzip":"");
+
+	if (!g_spawn_async (NULL, (gchar **)args->pdata, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL, &pid, &error)) {
+		g_printerr ("Could not run %s: %s\n", lifereaPath, error->message);
+		load_remove_dir (cachePath);
+		return 1;
+	}
+	g_strfreev ((gchar **)g_ptr_array_free (args, FALSE));
+
+	loop = g_main_loop_new (NULL, FALSE);
+	g_child_watch_add (pid, load_liferea_exited, NULL);
+	g_main_loop_run (loop);
+	g_main_loop_unref (loop);
+
+	g_print ("server: %u responses (%u 2xx, %u 3xx, %u 4xx, %u 5xx), %u not modified, %u redirects, "
+	         "%u gzip encoded, %" G_GUINT64_FORMAT " kB sent\n",
+	         responses[1] + responses[2] + responses[3] + responses[4] + responses[5],
+	         responses[2], responses[3], responses[4], responses[5],
+	         notModifiedCount, redirectCount, gzipCount, bytesSent / 1024);
+
+	if (keep)
+		g_print ("cache directory kept in %s\n", cachePath);
+	else
+		load_remove_dir (cachePath);
+
+	soup_server_quit (server);
+	g_object_unref (server);
+	g_free (feeds);
+	g_free (filler);
+	g_free (cachePath);
+
+	if (!WIFEXITED (lifereaStatus) || WEXITSTATUS (lifereaStatus)) {
+		g_printerr ("Liferea did not exit normally!\n");
+		return 1;
+	}
+
+	return 0;
+}
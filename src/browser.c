@@ -25,6 +25,7 @@
 #include "common.h"
 #include "conf.h"
 #include "debug.h"
+#include "ui_observer.h"
 #include "ui/liferea_shell.h"
 
 static struct browser browsers[] = {
@@ -221,7 +222,7 @@ browser_execute (const gchar *cmd, const gchar *uri, gboolean sync)
 		liferea_shell_set_important_status_bar (_("Browser command failed: %s"), error->message);
 		g_error_free (error);
 	} else if (status == 0) {
-		liferea_shell_set_status_bar (_("Starting: \"%s\""), tmp);
+		ui_observer_set_status_bar (_("Starting: \"%s\""), tmp);
 		done = TRUE;
 	}
   
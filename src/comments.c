@@ -28,8 +28,8 @@
 #include "metadata.h"
 #include "net.h"
 #include "net_monitor.h"
+#include "ui_observer.h"
 #include "update.h"
-#include "ui/itemview.h"
 
 /* Comment feeds in Liferea are simple flat lists of items attached
    to a single item. Each item that has a comment feed URL in its 
@@ -122,7 +122,7 @@ comments_process_update_result (const struct updateResult * const result, gpoint
 		metadata_list_set (&item->metadata, "commentFeedGone", "true");
 	} else if (304 == result->httpstatus) {
 		debug1(DEBUG_UPDATE, "comment feed \"%s\" did not change", result->source);
-	} else if (result->data) {
+	} else if (result->data || result->doc || result->docErrors) {
 		debug1(DEBUG_UPDATE, "received update result for comment feed \"%s\"", result->source);
 
 		/* parse the new downloaded feed into fake node, subscription and feed */
@@ -134,6 +134,8 @@ comments_process_update_result (const struct updateResult * const result, gpoint
 		node_set_subscription (node, ctxt->subscription);
 		ctxt->data = result->data;
 		ctxt->dataLength = result->size;
+		ctxt->doc = result->doc;
+		ctxt->docErrors = result->docErrors;
 		feed_parse (ctxt);
 
 		if (ctxt->failed) {
@@ -177,8 +179,8 @@ comments_process_update_result (const struct updateResult * const result, gpoint
 	commentFeed->updateJob = NULL;
 
 	/* rerender item with new comments */
-	itemview_update_item (item); 
-	itemview_update ();
+	ui_observer_item_updated (item); 
+	ui_observer_items_changed ();
 	
 	item_unload (item);
 		
@@ -227,11 +229,13 @@ comments_refresh (itemPtr item)
 		request = update_request_new ();
 		request->options = g_new0 (struct updateOptions, 1);	// FIXME: use copy of parent subscription options
 		request->source = g_strdup (url);
+		request->parseXml = TRUE;
+		request->useCache = TRUE;
 		commentFeed->updateJob = update_execute_request (commentFeed, request, comments_process_update_result, commentFeed, FEED_REQ_PRIORITY_HIGH);
 
 		/* Item view refresh to change link from "Update" to "Updating..." */
-		itemview_update_item (item); 
-		itemview_update ();
+		ui_observer_item_updated (item); 
+		ui_observer_items_changed ();
 	}
 }
 
@@ -241,7 +245,7 @@ comments_to_xml (xmlNodePtr parentNode, const gchar *id)
 	xmlNodePtr	commentsNode;
 	commentFeedPtr	commentFeed;
 	itemSetPtr	itemSet;
-	GList		*iter;
+	guint		i;
 	
 	commentFeed = comment_feed_from_id (id);
 	if (!commentFeed)
@@ -252,13 +256,11 @@ comments_to_xml (xmlNodePtr parentNode, const gchar *id)
 	itemSet = db_itemset_load (id);
 	g_return_if_fail (itemSet != NULL);
 
-	iter = itemSet->ids;
-	while (iter) 
+	for (i = 0; i < itemset_get_length (itemSet); i++)
 	{
-		itemPtr comment = item_load (GPOINTER_TO_UINT (iter->data));
+		itemPtr comment = item_load (itemset_get_id (itemSet, i));
 		item_to_xml (comment, commentsNode);
 		item_unload (comment);
-		iter = g_list_next (iter);
 	}
 
 	xmlNewTextChild (commentsNode, NULL, "updateState", 
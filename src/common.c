@@ -67,17 +67,21 @@ common_check_dir (gchar *path)
 }
 
 static void
-common_init_cache_path (void)
+common_init_cache_path (const gchar *path)
 {
 	gchar *cachePath;
 
-	lifereaUserPath = g_build_filename (g_get_home_dir(), ".liferea_1.7", NULL);
+	if (path)
+		lifereaUserPath = g_strdup (path);
+	else
+		lifereaUserPath = g_build_filename (g_get_home_dir(), ".liferea_1.7", NULL);
 	cachePath = g_build_filename (lifereaUserPath, "cache", NULL);
 
 	common_check_dir (g_strdup (lifereaUserPath));
 	common_check_dir (g_strdup (cachePath));
 	common_check_dir (g_build_filename (cachePath, "feeds", NULL));
 	common_check_dir (g_build_filename (cachePath, "favicons", NULL));
+	common_check_dir (g_build_filename (cachePath, "http", NULL));
 	common_check_dir (g_build_filename (cachePath, "plugins", NULL));
 	common_check_dir (g_build_filename (cachePath, "scripts", NULL));
 
@@ -92,11 +96,18 @@ const gchar *
 common_get_cache_path (void)
 {	
 	if (!lifereaUserPath)
-		common_init_cache_path ();
+		common_init_cache_path (NULL);
 		
 	return lifereaUserPath;
 }
 
+void
+common_set_cache_path (const gchar *path)
+{
+	g_free (lifereaUserPath);
+	common_init_cache_path (path);
+}
+
 gchar *
 common_create_cache_filename (const gchar *folder, const gchar *filename, const gchar *extension)
 {
@@ -153,6 +164,29 @@ common_uri_sanitize (const xmlChar *uri)
 	return result;
 }
 
+gchar *
+common_get_url_host (const gchar *url)
+{
+	const gchar	*start, *end, *user;
+
+	start = strstr (url, "://");
+	if (!start || !strncmp (url, "file://", 7))
+		return NULL;
+
+	start += 3;
+	end = start + strcspn (start, "/?#");
+
+	/* skip user name and password */
+	for (user = start; user < end; user++)
+		if (*user == '@')
+			start = user + 1;
+
+	if (start == end)
+		return NULL;
+
+	return g_ascii_strdown (start, end - start);
+}
+
 /* to correctly escape and expand URLs */
 xmlChar *
 common_build_url (const gchar *url, const gchar *baseURL)
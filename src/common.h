@@ -71,6 +71,15 @@ long common_parse_long (const gchar *str, long def);
  */
 const gchar *	common_get_cache_path(void);
 
+/**
+ * Overrides the cache file storage path. Used by the benchmarks
+ * to work on a temporary cache. Must be called before any cache
+ * file is accessed.
+ *
+ * @param path		the new path (created if it does not exist)
+ */
+void common_set_cache_path (const gchar *path);
+
 /**
  * Method to build cache file names.
  *
@@ -123,6 +132,16 @@ xmlChar * common_uri_sanitize(const xmlChar *uri);
  */
 xmlChar * common_build_url(const gchar *url, const gchar *baseURL);
 
+/**
+ * Extracts the lower case host name (including the port)
+ * from the given URL.
+ *
+ * @param url		the URL
+ *
+ * @returns new host name (to be free'd using g_free()) or NULL if the URL has no host
+ */
+gchar * common_get_url_host (const gchar *url);
+
 /**
  * Analyzes the given string and returns the LTR/RTL
  * setting that should be used when displaying it in
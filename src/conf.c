@@ -29,9 +29,8 @@
 #include "conf.h"
 #include "debug.h"
 #include "net.h"
+#include "ui_observer.h"
 #include "update.h"
-#include "ui/liferea_shell.h"
-#include "ui/ui_tray.h"
 
 #define MAX_GCONF_PATHLEN	256
 
@@ -113,7 +112,7 @@ conf_tray_settings_cb (GConfClient *client, guint cnxn_id, GConfEntry *entry, gp
 	if (entry) {
 		value = gconf_entry_get_value (entry);
 		if (value && value->type == GCONF_VALUE_BOOL)
-			ui_tray_enable (gconf_value_get_bool (value));
+			ui_observer_set_tray_icon (gconf_value_get_bool (value));
 	}
 }
 
@@ -126,7 +125,7 @@ conf_toolbar_style_settings_cb (GConfClient *client,
 	gchar *style = conf_get_toolbar_style ();
 
 	if (style) {
-		liferea_shell_set_toolbar_style (style);
+		ui_observer_set_toolbar_style (style);
 		g_free (style);
 	}
 }
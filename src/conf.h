@@ -40,12 +40,20 @@
 /* enclosure handling */
 #define ENCLOSURE_DOWNLOAD_TOOL		"/apps/liferea/enclosure-download-tool"
 #define ENCLOSURE_DOWNLOAD_PATH		"/apps/liferea/enclosure-download-path"
+#define ENCLOSURE_MAX_DOWNLOADS		"/apps/liferea/enclosure-max-downloads"
+#define ENCLOSURE_DOWNLOAD_RATE		"/apps/liferea/enclosure-download-rate"
 
 /* feed handling settings */
 #define DEFAULT_MAX_ITEMS		"/apps/liferea/maxitemcount"
+#define ARCHIVE_DROPPED_ITEMS		"/apps/liferea/archive-dropped-items"
 #define DEFAULT_UPDATE_INTERVAL		"/apps/liferea/default-update-interval"
 #define STARTUP_FEED_ACTION		"/apps/liferea/startup_feed_action"
 
+/* DB tuning settings */
+#define DB_TUNING_PROFILE		"/apps/liferea/db-tuning-profile"
+#define DB_CACHE_SIZE			"/apps/liferea/db-cache-size"
+#define DB_MMAP_SIZE			"/apps/liferea/db-mmap-size"
+
 /* folder handling settings */
 #define FOLDER_DISPLAY_MODE		"/apps/liferea/folder-display-mode"
 #define FOLDER_DISPLAY_HIDE_READ	"/apps/liferea/folder-display-hide-read"
@@ -70,6 +78,9 @@
 #define LAST_ZOOMLEVEL			"/apps/liferea/last-zoomlevel"
 
 /* networking settings */
+#define NETWORK_MAX_CONNS		"/apps/liferea/network-max-conns"
+#define NETWORK_MAX_CONNS_PER_HOST	"/apps/liferea/network-max-conns-per-host"
+#define NETWORK_IDLE_TIMEOUT		"/apps/liferea/network-idle-timeout"
 #define PROXY_DETECT_MODE		"/apps/liferea/proxy/detect-mode"
 #define PROXY_HOST			"/apps/liferea/proxy/host"
 #define PROXY_PORT			"/apps/liferea/proxy/port"
@@ -25,8 +25,11 @@
 #include "common.h"
 #include "conf.h"
 #include "db.h"
+#include "db_profile.h"
+#include "db_profiler.h"
 #include "debug.h"
 #include "item.h"
+#include "item_index.h"
 #include "itemset.h"
 #include "metadata.h"
 #include "sqlite3async.h"
@@ -40,10 +43,38 @@ static sqlite3	*db = NULL;
 /** hash of all prepared statements */
 static GHashTable *statements = NULL;
 
-/** the sqlite async thread */
+/** prepared statement -> statement name (for the SQL profiler) */
+static GHashTable *statementNames = NULL;
+
+/** the sqlite async thread (only used with the async profile) */
 static GThread *asyncthread = NULL;
 
+/** the active DB tuning profile */
+static dbProfile profile;
+
+/** metadata type id -> DB metadata key id (see table metadata_keys) */
+static GArray *metadataKeyIds = NULL;
+
+/** DB metadata key id -> metadata type id */
+static GArray *metadataTypeIds = NULL;
+
+/** generation counter of the items table (see item_index.h) */
+static gint64 itemIndexGeneration = 0;
+
+/** TRUE if the generation counter was increased since the last snapshot */
+static gboolean itemIndexChanged = FALSE;
+
+/** timer for delayed item index snapshot writing */
+static guint itemIndexUpdateTimer = 0;
+
+/** TRUE if the item archive DB is attached (see db_itemset_retire()) */
+static gboolean archiveAttached = FALSE;
+
+/** delay in seconds for writing the item index snapshot after changes */
+#define ITEM_INDEX_UPDATE_DELAY	30
+
 static void db_view_remove (const gchar *id);
+static gboolean db_archive_attach (void);
 
 static void
 db_prepare_stmt (sqlite3_stmt **stmt, const gchar *sql) 
@@ -70,8 +101,52 @@ db_new_statement (const gchar *name, const gchar *sql)
 	
 	if (!statements)
 		statements = g_hash_table_new (g_str_hash, g_str_equal);
+	if (!statementNames)
+		statementNames = g_hash_table_new (g_direct_hash, g_direct_equal);
 				
 	g_hash_table_insert (statements, (gpointer)name, (gpointer)statement);
+	g_hash_table_insert (statementNames, (gpointer)statement, (gpointer)name);
+}
+
+/* Returns the name of a prepared statement or NULL for ad-hoc statements */
+static const gchar *
+db_get_statement_name (sqlite3_stmt *stmt)
+{
+	return statementNames?g_hash_table_lookup (statementNames, stmt):NULL;
+}
+
+/* The sqlite3_step(), sqlite3_reset() and sqlite3_finalize()
+   wrappers measure the statement execution time when profiling
+   (see db_profiler.h) */
+static gint
+db_step (sqlite3_stmt *stmt)
+{
+	if (!db_profiler_enabled ())
+		return sqlite3_step (stmt);
+
+	return db_profiler_step (stmt, db_get_statement_name (stmt));
+}
+
+static void
+db_reset (sqlite3_stmt *stmt)
+{
+	if (!db_profiler_enabled ()) {
+		sqlite3_reset (stmt);
+		return;
+	}
+
+	db_profiler_reset (stmt, db_get_statement_name (stmt));
+}
+
+static void
+db_finalize (sqlite3_stmt *stmt)
+{
+	if (!db_profiler_enabled ()) {
+		sqlite3_finalize (stmt);
+		return;
+	}
+
+	db_profiler_finalize (stmt, db_get_statement_name (stmt));
 }
 
 static sqlite3_stmt *
@@ -83,7 +158,7 @@ db_get_statement (const gchar *name)
 	if (!statement)
 		g_error ("Fatal: unknown prepared statement \"%s\" requested!", name);	
 
-	sqlite3_reset (statement);
+	db_reset (statement);
 	return statement;
 }
 
@@ -94,7 +169,7 @@ db_exec (const gchar *sql)
 	gint	res;
 	
 	debug1 (DEBUG_DB, "executing SQL: %s", sql);
-	res = sqlite3_exec (db, sql, NULL, NULL, &err);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
 	if (1 >= res) {
 		debug2 (DEBUG_DB, " -> result: %d (%s)", res, err?err:"success");
 	} else {
@@ -112,10 +187,10 @@ db_table_exists (const gchar *name)
 
 	sql = sqlite3_mprintf ("SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = '%s';", name);
 	db_prepare_stmt (&stmt, sql);
-	sqlite3_reset (stmt);
-	sqlite3_step (stmt);
+	db_reset (stmt);
+	db_step (stmt);
 	res = sqlite3_column_int (stmt, 0);
-	sqlite3_finalize (stmt);
+	db_finalize (stmt);
 	sqlite3_free (sql);
 	return (1 == res);
 }
@@ -126,7 +201,7 @@ db_set_schema_version (gint schemaVersion)
 	gchar	*err, *sql;
 
 	sql = sqlite3_mprintf ("REPLACE INTO info (name, value) VALUES ('schemaVersion',%d);", schemaVersion);
-	if (SQLITE_OK != sqlite3_exec (db, sql, NULL, NULL, &err))
+	if (SQLITE_OK != db_profiler_exec (db, sql, NULL, NULL, &err))
 		debug1 (DEBUG_DB, "setting schema version failed: %s", err);
 	sqlite3_free (sql);
 	sqlite3_free (err);
@@ -148,13 +223,41 @@ db_get_schema_version (void)
 	}
 	
 	db_prepare_stmt (&stmt, "SELECT value FROM info WHERE name = 'schemaVersion'");
-	sqlite3_step (stmt);
+	db_step (stmt);
 	schemaVersion = sqlite3_column_int (stmt, 0);
-	sqlite3_finalize (stmt);
+	db_finalize (stmt);
 	
 	return schemaVersion;
 }
 
+static gint64
+db_get_item_index_generation (void)
+{
+	gint64		generation = 0;
+	sqlite3_stmt	*stmt;
+
+	db_prepare_stmt (&stmt, "SELECT value FROM info WHERE name = 'itemIndexGeneration'");
+	if (SQLITE_ROW == db_step (stmt))
+		generation = sqlite3_column_int64 (stmt, 0);
+	db_finalize (stmt);
+
+	return generation;
+}
+
+static void
+db_set_item_index_generation (gint64 generation)
+{
+	gchar	*err, *sql;
+
+	sql = sqlite3_mprintf ("REPLACE INTO info (name, value) VALUES ('itemIndexGeneration',%lld);", (sqlite3_int64)generation);
+	if (SQLITE_OK != db_profiler_exec (db, sql, NULL, NULL, &err))
+		g_warning ("setting item index generation failed: %s", err);
+	sqlite3_free (sql);
+	sqlite3_free (err);
+
+	itemIndexGeneration = generation;
+}
+
 static void
 db_begin_transaction (void)
 {
@@ -162,7 +265,7 @@ db_begin_transaction (void)
 	gint	res;
 	
 	sql = sqlite3_mprintf ("BEGIN");
-	res = sqlite3_exec (db, sql, NULL, NULL, &err);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
 	if (SQLITE_OK != res) 
 		g_warning ("Transaction begin failed (%s) SQL: %s", err, sql);
 	sqlite3_free (sql);
@@ -176,7 +279,7 @@ db_end_transaction (void)
 	gint	res;
 	
 	sql = sqlite3_mprintf ("END");
-	res = sqlite3_exec (db, sql, NULL, NULL, &err);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
 	if (SQLITE_OK != res) 
 		g_warning ("Transaction end failed (%s) SQL: %s", err, sql);
 	sqlite3_free (sql);
@@ -197,6 +300,201 @@ db_sqlite3async_thread (gpointer data)
 	return NULL;
 }
 
+static void
+db_sqlite3async_report (void)
+{
+	sqlite3async_stats	stats;
+
+	if (SQLITE_OK != sqlite3async_control (SQLITEASYNC_GET_STATS, &stats))
+		return;
+
+	debug6 (DEBUG_DB, "async write queue: %" G_GINT64_FORMAT " ops, max depth %d, %" G_GINT64_FORMAT " of %" G_GINT64_FORMAT " writes coalesced, latency avg %" G_GINT64_FORMAT "ms max %" G_GINT64_FORMAT "ms",
+	        (gint64)stats.nOp, stats.nQueueMax,
+	        (gint64)stats.nCoalesced, (gint64)stats.nWrite,
+	        (gint64)(stats.nOp?stats.iLatencyTotal / stats.nOp / 1000:0),
+	        (gint64)(stats.iLatencyMax / 1000));
+}
+
+/* Metadata keys are stored as integer key ids referencing the metadata_keys
+   table. The key ids are mapped to the interned metadata type ids of the
+   running instance using two arrays, so both directions are O(1). */
+
+static void
+db_metadata_key_map (guint keyId, guint typeId)
+{
+	if (metadataKeyIds->len <= typeId)
+		g_array_set_size (metadataKeyIds, typeId + 1);
+	g_array_index (metadataKeyIds, guint, typeId) = keyId;
+
+	if (metadataTypeIds->len <= keyId)
+		g_array_set_size (metadataTypeIds, keyId + 1);
+	g_array_index (metadataTypeIds, guint, keyId) = typeId;
+}
+
+static void
+db_metadata_keys_load (void)
+{
+	sqlite3_stmt	*stmt;
+
+	metadataKeyIds = g_array_new (FALSE, TRUE, sizeof (guint));
+	metadataTypeIds = g_array_new (FALSE, TRUE, sizeof (guint));
+
+	stmt = db_get_statement ("metadataKeysLoadStmt");
+	while (db_step (stmt) == SQLITE_ROW)
+		db_metadata_key_map (sqlite3_column_int (stmt, 0),
+		                     metadata_type_get_id (sqlite3_column_text (stmt, 1)));
+
+	debug1 (DEBUG_DB, "loaded %u metadata keys", metadataTypeIds->len?metadataTypeIds->len - 1:0);
+}
+
+/* Returns the key id for the given metadata type or 0 if the
+   key is not yet in the metadata_keys table. Never writes to the DB. */
+static guint
+db_metadata_key_lookup (const gchar *key)
+{
+	guint	typeId;
+
+	typeId = metadata_type_get_id (key);
+	if (typeId < metadataKeyIds->len)
+		return g_array_index (metadataKeyIds, guint, typeId);
+
+	return 0;
+}
+
+/* Returns the key id for the given metadata type, new keys are added
+   to the metadata_keys table on first use. Returns 0 on error. */
+static guint
+db_metadata_key_id (const gchar *key)
+{
+	sqlite3_stmt	*stmt;
+	guint		keyId;
+	gint		res;
+
+	keyId = db_metadata_key_lookup (key);
+	if (keyId)
+		return keyId;
+
+	stmt = db_get_statement ("metadataKeyInsertStmt");
+	sqlite3_bind_text (stmt, 1, key, -1, SQLITE_TRANSIENT);
+	res = db_step (stmt);
+	if (SQLITE_DONE != res) {
+		g_warning ("Insert in \"metadata_keys\" table failed (error code=%d, %s)", res, sqlite3_errmsg (db));
+		return 0;
+	}
+
+	keyId = (guint)sqlite3_last_insert_rowid (db);
+	db_metadata_key_map (keyId, metadata_type_get_id (key));
+	debug2 (DEBUG_DB, "new metadata key id %u for \"%s\"", keyId, key);
+
+	return keyId;
+}
+
+static const gchar *
+db_metadata_key_name (guint keyId)
+{
+	if (keyId >= metadataTypeIds->len)
+		return NULL;
+
+	return metadata_type_get_name (g_array_index (metadataTypeIds, guint, keyId));
+}
+
+/* The item index snapshot is updated some time after the first item
+   change. As long as it is not written the generation counter in the
+   DB differs from the snapshot one, so a crash in between causes a
+   rebuild on next startup instead of using outdated information. */
+
+static void
+db_item_index_add_rows (itemIndexWriterPtr writer, sqlite3_stmt *stmt)
+{
+	while (db_step (stmt) == SQLITE_ROW) {
+		guint8 flags = 0;
+
+		if (sqlite3_column_int (stmt, 3))
+			flags |= ITEM_INDEX_FLAG_READ;
+		if (sqlite3_column_int (stmt, 4))
+			flags |= ITEM_INDEX_FLAG_MARKED;
+		if (sqlite3_column_int (stmt, 5))
+			flags |= ITEM_INDEX_FLAG_POPUP;
+		if (sqlite3_column_int (stmt, 6))
+			flags |= ITEM_INDEX_FLAG_UPDATED;
+
+		item_index_writer_add (writer,
+		                       sqlite3_column_text (stmt, 0),
+		                       sqlite3_column_int (stmt, 1),
+		                       sqlite3_column_int64 (stmt, 2),
+		                       flags);
+	}
+}
+
+static void
+db_item_index_update (void)
+{
+	itemIndexWriterPtr	writer;
+	sqlite3_stmt		*stmt;
+	GSList			*iter, *dirty;
+
+	debug_start_measurement (DEBUG_DB);
+
+	writer = item_index_writer_new ();
+	if (item_index_is_valid ()) {
+		item_index_writer_copy_clean (writer);
+
+		iter = dirty = item_index_get_dirty_nodes ();
+		while (iter) {
+			stmt = db_get_statement ("itemIndexNodeLoadStmt");
+			sqlite3_bind_text (stmt, 1, (gchar *)iter->data, -1, SQLITE_TRANSIENT);
+			db_item_index_add_rows (writer, stmt);
+			iter = g_slist_next (iter);
+		}
+		debug1 (DEBUG_DB, "updating item index snapshot (%u changed nodes)", g_slist_length (dirty));
+		g_slist_free (dirty);
+	} else {
+		debug0 (DEBUG_DB, "rebuilding item index snapshot");
+		db_item_index_add_rows (writer, db_get_statement ("itemIndexLoadStmt"));
+	}
+	item_index_writer_commit (writer, itemIndexGeneration);
+	itemIndexChanged = FALSE;
+
+	debug_end_measurement (DEBUG_DB, "item index update");
+}
+
+static gboolean
+db_item_index_update_cb (gpointer user_data)
+{
+	itemIndexUpdateTimer = 0;
+	db_item_index_update ();
+	return FALSE;
+}
+
+static void
+db_item_index_schedule_update (void)
+{
+	if (!itemIndexUpdateTimer)
+		itemIndexUpdateTimer = g_timeout_add_seconds (ITEM_INDEX_UPDATE_DELAY, db_item_index_update_cb, NULL);
+}
+
+/* To be called for each node whose items are changed */
+static void
+db_item_index_touch (const gchar *nodeId)
+{
+	if (!itemIndexChanged) {
+		db_set_item_index_generation (itemIndexGeneration + 1);
+		itemIndexChanged = TRUE;
+		db_item_index_schedule_update ();
+	}
+
+	item_index_invalidate_node (nodeId);
+}
+
+/* Invalidates all nodes returned by the given statement */
+static void
+db_item_index_touch_nodes (sqlite3_stmt *stmt)
+{
+	while (db_step (stmt) == SQLITE_ROW)
+		db_item_index_touch (sqlite3_column_text (stmt, 0));
+	db_reset (stmt);
+}
+
 /* We are opening the database twice since schema migration doesn't seem
    to work with sqlite3async. */
 static void
@@ -215,19 +513,58 @@ db_open (const char *zVfs)
 	sqlite3_extended_result_codes (db, TRUE);
 }
 
-#define SCHEMA_TARGET_VERSION 9
+/* Determines the tuning profile from the DB size, the available memory
+   and the user preferences. The cache and mmap sizes can be overridden
+   using gconf keys (0 = automatic, mmap < 0 = disabled). */
+static void
+db_profile_setup (void)
+{
+	gchar	*filename, *name = NULL;
+	gint	value;
+
+	conf_get_str_value (DB_TUNING_PROFILE, &name);
+	filename = common_create_cache_filename (NULL, "liferea", "db");
+	db_profile_init (&profile, db_profile_mode_from_name (name), filename);
+	g_free (filename);
+	g_free (name);
+
+	if (conf_get_int_value (DB_CACHE_SIZE, &value) && value > 0)
+		profile.cacheSize = value;
+	if (conf_get_int_value (DB_MMAP_SIZE, &value) && value != 0)
+		profile.mmapSize = (value > 0)?(gint64)value * 1024 * 1024:0;
+}
+
+static void
+db_profile_report (void)
+{
+	gchar	*report;
+
+	/* always reported to make benchmark results comparable */
+	report = db_profile_apply (&profile, db);
+	g_message ("DB tuning: %s", report);
+	g_free (report);
+}
+
+#define SCHEMA_TARGET_VERSION 10
 
 /* opening or creation of database */
 void
 db_init (void)
 {
-	gint		res;
+	gint		res, cleanupChanges;
 	GError          *error;
+	gchar		*archiveFilename;
 		
 	debug_enter ("db_init");
 
+	db_profile_setup ();
 	db_open (NULL);
 
+	/* Switching the journal mode needs the default VFS */
+	if (!db_profile_set_journal_mode (&profile, db))
+		debug1 (DEBUG_DB, "could not set journal mode for profile \"%s\"", db_profile_mode_to_name (profile.mode));
+	g_free (db_profile_apply (&profile, db));
+
 	/* create info table/check versioning info */				   
 	debug1 (DEBUG_DB, "current DB schema version: %d", db_get_schema_version ());
 
@@ -370,9 +707,9 @@ db_init (void)
 			if (SQLITE_OK != res) {
 				debug1 (DEBUG_DB, "Could not determine views (error=%d)", res);
 			} else {
-				sqlite3_reset (stmt);
+				db_reset (stmt);
 
-					while (sqlite3_step (stmt) == SQLITE_ROW) {
+					while (db_step (stmt) == SQLITE_ROW) {
 						const gchar *viewName = sqlite3_column_text (stmt, 0) + strlen("view_");
 						gchar *copySql = g_strdup_printf("INSERT INTO search_folder_items (node_id, item_id) SELECT '%s',item_id FROM view_%s;", viewName, viewName);
 						
@@ -382,9 +719,50 @@ db_init (void)
 						g_free (copySql);
 					}
 			
-				sqlite3_finalize (stmt);
+				db_finalize (stmt);
 			}
 		}
+
+		if (db_get_schema_version () == 9) {
+			/* 1.7.4 -> 1.7.5 interning metadata keys */
+			debug0 (DEBUG_DB, "migrating from schema version 9 to 10 (interning metadata keys)");
+			db_exec ("BEGIN; "
+			         "CREATE TABLE metadata_keys ("
+			         "   key_id		INTEGER,"
+			         "   key		TEXT UNIQUE,"
+			         "   PRIMARY KEY (key_id)"
+			         "); "
+			         "INSERT INTO metadata_keys (key) SELECT DISTINCT key FROM metadata "
+			         "   UNION SELECT DISTINCT key FROM subscription_metadata; "
+			         "CREATE TEMPORARY TABLE metadata_backup(item_id,nr,key_id,value); "
+			         "INSERT INTO metadata_backup SELECT item_id,nr,key_id,value FROM metadata "
+			         "   JOIN metadata_keys ON metadata_keys.key = metadata.key; "
+			         "DROP TABLE metadata; "
+			         "CREATE TABLE metadata ("
+			         "   item_id		INTEGER,"
+			         "   nr              	INTEGER,"
+			         "   key_id             INTEGER,"
+			         "   value           	TEXT,"
+			         "   PRIMARY KEY (item_id, nr)"
+			         "); "
+			         "INSERT INTO metadata SELECT item_id,nr,key_id,value FROM metadata_backup; "
+			         "DROP TABLE metadata_backup; "
+			         "CREATE TEMPORARY TABLE subscription_metadata_backup(node_id,nr,key_id,value); "
+			         "INSERT INTO subscription_metadata_backup SELECT node_id,nr,key_id,value FROM subscription_metadata "
+			         "   JOIN metadata_keys ON metadata_keys.key = subscription_metadata.key; "
+			         "DROP TABLE subscription_metadata; "
+			         "CREATE TABLE subscription_metadata ("
+			         "   node_id            STRING,"
+			         "   nr                 INTEGER,"
+			         "   key_id             INTEGER,"
+			         "   value              TEXT,"
+			         "   PRIMARY KEY (node_id, nr)"
+			         "); "
+			         "INSERT INTO subscription_metadata SELECT node_id,nr,key_id,value FROM subscription_metadata_backup; "
+			         "DROP TABLE subscription_metadata_backup; "
+			         "REPLACE INTO info (name, value) VALUES ('schemaVersion',10); "
+			         "END;");
+		}
 	}
 
 	if (SCHEMA_TARGET_VERSION != db_get_schema_version ())
@@ -426,11 +804,18 @@ db_init (void)
 	db_exec ("CREATE INDEX items_idx2 ON items (comment_feed_id);");
 	db_exec ("CREATE INDEX items_idx3 ON items (node_id);");
 	db_exec ("CREATE INDEX items_idx4 ON items (item_id);");
+	db_exec ("CREATE INDEX items_idx5 ON items (node_id, popup, read);");
 		
+	db_exec ("CREATE TABLE metadata_keys ("
+	         "   key_id		INTEGER,"
+	         "   key		TEXT UNIQUE,"
+	         "   PRIMARY KEY (key_id)"
+	         ");");
+
 	db_exec ("CREATE TABLE metadata ("
         	 "   item_id		INTEGER,"
         	 "   nr              	INTEGER,"
-        	 "   key             	TEXT,"
+        	 "   key_id             INTEGER,"
         	 "   value           	TEXT,"
         	 "   PRIMARY KEY (item_id, nr)"
         	 ");");
@@ -452,7 +837,7 @@ db_init (void)
 	db_exec ("CREATE TABLE subscription_metadata ("
         	 "   node_id            STRING,"
 		 "   nr                 INTEGER,"
-		 "   key                TEXT,"
+		 "   key_id             INTEGER,"
 		 "   value              TEXT,"
 		 "   PRIMARY KEY (node_id, nr)"
 		 ");");
@@ -488,6 +873,8 @@ db_init (void)
 		
 	/* 3. Cleanup of DB */
 
+	cleanupChanges = sqlite3_total_changes (db);
+
 	/* Note: do not check on subscriptions here, as non-subscription node
 	   types (e.g. news bin) do contain items too. */
 	debug0 (DEBUG_DB, "Checking for items without a feed list node...\n");
@@ -507,6 +894,11 @@ db_init (void)
 	db_exec ("DELETE FROM search_folder_items WHERE node_id NOT IN "
         	 "(SELECT node_id FROM node);");
 			  
+	/* Any item removed during cleanup renders the item index snapshot outdated */
+	itemIndexGeneration = db_get_item_index_generation ();
+	if (cleanupChanges != sqlite3_total_changes (db))
+		db_set_item_index_generation (itemIndexGeneration + 1);
+
 	debug0 (DEBUG_DB, "DB cleanup finished. Continuing startup.");
 		
 	/* 4. Creating triggers (after cleanup so it is not slowed down by triggers) */
@@ -525,24 +917,53 @@ db_init (void)
 
 	sqlite3_close (db);
 
-	if (sqlite3async_initialize (NULL, 0) == SQLITE_OK) {
-		debug0 (DEBUG_DB, "sqlite3async() == SQLITE_OK, starting async thread");
-		asyncthread = g_thread_create (db_sqlite3async_thread, NULL, TRUE, &error);
-		if (asyncthread == NULL) {
-			sqlite3async_shutdown ();
-			g_error ("Could not start async thread, exiting (%s)\n", error->message);
-		}
+	if (DB_PROFILE_WAL == profile.mode) {
+		db_open (NULL);
 	} else {
-		g_error ("Could not initiate async sqlite, exiting\n");
+		if (sqlite3async_initialize (NULL, 0) == SQLITE_OK) {
+			debug0 (DEBUG_DB, "sqlite3async() == SQLITE_OK, starting async thread");
+			asyncthread = g_thread_create (db_sqlite3async_thread, NULL, TRUE, &error);
+			if (asyncthread == NULL) {
+				sqlite3async_shutdown ();
+				g_error ("Could not start async thread, exiting (%s)\n", error->message);
+			}
+		} else {
+			g_error ("Could not initiate async sqlite, exiting\n");
+		}
+
+		db_open (SQLITEASYNC_VFSNAME);
 	}
+	db_profile_report ();
 
-	db_open (SQLITEASYNC_VFSNAME);
+	/* Temporary list of items to be archived and/or removed (see db_itemset_retire()) */
+	db_exec ("CREATE TEMP TABLE retired_items (item_id INTEGER PRIMARY KEY);");
 
 	/* Note: view counting triggers are set up in the view preparation code (see db_view_create()) */		
 	/* prepare statements */
 	
 	db_new_statement ("itemsetLoadStmt",
-	                  "SELECT item_id FROM items WHERE node_id = ?");
+	                  "SELECT item_id FROM items WHERE node_id = ? ORDER BY item_id");
+
+	db_new_statement ("itemsetNodesFindStmt",
+	                  "SELECT DISTINCT node_id FROM items WHERE parent_node_id = ?");
+
+	db_new_statement ("itemNodesFindStmt",
+	                  "SELECT DISTINCT node_id FROM items WHERE item_id = ? OR parent_item_id = ?");
+
+	db_new_statement ("itemRetireStmt",
+	                  "INSERT OR IGNORE INTO temp.retired_items (item_id) VALUES (?)");
+
+	db_new_statement ("itemRetireNodesFindStmt",
+	                  "SELECT DISTINCT node_id FROM items WHERE item_id IN "
+	                  "(SELECT item_id FROM temp.retired_items)");
+
+	db_new_statement ("itemIndexLoadStmt",
+	                  "SELECT node_id,item_id,date,read,marked,popup,updated FROM items "
+	                  "ORDER BY node_id, item_id");
+
+	db_new_statement ("itemIndexNodeLoadStmt",
+	                  "SELECT node_id,item_id,date,read,marked,popup,updated FROM items "
+	                  "WHERE node_id = ? ORDER BY item_id");
 		       
 	db_new_statement ("itemsetReadCountStmt",
 	                  "SELECT COUNT(*) FROM items "
@@ -581,6 +1002,25 @@ db_init (void)
 			  "parent_node_id "
 	                  " FROM items WHERE item_id = ?");      
 	
+	db_new_statement ("itemHeadersLoadStmt",
+	                  "SELECT item_id,node_id,title,source,date,read,marked FROM items "
+	                  "WHERE node_id = ?1 AND comment = 0 AND (?2 = 0 OR item_id < ?2) "
+	                  "ORDER BY item_id DESC LIMIT ?3");
+
+	db_new_statement ("itemHeadersSearchStmt",
+	                  "SELECT item_id,node_id,title,source,date,read,marked FROM items "
+	                  "WHERE comment = 0 AND (title LIKE ?1 ESCAPE '\\' OR description LIKE ?1 ESCAPE '\\') AND (?2 = 0 OR item_id < ?2) "
+	                  "ORDER BY item_id DESC LIMIT ?3");
+
+	db_new_statement ("searchFolderItemHeadersLoadStmt",
+	                  "SELECT items.item_id,items.node_id,title,source,date,read,marked FROM items "
+	                  "INNER JOIN search_folder_items ON items.item_id = search_folder_items.item_id "
+	                  "WHERE search_folder_items.node_id = ?1 AND comment = 0 AND (?2 = 0 OR items.item_id < ?2) "
+	                  "ORDER BY items.item_id DESC LIMIT ?3");
+
+	db_new_statement ("itemDescriptionLoadStmt",
+	                  "SELECT description FROM items WHERE item_id = ?");
+
 	db_new_statement ("itemUpdateStmt",
 	                  "REPLACE INTO items ("
 	                  "title,"
@@ -606,7 +1046,7 @@ db_init (void)
 			  "WHERE item_id=?");
 
 	db_new_statement ("duplicatesFindStmt",
-	                  "SELECT item_id FROM items WHERE source_id = ?");
+	                  "SELECT item_id FROM items WHERE source_id = ? ORDER BY item_id");
 			 
 	db_new_statement ("duplicateNodesFindStmt",
 	                  "SELECT node_id FROM items WHERE item_id IN "
@@ -616,10 +1056,16 @@ db_init (void)
  	                  "UPDATE items SET read = 1, updated = 0 WHERE source_id = ?");
 						
 	db_new_statement ("metadataLoadStmt",
-	                  "SELECT key,value,nr FROM metadata WHERE item_id = ? ORDER BY nr");
+	                  "SELECT key_id,value,nr FROM metadata WHERE item_id = ? ORDER BY nr");
 			
 	db_new_statement ("metadataUpdateStmt",
-	                  "REPLACE INTO metadata (item_id,nr,key,value) VALUES (?,?,?,?)");
+	                  "REPLACE INTO metadata (item_id,nr,key_id,value) VALUES (?,?,?,?)");
+
+	db_new_statement ("metadataKeysLoadStmt",
+	                  "SELECT key_id,key FROM metadata_keys");
+
+	db_new_statement ("metadataKeyInsertStmt",
+	                  "INSERT INTO metadata_keys (key) VALUES (?)");
 			
 	db_new_statement ("subscriptionUpdateStmt",
 	                  "REPLACE INTO subscription ("
@@ -649,20 +1095,42 @@ db_init (void)
 			  "FROM subscription");
 	
 	db_new_statement ("subscriptionMetadataLoadStmt",
-	                  "SELECT key,value,nr FROM subscription_metadata WHERE node_id = ? ORDER BY nr");
+	                  "SELECT key_id,value,nr FROM subscription_metadata WHERE node_id = ? ORDER BY nr");
 			
 	db_new_statement ("subscriptionMetadataUpdateStmt",
-	                  "REPLACE INTO subscription_metadata (node_id,nr,key,value) VALUES (?,?,?,?)");
+	                  "REPLACE INTO subscription_metadata (node_id,nr,key_id,value) VALUES (?,?,?,?)");
 	
 	db_new_statement ("nodeUpdateStmt",
 	                  "REPLACE INTO node (node_id,parent_id,title,type,expanded,view_mode,sort_column,sort_reversed) VALUES (?,?,?,?,?,?,?,?)");
+
+	db_new_statement ("nodeLoadStmt",
+	                  "SELECT title,view_mode,sort_column,sort_reversed FROM node WHERE node_id = ?");
+
+	db_new_statement ("subscriptionNodeLoadStmt",
+	                  "SELECT source,orig_source,filter_cmd,update_interval FROM subscription WHERE node_id = ?");
 	                  
 	db_new_statement ("itemUpdateSearchFoldersStmt",
 	                  "REPLACE INTO search_folder_items (node_id, item_id) VALUES (?,?)");
 	                  
 	db_new_statement ("searchFolderLoadStmt",
-	                  "SELECT item_id FROM search_folder_items WHERE node_id = ?;");
+	                  "SELECT item_id FROM search_folder_items WHERE node_id = ? ORDER BY item_id;");
 			  
+	db_metadata_keys_load ();
+
+	/* An existing archive stays attached so archived items can be found */
+	archiveFilename = common_create_cache_filename (NULL, "liferea-archive", "db");
+	if (g_file_test (archiveFilename, G_FILE_TEST_EXISTS))
+		db_archive_attach ();
+	g_free (archiveFilename);
+
+	if (!item_index_open (itemIndexGeneration)) {
+		/* Force a generation change so that a crash before writing
+		   the new snapshot can never match the invalid one. */
+		db_set_item_index_generation (itemIndexGeneration + 1);
+		itemIndexChanged = TRUE;
+		db_item_index_schedule_update ();
+	}
+
 	g_assert (sqlite3_get_autocommit (db));
 	
 	debug_exit ("db_init");
@@ -671,7 +1139,34 @@ db_init (void)
 static void
 db_free_statements (gpointer key, gpointer value, gpointer user_data)
 {
-	sqlite3_finalize ((sqlite3_stmt *)value);
+	db_finalize ((sqlite3_stmt *)value);
+}
+
+void
+db_write_sql_profile (void)
+{
+	gchar	*filename, *report;
+
+	if (!(debug_level & DEBUG_SQL) || !db)
+		return;
+
+	filename = common_create_cache_filename (NULL, "sqlprofile", "txt");
+	report = db_profiler_report (db);
+	if (!g_file_set_contents (filename, report, -1, NULL))
+		g_warning ("Could not write SQL profile to %s", filename);
+	else
+		debug1 (DEBUG_SQL, "SQL profile written to %s", filename);
+	g_free (report);
+	g_free (filename);
+}
+
+gint
+db_get_total_changes (void)
+{
+	if (!db)
+		return 0;
+
+	return sqlite3_total_changes (db);
 }
 
 void
@@ -683,6 +1178,33 @@ db_deinit (void)
 	if (FALSE == sqlite3_get_autocommit (db))
 		g_warning ("Fatal: DB not in auto-commit mode. This is a bug. Data may be lost!");
 	
+	if (itemIndexUpdateTimer) {
+		g_source_remove (itemIndexUpdateTimer);
+		itemIndexUpdateTimer = 0;
+	}
+
+	if (itemIndexChanged)
+		db_item_index_update ();
+	item_index_close ();
+
+	if (metadataKeyIds) {
+		g_array_free (metadataKeyIds, TRUE);
+		g_array_free (metadataTypeIds, TRUE);
+		metadataKeyIds = metadataTypeIds = NULL;
+	}
+
+	if (debug_level & DEBUG_SQL) {
+		gchar *report = db_profiler_report (db);
+		g_print ("%s", report);
+		g_free (report);
+		db_profiler_free ();
+	}
+
+	if (statementNames) {
+		g_hash_table_destroy (statementNames);
+		statementNames = NULL;
+	}
+
 	if (statements) {
 		g_hash_table_foreach (statements, db_free_statements, NULL);
 		g_hash_table_destroy (statements);	
@@ -693,45 +1215,60 @@ db_deinit (void)
 		g_warning ("DB close failed: %s", sqlite3_errmsg (db));
 	
 	db = NULL;
-	
-	sqlite3async_control (SQLITEASYNC_HALT, SQLITEASYNC_HALT_IDLE);
-	debug0 (DEBUG_DB, "Waiting for async thread to join...");
-	g_thread_join (asyncthread);
-	sqlite3async_shutdown ();
+	archiveAttached = FALSE;
+	
+	if (asyncthread) {
+		sqlite3async_control (SQLITEASYNC_HALT, SQLITEASYNC_HALT_IDLE);
+		debug0 (DEBUG_DB, "Waiting for async thread to join...");
+		g_thread_join (asyncthread);
+		asyncthread = NULL;
+		db_sqlite3async_report ();
+		sqlite3async_shutdown ();
+	}
 		
 	debug_exit ("db_deinit");
 }
 
-static GSList *
-db_metadata_list_append (GSList *metadata, const char *key, const char *value)
+gboolean
+db_is_open (void)
+{
+	return NULL != db;
+}
+
+static metadataListPtr
+db_metadata_list_append (metadataListPtr metadata, guint keyId, const char *value)
 {
-	if (metadata_is_type_registered (key))
+	const gchar	*key = db_metadata_key_name (keyId);
+
+	if (key && metadata_is_type_registered (key))
 		metadata = metadata_list_append (metadata, key, value);
 	else
-		debug1 (DEBUG_DB, "Trying to load unregistered metadata type %s from DB.", key);
+		debug2 (DEBUG_DB, "Trying to load unregistered metadata type %s (key id %u) from DB.", key, keyId);
 
 	return metadata;
 }
 
-static GSList *
+static metadataListPtr
 db_item_metadata_load(itemPtr item) 
 {
-	GSList		*metadata = NULL;
+	metadataListPtr	metadata = NULL;
 	sqlite3_stmt 	*stmt;
 	gint		res;
+	guint		enclosureKeyId;
+
+	/* 0 if no enclosure was ever stored, which matches no key id */
+	enclosureKeyId = db_metadata_key_lookup ("enclosure");
 
 	stmt = db_get_statement ("metadataLoadStmt");
 	res = sqlite3_bind_int (stmt, 1, item->id);
 	if (SQLITE_OK != res)
 		g_error ("db_item_load_metadata: sqlite bind failed (error code %d)!", res);
 
-	while (sqlite3_step (stmt) == SQLITE_ROW) {
-		const char *key, *value;
-		key = sqlite3_column_text(stmt, 0);
-		value = sqlite3_column_text(stmt, 1);
-		if (g_str_equal (key, "enclosure"))
+	while (db_step (stmt) == SQLITE_ROW) {
+		guint keyId = sqlite3_column_int (stmt, 0);
+		if (keyId == enclosureKeyId)
 			item->hasEnclosure = TRUE;
-		metadata = db_metadata_list_append (metadata, key, value); 
+		metadata = db_metadata_list_append (metadata, keyId, sqlite3_column_text (stmt, 1)); 
 	}
 
 	return metadata;
@@ -745,14 +1282,19 @@ db_item_metadata_update_cb (const gchar *key,
 {
 	sqlite3_stmt	*stmt;
 	itemPtr		item = (itemPtr)user_data;
+	guint		keyId;
 	gint		res;
 
+	keyId = db_metadata_key_id (key);
+	if (!keyId)
+		return;
+
 	stmt = db_get_statement ("metadataUpdateStmt");
 	sqlite3_bind_int  (stmt, 1, item->id);
 	sqlite3_bind_int  (stmt, 2, index);
-	sqlite3_bind_text (stmt, 3, key, -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int  (stmt, 3, keyId);
 	sqlite3_bind_text (stmt, 4, value, -1, SQLITE_TRANSIENT);
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 	if (SQLITE_DONE != res) 
 		g_warning ("Update in \"metadata\" table failed (error code=%d, %s)", res, sqlite3_errmsg (db));
 }
@@ -806,19 +1348,26 @@ db_itemset_load (const gchar *id)
 {
 	sqlite3_stmt	*stmt;
 	itemSetPtr 	itemSet;
+	const guint32	*ids;
+	guint		count;
 	gint		res;
 
 	debug2(DEBUG_DB, "loading itemset for node \"%s\" (thread=%p)", id, g_thread_self());
-	itemSet = g_new0(struct itemSet, 1);
-	itemSet->nodeId = (gchar *)id;
+	itemSet = itemset_new (id);
+
+	if (item_index_get_ids (id, &ids, &count)) {
+		debug1 (DEBUG_DB, "using item index snapshot (%u items)", count);
+		g_array_append_vals (itemSet->ids, ids, count);
+		return itemSet;
+	}
 
 	stmt = db_get_statement ("itemsetLoadStmt");
 	res = sqlite3_bind_text (stmt, 1, id, -1, SQLITE_TRANSIENT);
 	if (SQLITE_OK != res)
 		g_error ("db_itemset_load: sqlite bind failed (error code %d)!", res);
 
-	while (sqlite3_step (stmt) == SQLITE_ROW) {
-		itemSet->ids = g_list_append (itemSet->ids, GUINT_TO_POINTER (sqlite3_column_int (stmt, 0)));
+	while (db_step (stmt) == SQLITE_ROW) {
+		itemset_add_id (itemSet, sqlite3_column_int (stmt, 0));
 	}
 
 	debug0 (DEBUG_DB, "loading of itemset finished");
@@ -841,9 +1390,9 @@ db_item_load (gulong id)
 	if (SQLITE_OK != res)
 		g_error ("db_item_load: sqlite bind failed (error code %d)!", res);
 
-	if (sqlite3_step (stmt) == SQLITE_ROW) {
+	if (db_step (stmt) == SQLITE_ROW) {
 		item = db_load_item_from_columns (stmt);
-		res = sqlite3_step (stmt);
+		res = db_step (stmt);
 		/* FIXME: sometimes (after updates) we get an unexpected SQLITE_ROW here! 
 		  if(SQLITE_DONE != res)
 			g_warning("Unexpected result when retrieving single item id=%lu! (error code=%d, %s)", id, res, sqlite3_errmsg(db));
@@ -857,6 +1406,133 @@ db_item_load (gulong id)
 	return item;
 }
 
+/* Returns a LIKE pattern (for ESCAPE '\') matching the given
+   text anywhere, wildcards in the text are matched literally */
+static gchar *
+db_like_pattern (const gchar *text)
+{
+	GString	*pattern = g_string_new ("%");
+
+	for (; *text; text++) {
+		if ('\\' == *text || '%' == *text || '_' == *text)
+			g_string_append_c (pattern, '\\');
+		g_string_append_c (pattern, *text);
+	}
+	g_string_append_c (pattern, '%');
+
+	return g_string_free (pattern, FALSE);
+}
+
+/* Passes the rows of an item header query to the callback */
+static guint
+db_item_headers_step (sqlite3_stmt *stmt, gulong cursor, guint limit, dbItemHeaderFunc func, gpointer user_data)
+{
+	guint	count = 0;
+	gint	res;
+
+	sqlite3_bind_int (stmt, 2, cursor);
+	sqlite3_bind_int (stmt, 3, limit);
+
+	/* rows are passed on directly, nothing is collected here */
+	while (SQLITE_ROW == (res = db_step (stmt))) {
+		(*func) (sqlite3_column_int (stmt, 0),
+		         (const gchar *)sqlite3_column_text (stmt, 1),
+		         (const gchar *)sqlite3_column_text (stmt, 2),
+		         (const gchar *)sqlite3_column_text (stmt, 3),
+		         sqlite3_column_int64 (stmt, 4),
+		         sqlite3_column_int (stmt, 5)?TRUE:FALSE,
+		         sqlite3_column_int (stmt, 6)?TRUE:FALSE,
+		         user_data);
+		count++;
+	}
+
+	if (SQLITE_DONE != res)
+		g_warning ("loading item headers failed (error code=%d, %s)", res, sqlite3_errmsg (db));
+
+	return count;
+}
+
+guint
+db_item_headers_foreach (GSList *nodeIds, const gchar *search, gulong cursor, guint limit, dbItemHeaderFunc func, gpointer user_data)
+{
+	sqlite3_stmt	*stmt;
+	gchar		*pattern = NULL;
+	guint		count;
+
+	debug_start_measurement (DEBUG_DB);
+
+	if (nodeIds && !nodeIds->next) {
+		stmt = db_get_statement ("itemHeadersLoadStmt");
+		sqlite3_bind_text (stmt, 1, nodeIds->data, -1, SQLITE_TRANSIENT);
+		count = db_item_headers_step (stmt, cursor, limit, func, user_data);
+	} else if (nodeIds) {
+		/* the items of several nodes (e.g. of all feeds of a folder)
+		   need a statement for the number of nodes */
+		GString	*sql = g_string_new ("SELECT item_id,node_id,title,source,date,read,marked FROM items WHERE node_id IN (");
+		GSList	*iter;
+
+		for (iter = nodeIds; iter; iter = g_slist_next (iter)) {
+			gchar *quoted = sqlite3_mprintf ("%Q%s", iter->data, iter->next?",":"");
+			g_string_append (sql, quoted);
+			sqlite3_free (quoted);
+		}
+		g_string_append (sql, ") AND comment = 0 AND (?2 = 0 OR item_id < ?2) ORDER BY item_id DESC LIMIT ?3");
+
+		db_prepare_stmt (&stmt, sql->str);
+		count = db_item_headers_step (stmt, cursor, limit, func, user_data);
+		db_finalize (stmt);
+		g_string_free (sql, TRUE);
+	} else {
+		pattern = db_like_pattern (search);
+		stmt = db_get_statement (archiveAttached?"archiveItemHeadersSearchStmt":"itemHeadersSearchStmt");
+		sqlite3_bind_text (stmt, 1, pattern, -1, SQLITE_TRANSIENT);
+		count = db_item_headers_step (stmt, cursor, limit, func, user_data);
+		g_free (pattern);
+	}
+
+	debug_end_measurement (DEBUG_DB, "loading item headers");
+
+	return count;
+}
+
+guint
+db_search_folder_item_headers_foreach (const gchar *id, gulong cursor, guint limit, dbItemHeaderFunc func, gpointer user_data)
+{
+	sqlite3_stmt	*stmt;
+	guint		count;
+
+	debug_start_measurement (DEBUG_DB);
+
+	stmt = db_get_statement ("searchFolderItemHeadersLoadStmt");
+	sqlite3_bind_text (stmt, 1, id, -1, SQLITE_TRANSIENT);
+	count = db_item_headers_step (stmt, cursor, limit, func, user_data);
+
+	debug_end_measurement (DEBUG_DB, "loading search folder item headers");
+
+	return count;
+}
+
+gchar *
+db_item_get_description (gulong id)
+{
+	sqlite3_stmt	*stmt;
+	gchar		*description = NULL;
+
+	stmt = db_get_statement ("itemDescriptionLoadStmt");
+	sqlite3_bind_int (stmt, 1, id);
+	if (SQLITE_ROW == db_step (stmt))
+		description = g_strdup ((const gchar *)sqlite3_column_text (stmt, 0));
+
+	if (!description && archiveAttached) {
+		stmt = db_get_statement ("archiveItemDescriptionLoadStmt");
+		sqlite3_bind_int (stmt, 1, id);
+		if (SQLITE_ROW == db_step (stmt))
+			description = g_strdup ((const gchar *)sqlite3_column_text (stmt, 0));
+	}
+
+	return description;
+}
+
 /* Item modification methods */
 
 static int
@@ -890,8 +1566,11 @@ db_item_set_id (itemPtr item)
 	
 	g_assert (0 == item->id);
 	
-	sql = sqlite3_mprintf ("SELECT MAX(item_id) FROM items");
-	res = sqlite3_exec (db, sql, db_item_set_id_cb, item, &err);
+	/* Retired item ids must not be reused as they are kept in the archive */
+	sql = sqlite3_mprintf ("SELECT MAX(id) FROM ("
+	                       "SELECT MAX(item_id) AS id FROM items UNION ALL "
+	                       "SELECT CAST(value AS INTEGER) FROM info WHERE name = 'retiredItemIdMax')");
+	res = db_profiler_exec (db, sql, db_item_set_id_cb, item, &err);
 	if (SQLITE_OK != res) 
 		g_warning ("Select failed (%s) SQL: %s", err, sql);
 	sqlite3_free (sql);
@@ -914,14 +1593,14 @@ db_item_search_folders_update (itemPtr item)
 		stmt = db_get_statement ("itemUpdateSearchFoldersStmt");
 		sqlite3_bind_text (stmt, 1, vfolder->node->id, -1, SQLITE_TRANSIENT);
 		sqlite3_bind_int (stmt, 2, item->id);
-		res = sqlite3_step (stmt);
+		res = db_step (stmt);
 
 		if (SQLITE_DONE != res) 
 			g_warning ("item update of search folders failed (error code=%d, %s)", res, sqlite3_errmsg (db));
 		
 		iter = g_slist_next (iter);
 	}
-	g_slist_free (iter);
+	g_slist_free (list);
 }
 
 void
@@ -960,10 +1639,12 @@ db_item_update (itemPtr item)
 	sqlite3_bind_text (stmt, 15, item->nodeId, -1, SQLITE_TRANSIENT);
 	sqlite3_bind_text (stmt, 16, item->parentNodeId, -1, SQLITE_TRANSIENT);
 
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 
 	if (SQLITE_DONE != res) 
 		g_warning ("item update failed (error code=%d, %s)", res, sqlite3_errmsg (db));
+
+	db_item_index_touch (item->nodeId);
 	
 	db_item_metadata_update (item);
 	db_item_search_folders_update (item);
@@ -993,12 +1674,30 @@ db_item_state_update (itemPtr item)
 	sqlite3_bind_int (stmt, 3, item->updateStatus?1:0);
 	sqlite3_bind_int (stmt, 4, item->id);
 
-	if (sqlite3_step (stmt) != SQLITE_DONE) 
+	if (db_step (stmt) != SQLITE_DONE) 
 		g_warning ("item state update failed (%s)", sqlite3_errmsg (db));
+
+	db_item_index_touch (item->nodeId);
 	debug_end_measurement (DEBUG_DB, "item state update");
 	
 }
 
+void
+db_items_state_update (GSList *items)
+{
+	GSList	*iter;
+
+	debug1 (DEBUG_DB, "updating state of %u items", g_slist_length (items));
+	debug_start_measurement (DEBUG_DB);
+
+	db_begin_transaction ();
+	for (iter = items; iter; iter = g_slist_next (iter))
+		db_item_state_update ((itemPtr)iter->data);
+	db_end_transaction ();
+
+	debug_end_measurement (DEBUG_DB, "items state update");
+}
+
 void
 db_item_remove (gulong id) 
 {
@@ -1006,19 +1705,24 @@ db_item_remove (gulong id)
 	gint		res;
 	
 	debug1 (DEBUG_DB, "removing item with id %lu", id);
+
+	stmt = db_get_statement ("itemNodesFindStmt");
+	sqlite3_bind_int (stmt, 1, id);
+	sqlite3_bind_int (stmt, 2, id);
+	db_item_index_touch_nodes (stmt);
 	
 	stmt = db_get_statement ("itemsetRemoveStmt");
 	sqlite3_bind_int (stmt, 1, id);
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 
 	if (SQLITE_DONE != res)
 		g_warning ("item remove failed (error code=%d, %s)", res, sqlite3_errmsg (db));
 }
 
-GSList * 
+itemSetPtr
 db_item_get_duplicates (const gchar *guid) 
 {
-	GSList		*duplicates = NULL;
+	itemSetPtr	duplicates;
 	sqlite3_stmt	*stmt;
 	gint		res;
 
@@ -1029,11 +1733,9 @@ db_item_get_duplicates (const gchar *guid)
 	if (SQLITE_OK != res)
 		g_error ("db_item_get_duplicates: sqlite bind failed (error code %d)!", res);
 
-	while (sqlite3_step (stmt) == SQLITE_ROW) 
-	{
-		gulong id = sqlite3_column_int (stmt, 0);
-		duplicates = g_slist_append (duplicates, GUINT_TO_POINTER (id));
-	}
+	duplicates = itemset_new (NULL);
+	while (db_step (stmt) == SQLITE_ROW) 
+		itemset_add_id (duplicates, sqlite3_column_int (stmt, 0));
 
 	debug_end_measurement (DEBUG_DB, "searching for duplicates");
 	
@@ -1054,10 +1756,10 @@ db_item_get_duplicate_nodes (const gchar *guid)
 	if (SQLITE_OK != res)
 		g_error ("db_item_get_duplicates: sqlite bind failed (error code %d)!", res);
 
-	while (sqlite3_step (stmt) == SQLITE_ROW) 
+	while (db_step (stmt) == SQLITE_ROW) 
 	{
 		gchar *id = g_strdup( sqlite3_column_text (stmt, 0));
-		duplicates = g_slist_append (duplicates, id);
+		duplicates = g_slist_prepend (duplicates, id);
 	}
 
 	debug_end_measurement (DEBUG_DB, "searching for duplicates");
@@ -1072,10 +1774,14 @@ db_itemset_remove_all (const gchar *id)
 	gint		res;
 	
 	debug1(DEBUG_DB, "removing all items for item set with %s", id);
+
+	stmt = db_get_statement ("itemsetNodesFindStmt");
+	sqlite3_bind_text (stmt, 1, id, -1, SQLITE_TRANSIENT);
+	db_item_index_touch_nodes (stmt);
 		
 	stmt = db_get_statement ("itemsetRemoveAllStmt");
 	sqlite3_bind_text (stmt, 1, id, -1, SQLITE_TRANSIENT);
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 
 	if (SQLITE_DONE != res)
 		g_warning ("removing all items failed (error code=%d, %s)", res, sqlite3_errmsg (db));
@@ -1091,10 +1797,145 @@ db_itemset_mark_all_popup (const gchar *id)
 		
 	stmt = db_get_statement ("itemsetMarkAllPopupStmt");
 	sqlite3_bind_text (stmt, 1, id, -1, SQLITE_TRANSIENT);
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 
 	if (SQLITE_DONE != res)
 		g_warning ("marking all items popup failed (error code=%d, %s)", res, sqlite3_errmsg(db));
+
+	db_item_index_touch (id);
+}
+
+/* Item retention: items dropped because of the cache limit are removed
+   in one set based operation. If archiving is enabled they are moved
+   to a separate archive DB file, so the main DB stays small. The archive
+   has the same layout as the items, metadata and metadata_keys tables.
+   Once it exists it stays attached and the item search and description
+   lookup also query archive.items. */
+
+static gboolean
+db_archive_attach (void)
+{
+	gchar	*filename, *sql, *err = NULL;
+	gint	res;
+
+	if (archiveAttached)
+		return TRUE;
+
+	filename = common_create_cache_filename (NULL, "liferea-archive", "db");
+	sql = sqlite3_mprintf ("ATTACH DATABASE %Q AS archive", filename);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
+	if (SQLITE_OK != res)
+		g_warning ("Attaching the item archive %s failed (%s)", filename, err);
+	sqlite3_free (sql);
+	sqlite3_free (err);
+	g_free (filename);
+
+	if (SQLITE_OK != res)
+		return FALSE;
+
+	db_exec ("CREATE TABLE IF NOT EXISTS archive.items ("
+	         "   item_id		INTEGER,"
+	         "   parent_item_id     INTEGER,"
+	         "   node_id		TEXT,"
+	         "   parent_node_id     TEXT,"
+	         "   title		TEXT,"
+	         "   read		INTEGER,"
+	         "   updated		INTEGER,"
+	         "   popup		INTEGER,"
+	         "   marked		INTEGER,"
+	         "   source		TEXT,"
+	         "   source_id		TEXT,"
+	         "   valid_guid		INTEGER,"
+	         "   description	TEXT,"
+	         "   date		INTEGER,"
+	         "   comment_feed_id	TEXT,"
+	         "   comment            INTEGER,"
+	         "   PRIMARY KEY (item_id)"
+	         ");");
+	db_exec ("CREATE INDEX IF NOT EXISTS archive.items_idx ON items (node_id);");
+	db_exec ("CREATE TABLE IF NOT EXISTS archive.metadata ("
+	         "   item_id		INTEGER,"
+	         "   nr              	INTEGER,"
+	         "   key_id             INTEGER,"
+	         "   value           	TEXT,"
+	         "   PRIMARY KEY (item_id, nr)"
+	         ");");
+	db_exec ("CREATE INDEX IF NOT EXISTS archive.metadata_idx ON metadata (item_id);");
+	db_exec ("CREATE TABLE IF NOT EXISTS archive.metadata_keys ("
+	         "   key_id		INTEGER,"
+	         "   key		TEXT UNIQUE,"
+	         "   PRIMARY KEY (key_id)"
+	         ");");
+
+	db_new_statement ("archiveItemHeadersSearchStmt",
+	                  "SELECT item_id,node_id,title,source,date,read,marked FROM main.items "
+	                  "WHERE comment = 0 AND (title LIKE ?1 ESCAPE '\\' OR description LIKE ?1 ESCAPE '\\') AND (?2 = 0 OR item_id < ?2) "
+	                  "UNION ALL "
+	                  "SELECT item_id,node_id,title,source,date,read,marked FROM archive.items "
+	                  "WHERE comment = 0 AND (title LIKE ?1 ESCAPE '\\' OR description LIKE ?1 ESCAPE '\\') AND (?2 = 0 OR item_id < ?2) "
+	                  "ORDER BY item_id DESC LIMIT ?3");
+
+	db_new_statement ("archiveItemDescriptionLoadStmt",
+	                  "SELECT description FROM archive.items WHERE item_id = ?");
+
+	archiveAttached = TRUE;
+
+	return TRUE;
+}
+
+void
+db_itemset_retire (itemSetPtr itemSet)
+{
+	sqlite3_stmt	*stmt;
+	gboolean	archive = FALSE;
+	guint		i;
+
+	if (!itemset_get_length (itemSet))
+		return;
+
+	debug2 (DEBUG_DB, "retiring %u items of item set %s", itemset_get_length (itemSet), itemSet->nodeId);
+	debug_start_measurement (DEBUG_DB);
+
+	/* attaching is not possible within a transaction */
+	conf_get_bool_value (ARCHIVE_DROPPED_ITEMS, &archive);
+	if (archive)
+		archive = db_archive_attach ();
+
+	db_begin_transaction ();
+
+	for (i = 0; i < itemset_get_length (itemSet); i++) {
+		stmt = db_get_statement ("itemRetireStmt");
+		sqlite3_bind_int (stmt, 1, itemset_get_id (itemSet, i));
+		if (SQLITE_DONE != db_step (stmt))
+			g_warning ("item retiring failed (%s)", sqlite3_errmsg (db));
+	}
+
+	/* comments go together with their parent item */
+	db_exec ("INSERT OR IGNORE INTO temp.retired_items SELECT item_id FROM items "
+	         "WHERE parent_item_id IN (SELECT item_id FROM temp.retired_items);");
+
+	db_item_index_touch_nodes (db_get_statement ("itemRetireNodesFindStmt"));
+
+	db_exec ("REPLACE INTO info (name, value) SELECT 'retiredItemIdMax', MAX(id) FROM ("
+	         "SELECT MAX(item_id) AS id FROM temp.retired_items UNION ALL "
+	         "SELECT CAST(value AS INTEGER) FROM info WHERE name = 'retiredItemIdMax');");
+
+	if (archive) {
+		db_exec ("INSERT OR IGNORE INTO archive.metadata_keys SELECT * FROM main.metadata_keys;");
+		db_exec ("INSERT OR REPLACE INTO archive.items SELECT * FROM main.items "
+		         "WHERE item_id IN (SELECT item_id FROM temp.retired_items);");
+		db_exec ("INSERT OR REPLACE INTO archive.metadata SELECT * FROM main.metadata "
+		         "WHERE item_id IN (SELECT item_id FROM temp.retired_items);");
+	}
+
+	/* metadata is removed by the item_removal trigger */
+	db_exec ("DELETE FROM main.search_folder_items WHERE item_id IN (SELECT item_id FROM temp.retired_items);");
+	db_exec ("DELETE FROM main.items WHERE item_id IN (SELECT item_id FROM temp.retired_items);");
+	db_exec ("DELETE FROM temp.retired_items;");
+
+	db_end_transaction ();
+
+	debug_end_measurement (DEBUG_DB, archive?"archiving items":"removing items");
 }
 
 /* Statistics interface */
@@ -1104,13 +1945,16 @@ db_itemset_get_unread_count (const gchar *id)
 {
 	sqlite3_stmt	*stmt;
 	gint		res;
-	guint		count = 0;
+	guint		count = 0, itemCount;
+
+	if (item_index_get_counts (id, &itemCount, &count))
+		return count;
 	
 	debug_start_measurement (DEBUG_DB);
 	
 	stmt = db_get_statement ("itemsetReadCountStmt");
 	sqlite3_bind_text (stmt, 1, id, -1, SQLITE_TRANSIENT);
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 	
 	if (SQLITE_ROW == res)
 		count = sqlite3_column_int (stmt, 0);
@@ -1127,13 +1971,16 @@ db_itemset_get_item_count (const gchar *id)
 {
 	sqlite3_stmt 	*stmt;
 	gint		res;
-	guint		count = 0;
+	guint		count = 0, unreadCount;
+
+	if (item_index_get_counts (id, &count, &unreadCount))
+		return count;
 
 	debug_start_measurement (DEBUG_DB);
 	
 	stmt = db_get_statement ("itemsetItemCountStmt");
 	sqlite3_bind_text (stmt, 1, id, -1, SQLITE_TRANSIENT);
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 	
 	if (SQLITE_ROW == res)
 		count = sqlite3_column_int (stmt, 0);
@@ -1145,6 +1992,70 @@ db_itemset_get_item_count (const gchar *id)
 	return count;
 }
 
+popupStatsPtr
+db_itemset_get_popup_stats (GSList *ids, guint maxTitles)
+{
+	popupStatsPtr	stats;
+	sqlite3_stmt	*stmt;
+	GString		*sql;
+	GSList		*iter;
+	gchar		*tmp;
+	gint		res;
+
+	stats = g_new0 (struct popupStats, 1);
+	stats->nodeCounts = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	if (!ids)
+		return stats;
+
+	debug_start_measurement (DEBUG_DB);
+
+	/* One query for all nodes using the (node_id, popup, read) index,
+	   only the matching rows are returned, no item is loaded. */
+	sql = g_string_new ("SELECT node_id, title FROM items WHERE popup = 1 AND read = 0 AND node_id IN (");
+	for (iter = ids; iter; iter = g_slist_next (iter)) {
+		tmp = sqlite3_mprintf ("%Q%s", (const gchar *)iter->data, g_slist_next (iter)?",":"");
+		g_string_append (sql, tmp);
+		sqlite3_free (tmp);
+	}
+	g_string_append (sql, ") ORDER BY date DESC");
+
+	db_prepare_stmt (&stmt, sql->str);
+	g_string_free (sql, TRUE);
+
+	while (SQLITE_ROW == (res = db_step (stmt))) {
+		const gchar	*nodeId = (const gchar *)sqlite3_column_text (stmt, 0);
+		const gchar	*title = (const gchar *)sqlite3_column_text (stmt, 1);
+		guint		count;
+
+		stats->count++;
+
+		count = GPOINTER_TO_UINT (g_hash_table_lookup (stats->nodeCounts, nodeId));
+		g_hash_table_replace (stats->nodeCounts, g_strdup (nodeId), GUINT_TO_POINTER (count + 1));
+
+		if (stats->count <= maxTitles)
+			stats->titles = g_slist_append (stats->titles, g_strdup (title?title:""));
+	}
+
+	if (SQLITE_DONE != res)
+		g_warning ("popup item counting failed (error code=%d, %s)", res, sqlite3_errmsg (db));
+
+	db_finalize (stmt);
+
+	debug_end_measurement (DEBUG_DB, "counting popup items");
+
+	return stats;
+}
+
+void
+db_popup_stats_free (popupStatsPtr stats)
+{
+	g_hash_table_destroy (stats->nodeCounts);
+	g_slist_foreach (stats->titles, (GFunc)g_free, NULL);
+	g_slist_free (stats->titles);
+	g_free (stats);
+}
+
 /* This method is only used for migration from old schema versions */
 static void
 db_view_remove_triggers (const gchar *id)
@@ -1154,7 +2065,7 @@ db_view_remove_triggers (const gchar *id)
 	
 	err = NULL;
 	sql = sqlite3_mprintf ("DROP TRIGGER view_%s_insert_before;", id);
-	res = sqlite3_exec (db, sql, NULL, NULL, &err);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
 	if (SQLITE_OK != res) 
 		debug2 (DEBUG_DB, "Dropping trigger failed (%s) SQL: %s", err, sql);
 	sqlite3_free (sql);
@@ -1162,7 +2073,7 @@ db_view_remove_triggers (const gchar *id)
 
 	err = NULL;
 	sql = sqlite3_mprintf ("DROP TRIGGER view_%s_insert_after;", id);
-	res = sqlite3_exec (db, sql, NULL, NULL, &err);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
 	if (SQLITE_OK != res) 
 		debug2 (DEBUG_DB, "Dropping trigger failed (%s) SQL: %s", err, sql);
 	sqlite3_free (sql);
@@ -1170,7 +2081,7 @@ db_view_remove_triggers (const gchar *id)
 	
 	err = NULL;
 	sql = sqlite3_mprintf ("DROP TRIGGER view_%s_delete;", id);
-	res = sqlite3_exec (db, sql, NULL, NULL, &err);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
 	if (SQLITE_OK != res) 
 		debug2 (DEBUG_DB, "Dropping trigger failed (%s) SQL: %s", err, sql);
 	sqlite3_free (sql);
@@ -1178,7 +2089,7 @@ db_view_remove_triggers (const gchar *id)
 	
 	err = NULL;
 	sql = sqlite3_mprintf ("DROP TRIGGER view_%s_update_before;", id);
-	res = sqlite3_exec (db, sql, NULL, NULL, &err);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
 	if (SQLITE_OK != res) 
 		debug2 (DEBUG_DB, "Dropping trigger failed (%s) SQL: %s", err, sql);
 	sqlite3_free (sql);
@@ -1186,7 +2097,7 @@ db_view_remove_triggers (const gchar *id)
 	
 	err = NULL;
 	sql = sqlite3_mprintf ("DROP TRIGGER view_%s_update_after;", id);
-	res = sqlite3_exec (db, sql, NULL, NULL, &err);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
 	if (SQLITE_OK != res) 
 		debug2 (DEBUG_DB, "Dropping trigger failed (%s) SQL: %s", err, sql);
 	sqlite3_free (sql);
@@ -1209,7 +2120,7 @@ db_view_remove (const gchar *id)
 	   used during schema migration to remove all views. */	
 		
 	sql = sqlite3_mprintf ("DROP VIEW view_%s;", id);	
-	res = sqlite3_exec (db, sql, NULL, NULL, &err);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
 	if (SQLITE_OK != res) 
 		g_warning ("Dropping view failed (%s) SQL: %s", err, sql);
 	
@@ -1231,14 +2142,13 @@ db_search_folder_load (const gchar *id)
 	if (SQLITE_OK != res)
 		g_error ("db_load_metadata: sqlite bind failed (error code %d)!", res);
 	
-	itemSet = g_new0 (struct itemSet, 1);
-	itemSet->nodeId = (gchar *)id;
+	itemSet = itemset_new (id);
 
-	while (sqlite3_step (stmt) == SQLITE_ROW) {
-		itemSet->ids = g_list_append (itemSet->ids, GUINT_TO_POINTER (sqlite3_column_int (stmt, 0)));
+	while (db_step (stmt) == SQLITE_ROW) {
+		itemset_add_id (itemSet, sqlite3_column_int (stmt, 0));
 	}
 	
-	debug1 (DEBUG_DB, "loading search folder finished (%d items)", g_list_length (itemSet->ids));
+	debug1 (DEBUG_DB, "loading search folder finished (%d items)", itemset_get_length (itemSet));
 	
 	return itemSet;
 }
@@ -1252,7 +2162,7 @@ db_search_folder_reset (const gchar *id)
 	debug2 (DEBUG_DB, "resetting search folder node \"%s\" (thread=%p)", id, g_thread_self ());
 	
 	sql = sqlite3_mprintf ("DELETE FROM search_folder_items WHERE node_id = %s;", id);
-	res = sqlite3_exec (db, sql, NULL, NULL, &err);
+	res = db_profiler_exec (db, sql, NULL, NULL, &err);
 	if (SQLITE_OK != res)
 		g_warning ("resetting search folder failed (%s) SQL: %s", err, sql);
 
@@ -1262,10 +2172,10 @@ db_search_folder_reset (const gchar *id)
 	debug0 (DEBUG_DB, "removing search folder finished");
 }
 
-static GSList *
+static metadataListPtr
 db_subscription_metadata_load(const gchar *id) 
 {
-	GSList		*metadata = NULL;
+	metadataListPtr	metadata = NULL;
 	sqlite3_stmt	*stmt;
 	gint		res;
 
@@ -1274,9 +2184,9 @@ db_subscription_metadata_load(const gchar *id)
 	if (SQLITE_OK != res)
 		g_error ("db_load_metadata: sqlite bind failed (error code %d)!", res);
 
-	while (sqlite3_step (stmt) == SQLITE_ROW) {
-		metadata = db_metadata_list_append (metadata, sqlite3_column_text(stmt, 0), 
-		                                           sqlite3_column_text(stmt, 1));
+	while (db_step (stmt) == SQLITE_ROW) {
+		metadata = db_metadata_list_append (metadata, sqlite3_column_int (stmt, 0), 
+		                                           sqlite3_column_text (stmt, 1));
 	}
 
 	return metadata;
@@ -1290,14 +2200,19 @@ db_subscription_metadata_update_cb (const gchar *key,
 {
 	sqlite3_stmt	*stmt;
 	nodePtr		node = (nodePtr)user_data;
+	guint		keyId;
 	gint		res;
 
+	keyId = db_metadata_key_id (key);
+	if (!keyId)
+		return;
+
 	stmt = db_get_statement ("subscriptionMetadataUpdateStmt");
 	sqlite3_bind_text (stmt, 1, node->id, -1, SQLITE_TRANSIENT);
 	sqlite3_bind_int  (stmt, 2, index);
-	sqlite3_bind_text (stmt, 3, key, -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int  (stmt, 3, keyId);
 	sqlite3_bind_text (stmt, 4, value, -1, SQLITE_TRANSIENT);
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 	if (SQLITE_DONE != res) 
 		g_warning ("Update in \"metadata\" table failed (error code=%d, %s)", res, sqlite3_errmsg (db));
 }
@@ -1335,7 +2250,7 @@ db_subscription_update (subscriptionPtr subscription)
 	                             subscription->httpError ||
 				     subscription->filterError)?1:0);
 	
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 	if (SQLITE_DONE != res)
 		g_warning ("Could not update subscription info %s in DB (error code %d)!", subscription->node->id, res);
 		
@@ -1356,7 +2271,7 @@ db_subscription_remove (const gchar *id)
 	stmt = db_get_statement ("subscriptionRemoveStmt");
 	sqlite3_bind_text (stmt, 1, id, -1, SQLITE_TRANSIENT);
 
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 	if (SQLITE_DONE != res)
 		g_warning ("Could not remove subscription %s from DB (error code %d)!", id, res);
 
@@ -1382,9 +2297,79 @@ db_node_update (nodePtr node)
 	sqlite3_bind_int  (stmt, 7, node->sortColumn);
 	sqlite3_bind_int  (stmt, 8, node->sortReversed?1:0);
 	
-	res = sqlite3_step (stmt);
+	res = db_step (stmt);
 	if (SQLITE_DONE != res)
 		g_warning ("Could not update subscription info %s in DB (error code %d)!", node->id, res);
 		
 	debug_end_measurement (DEBUG_DB, "subscription_update");
 }
+
+/* Replaces a string field with a column value that may be NULL */
+static void
+db_column_replace_text (sqlite3_stmt *stmt, gint column, gchar **field)
+{
+	g_free (*field);
+	*field = g_strdup (sqlite3_column_text (stmt, column));
+}
+
+gboolean
+db_node_load (nodePtr node)
+{
+	sqlite3_stmt	*stmt;
+	gboolean	found = FALSE;
+
+	debug2 (DEBUG_DB, "loading node info %s (thread %p)", node->id, g_thread_self());
+	debug_start_measurement (DEBUG_DB);
+
+	stmt = db_get_statement ("nodeLoadStmt");
+	sqlite3_bind_text (stmt, 1, node->id, -1, SQLITE_TRANSIENT);
+	if (SQLITE_ROW == db_step (stmt)) {
+		found = TRUE;
+		if (sqlite3_column_text (stmt, 0))
+			db_column_replace_text (stmt, 0, &node->title);
+		node->viewMode = sqlite3_column_int (stmt, 1);
+		node->sortColumn = sqlite3_column_int (stmt, 2);
+		node->sortReversed = (1 == sqlite3_column_int (stmt, 3));
+	}
+	db_reset (stmt);
+
+	if (found && node->subscription) {
+		subscriptionPtr subscription = node->subscription;
+
+		stmt = db_get_statement ("subscriptionNodeLoadStmt");
+		sqlite3_bind_text (stmt, 1, node->id, -1, SQLITE_TRANSIENT);
+		if (SQLITE_ROW == db_step (stmt)) {
+			if (sqlite3_column_text (stmt, 0))
+				db_column_replace_text (stmt, 0, &subscription->source);
+			db_column_replace_text (stmt, 1, &subscription->origSource);
+			db_column_replace_text (stmt, 2, &subscription->filtercmd);
+			subscription->updateInterval = sqlite3_column_int (stmt, 3);
+		}
+		db_reset (stmt);
+	}
+
+	debug_end_measurement (DEBUG_DB, "node load");
+
+	return found;
+}
+
+void
+db_nodes_update (GSList *nodes)
+{
+	GSList	*iter;
+
+	debug1 (DEBUG_DB, "updating %u nodes", g_slist_length (nodes));
+	debug_start_measurement (DEBUG_DB);
+
+	db_begin_transaction ();
+	for (iter = nodes; iter; iter = g_slist_next (iter)) {
+		nodePtr node = (nodePtr)iter->data;
+
+		if (node->subscription)
+			db_subscription_update (node->subscription);
+		db_node_update (node);
+	}
+	db_end_transaction ();
+
+	debug_end_measurement (DEBUG_DB, "nodes update");
+}
@@ -38,6 +38,27 @@ void db_init(void);
  */
 void db_deinit(void);
 
+/**
+ * Returns whether the DB is open.
+ *
+ * @returns FALSE before db_init() and after db_deinit()
+ */
+gboolean db_is_open (void);
+
+/**
+ * Writes the SQL profile (see db_profiler.h) to sqlprofile.txt
+ * in the cache directory. Does nothing if the SQL profiler
+ * was not enabled with --debug-sql.
+ */
+void db_write_sql_profile (void);
+
+/**
+ * Returns the number of rows changed since the DB was opened.
+ *
+ * @returns number of inserted, updated and deleted rows
+ */
+gint db_get_total_changes (void);
+
 /* item set access (note: item sets are identified by the node id string) */
 
 /**
@@ -56,6 +77,16 @@ itemSetPtr	db_itemset_load(const gchar *id);
  */
 void		db_itemset_remove_all(const gchar *id);
 
+/**
+ * Removes the given items (and their comments) from the DB
+ * using a single set operation. If item archiving is enabled
+ * the items are moved to the archive DB instead, which stays
+ * attached for searching.
+ *
+ * @param itemSet	the items to remove
+ */
+void		db_itemset_retire(itemSetPtr itemSet);
+
 /**
  * Mass items state changing methods. Mark all items of
  * a given item set as old/popup.
@@ -64,6 +95,31 @@ void		db_itemset_remove_all(const gchar *id);
  */
 void		db_itemset_mark_all_popup(const gchar *id);
 
+/** notification statistics of one or more item sets */
+typedef struct popupStats {
+	guint		count;		/**< number of unread items not yet notified */
+	GHashTable	*nodeCounts;	/**< node id -> number of such items (nodes without any are missing) */
+	GSList		*titles;	/**< titles of the newest of these items, newest first */
+} *popupStatsPtr;
+
+/**
+ * Counts the unread items not yet notified (popup flag set)
+ * of the given item sets with a single query.
+ *
+ * @param ids		list of node ids
+ * @param maxTitles	maximum number of item titles to return
+ *
+ * @returns new statistics, free with db_popup_stats_free()
+ */
+popupStatsPtr	db_itemset_get_popup_stats(GSList *ids, guint maxTitles);
+
+/**
+ * Frees the given notification statistics.
+ *
+ * @param stats	the statistics
+ */
+void		db_popup_stats_free(popupStatsPtr stats);
+
 /**
  * Returns the number of unread items for the given item set.
  *
@@ -93,6 +149,53 @@ guint		db_itemset_get_item_count(const gchar *id);
  */
 itemPtr	db_item_load(gulong id);
 
+/**
+ * Callback for db_item_headers_foreach()
+ */
+typedef void (*dbItemHeaderFunc) (gulong id, const gchar *nodeId, const gchar *title,
+                                  const gchar *source, gint64 date, gboolean read,
+                                  gboolean marked, gpointer user_data);
+
+/**
+ * Passes the headers of a page of items to the given callback
+ * without loading the items. Items are returned newest (highest
+ * id) first, comments are skipped. Searches also return
+ * archived items (see db_itemset_retire()).
+ *
+ * @param nodeIds	ids of the nodes whose items are wanted (or NULL to search)
+ * @param search	text to find in item titles or descriptions (if nodeIds is NULL)
+ * @param cursor	only items with a lower id are returned (0 for the first page)
+ * @param limit		maximum number of items
+ * @param func		the callback
+ * @param user_data	user data for the callback
+ *
+ * @returns the number of items passed to the callback
+ */
+guint	db_item_headers_foreach(GSList *nodeIds, const gchar *search, gulong cursor, guint limit, dbItemHeaderFunc func, gpointer user_data);
+
+/**
+ * Like db_item_headers_foreach() for the items matching a search folder.
+ *
+ * @param id		the search folder node id
+ * @param cursor	only items with a lower id are returned (0 for the first page)
+ * @param limit		maximum number of items
+ * @param func		the callback
+ * @param user_data	user data for the callback
+ *
+ * @returns the number of items passed to the callback
+ */
+guint	db_search_folder_item_headers_foreach(const gchar *id, gulong cursor, guint limit, dbItemHeaderFunc func, gpointer user_data);
+
+/**
+ * Loads only the description of the item specified by id.
+ * Falls back to the item archive for retired items.
+ *
+ * @param id		the id
+ *
+ * @returns new string (or NULL)
+ */
+gchar *	db_item_get_description(gulong id);
+
 /**
  * Updates all attributes of the item in the DB
  *
@@ -115,13 +218,20 @@ void	db_item_remove(gulong id);
 void    db_item_state_update (itemPtr item);
 
 /**
- * Returns a list of item ids with the given GUID. 
+ * Updates the state of the given items in a single transaction.
+ *
+ * @param items		list of items
+ */
+void	db_items_state_update (GSList *items);
+
+/**
+ * Returns the ids of all items with the given GUID. 
  *
  * @param guid	the item GUID
  *
- * @returns a list of item ids
+ * @returns a new item set (to be free'd using itemset_free())
  */
-GSList * db_item_get_duplicates(const gchar *guid);
+itemSetPtr db_item_get_duplicates(const gchar *guid);
 
 /**
  * Returns a list of node ids containing an item with the given GUID. 
@@ -176,4 +286,24 @@ void db_subscription_remove (const gchar *id);
  */
 void db_node_update (nodePtr node);
 
+/**
+ * Loads the node properties saved with db_node_update() (title,
+ * view mode and sorting) and the subscription source, filter and
+ * update interval. The DB is updated whenever a node changes, so
+ * it can be newer than the feed list OPML file.
+ *
+ * @param node		the node
+ *
+ * @returns FALSE if the node is not in the DB
+ */
+gboolean db_node_load (nodePtr node);
+
+/**
+ * Updates the properties and the subscription info of the
+ * given nodes in a single transaction.
+ *
+ * @param nodes		list of nodes
+ */
+void db_nodes_update (GSList *nodes);
+
 #endif
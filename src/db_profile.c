@@ -0,0 +1,177 @@
+/**
+ * @file db_profile.c  SQLite tuning profiles
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "db_profile.h"
+
+#include <glib/gstdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "db_profiler.h"
+
+/* size limits for the automatic profile calculation */
+#define MIN_CACHE_SIZE_KB	2048
+#define MAX_CACHE_SIZE_KB	65536
+#define MAX_MMAP_SIZE		(G_GINT64_CONSTANT (256) * 1024 * 1024)
+
+dbProfileMode
+db_profile_mode_from_name (const gchar *name)
+{
+	if (name && g_str_equal (name, "wal"))
+		return DB_PROFILE_WAL;
+
+	return DB_PROFILE_ASYNC;
+}
+
+const gchar *
+db_profile_mode_to_name (dbProfileMode mode)
+{
+	return (DB_PROFILE_WAL == mode)?"wal":"async";
+}
+
+static gint64
+db_profile_get_physical_memory (void)
+{
+#if defined (_SC_PHYS_PAGES) && defined (_SC_PAGESIZE)
+	glong pages = sysconf (_SC_PHYS_PAGES);
+	glong pageSize = sysconf (_SC_PAGESIZE);
+
+	if (pages > 0 && pageSize > 0)
+		return (gint64)pages * pageSize;
+#endif
+	return 0;
+}
+
+void
+db_profile_init (dbProfile *profile, dbProfileMode mode, const gchar *filename)
+{
+	struct stat	st;
+	gint64		cacheSize;
+
+	memset (profile, 0, sizeof (dbProfile));
+	profile->mode = mode;
+	profile->physMem = db_profile_get_physical_memory ();
+	if (0 == g_stat (filename, &st))
+		profile->dbSize = st.st_size;
+
+	/* Cache a quarter of the DB, but never more than 1/64 of the memory */
+	cacheSize = profile->dbSize / 1024 / 4;
+	if (profile->physMem && cacheSize > profile->physMem / 1024 / 64)
+		cacheSize = profile->physMem / 1024 / 64;
+	profile->cacheSize = CLAMP (cacheSize, MIN_CACHE_SIZE_KB, MAX_CACHE_SIZE_KB);
+
+	/* Map the whole DB plus room for growth, but never more than 1/8 of the memory */
+	if (DB_PROFILE_WAL == mode) {
+		profile->mmapSize = MIN (profile->dbSize * 2, MAX_MMAP_SIZE);
+		if (profile->physMem)
+			profile->mmapSize = MIN (profile->mmapSize, profile->physMem / 8);
+	}
+}
+
+/* Runs a PRAGMA and returns the first result column */
+static gchar *
+db_profile_pragma (sqlite3 *db, const gchar *pragma)
+{
+	sqlite3_stmt	*stmt;
+	gchar		*result = NULL;
+
+	if (SQLITE_OK != sqlite3_prepare_v2 (db, pragma, -1, &stmt, NULL))
+		return NULL;
+
+	if (SQLITE_ROW == db_profiler_step (stmt, NULL))
+		result = g_strdup ((const gchar *)sqlite3_column_text (stmt, 0));
+	db_profiler_finalize (stmt, NULL);
+
+	return result;
+}
+
+static gchar *
+db_profile_pragma_printf (sqlite3 *db, const gchar *format, ...)
+{
+	va_list		args;
+	gchar		*pragma, *result;
+
+	va_start (args, format);
+	pragma = g_strdup_vprintf (format, args);
+	va_end (args);
+
+	result = db_profile_pragma (db, pragma);
+	g_free (pragma);
+
+	return result;
+}
+
+gboolean
+db_profile_set_journal_mode (dbProfile *profile, sqlite3 *db)
+{
+	const gchar	*wanted;
+	gchar		*mode;
+	gboolean	success;
+
+	/* Note: WAL needs SQLite 3.7.0, older versions keep the rollback journal */
+	wanted = (DB_PROFILE_WAL == profile->mode)?"wal":"delete";
+	mode = db_profile_pragma_printf (db, "PRAGMA journal_mode = %s", wanted);
+	success = (mode && 0 == g_ascii_strcasecmp (mode, wanted));
+	if (!success && DB_PROFILE_WAL == profile->mode)
+		profile->mode = DB_PROFILE_ASYNC;
+	g_free (mode);
+
+	return success;
+}
+
+gchar *
+db_profile_apply (dbProfile *profile, sqlite3 *db)
+{
+	gchar	*journal, *cache, *mmap, *sync, *pageSize, *report;
+	gint	pages;
+
+	/* cache_size is given in pages as older SQLite versions
+	   do not support negative (KB based) values */
+	pageSize = db_profile_pragma (db, "PRAGMA page_size");
+	pages = profile->cacheSize * 1024 / MAX (512, pageSize?atoi (pageSize):1024);
+	g_free (pageSize);
+
+	g_free (db_profile_pragma_printf (db, "PRAGMA cache_size = %d", pages));
+	g_free (db_profile_pragma (db, "PRAGMA temp_store = MEMORY"));
+	g_free (db_profile_pragma (db, "PRAGMA synchronous = NORMAL"));
+	g_free (db_profile_pragma_printf (db, "PRAGMA mmap_size = %" G_GINT64_FORMAT, profile->mmapSize));
+
+	journal = db_profile_pragma (db, "PRAGMA journal_mode");
+	cache = db_profile_pragma (db, "PRAGMA cache_size");
+	mmap = db_profile_pragma (db, "PRAGMA mmap_size");	/* SQLite 3.7.17+ */
+	sync = db_profile_pragma (db, "PRAGMA synchronous");
+
+	report = g_strdup_printf ("profile=%s journal_mode=%s cache_size=%s mmap_size=%s synchronous=%s "
+	                          "(DB size %" G_GINT64_FORMAT " KB, memory %" G_GINT64_FORMAT " MB)",
+	                          db_profile_mode_to_name (profile->mode),
+	                          journal?journal:"?", cache?cache:"?",
+	                          mmap?mmap:"unsupported", sync?sync:"?",
+	                          profile->dbSize / 1024, profile->physMem / 1024 / 1024);
+
+	g_free (journal);
+	g_free (cache);
+	g_free (mmap);
+	g_free (sync);
+
+	return report;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file db_profile.h  SQLite tuning profiles
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _DB_PROFILE_H
+#define _DB_PROFILE_H
+
+#include <glib.h>
+#include <sqlite3.h>
+
+/* A DB profile describes how the cache DB is opened and which PRAGMAs
+   are applied to it. There are two journal strategies:
+
+   async	rollback journal, all writes are queued to the sqlite3async
+   		VFS background thread (the classic Liferea setup)
+   wal		write-ahead log using the default VFS, no background thread
+
+   The async VFS supports neither shared memory nor memory mapping, so
+   mmap is only used with WAL. This module does not depend on any other
+   Liferea code so it can be linked into benchmarks. */
+
+typedef enum {
+	DB_PROFILE_ASYNC = 0,
+	DB_PROFILE_WAL
+} dbProfileMode;
+
+typedef struct dbProfile {
+	dbProfileMode	mode;
+	gint		cacheSize;	/**< page cache size in KB */
+	gint64		mmapSize;	/**< memory mapping size in bytes (0 = disabled) */
+	gint64		dbSize;		/**< DB file size the profile was calculated for */
+	gint64		physMem;	/**< physical memory size (0 if unknown) */
+} dbProfile;
+
+/**
+ * Parses a profile name ("async" or "wal").
+ *
+ * @param name		the profile name (or NULL)
+ *
+ * @returns the profile mode (async for unknown names)
+ */
+dbProfileMode db_profile_mode_from_name (const gchar *name);
+
+/**
+ * Returns the name of the given profile mode.
+ *
+ * @param mode		the profile mode
+ *
+ * @returns a static string
+ */
+const gchar * db_profile_mode_to_name (dbProfileMode mode);
+
+/**
+ * Calculates the cache and mmap sizes for the given mode
+ * from the DB file size and the available memory.
+ *
+ * @param profile	the profile to fill
+ * @param mode		the profile mode
+ * @param filename	the DB file name
+ */
+void db_profile_init (dbProfile *profile, dbProfileMode mode, const gchar *filename);
+
+/**
+ * Sets the journal mode of the DB. Must be called with a
+ * connection using the default VFS before opening the DB
+ * with the async VFS, as a WAL DB cannot be opened by it.
+ *
+ * @param profile	the profile
+ * @param db		the DB connection
+ *
+ * @returns TRUE if the requested journal mode is active
+ */
+gboolean db_profile_set_journal_mode (dbProfile *profile, sqlite3 *db);
+
+/**
+ * Applies the per-connection PRAGMAs of the profile.
+ *
+ * @param profile	the profile
+ * @param db		the DB connection
+ *
+ * @returns a human readable description of the effective
+ *          settings (to be free'd using g_free())
+ */
+gchar * db_profile_apply (dbProfile *profile, sqlite3 *db);
+
+#endif
@@ -0,0 +1,289 @@
+/**
+ * @file db_profiler.c  SQL statement profiler
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "db_profiler.h"
+
+#include <string.h>
+
+#include "debug.h"
+#include "metrics.h"
+
+/* number of statements whose query plan is reported */
+#define DB_PROFILER_PLANS	5
+
+typedef struct dbProfilerEntry {
+	gchar		*name;		/**< statement name or SQL text */
+	gchar		*sql;		/**< SQL text (or NULL if not yet known) */
+	guint		calls;		/**< number of executions */
+	guint64		rows;		/**< number of returned rows */
+	guint64		time;		/**< total execution time in ns */
+	guint64		maxTime;	/**< longest execution time in ns */
+	guint64		fullScanSteps;	/**< steps of full table scans */
+	guint64		sortSteps;	/**< sort operations */
+} *dbProfilerEntryPtr;
+
+/** statement name or SQL text -> dbProfilerEntry */
+static GHashTable *entries = NULL;
+
+/** statement -> time spent in sqlite3_step() since its last reset (in us) */
+static GHashTable *stepTimes = NULL;
+
+static void
+db_profiler_entry_free (dbProfilerEntryPtr entry)
+{
+	g_free (entry->name);
+	g_free (entry->sql);
+	g_free (entry);
+}
+
+static dbProfilerEntryPtr
+db_profiler_get_entry (const gchar *name)
+{
+	dbProfilerEntryPtr	entry;
+
+	if (!entries)
+		entries = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)db_profiler_entry_free);
+
+	entry = g_hash_table_lookup (entries, name);
+	if (!entry) {
+		entry = g_new0 (struct dbProfilerEntry, 1);
+		entry->name = g_strdup (name);
+		g_hash_table_insert (entries, entry->name, entry);
+	}
+
+	return entry;
+}
+
+static void
+db_profiler_statement (sqlite3_stmt *stmt, const gchar *name, guint64 nanoseconds)
+{
+	dbProfilerEntryPtr	entry;
+	gint			fullScanSteps = 0;
+
+	entry = db_profiler_get_entry (name);
+	entry->calls++;
+	entry->time += nanoseconds;
+	entry->maxTime = MAX (entry->maxTime, nanoseconds);
+
+	if (!stmt)
+		return;
+
+	if (!entry->sql)
+		entry->sql = g_strdup (sqlite3_sql (stmt));
+
+	fullScanSteps = sqlite3_stmt_status (stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, TRUE);
+	entry->sortSteps += sqlite3_stmt_status (stmt, SQLITE_STMTSTATUS_SORT, TRUE);
+
+	if (fullScanSteps > 0) {
+		/* report each statement only once, the report has the totals */
+		if (!entry->fullScanSteps)
+			debug2 (DEBUG_SQL, "full table scan (%d steps) by %s", fullScanSteps, name);
+		entry->fullScanSteps += fullScanSteps;
+	}
+}
+
+/* Accounts the step time of a finished, reset or finalized statement.
+   Ad-hoc statements are profiled by their SQL text. */
+static void
+db_profiler_done (sqlite3_stmt *stmt, const gchar *name)
+{
+	gint64	*time;
+
+	if (!stepTimes || !(time = g_hash_table_lookup (stepTimes, stmt)))
+		return;
+
+	metrics_observe ("db.statement_time", name?name:"other", *time);
+	if (debug_level & DEBUG_SQL)
+		db_profiler_statement (stmt, name?name:sqlite3_sql (stmt), *time * 1000);
+
+	g_hash_table_remove (stepTimes, stmt);
+}
+
+gboolean
+db_profiler_enabled (void)
+{
+	return 0 != (debug_level & (DEBUG_SQL | DEBUG_PERF));
+}
+
+gint
+db_profiler_step (sqlite3_stmt *stmt, const gchar *name)
+{
+	gint64	start, *time;
+	gint	res;
+
+	if (!db_profiler_enabled ())
+		return sqlite3_step (stmt);
+
+	start = metrics_now ();
+	res = sqlite3_step (stmt);
+
+	if (!stepTimes)
+		stepTimes = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+	time = g_hash_table_lookup (stepTimes, stmt);
+	if (!time) {
+		time = g_new0 (gint64, 1);
+		g_hash_table_insert (stepTimes, stmt, time);
+	}
+	*time += metrics_now () - start;
+
+	if (SQLITE_ROW != res)
+		db_profiler_done (stmt, name);
+	else if (debug_level & DEBUG_SQL)
+		db_profiler_get_entry (name?name:sqlite3_sql (stmt))->rows++;
+
+	return res;
+}
+
+void
+db_profiler_reset (sqlite3_stmt *stmt, const gchar *name)
+{
+	if (db_profiler_enabled ())
+		db_profiler_done (stmt, name);
+	sqlite3_reset (stmt);
+}
+
+void
+db_profiler_finalize (sqlite3_stmt *stmt, const gchar *name)
+{
+	if (db_profiler_enabled ())
+		db_profiler_done (stmt, name);
+	sqlite3_finalize (stmt);
+}
+
+gint
+db_profiler_exec (sqlite3 *db, const gchar *sql, sqlite3_callback callback, gpointer user_data, gchar **err)
+{
+	gint64	start, time;
+	gint	res;
+
+	if (!db_profiler_enabled ())
+		return sqlite3_exec (db, sql, callback, user_data, err);
+
+	start = metrics_now ();
+	res = sqlite3_exec (db, sql, callback, user_data, err);
+	time = metrics_now () - start;
+
+	metrics_observe ("db.statement_time", "other", time);
+	if (debug_level & DEBUG_SQL)
+		db_profiler_statement (NULL, sql, time * 1000);
+
+	return res;
+}
+
+static gint
+db_profiler_compare (gconstpointer a, gconstpointer b)
+{
+	dbProfilerEntryPtr	e1 = *(dbProfilerEntryPtr *)a;
+	dbProfilerEntryPtr	e2 = *(dbProfilerEntryPtr *)b;
+
+	if (e1->time == e2->time)
+		return strcmp (e1->name, e2->name);
+
+	return (e1->time < e2->time)?1:-1;
+}
+
+static void
+db_profiler_add_to_array (gpointer key, gpointer value, gpointer user_data)
+{
+	g_ptr_array_add ((GPtrArray *)user_data, value);
+}
+
+static void
+db_profiler_append_plan (GString *report, sqlite3 *db, dbProfilerEntryPtr entry)
+{
+	sqlite3_stmt	*stmt;
+	gchar		*sql;
+	gint		res;
+
+	g_string_append_printf (report, "\n%s\n", entry->name);
+	if (!entry->sql)
+		return;
+
+	/* unbound parameters are NULL which does not change the plan */
+	sql = g_strdup_printf ("EXPLAIN QUERY PLAN %s", entry->sql);
+	res = sqlite3_prepare_v2 (db, sql, -1, &stmt, NULL);
+	g_free (sql);
+	if (SQLITE_OK != res) {
+		g_string_append_printf (report, "    (no query plan: %s)\n", sqlite3_errmsg (db));
+		return;
+	}
+
+	/* the detail text is the last column in all SQLite versions */
+	while (SQLITE_ROW == sqlite3_step (stmt))
+		g_string_append_printf (report, "    %s\n", sqlite3_column_text (stmt, sqlite3_column_count (stmt) - 1));
+
+	sqlite3_finalize (stmt);
+}
+
+gchar *
+db_profiler_report (sqlite3 *db)
+{
+	GString		*report;
+	GPtrArray	*sorted;
+	guint		i;
+
+	report = g_string_new ("SQL profile (sorted by total time)\n\n");
+	g_string_append_printf (report, "%8s %10s %10s %10s %10s %10s %8s  %s\n",
+	                        "calls", "rows", "total ms", "avg us", "max us", "full scan", "sorts", "statement");
+
+	if (!entries)
+		return g_string_free (report, FALSE);
+
+	sorted = g_ptr_array_new ();
+	g_hash_table_foreach (entries, db_profiler_add_to_array, sorted);
+	g_ptr_array_sort (sorted, db_profiler_compare);
+
+	for (i = 0; i < sorted->len; i++) {
+		dbProfilerEntryPtr entry = g_ptr_array_index (sorted, i);
+
+		g_string_append_printf (report, "%8u %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+		                                " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %8" G_GUINT64_FORMAT "  %s\n",
+		                        entry->calls, entry->rows,
+		                        entry->time / 1000000,
+		                        entry->calls?entry->time / entry->calls / 1000:0,
+		                        entry->maxTime / 1000,
+		                        entry->fullScanSteps, entry->sortSteps,
+		                        entry->name);
+	}
+
+	g_string_append (report, "\nQuery plans of the slowest statements\n");
+	for (i = 0; i < sorted->len && i < DB_PROFILER_PLANS; i++)
+		db_profiler_append_plan (report, db, g_ptr_array_index (sorted, i));
+
+	g_ptr_array_free (sorted, TRUE);
+
+	return g_string_free (report, FALSE);
+}
+
+void
+db_profiler_free (void)
+{
+	if (entries) {
+		g_hash_table_destroy (entries);
+		entries = NULL;
+	}
+
+	if (stepTimes) {
+		g_hash_table_destroy (stepTimes);
+		stepTimes = NULL;
+	}
+}
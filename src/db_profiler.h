@@ -0,0 +1,97 @@
+/**
+ * @file db_profiler.h  SQL statement profiler
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _DB_PROFILER_H
+#define _DB_PROFILER_H
+
+#include <glib.h>
+#include <sqlite3.h>
+
+/* The SQL profiler is enabled with --debug-sql. It collects the number
+   of executions, the returned rows, the execution time and the full
+   table scan and sort steps of each prepared statement (by name) and of
+   each ad-hoc SQL statement (by SQL text). The report lists the
+   statements by total execution time and includes the query plans
+   of the slowest ones.
+
+   The execution time is the time spent in sqlite3_step(), so time
+   callers spend processing the rows is not counted. Statements are
+   accounted in the "db.statement_time" metric when they are done,
+   reset or finalized, which is why all DB access has to use the
+   wrappers below. Without --debug-sql and --debug-performance the
+   wrappers only call SQLite and measure nothing. */
+
+/**
+ * Returns whether statements are timed.
+ *
+ * @returns TRUE with --debug-sql or --debug-performance
+ */
+gboolean db_profiler_enabled (void);
+
+/**
+ * sqlite3_step() wrapper measuring the step time.
+ *
+ * @param stmt		the statement
+ * @param name		statement name (or NULL for ad-hoc statements)
+ *
+ * @returns the sqlite3_step() result
+ */
+gint db_profiler_step (sqlite3_stmt *stmt, const gchar *name);
+
+/**
+ * sqlite3_reset() wrapper accounting statements
+ * whose rows were not all fetched.
+ *
+ * @param stmt		the statement
+ * @param name		statement name (or NULL for ad-hoc statements)
+ */
+void db_profiler_reset (sqlite3_stmt *stmt, const gchar *name);
+
+/**
+ * sqlite3_finalize() wrapper, see db_profiler_reset().
+ *
+ * @param stmt		the statement
+ * @param name		statement name (or NULL for ad-hoc statements)
+ */
+void db_profiler_finalize (sqlite3_stmt *stmt, const gchar *name);
+
+/**
+ * sqlite3_exec() wrapper measuring the execution time.
+ *
+ * @returns the sqlite3_exec() result
+ */
+gint db_profiler_exec (sqlite3 *db, const gchar *sql, sqlite3_callback callback, gpointer user_data, gchar **err);
+
+/**
+ * Creates the profiling report.
+ *
+ * @param db		the DB to run EXPLAIN QUERY PLAN on
+ *
+ * @returns new string (to be free'd using g_free)
+ */
+gchar * db_profiler_report (sqlite3 *db);
+
+/**
+ * Frees all profiling data.
+ */
+void db_profiler_free (void);
+
+#endif
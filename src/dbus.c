@@ -25,11 +25,30 @@
 #ifdef USE_DBUS	
 
 #include <dbus/dbus-glib.h>
+#include "db.h"
 #include "dbus.h"
 #include "feedlist.h"
+#include "item.h"
+#include "item_state.h"
+#include "metrics.h"
 #include "net_monitor.h"
+#include "node.h"
+#include "node_type.h"
 #include "subscription.h"
-#include "ui/liferea_shell.h"
+#include "ui_observer.h"
+#include "vfolder.h"
+
+/* maximum number of nodes or items returned by one query call */
+#define LF_DBUS_MAX_PAGE	500
+
+#define LF_DBUS_ERROR		g_quark_from_static_string ("liferea-dbus-error-quark")
+
+#define LF_DBUS_TYPE_NODE	(dbus_g_type_get_struct ("GValueArray", G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_UINT, G_TYPE_UINT, G_TYPE_INVALID))
+#define LF_DBUS_TYPE_ITEM	(dbus_g_type_get_struct ("GValueArray", G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT64, G_TYPE_BOOLEAN, G_TYPE_BOOLEAN, G_TYPE_INVALID))
+#define LF_DBUS_TYPE_BODY	(dbus_g_type_get_struct ("GValueArray", G_TYPE_UINT, G_TYPE_STRING, G_TYPE_INVALID))
+
+/* D-Bus strings must not be NULL */
+#define LF_DBUS_STRING(str)	((str)?(str):"")
 
 G_DEFINE_TYPE(LifereaDBus, liferea_dbus, G_TYPE_OBJECT)
 
@@ -51,7 +70,7 @@ liferea_dbus_set_online (LifereaDBus *self, gboolean online, gboolean *ret, GErr
 gboolean
 liferea_dbus_subscribe (LifereaDBus *self, gchar *url, gboolean *ret, GError **err)
 {
-	liferea_shell_present ();
+	ui_observer_present ();
 	feedlist_add_subscription (url, NULL, NULL, 0);
 	*ret = TRUE;
 	return TRUE;
@@ -79,6 +98,224 @@ liferea_dbus_refresh (LifereaDBus *self, gboolean *ret, GError **err)
 	return TRUE;
 }
 
+/* query API */
+
+static guint
+liferea_dbus_page_size (guint limit)
+{
+	if (0 == limit || limit > LF_DBUS_MAX_PAGE)
+		return LF_DBUS_MAX_PAGE;
+
+	return limit;
+}
+
+typedef struct nodeQuery {
+	GPtrArray	*nodes;		/**< result structs */
+	guint		offset;		/**< number of nodes to skip */
+	guint		limit;		/**< maximum number of nodes */
+	guint		position;	/**< number of nodes visited */
+} nodeQuery;
+
+static void
+liferea_dbus_add_node (nodePtr node, gpointer user_data)
+{
+	nodeQuery	*query = (nodeQuery *)user_data;
+	GValue		value = { 0, };
+
+	if (query->position >= query->offset + query->limit)
+		return;
+
+	if (query->position++ >= query->offset) {
+		g_value_init (&value, LF_DBUS_TYPE_NODE);
+		g_value_take_boxed (&value, dbus_g_type_specialized_construct (LF_DBUS_TYPE_NODE));
+		dbus_g_type_struct_set (&value,
+		                        0, node->id,
+		                        1, (node->parent != feedlist_get_root ())?node->parent->id:"",
+		                        2, LF_DBUS_STRING (node_get_title (node)),
+		                        3, NODE_TYPE (node)->id,
+		                        4, node->unreadCount,
+		                        5, node->itemCount,
+		                        G_MAXUINT);
+		g_ptr_array_add (query->nodes, g_value_get_boxed (&value));
+	}
+
+	if (node->children)
+		node_foreach_child_data (node, liferea_dbus_add_node, query);
+}
+
+gboolean
+liferea_dbus_get_nodes (LifereaDBus *self, guint offset, guint limit, GPtrArray **nodes, guint *next_offset, GError **err)
+{
+	nodeQuery	query;
+
+	query.nodes = g_ptr_array_new ();
+	query.offset = offset;
+	query.limit = liferea_dbus_page_size (limit);
+	query.position = 0;
+
+	node_foreach_child_data (feedlist_get_root (), liferea_dbus_add_node, &query);
+
+	*nodes = query.nodes;
+	*next_offset = (query.nodes->len == query.limit)?offset + query.limit:0;
+	return TRUE;
+}
+
+typedef struct itemQuery {
+	GPtrArray	*items;		/**< result structs */
+	gulong		lastId;		/**< id of the last item added */
+} itemQuery;
+
+static void
+liferea_dbus_add_item (gulong id, const gchar *nodeId, const gchar *title,
+                       const gchar *source, gint64 date, gboolean read,
+                       gboolean marked, gpointer user_data)
+{
+	itemQuery	*query = (itemQuery *)user_data;
+	GValue		value = { 0, };
+
+	g_value_init (&value, LF_DBUS_TYPE_ITEM);
+	g_value_take_boxed (&value, dbus_g_type_specialized_construct (LF_DBUS_TYPE_ITEM));
+	dbus_g_type_struct_set (&value,
+	                        0, (guint)id,
+	                        1, LF_DBUS_STRING (nodeId),
+	                        2, LF_DBUS_STRING (title),
+	                        3, LF_DBUS_STRING (source),
+	                        4, date,
+	                        5, read,
+	                        6, marked,
+	                        G_MAXUINT);
+	g_ptr_array_add (query->items, g_value_get_boxed (&value));
+	query->lastId = id;
+}
+
+/* Collects the ids of the node and all its child nodes storing items */
+static void
+liferea_dbus_collect_node_ids (nodePtr node, gpointer user_data)
+{
+	GSList	**ids = (GSList **)user_data;
+
+	if (IS_VFOLDER (node))
+		return;
+
+	*ids = g_slist_prepend (*ids, node->id);
+	if (node->children)
+		node_foreach_child_data (node, liferea_dbus_collect_node_ids, ids);
+}
+
+gboolean
+liferea_dbus_get_items (LifereaDBus *self, gchar *node_id, guint cursor, guint limit, GPtrArray **items, guint *next_cursor, GError **err)
+{
+	nodePtr		node = node_from_id (node_id);
+	GSList		*ids = NULL;
+	itemQuery	query;
+	guint		count = 0;
+
+	query.items = g_ptr_array_new ();
+	query.lastId = 0;
+
+	/* The item headers are read directly from the DB without
+	   loading the item set or touching the item list. Folders
+	   return the items of all their feeds, search folders the
+	   matching items. */
+	limit = liferea_dbus_page_size (limit);
+	if (node && IS_VFOLDER (node)) {
+		count = db_search_folder_item_headers_foreach (node->id, cursor, limit, liferea_dbus_add_item, &query);
+	} else if (node) {
+		liferea_dbus_collect_node_ids (node, &ids);
+		count = db_item_headers_foreach (ids, NULL, cursor, limit, liferea_dbus_add_item, &query);
+		g_slist_free (ids);
+	}
+
+	*items = query.items;
+	*next_cursor = (count == limit)?query.lastId:0;
+	return TRUE;
+}
+
+gboolean
+liferea_dbus_search_items (LifereaDBus *self, gchar *text, guint cursor, guint limit, GPtrArray **items, guint *next_cursor, GError **err)
+{
+	itemQuery	query;
+	guint		count;
+
+	query.items = g_ptr_array_new ();
+	query.lastId = 0;
+
+	limit = liferea_dbus_page_size (limit);
+	count = db_item_headers_foreach (NULL, text, cursor, limit, liferea_dbus_add_item, &query);
+
+	*items = query.items;
+	*next_cursor = (count == limit)?query.lastId:0;
+	return TRUE;
+}
+
+gboolean
+liferea_dbus_get_item_bodies (LifereaDBus *self, GArray *ids, GPtrArray **bodies, GError **err)
+{
+	guint	i;
+
+	if (ids->len > LF_DBUS_MAX_PAGE) {
+		g_set_error (err, LF_DBUS_ERROR, 0, "At most %d item bodies can be requested at once", LF_DBUS_MAX_PAGE);
+		return FALSE;
+	}
+
+	*bodies = g_ptr_array_new ();
+
+	for (i = 0; i < ids->len; i++) {
+		guint	id = g_array_index (ids, guint, i);
+		gchar	*description;
+		GValue	value = { 0, };
+
+		description = db_item_get_description (id);
+		if (!description)
+			continue;
+
+		g_value_init (&value, LF_DBUS_TYPE_BODY);
+		g_value_take_boxed (&value, dbus_g_type_specialized_construct (LF_DBUS_TYPE_BODY));
+		dbus_g_type_struct_set (&value, 0, id, 1, description, G_MAXUINT);
+		g_ptr_array_add (*bodies, g_value_get_boxed (&value));
+		g_free (description);
+	}
+
+	return TRUE;
+}
+
+gboolean
+liferea_dbus_mark_items_read (LifereaDBus *self, GArray *ids, gboolean read, guint *changed, GError **err)
+{
+	GSList	*items = NULL;
+	guint	i;
+
+	*changed = 0;
+
+	for (i = 0; i < ids->len; i++) {
+		itemPtr item = item_load (g_array_index (ids, guint, i));
+		if (!item)
+			continue;
+
+		if (item->readStatus != read) {
+			items = g_slist_prepend (items, item);
+			(*changed)++;
+		} else {
+			item_unload (item);
+		}
+	}
+
+	items = g_slist_reverse (items);
+	items_set_read_state (items, read);
+
+	g_slist_foreach (items, (GFunc)item_unload, NULL);
+	g_slist_free (items);
+
+	return TRUE;
+}
+
+gboolean
+liferea_dbus_get_metrics (LifereaDBus *self, gchar **json, GError **err)
+{
+	*json = metrics_to_json ();
+	return TRUE;
+}
+
 #include "dbus_wrap.c"
 
 static void liferea_dbus_init(LifereaDBus *obj) { }
@@ -31,6 +31,8 @@
 #include <glib.h>
 
 #include "debug.h"
+#include "metrics.h"
+#include "watchdog.h"
 
 unsigned long debug_level = 0;
 
@@ -52,29 +54,32 @@ debug_get_prefix (unsigned long flag)
 	if (flag & DEBUG_DB)		return "DB";
 	if (flag & DEBUG_PERF)		return "PERF";
 	if (flag & DEBUG_VFOLDER)	return "VFOLDER";
+	if (flag & DEBUG_SQL)		return "SQL";
 	return "";	
 }
 
 void
 debug_start_measurement_func (const char * function)
 {
-	GTimeVal	*startTime = NULL;
+	gint64	*startTime = NULL;
 	
 	if (!function)
 		return;
+
+	watchdog_phase_enter (function);
 		
 	if (!startTimes)
 		startTimes = g_hash_table_new (g_str_hash, g_str_equal);
 	
-	startTime = (GTimeVal *) g_hash_table_lookup (startTimes, function);
+	startTime = (gint64 *) g_hash_table_lookup (startTimes, function);
 	
 	if (!startTime)
 	{
-		startTime = g_new0 (GTimeVal, 1);
+		startTime = g_new0 (gint64, 1);
 		g_hash_table_insert (startTimes, g_strdup(function), startTime);
 	}
 
-	g_get_current_time (startTime);
+	*startTime = metrics_now ();
 }
 
 void
@@ -82,12 +87,13 @@ debug_end_measurement_func (const char * function,
                             unsigned long flags, 
 			    const char *name)
 {
-	GTimeVal	*startTime = NULL;
-	GTimeVal	endTime;
-	unsigned long	duration = 0;
+	gint64		*startTime = NULL;
+	gint64		duration;
 		
 	if (!function)
 		return;
+
+	watchdog_phase_leave (function);
 		
 	if (!startTimes)
 		return;
@@ -97,20 +103,18 @@ debug_end_measurement_func (const char * function,
 	if (!startTime) 
 		return;
 		
-	g_get_current_time (&endTime);
-	g_time_val_add (&endTime, (-1) * startTime->tv_usec);
-	
-	if ((0 == endTime.tv_sec - startTime->tv_sec) &&
-	    (0 == endTime.tv_usec/1000))
+	duration = metrics_now () - *startTime;
+	metrics_observe ("debug.measurement", name, duration);
+
+	if (duration < 1000)
 		return;
 	
 	g_print ("%s: %s took %01ld,%03lds\n", debug_get_prefix (flags), name, 
-	                                     endTime.tv_sec - startTime->tv_sec, 
-					     endTime.tv_usec/1000);
+	                                     (long)(duration / G_USEC_PER_SEC),
+					     (long)((duration / 1000) % 1000));
 					     
-	duration = (endTime.tv_sec - startTime->tv_sec)*1000 + endTime.tv_usec/1000;
-	if (duration > 250)
-		debug2 (DEBUG_PERF, "function \"%s\" is slow! Took %dms.", name, duration);
+	if (duration > 250 * 1000)
+		debug2 (DEBUG_PERF, "function \"%s\" is slow! Took %ldms.", name, (long)(duration / 1000));
 }
  
 void
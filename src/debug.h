@@ -37,7 +37,8 @@ typedef enum
 	DEBUG_DB		= (1<<8),
 	DEBUG_PERF		= (1<<9),
 	DEBUG_VFOLDER		= (1<<10),
-	DEBUG_VERBOSE		= (1<<11)
+	DEBUG_VERBOSE		= (1<<11),
+	DEBUG_SQL		= (1<<12)
 }
 DebugFlags;
 
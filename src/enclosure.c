@@ -25,9 +25,10 @@
 #include "conf.h"
 #include "debug.h"
 #include "enclosure.h"
+#include "enclosure_download.h"
+#include "ui_observer.h"
 #include "xml.h"
 #include "ui/ui_prefs.h"	// FIXME: remove this!
-#include "ui/liferea_shell.h"
 
 /*
    Liferea manages a MIME type configuration to allow
@@ -38,15 +39,17 @@
    The MIME type configuration is saved into a XML file
    in the cache directory.
    
-   Enclosure download is currently done using external
-   tools (wget,curl,gwget...) and is performed by a new
-   glib thread that first downloads the file and then 
-   starts the configured launcher command in background
-   and terminates.
+   Enclosures are downloaded by the download manager
+   (see enclosure_download.h) which starts the configured
+   launcher command in background once the download is
+   complete. If an external download manager (gwget, kget)
+   is configured the URL is passed to it by a new glib
+   thread instead.
    
    There is also an automatic enclosure downloading 
    feature that just downloads enclosures but does not
-   trigger any launcher command.
+   trigger any launcher command. Those downloads are
+   queued like any other.
  */
 
 static GSList *types = NULL;
@@ -271,7 +274,7 @@ enclosure_exec (gpointer data)
 	
 	if ((error && (0 != error->code)) || !WIFEXITED(status) || WEXITSTATUS(status)) {
 		g_warning ("Failed to execute command \"%s\", exited: %i, status: %i, stderr: %s, stdout: %s", ejp->download, WIFEXITED(status), WEXITSTATUS(status), stderr_message?:"", stdout_message?:"");
-		liferea_shell_set_status_bar (_("Enclosure download FAILED: \"%s\""), ejp->filename);
+		ui_observer_set_status_bar (_("Enclosure download FAILED: \"%s\""), ejp->filename);
 	} else {
 		if (ejp->run) {
 			/* execute */
@@ -281,7 +284,7 @@ enclosure_exec (gpointer data)
 				g_warning ("Launch command \"%s\" failed!", ejp->run);
 		} else {
 			/* just saving */
-			liferea_shell_set_status_bar (_("Enclosure download finished: \"%s\""), ejp->filename);
+			ui_observer_set_status_bar (_("Enclosure download finished: \"%s\""), ejp->filename);
 		}
 	}
 	if (error)
@@ -337,15 +340,27 @@ enclosure_download (encTypePtr type, const gchar *url, gchar *filename)
 	g_free (filenameQ);
 	g_free (urlQ);
 	
-	if (type && type->remote) {
-		debug1 (DEBUG_UPDATE, "passing URL %s to command...", url);
-	} else {
-		debug2 (DEBUG_UPDATE, "downloading %s to %s...", url, filename);
-	}
-
 	/* free now unnecessary stuff */
 	if (type && !type->permanent)
 		enclosure_mime_type_remove (type);
+
+	if (job->download && tool->niceFilename) {
+		/* wget and curl just save the file, which the
+		   download manager does without extra processes */
+		debug2 (DEBUG_UPDATE, "queuing download of %s to %s...", url, filename);
+		enclosure_download_queue (url, filename, job->run);
+		g_free (job->download);
+		g_free (job->run);
+		g_free (job->filename);
+		g_free (job);
+		return;
+	}
+
+	if (job->download) {
+		debug2 (DEBUG_UPDATE, "downloading %s to %s...", url, filename);
+	} else {
+		debug1 (DEBUG_UPDATE, "passing URL %s to command...", url);
+	}
 	
 	g_thread_create (enclosure_exec, job, FALSE, NULL);
 }
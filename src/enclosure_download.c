@@ -0,0 +1,538 @@
+/**
+ * @file enclosure_download.c  enclosure download manager
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "enclosure_download.h"
+
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "conf.h"
+#include "debug.h"
+#include "net.h"
+#include "ui_observer.h"
+
+#define ENCLOSURE_DOWNLOAD_DEFAULT_MAX	2
+
+/* minimum time between two progress updates of the enclosure list (s) */
+#define ENCLOSURE_DOWNLOAD_PROGRESS_INTERVAL	0.5
+
+/* block size for checksumming existing files */
+#define ENCLOSURE_DOWNLOAD_READ_SIZE	(64 * 1024)
+
+typedef enum {
+	ENCLOSURE_DOWNLOAD_STATE_PENDING,	/**< waiting in the queue */
+	ENCLOSURE_DOWNLOAD_STATE_CHECKING,	/**< existing files are checksummed */
+	ENCLOSURE_DOWNLOAD_STATE_RUNNING	/**< receiving data */
+} encDownloadState;
+
+/** enclosure download state */
+typedef struct encDownload {
+	gchar			*url;		/**< enclosure URL */
+	gchar			*filename;	/**< the file to save to */
+	gchar			*partname;	/**< the file the data is written to until complete */
+	gchar			*run;		/**< command to run after the download (or NULL) */
+	encDownloadState	state;
+
+	gint64			knownSize;	/**< size of the last finished download (or -1) */
+	gchar			*knownChecksum;	/**< checksum of the last finished download (or NULL) */
+	gboolean		skip;		/**< TRUE if the file is already complete */
+
+	FILE			*file;		/**< partial file while running */
+	GChecksum		*checksum;	/**< checksum of the partial file */
+	goffset			received;	/**< size of the partial file */
+	goffset			total;		/**< expected size of the file (or -1) */
+	gboolean		failed;		/**< TRUE if the received data cannot be used */
+	gboolean		restarted;	/**< TRUE if the download was restarted from the beginning */
+
+	networkDownloadPtr	download;	/**< the network transfer while running */
+	GTimer			*timer;		/**< time since the transfer started */
+	goffset			timerStart;	/**< size of the partial file when the transfer started */
+	gdouble			lastProgress;	/**< time of the last progress update */
+	gint			rateLimit;	/**< bandwidth limit of all downloads in kB/s (or 0) */
+} *encDownloadPtr;
+
+static GQueue		*pending = NULL;	/**< queued downloads */
+static GHashTable	*downloads = NULL;	/**< URL -> queued, checking or running download */
+static guint		activeCount = 0;	/**< number of checking or running downloads */
+static GKeyFile		*finishedDownloads = NULL;	/**< size and checksum of finished downloads */
+static gboolean		shuttingDown = FALSE;
+
+static void enclosure_download_dispatch (void);
+static const networkDownloadFuncs enclosureDownloadFuncs;
+
+static gchar *
+enclosure_download_get_group (const gchar *url)
+{
+	return g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1);
+}
+
+static GKeyFile *
+enclosure_download_get_finished (void)
+{
+	gchar	*filename;
+
+	if (finishedDownloads)
+		return finishedDownloads;
+
+	finishedDownloads = g_key_file_new ();
+	filename = common_create_cache_filename (NULL, "enclosure_downloads", "ini");
+	g_key_file_load_from_file (finishedDownloads, filename, G_KEY_FILE_NONE, NULL);
+	g_free (filename);
+
+	return finishedDownloads;
+}
+
+static void
+enclosure_download_save_finished (void)
+{
+	gchar	*filename, *data;
+	gsize	length;
+
+	filename = common_create_cache_filename (NULL, "enclosure_downloads", "ini");
+	data = g_key_file_to_data (finishedDownloads, &length, NULL);
+	if (!g_file_set_contents (filename, data, length, NULL))
+		g_warning ("Could not save the enclosure download list to %s!", filename);
+	g_free (data);
+	g_free (filename);
+}
+
+static void
+enclosure_download_free (encDownloadPtr dl)
+{
+	if (dl->file)
+		fclose (dl->file);
+	if (dl->checksum)
+		g_checksum_free (dl->checksum);
+	if (dl->timer)
+		g_timer_destroy (dl->timer);
+	g_free (dl->url);
+	g_free (dl->filename);
+	g_free (dl->partname);
+	g_free (dl->run);
+	g_free (dl->knownChecksum);
+	g_free (dl);
+}
+
+static void
+enclosure_download_progress (encDownloadPtr dl)
+{
+	if (!shuttingDown)
+		ui_observer_enclosure_download_progress (dl->url);
+}
+
+static void
+enclosure_download_run (encDownloadPtr dl)
+{
+	GError	*error = NULL;
+
+	if (!dl->run)
+		return;
+
+	debug1 (DEBUG_UPDATE, "running launch command \"%s\"", dl->run);
+	if (!g_spawn_command_line_async (dl->run, &error)) {
+		g_warning ("Launch command \"%s\" failed: %s", dl->run, error->message);
+		g_error_free (error);
+	}
+}
+
+/* Removes a checking or running download and starts the next one */
+static void
+enclosure_download_done (encDownloadPtr dl)
+{
+	g_hash_table_remove (downloads, dl->url);
+	activeCount--;
+
+	enclosure_download_progress (dl);
+	enclosure_download_free (dl);
+
+	enclosure_download_dispatch ();
+}
+
+static void
+enclosure_download_remember (encDownloadPtr dl)
+{
+	GKeyFile	*keyFile = enclosure_download_get_finished ();
+	gchar		*group = enclosure_download_get_group (dl->url);
+	gchar		*size;
+
+	g_key_file_set_string (keyFile, group, "url", dl->url);
+	g_key_file_set_string (keyFile, group, "filename", dl->filename);
+	size = g_strdup_printf ("%" G_GINT64_FORMAT, (gint64)dl->received);
+	g_key_file_set_string (keyFile, group, "size", size);
+	g_free (size);
+	g_key_file_set_string (keyFile, group, "sha1", g_checksum_get_string (dl->checksum));
+	enclosure_download_save_finished ();
+
+	g_free (group);
+}
+
+/* network callbacks */
+
+static void
+enclosure_download_started (gpointer user_data, goffset offset, goffset total)
+{
+	encDownloadPtr	dl = (encDownloadPtr)user_data;
+
+	if (offset != dl->received) {
+		if (0 != offset) {
+			g_warning ("Download of %s resumed at the wrong position!", dl->url);
+			dl->failed = TRUE;
+			return;
+		}
+
+		/* the server ignored the Range header and sends the whole file */
+		debug1 (DEBUG_UPDATE, "restarting download of %s", dl->url);
+		dl->file = freopen (dl->partname, "wb", dl->file);
+		g_checksum_free (dl->checksum);
+		dl->checksum = g_checksum_new (G_CHECKSUM_SHA1);
+		dl->received = 0;
+		if (!dl->file) {
+			dl->failed = TRUE;
+			return;
+		}
+	}
+
+	dl->total = total;
+	dl->timerStart = dl->received;
+	g_timer_start (dl->timer);
+}
+
+static void
+enclosure_download_received (gpointer user_data, const gchar *data, gsize length)
+{
+	encDownloadPtr	dl = (encDownloadPtr)user_data;
+	gdouble		elapsed, expected;
+
+	if (dl->failed)
+		return;
+
+	if (length != fwrite (data, 1, length, dl->file)) {
+		g_warning ("Could not write to %s!", dl->partname);
+		dl->failed = TRUE;
+		return;
+	}
+	g_checksum_update (dl->checksum, (const guchar *)data, length);
+	dl->received += length;
+
+	elapsed = g_timer_elapsed (dl->timer, NULL);
+	if (elapsed - dl->lastProgress > ENCLOSURE_DOWNLOAD_PROGRESS_INTERVAL) {
+		dl->lastProgress = elapsed;
+		enclosure_download_progress (dl);
+	}
+
+	/* The bandwidth limit is shared by all running downloads.
+	   A download ahead of its share is paused until it is not. */
+	if (dl->rateLimit > 0) {
+		expected = (gdouble)(dl->received - dl->timerStart) * activeCount / (dl->rateLimit * 1024);
+		if (expected > elapsed + 0.1)
+			network_download_pause (dl->download, (guint)((expected - elapsed) * 1000));
+	}
+}
+
+static void
+enclosure_download_finished (gpointer user_data, gint netstatus, gint httpstatus)
+{
+	encDownloadPtr	dl = (encDownloadPtr)user_data;
+	gboolean	complete;
+
+	dl->download = NULL;
+
+	/* "416 Requested Range Not Satisfiable" for a partial file means
+	   it is as large as (or larger than) the file on the server */
+	if (416 == httpstatus && dl->received > 0 && !dl->restarted) {
+		debug1 (DEBUG_UPDATE, "partial download of %s is invalid, restarting", dl->url);
+		dl->restarted = TRUE;
+		dl->file = freopen (dl->partname, "wb", dl->file);
+		g_checksum_free (dl->checksum);
+		dl->checksum = g_checksum_new (G_CHECKSUM_SHA1);
+		dl->received = 0;
+		if (dl->file)
+			dl->download = network_download_new (dl->url, 0, &enclosureDownloadFuncs, dl);
+		if (dl->download)
+			return;
+	}
+
+	complete = !netstatus && httpstatus >= 200 && httpstatus < 300 && !dl->failed &&
+	           (dl->total < 0 || dl->received == dl->total);
+
+	if (dl->file && 0 != fclose (dl->file))
+		complete = FALSE;
+	dl->file = NULL;
+
+	if (complete && 0 != g_rename (dl->partname, dl->filename)) {
+		g_warning ("Could not rename %s to %s!", dl->partname, dl->filename);
+		complete = FALSE;
+	}
+
+	if (complete) {
+		debug2 (DEBUG_UPDATE, "download of %s to %s finished", dl->url, dl->filename);
+		enclosure_download_remember (dl);
+		if (!shuttingDown) {
+			if (dl->run)
+				enclosure_download_run (dl);
+			else
+				ui_observer_set_status_bar (_("Enclosure download finished: \"%s\""), dl->filename);
+		}
+	} else {
+		debug3 (DEBUG_UPDATE, "download of %s failed (%d/%d)", dl->url, netstatus, httpstatus);
+
+		/* only transfer errors are worth to be resumed */
+		if (httpstatus >= 400)
+			g_unlink (dl->partname);
+		if (!shuttingDown)
+			ui_observer_set_status_bar (_("Enclosure download FAILED: \"%s\" (%s)"), dl->filename,
+			                              network_strerror (netstatus, httpstatus));
+	}
+
+	enclosure_download_done (dl);
+}
+
+static const networkDownloadFuncs enclosureDownloadFuncs = {
+	enclosure_download_started,
+	enclosure_download_received,
+	enclosure_download_finished
+};
+
+/* existing file checks (in a separate thread) */
+
+static gboolean
+enclosure_download_checksum_file (const gchar *filename, GChecksum *checksum, goffset *size)
+{
+	FILE	*file;
+	guchar	*buffer;
+	gsize	length;
+
+	file = g_fopen (filename, "rb");
+	if (!file)
+		return FALSE;
+
+	*size = 0;
+	buffer = g_malloc (ENCLOSURE_DOWNLOAD_READ_SIZE);
+	while (0 < (length = fread (buffer, 1, ENCLOSURE_DOWNLOAD_READ_SIZE, file))) {
+		g_checksum_update (checksum, buffer, length);
+		*size += length;
+	}
+	g_free (buffer);
+	fclose (file);
+
+	return TRUE;
+}
+
+static gboolean enclosure_download_checked (gpointer user_data);
+
+static gpointer
+enclosure_download_check (gpointer data)
+{
+	encDownloadPtr	dl = (encDownloadPtr)data;
+	struct stat	info;
+	goffset		size;
+
+	/* A file with the size and checksum of the last download
+	   of the URL needs not to be downloaded again */
+	if (dl->knownChecksum && 0 == g_stat (dl->filename, &info) && info.st_size == dl->knownSize) {
+		GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+		if (enclosure_download_checksum_file (dl->filename, checksum, &size))
+			dl->skip = g_str_equal (g_checksum_get_string (checksum), dl->knownChecksum);
+		g_checksum_free (checksum);
+	}
+
+	/* Otherwise a partial file is to be resumed */
+	if (!dl->skip) {
+		dl->checksum = g_checksum_new (G_CHECKSUM_SHA1);
+		if (enclosure_download_checksum_file (dl->partname, dl->checksum, &size))
+			dl->received = size;
+	}
+
+	g_idle_add (enclosure_download_checked, dl);
+
+	return NULL;
+}
+
+static gboolean
+enclosure_download_checked (gpointer user_data)
+{
+	encDownloadPtr	dl = (encDownloadPtr)user_data;
+
+	if (shuttingDown) {
+		enclosure_download_free (dl);
+		return FALSE;
+	}
+
+	if (dl->skip) {
+		debug2 (DEBUG_UPDATE, "%s is already downloaded to %s", dl->url, dl->filename);
+		if (dl->run)
+			enclosure_download_run (dl);
+		else
+			ui_observer_set_status_bar (_("Enclosure download finished: \"%s\""), dl->filename);
+		enclosure_download_done (dl);
+		return FALSE;
+	}
+
+	dl->file = g_fopen (dl->partname, dl->received ? "ab" : "wb");
+	if (dl->file)
+		dl->download = network_download_new (dl->url, dl->received, &enclosureDownloadFuncs, dl);
+
+	if (!dl->download) {
+		ui_observer_set_status_bar (_("Enclosure download FAILED: \"%s\""), dl->filename);
+		enclosure_download_done (dl);
+		return FALSE;
+	}
+
+	dl->state = ENCLOSURE_DOWNLOAD_STATE_RUNNING;
+	dl->timer = g_timer_new ();
+	conf_get_int_value (ENCLOSURE_DOWNLOAD_RATE, &dl->rateLimit);
+	enclosure_download_progress (dl);
+
+	return FALSE;
+}
+
+static void
+enclosure_download_dispatch (void)
+{
+	gint	maxDownloads = 0;
+
+	if (shuttingDown)
+		return;
+
+	conf_get_int_value (ENCLOSURE_MAX_DOWNLOADS, &maxDownloads);
+	if (maxDownloads <= 0)
+		maxDownloads = ENCLOSURE_DOWNLOAD_DEFAULT_MAX;
+
+	while (activeCount < (guint)maxDownloads && !g_queue_is_empty (pending)) {
+		encDownloadPtr	dl = (encDownloadPtr)g_queue_pop_head (pending);
+		GKeyFile	*keyFile = enclosure_download_get_finished ();
+		gchar		*group = enclosure_download_get_group (dl->url);
+		gchar		*filename, *size;
+
+		/* the key file is not to be accessed by the check thread */
+		filename = g_key_file_get_string (keyFile, group, "filename", NULL);
+		if (filename && g_str_equal (filename, dl->filename)) {
+			dl->knownChecksum = g_key_file_get_string (keyFile, group, "sha1", NULL);
+			size = g_key_file_get_string (keyFile, group, "size", NULL);
+			dl->knownSize = size ? g_ascii_strtoll (size, NULL, 10) : -1;
+			g_free (size);
+		}
+		g_free (filename);
+		g_free (group);
+
+		debug2 (DEBUG_UPDATE, "starting download of %s to %s", dl->url, dl->filename);
+		dl->state = ENCLOSURE_DOWNLOAD_STATE_CHECKING;
+		activeCount++;
+		g_thread_create (enclosure_download_check, dl, FALSE, NULL);
+	}
+}
+
+void
+enclosure_download_queue (const gchar *url, const gchar *filename, const gchar *run)
+{
+	encDownloadPtr	dl;
+
+	if (!downloads) {
+		downloads = g_hash_table_new (g_str_hash, g_str_equal);
+		pending = g_queue_new ();
+	}
+
+	dl = g_hash_table_lookup (downloads, url);
+	if (dl) {
+		debug1 (DEBUG_UPDATE, "download of %s is already queued", url);
+		if (run && !dl->run)
+			dl->run = g_strdup (run);
+		return;
+	}
+
+	dl = g_new0 (struct encDownload, 1);
+	dl->url = g_strdup (url);
+	dl->filename = g_strdup (filename);
+	dl->partname = g_strdup_printf ("%s.part", filename);
+	dl->run = g_strdup (run);
+	dl->knownSize = -1;
+	dl->total = -1;
+	dl->state = ENCLOSURE_DOWNLOAD_STATE_PENDING;
+
+	g_hash_table_insert (downloads, dl->url, dl);
+	g_queue_push_tail (pending, dl);
+	enclosure_download_progress (dl);
+
+	enclosure_download_dispatch ();
+}
+
+gboolean
+enclosure_download_get_progress (const gchar *url, goffset *received, goffset *total)
+{
+	encDownloadPtr	dl;
+
+	if (!downloads)
+		return FALSE;
+
+	dl = g_hash_table_lookup (downloads, url);
+	if (!dl)
+		return FALSE;
+
+	*received = 0;
+	*total = -1;
+	if (ENCLOSURE_DOWNLOAD_STATE_RUNNING == dl->state) {
+		*received = dl->received;
+		*total = dl->total;
+	}
+
+	return TRUE;
+}
+
+static void
+enclosure_download_cancel (gpointer key, gpointer value, gpointer user_data)
+{
+	encDownloadPtr	dl = (encDownloadPtr)value;
+
+	/* checking downloads are free'd by enclosure_download_checked() */
+	switch (dl->state) {
+		case ENCLOSURE_DOWNLOAD_STATE_RUNNING:
+			if (dl->download)
+				network_download_cancel (dl->download);
+			enclosure_download_free (dl);
+			break;
+		case ENCLOSURE_DOWNLOAD_STATE_PENDING:
+			enclosure_download_free (dl);
+			break;
+		default:
+			break;
+	}
+}
+
+void
+enclosure_download_deinit (void)
+{
+	shuttingDown = TRUE;
+
+	if (downloads) {
+		g_hash_table_foreach (downloads, enclosure_download_cancel, NULL);
+		g_hash_table_destroy (downloads);
+		g_queue_free (pending);
+		downloads = NULL;
+		pending = NULL;
+	}
+
+	if (finishedDownloads)
+		g_key_file_free (finishedDownloads);
+	finishedDownloads = NULL;
+}
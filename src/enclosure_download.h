@@ -0,0 +1,61 @@
+/**
+ * @file enclosure_download.h  enclosure download manager
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _ENCLOSURE_DOWNLOAD_H
+#define _ENCLOSURE_DOWNLOAD_H
+
+#include <glib.h>
+
+/* Enclosures are downloaded using the HTTP session of the update
+   code. At most ENCLOSURE_MAX_DOWNLOADS downloads run at once, all
+   others wait in a FIFO queue. Data is written to "<filename>.part"
+   which is renamed when the download is complete, interrupted
+   downloads are resumed with a Range request. The size and SHA1
+   checksum of finished downloads are remembered so that downloading
+   an unchanged file again is skipped. */
+
+/**
+ * Queues the download of an enclosure. Does nothing if the
+ * URL is already queued.
+ *
+ * @param url		the enclosure URL
+ * @param filename	the file to save the enclosure to
+ * @param run		command to run when the download is done (or NULL)
+ */
+void enclosure_download_queue (const gchar *url, const gchar *filename, const gchar *run);
+
+/**
+ * Returns the progress of a queued enclosure download.
+ *
+ * @param url		the enclosure URL
+ * @param received	returns the number of downloaded bytes
+ * @param total		returns the file size (-1 if not yet known)
+ *
+ * @returns TRUE if the URL is queued or being downloaded
+ */
+gboolean enclosure_download_get_progress (const gchar *url, goffset *received, goffset *total);
+
+/**
+ * Stops all downloads. Partial files are kept to be
+ * resumed later.
+ */
+void enclosure_download_deinit (void);
+
+#endif
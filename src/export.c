@@ -24,6 +24,8 @@
 #include "export.h"
 
 #include <libxml/tree.h>
+#include <libxml/xmlreader.h>
+#include <libxml/xmlwriter.h>
 
 #include "common.h"
 #include "db.h"
@@ -33,28 +35,69 @@
 #include "folder.h"
 #include "vfolder.h"
 #include "xml.h"
+#include "ui_observer.h"
 #include "fl_sources/node_source.h"
-#include "ui/ui_node.h"
+
+/* Both import and export stream the OPML document, so that even very
+   large feed lists never exist as a complete DOM tree. Only a single
+   outline element is passed as XML node to the node type specific
+   import and export methods. */
 
 struct exportData {
-	gboolean	trusted; /**< Include all the extra Liferea-specific tags */
-	xmlNodePtr	cur;
+	gboolean		trusted; /**< Include all the extra Liferea-specific tags */
+	xmlTextWriterPtr	writer;
+	gboolean		error;
 };
 
-/* Used for exporting, this adds a folder or feed's node to the XML tree */
+static void export_node_children (nodePtr node, struct exportData *data);
+
+/* Writes the given element with all attributes and child elements. 
+   If close is FALSE the element is left open for further children. */
+static gboolean
+export_write_element (xmlTextWriterPtr writer, xmlNodePtr cur, gboolean close)
+{
+	xmlAttrPtr	attr;
+	xmlNodePtr	child;
+	gboolean	ok;
+
+	ok = (xmlTextWriterStartElement (writer, cur->name) >= 0);
+
+	for (attr = cur->properties; attr && ok; attr = attr->next) {
+		xmlChar *value = xmlNodeListGetString (cur->doc, attr->children, 1);
+		ok = (xmlTextWriterWriteAttribute (writer, attr->name, value?value:BAD_CAST"") >= 0);
+		xmlFree (value);
+	}
+
+	for (child = cur->children; child && ok; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE)
+			ok = export_write_element (writer, child, TRUE);
+		else if (child->type == XML_TEXT_NODE)
+			ok = (xmlTextWriterWriteString (writer, child->content) >= 0);
+	}
+
+	if (close && ok)
+		ok = (xmlTextWriterEndElement (writer) >= 0);
+
+	return ok;
+}
+
+/* Used for exporting, this writes a folder or feed's outline tag */
 static void
 export_append_node_tag (nodePtr node, gpointer userdata)
 {
-	xmlNodePtr 	cur = ((struct exportData*)userdata)->cur;
-	gboolean	internal = ((struct exportData*)userdata)->trusted;
-	xmlNodePtr	childNode;
-	gchar		*tmp;
+	struct exportData	*data = (struct exportData *)userdata;
+	gboolean		internal = data->trusted;
+	xmlNodePtr		childNode;
+	gchar			*tmp;
 
 	// FIXME: use node type capability for this condition
 	if (!internal && (IS_NODE_SOURCE (node) || IS_VFOLDER (node)))
 		return;
 	
-	childNode = xmlNewChild (cur, NULL, BAD_CAST"outline", NULL);
+	if (data->error)
+		return;
+
+	childNode = xmlNewNode (NULL, BAD_CAST"outline");
 
 	/* 1. write generic node attributes */
 	xmlNewProp (childNode, BAD_CAST"title", BAD_CAST node_get_title(node));
@@ -99,77 +142,76 @@ export_append_node_tag (nodePtr node, gpointer userdata)
 	
 	/* 3. add children */
 	if (internal) {
-		if (ui_node_is_expanded (node->id))
+		if (node->expanded)
 			xmlNewProp (childNode, BAD_CAST"expanded", BAD_CAST"true");
 		else
 			xmlNewProp (childNode, BAD_CAST"collapsed", BAD_CAST"true");
 	}
 	
+	if (!export_write_element (data->writer, childNode, FALSE))
+		data->error = TRUE;
+
 	if (IS_FOLDER (node))
-		export_node_children (node, childNode, internal);
+		export_node_children (node, data);
+
+	if (xmlTextWriterEndElement (data->writer) < 0)
+		data->error = TRUE;
+
+	xmlFreeNode (childNode);
 }
 
-void
-export_node_children (nodePtr node, xmlNodePtr cur, gboolean trusted)
+static void
+export_node_children (nodePtr node, struct exportData *data)
 {
-	struct exportData	params;
-	
-	params.cur = cur;
-	params.trusted = trusted;
-	node_foreach_child_data (node, export_append_node_tag, &params);
+	node_foreach_child_data (node, export_append_node_tag, data);
 }
 
 gboolean
 export_OPML_feedlist (const gchar *filename, nodePtr node, gboolean trusted)
 {
-	xmlDocPtr 	doc;
-	xmlNodePtr 	cur, opmlNode;
-	gboolean	error = FALSE;
-	gchar		*backupFilename;
-	int		old_umask = 0;
+	struct exportData	data;
+	gboolean		error = FALSE;
+	gchar			*backupFilename;
+	int			old_umask = 0;
 
 	debug_enter ("export_OPML_feedlist");
 	
 	backupFilename = g_strdup_printf ("%s~", filename);
 	
-	doc = xmlNewDoc ("1.0");
-	if (doc) {	
-		opmlNode = xmlNewDocNode (doc, NULL, BAD_CAST"opml", NULL);
-		if (opmlNode) {
-			xmlNewProp (opmlNode, BAD_CAST"version", BAD_CAST"1.0");
-			
-			/* create head */
-			cur = xmlNewChild (opmlNode, NULL, BAD_CAST"head", NULL);
-			if (cur)
-				xmlNewTextChild (cur, NULL, BAD_CAST"title", BAD_CAST"Liferea Feed List Export");
-			
-			/* create body with feed list */
-			cur = xmlNewChild (opmlNode, NULL, BAD_CAST"body", NULL);
-			if (cur)
-				export_node_children (node, cur, trusted);
-			
-			xmlDocSetRootElement (doc, opmlNode);		
-		} else {
-			g_warning ("could not create XML feed node for feed cache document!");
-			error = TRUE;
-		}
-		
-		if (!trusted)
-			old_umask = umask (022);	/* give read permissions for other, per-default we wouldn't give it... */
+	if (!trusted)
+		old_umask = umask (022);	/* give read permissions for other, per-default we wouldn't give it... */
+
+	data.trusted = trusted;
+	data.error = FALSE;
+	data.writer = xmlNewTextWriterFilename (backupFilename, 0);
+
+	if (!trusted)
+		umask (old_umask);
+
+	if (data.writer) {
+		if (xmlTextWriterStartDocument (data.writer, "1.0", NULL, NULL) < 0 ||
+		    xmlTextWriterStartElement (data.writer, BAD_CAST"opml") < 0 ||
+		    xmlTextWriterWriteAttribute (data.writer, BAD_CAST"version", BAD_CAST"1.0") < 0 ||
+		    xmlTextWriterStartElement (data.writer, BAD_CAST"head") < 0 ||
+		    xmlTextWriterWriteElement (data.writer, BAD_CAST"title", BAD_CAST"Liferea Feed List Export") < 0 ||
+		    xmlTextWriterEndElement (data.writer) < 0 ||
+		    xmlTextWriterStartElement (data.writer, BAD_CAST"body") < 0)
+			data.error = TRUE;
 
-		xmlSetDocCompressMode (doc, 0);
+		/* write body with feed list */
+		if (!data.error)
+			export_node_children (node, &data);
 
-		if (-1 == xmlSaveFile (backupFilename, doc)) {
+		/* closes body and opml */
+		if (!data.error && xmlTextWriterEndDocument (data.writer) < 0)
+			data.error = TRUE;
+
+		xmlFreeTextWriter (data.writer);
+
+		if (data.error) {
 			g_warning ("Could not export to OPML file!");
 			error = TRUE;
-		}
-		
-		if (!trusted)
-			umask (old_umask);
-			
-		xmlFreeDoc (doc);
-		
-		if (!error) {
+		} else {
 			if (rename (backupFilename, filename) < 0) {
 				g_warning (_("Error renaming %s to %s\n"), backupFilename, filename);
 				error = TRUE;
@@ -186,18 +228,75 @@ export_OPML_feedlist (const gchar *filename, nodePtr node, gboolean trusted)
 	return !error;
 }
 
-void
-import_parse_outline (xmlNodePtr cur, nodePtr parentNode, gboolean trusted)
+/* Favicon loading and the first download of imported nodes is deferred
+   and done in small batches from an idle callback. */
+
+#define IMPORT_DEFERRED_BATCH_SIZE	50
+
+typedef struct importDeferred {
+	gchar		*id;		/**< id of the imported node */
+	gboolean	needsUpdate;	/**< TRUE if the node needs a first download */
+} *importDeferredPtr;
+
+static GQueue	*importDeferredQueue = NULL;
+static guint	importDeferredId = 0;
+
+static gboolean
+import_deferred_cb (gpointer user_data)
 {
-	gchar		*title, *typeStr, *tmp, *sortStr;
-	xmlNodePtr	child;
-	nodePtr		node;
+	guint	count = 0;
+
+	while (count++ < IMPORT_DEFERRED_BATCH_SIZE && !g_queue_is_empty (importDeferredQueue)) {
+		importDeferredPtr	deferred = g_queue_pop_head (importDeferredQueue);
+		nodePtr			node = node_from_id (deferred->id);
+
+		if (node) {
+			/* Node types might have set an icon on import
+			   or a favicon was downloaded in the meantime */
+			if (!node->icon && (NODE_TYPE (node)->capabilities & NODE_CAPABILITY_UPDATE_FAVICON)) {
+				node_set_icon (node, favicon_load_from_cache (node->id));
+				ui_observer_node_changed (node);
+			}
+
+			if (deferred->needsUpdate && node->subscription) {
+				debug1 (DEBUG_CACHE, "doing first download of %s...", node_get_id (node));
+				subscription_update (node->subscription, 0);
+			}
+		}
+
+		g_free (deferred->id);
+		g_free (deferred);
+	}
+
+	if (!g_queue_is_empty (importDeferredQueue))
+		return TRUE;
+
+	importDeferredId = 0;
+	return FALSE;
+}
+
+static void
+import_defer (nodePtr node, gboolean needsUpdate)
+{
+	importDeferredPtr deferred = g_new0 (struct importDeferred, 1);
+
+	deferred->id = g_strdup (node->id);
+	deferred->needsUpdate = needsUpdate;
+
+	if (!importDeferredQueue)
+		importDeferredQueue = g_queue_new ();
+	g_queue_push_tail (importDeferredQueue, deferred);
+
+	if (!importDeferredId)
+		importDeferredId = g_idle_add (import_deferred_cb, NULL);
+}
+
+static nodeTypePtr
+import_outline_type (xmlNodePtr cur)
+{
+	gchar		*typeStr, *tmp;
 	nodeTypePtr	type = NULL;
-	gboolean	needsUpdate = FALSE;
-	
-	debug_enter("import_parse_outline");
 
-	/* 1. determine node type */
 	typeStr = xmlGetProp (cur, BAD_CAST"type");
 	if (typeStr) {
 		type = node_str_to_type (typeStr);
@@ -223,16 +322,30 @@ import_parse_outline (xmlNodePtr cur, nodePtr parentNode, gboolean trusted)
 			debug0 (DEBUG_CACHE, "-> must be a folder");
 		}
 	}
+
+	return type;
+}
+
+/* Creates a new node for the given outline and adds it to the feed
+   list. Returns TRUE in needsUpdate if the node needs to be downloaded. */
+static nodePtr
+import_outline_start (xmlNodePtr cur, nodeTypePtr type, nodePtr parentNode, gboolean trusted, gboolean *needsUpdate)
+{
+	gchar		*title, *tmp, *sortStr;
+	nodePtr		node;
 	
+	debug_enter("import_outline_start");
+
 	g_assert (NULL != type);
 	
-	/* 2. do general node parsing */	
+	/* 1. do general node parsing */	
 	node = node_new (type);
 	node_set_parent (node, parentNode, -1);
 	
 	/* The id should only be used from feedlist.opml. Otherwise,
 	   it could cause corruption if the same id was imported
 	   multiple times. */
+	*needsUpdate = FALSE;
 	if (trusted) {
 		gchar *id = NULL;
 		id = xmlGetProp (cur, BAD_CAST"id");
@@ -249,10 +362,10 @@ import_parse_outline (xmlNodePtr cur, nodePtr parentNode, gboolean trusted)
 			node_set_id (node, id);
 			xmlFree (id);
 		} else {
-			needsUpdate = TRUE;
+			*needsUpdate = TRUE;
 		}
 	} else {
-		needsUpdate = TRUE;
+		*needsUpdate = TRUE;
 	}
 	
 	/* title */
@@ -311,119 +424,195 @@ import_parse_outline (xmlNodePtr cur, nodePtr parentNode, gboolean trusted)
 	else 
 		node->expanded = TRUE;
 	
-	/* 3. Try to load the favicon (needs to be done before adding to the feed list) */
-	node_set_icon (node, favicon_load_from_cache (node->id));
-			
-	/* 4. add to GUI parent */
+	/* 2. add to GUI parent (the favicon is loaded later) */
 	feedlist_node_imported (node);
 
-	/* 5. import child nodes */
-	if (IS_FOLDER (node)) {
-		child = cur->xmlChildrenNode;
-		while (child) {
-			if (!xmlStrcmp (child->name, BAD_CAST"outline"))
-				import_parse_outline (child, node, trusted);
-			child = child->next;				
-		}
-	}
-	
-	/* 6. do node type specific parsing */
+	debug_exit ("import_outline_start");
+
+	return node;
+}
+
+/* Completes the import of a node after its child nodes were imported. */
+static void
+import_outline_finish (xmlNodePtr cur, nodePtr node, nodePtr parentNode, gboolean trusted, gboolean needsUpdate)
+{
+	/* 3. do node type specific parsing */
 	NODE_TYPE (node)->import (node, parentNode, cur, trusted);
 	
-	/* 7. update immediately if necessary */
-	if (needsUpdate && (NODE_TYPE(node))) {
-		debug1 (DEBUG_CACHE, "seems to be an import, setting new id: %s and doing first download...", node_get_id(node));
-		subscription_update (node->subscription, 0);
-	}
+	/* 4. load favicon and update later if necessary */
+	if (needsUpdate)
+		debug1 (DEBUG_CACHE, "seems to be an import, setting new id: %s and scheduling first download...", node_get_id(node));
+	import_defer (node, needsUpdate);
 	
-	/* 8. save node info to DB */
+	/* 5. save node info to DB, changes after the last feed list
+	      save were only written to the DB so it takes precedence */
+	if (trusted && !needsUpdate)
+		db_node_load (node);
 	db_node_update (node);
+}
+
+/* Copies the attributes of the current outline element of the reader
+   into a new XML node. Used for folders whose child outlines are
+   read one by one. */
+static xmlNodePtr
+import_read_attributes (xmlTextReaderPtr reader)
+{
+	xmlNodePtr cur = xmlNewNode (NULL, BAD_CAST"outline");
 
-	debug_exit ("import_parse_outline");
+	while (1 == xmlTextReaderMoveToNextAttribute (reader))
+		xmlNewProp (cur, xmlTextReaderConstName (reader), xmlTextReaderConstValue (reader));
+	xmlTextReaderMoveToElement (reader);
+
+	return cur;
 }
 
+/** an outline that is currently being imported */
+typedef struct importOutline {
+	xmlNodePtr	xml;		/**< the outline attributes */
+	nodePtr		node;		/**< the new node */
+	nodePtr		parentNode;	/**< the parent node */
+	gboolean	needsUpdate;
+	gint		depth;		/**< element depth of the outline */
+} *importOutlinePtr;
+
 static void
-import_parse_body (xmlNodePtr n, nodePtr parentNode, gboolean trusted)
+import_outline_pop (GSList **stack, gboolean trusted)
 {
-	xmlNodePtr cur;
-	
-	cur = n->xmlChildrenNode;
-	while (cur) {
-		if (!xmlStrcmp (cur->name, BAD_CAST"outline"))
-			import_parse_outline (cur, parentNode, trusted);
-		cur = cur->next;
-	}
+	importOutlinePtr outline = (importOutlinePtr)(*stack)->data;
+
+	import_outline_finish (outline->xml, outline->node, outline->parentNode, trusted, outline->needsUpdate);
+
+	*stack = g_slist_delete_link (*stack, *stack);
+	xmlFreeNode (outline->xml);
+	g_free (outline);
 }
 
-static void
-import_parse_OPML (xmlNodePtr n, nodePtr parentNode, gboolean trusted)
+/* Handles an outline start tag. Folders are pushed on the stack and
+   their children are read from the stream. All other outlines (with
+   children like search folder rules) are expanded and skipped. Returns
+   the result of the next reader operation. */
+static int
+import_parse_outline (xmlTextReaderPtr reader, GSList **stack, nodePtr parentNode, gboolean trusted)
 {
-	xmlNodePtr cur;
+	xmlNodePtr	cur;
+	nodeTypePtr	type;
+	nodePtr		node;
+	gboolean	needsUpdate;
+
+	cur = import_read_attributes (reader);
+	type = import_outline_type (cur);
 	
-	cur = n->xmlChildrenNode;
-	while (cur) {
-		/* we ignore the head */
-		if (!xmlStrcmp (cur->name, BAD_CAST"body")) {
-			import_parse_body (cur, parentNode, trusted);
-		}
-		cur = cur->next;
-	}	
+	if (type == folder_get_node_type ()) {
+		importOutlinePtr outline = g_new0 (struct importOutline, 1);
+
+		outline->xml = cur;
+		outline->parentNode = parentNode;
+		outline->node = import_outline_start (cur, type, parentNode, trusted, &outline->needsUpdate);
+		outline->depth = xmlTextReaderDepth (reader);
+		*stack = g_slist_prepend (*stack, outline);
+
+		/* empty elements have no end tag */
+		if (xmlTextReaderIsEmptyElement (reader))
+			import_outline_pop (stack, trusted);
+
+		return xmlTextReaderRead (reader);
+	}
+
+	xmlFreeNode (cur);
+	cur = xmlTextReaderExpand (reader);
+	if (!cur)
+		return -1;
+
+	node = import_outline_start (cur, type, parentNode, trusted, &needsUpdate);
+	import_outline_finish (cur, node, parentNode, trusted, needsUpdate);
+
+	return xmlTextReaderNext (reader);
 }
 
 gboolean
 import_OPML_feedlist (const gchar *filename, nodePtr parentNode, gboolean showErrors, gboolean trusted)
 {
-	xmlDocPtr 	doc;
-	xmlNodePtr 	cur;
-	gboolean	error = FALSE;
+	xmlTextReaderPtr	reader;
+	GSList			*stack = NULL;
+	gboolean		error = FALSE, empty = TRUE, inHead = FALSE, inBody = FALSE;
+	gint			ret;
 	
 	debug1 (DEBUG_CACHE, "Importing OPML file: %s", filename);
 	
 	/* read the feed list */
-	doc = xmlParseFile (filename);
-	if (!doc) {
+	reader = xmlReaderForFile (filename, NULL, 0);
+	if (!reader) {
 		if (showErrors)
 			ui_show_error_box (_("XML error while reading OPML file! Could not import \"%s\"!"), filename);
 		else
 			g_warning (_("XML error while reading OPML file! Could not import \"%s\"!"), filename);
-		error = TRUE;
-	} else {
-		cur = xmlDocGetRootElement (doc);
-		if (!cur) {
-			if (showErrors)
-				ui_show_error_box (_("Empty document! OPML document \"%s\" should not be empty when importing."), filename);
-			else
-				g_warning (_("Empty document! OPML document \"%s\" should not be empty when importing."), filename);
-			error = TRUE;
-		} else {
-			if (!trusted) {
-				/* set title only when importing as folder and not as OPML source */
-				xmlNodePtr title = xpath_find (cur, "/opml/head/title"); 
-				if (title) {
-					xmlChar *titleStr = xmlNodeListGetString (title->doc, title->xmlChildrenNode, 1);
+		return FALSE;
+	}
+
+	ret = xmlTextReaderRead (reader);
+	while (1 == ret) {
+		const xmlChar	*name = xmlTextReaderConstLocalName (reader);
+		gint		depth = xmlTextReaderDepth (reader);
+		gint		type = xmlTextReaderNodeType (reader);
+
+		if (XML_READER_TYPE_ELEMENT == type) {
+			if (0 == depth) {
+				empty = FALSE;
+				if (xmlStrcmp (name, BAD_CAST"opml")) {
+					if (showErrors)
+						ui_show_error_box (_("\"%s\" is not a valid OPML document! Liferea cannot import this file!"), filename);
+					else
+						g_warning (_("\"%s\" is not a valid OPML document! Liferea cannot import this file!"), filename);
+					break;
+				}
+			} else if (1 == depth) {
+				/* we ignore the head except for the title */
+				inHead = !xmlStrcmp (name, BAD_CAST"head") && !xmlTextReaderIsEmptyElement (reader);
+				inBody = !xmlStrcmp (name, BAD_CAST"body") && !xmlTextReaderIsEmptyElement (reader);
+			} else if (inHead && 2 == depth && !xmlStrcmp (name, BAD_CAST"title")) {
+				if (!trusted) {
+					/* set title only when importing as folder and not as OPML source */
+					xmlChar *titleStr = xmlTextReaderReadString (reader);
 					if (titleStr) {
 						node_set_title (parentNode, titleStr);
 						xmlFree (titleStr);
 					}
 				}
+			} else if (inBody && !xmlStrcmp (name, BAD_CAST"outline")) {
+				nodePtr parent = stack?((importOutlinePtr)stack->data)->node:parentNode;
+
+				ret = import_parse_outline (reader, &stack, parent, trusted);
+				continue;
 			}
-		
-			while (cur) {
-				if (!xmlIsBlankNode (cur)) {
-					if (!xmlStrcmp (cur->name, BAD_CAST"opml")) {
-						import_parse_OPML (cur, parentNode, trusted);
-					} else {
-						if (showErrors)
-							ui_show_error_box (_("\"%s\" is not a valid OPML document! Liferea cannot import this file!"), filename);
-						else
-							g_warning (_("\"%s\" is not a valid OPML document! Liferea cannot import this file!"), filename);
-					}
-				}
-				cur = cur->next;
-			}
+		} else if (XML_READER_TYPE_END_ELEMENT == type) {
+			if (stack && depth == ((importOutlinePtr)stack->data)->depth)
+				import_outline_pop (&stack, trusted);
+			else if (1 == depth)
+				inHead = inBody = FALSE;
 		}
-		xmlFreeDoc (doc);
+
+		ret = xmlTextReaderRead (reader);
 	}
+
+	/* complete folders left open by a broken document */
+	while (stack)
+		import_outline_pop (&stack, trusted);
+
+	if (ret < 0) {
+		if (showErrors)
+			ui_show_error_box (_("XML error while reading OPML file! Could not import \"%s\"!"), filename);
+		else
+			g_warning (_("XML error while reading OPML file! Could not import \"%s\"!"), filename);
+		error = TRUE;
+	} else if (empty) {
+		if (showErrors)
+			ui_show_error_box (_("Empty document! OPML document \"%s\" should not be empty when importing."), filename);
+		else
+			g_warning (_("Empty document! OPML document \"%s\" should not be empty when importing."), filename);
+		error = TRUE;
+	}
+
+	xmlFreeTextReader (reader);
 	
 	return !error;
 }
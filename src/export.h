@@ -38,18 +38,9 @@
 gboolean export_OPML_feedlist(const gchar *filename, nodePtr node, gboolean internal);
 
 /**
- * Exports the given node children by calling their node type
- * specific export methods to add outline tags to the given
- * XML node.
- *
- * @param parentNode	the parent node
- * @param cur		the outline XML node
- * @param trusted	set to TRUE if the feedlist is being to a trusted source
- */
-void export_node_children(nodePtr node, xmlNodePtr cur, gboolean trusted);
-
-/**
- * Reads an OPML file and inserts it into the feedlist.
+ * Reads an OPML file and inserts it into the feedlist. The file
+ * is parsed as a stream. Favicons and the first download of new
+ * subscriptions are loaded later in the background.
  *
  * @param filename	path to file that will be read for importing
  * @param parentNode	node of the parent folder
@@ -60,16 +51,6 @@ void export_node_children(nodePtr node, xmlNodePtr cur, gboolean trusted);
  */
 gboolean import_OPML_feedlist(const gchar *filename, nodePtr parentNode, gboolean showErrors, gboolean trusted);
 
-/**
- * Parses the given outline XML node and depending on the
- * node type attribute calls the node specific import method.
- *
- * @param cur		the outline XML node
- * @param parentNode	the parent node
- * @param trusted	set to TRUE if the feedlist is being imported from a trusted source
- */
-void import_parse_outline(xmlNodePtr cur, nodePtr parentNode, gboolean trusted);
-
 /**
  * Called when user requested dialog to import an OPML file.
  */
@@ -33,9 +33,18 @@
 #include "common.h"
 #include "debug.h"
 #include "favicon.h"
+#include "favicon_atlas.h"
 #include "feed.h"
 #include "html.h"
 #include "metadata.h"
+#include "node.h"
+#include "ui_observer.h"
+
+/* Favicons are decoded, scaled and saved by a small pool of
+   worker threads. The scaled icons are kept in the favicon atlas
+   (see favicon_atlas.h), the original icon is kept as PNG file
+   for the HTML rendering. */
+#define FAVICON_DECODE_THREADS	2
 
 typedef struct faviconDownloadCtxt {
 	gchar		        *id;		/**< favicon cache id */
@@ -68,33 +77,183 @@ favicon_download_ctxt_free (faviconDownloadCtxtPtr ctxt)
 
 static void favicon_download_run(faviconDownloadCtxtPtr ctxt);
 
-GdkPixbuf * favicon_load_from_cache(const gchar *id) {
+/** favicon decoding job run by the worker threads */
+typedef struct faviconDecodeJob {
+	gchar			*id;		/**< favicon cache id */
+	gchar			*data;		/**< downloaded icon data (or NULL to load the cached PNG file) */
+	gsize			size;		/**< size of the data */
+	faviconDownloadCtxtPtr	ctxt;		/**< download context (or NULL) */
+	GdkPixbuf		*icon;		/**< result: the scaled icon (or NULL) */
+} *faviconDecodeJobPtr;
+
+static GThreadPool *decodePool = NULL;
+
+static GdkPixbuf *
+favicon_decode_data (faviconDecodeJobPtr job)
+{
+	GdkPixbufLoader	*loader = gdk_pixbuf_loader_new ();
+	GdkPixbuf	*pixbuf = NULL;
+	GError		*err = NULL;
+	gchar		*filename;
+
+	if (gdk_pixbuf_loader_write (loader, (guchar *)job->data, job->size, &err)) {
+		if (gdk_pixbuf_loader_close (loader, &err)) {
+			pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+			if (pixbuf) {
+				g_object_ref (pixbuf);
+				filename = common_create_cache_filename ("cache" G_DIR_SEPARATOR_S "favicons", job->id, "png");
+				debug2 (DEBUG_UPDATE, "saving favicon %s to file %s", job->id, filename);
+				if (!gdk_pixbuf_save (pixbuf, filename, "png", &err, NULL)) {
+					g_warning ("Could not save favicon (id=%s) to file %s!", job->id, filename);
+					g_object_unref (pixbuf);
+					pixbuf = NULL;
+				}
+				g_free (filename);
+			} else {
+				debug0 (DEBUG_UPDATE, "gdk_pixbuf_loader_get_pixbuf() failed!");
+			}
+		} else {
+			debug0 (DEBUG_UPDATE, "gdk_pixbuf_loader_close() failed!");
+		}
+	} else {
+		debug0 (DEBUG_UPDATE, "gdk_pixbuf_loader_write() failed!");
+		gdk_pixbuf_loader_close (loader, NULL);
+	}
+
+	if (err) {
+		g_warning ("%s\n", err->message);
+		g_error_free (err);
+	}
+
+	g_object_unref (loader);
+
+	return pixbuf;
+}
+
+static GdkPixbuf *
+favicon_decode_file (faviconDecodeJobPtr job)
+{
 	struct stat	statinfo;
 	gchar		*filename;
-	GdkPixbuf	*pixbuf, *result = NULL;
-	GError 		*error = NULL;
+	GdkPixbuf	*pixbuf = NULL;
+	GError		*error = NULL;
+
+	filename = common_create_cache_filename ("cache" G_DIR_SEPARATOR_S "favicons", job->id, "png");
+	if (0 == stat ((const char*)filename, &statinfo)) {
+		pixbuf = gdk_pixbuf_new_from_file (filename, &error);
+		if (!pixbuf) {
+			g_warning ("Failed to load pixbuf file: %s: %s", filename, error->message);
+			g_error_free (error);
+		}
+	}
+	g_free (filename);
 
-	debug_enter("favicon_load_from_cache");
-	
-	/* try to load a saved favicon */
-	filename = common_create_cache_filename("cache" G_DIR_SEPARATOR_S "favicons", id, "png");
-	
-	if(0 == stat((const char*)filename, &statinfo)) {
-		pixbuf = gdk_pixbuf_new_from_file(filename, &error);
-		if(pixbuf) {
-			result = gdk_pixbuf_scale_simple(pixbuf, 16, 16, GDK_INTERP_BILINEAR);
-			g_object_unref(pixbuf);
-		} else { /* Error */
-			fprintf(stderr, "Failed to load pixbuf file: %s: %s\n",
-			        filename, error->message);
-			g_error_free(error);
+	return pixbuf;
+}
+
+static gboolean
+favicon_decode_finished (gpointer user_data)
+{
+	faviconDecodeJobPtr	job = (faviconDecodeJobPtr)user_data;
+
+	if (job->icon)
+		favicon_atlas_set (job->id, job->icon);
+
+	if (job->ctxt) {
+		if (job->icon) {
+			/* Run favicon-updated callback */
+			if (job->ctxt->callback)
+				(job->ctxt->callback) (job->ctxt->user_data);
+			favicon_download_ctxt_free (job->ctxt);
+		} else {
+			favicon_download_run (job->ctxt);	/* try next... */
 		}
+	} else if (job->icon) {
+		/* a favicon that was not yet in the atlas */
+		nodePtr node = node_from_id (job->id);
+
+		if (node && !node->icon) {
+			node_set_icon (node, g_object_ref (job->icon));
+			ui_observer_node_changed (node);
+		}
+	} else {
+		/* no usable cached favicon, do not look again on next startup */
+		favicon_atlas_set_none (job->id);
 	}
-	g_free(filename);	
 
-	debug_exit("favicon_load_from_cache");
-	
-	return result;
+	if (job->icon)
+		g_object_unref (job->icon);
+	g_free (job->id);
+	g_free (job->data);
+	g_free (job);
+
+	return FALSE;
+}
+
+/* runs in a worker thread */
+static void
+favicon_decode (gpointer data, gpointer user_data)
+{
+	faviconDecodeJobPtr	job = (faviconDecodeJobPtr)data;
+	GdkPixbuf		*pixbuf;
+
+	if (job->data)
+		pixbuf = favicon_decode_data (job);
+	else
+		pixbuf = favicon_decode_file (job);
+
+	if (pixbuf) {
+		job->icon = gdk_pixbuf_scale_simple (pixbuf, FAVICON_ATLAS_ICON_SIZE, FAVICON_ATLAS_ICON_SIZE, GDK_INTERP_BILINEAR);
+		g_object_unref (pixbuf);
+	}
+
+	g_idle_add (favicon_decode_finished, job);
+}
+
+static void
+favicon_decode_queue (const gchar *id, const gchar *data, gsize size, faviconDownloadCtxtPtr ctxt)
+{
+	faviconDecodeJobPtr	job;
+
+	if (!decodePool)
+		decodePool = g_thread_pool_new (favicon_decode, NULL, FAVICON_DECODE_THREADS, FALSE, NULL);
+
+	job = g_new0 (struct faviconDecodeJob, 1);
+	job->id = g_strdup (id);
+	if (data) {
+		job->data = g_memdup (data, size);
+		job->size = size;
+	}
+	job->ctxt = ctxt;
+
+	g_thread_pool_push (decodePool, job, NULL);
+}
+
+GdkPixbuf *
+favicon_load_from_cache (const gchar *id)
+{
+	GdkPixbuf	*icon;
+
+	icon = favicon_atlas_lookup (id);
+	if (icon || favicon_atlas_contains (id))
+		return icon;
+
+	/* Favicons downloaded before the atlas existed are decoded in
+	   the background and set as node icon once they are ready */
+	favicon_decode_queue (id, NULL, 0, NULL);
+
+	return NULL;
+}
+
+void
+favicon_deinit (void)
+{
+	if (decodePool) {
+		g_thread_pool_free (decodePool, TRUE, TRUE);
+		decodePool = NULL;
+	}
+
+	favicon_atlas_free ();
 }
 
 gboolean
@@ -113,6 +272,8 @@ void favicon_remove_from_cache(const gchar *id) {
 	gchar		*filename;
 
 	debug_enter("favicon_remove");
+
+	favicon_atlas_remove (id);
 	
 	/* try to load a saved favicon */
 	filename = common_create_cache_filename( "cache" G_DIR_SEPARATOR_S "favicons", id, "png");
@@ -129,9 +290,6 @@ static void
 favicon_download_icon_cb (const struct updateResult * const result, gpointer user_data, updateFlags flags)
 {
 	faviconDownloadCtxtPtr	ctxt = (faviconDownloadCtxtPtr)user_data;
-	gchar		*tmp;
-	GError		*err = NULL;
-	gboolean	success = FALSE;
 	
 	debug4 (DEBUG_UPDATE, "icon download processing (%s, %d bytes, content type %s) for favicon %s", result->source, result->size, result->contentType, ctxt->id);
 
@@ -140,48 +298,11 @@ favicon_download_icon_cb (const struct updateResult * const result, gpointer use
 	    result->contentType /*&&*/
 	   /* the MIME type is wrong much too often, so we cannot check it... */
 	   /*(!strncmp("image", result->contentType, 5))*/) {
-		GdkPixbufLoader *loader = gdk_pixbuf_loader_new ();
-		GdkPixbuf *pixbuf;
-		if (gdk_pixbuf_loader_write (loader, (guchar *)result->data, (gsize)result->size, &err)) {
-			if (gdk_pixbuf_loader_close (loader, &err)) {
-				pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
-				if (pixbuf) {
-					tmp = common_create_cache_filename ("cache" G_DIR_SEPARATOR_S "favicons", ctxt->id, "png");
-					debug2 (DEBUG_UPDATE, "saving favicon %s to file %s", ctxt->id, tmp);
-					if (!gdk_pixbuf_save (pixbuf, tmp, "png", &err, NULL)) {
-						g_warning ("Could not save favicon (id=%s) to file %s!", ctxt->id, tmp);
-					} else {
-						success = TRUE;
-						/* Run favicon-updated callback */
-						if (ctxt->callback)
-							(ctxt->callback) (ctxt->user_data);
-					}
-					g_free (tmp);
-				} else {
-					debug0 (DEBUG_UPDATE, "gdk_pixbuf_loader_get_pixbuf() failed!");
-				}
-			} else {
-				debug0 (DEBUG_UPDATE, "gdk_pixbuf_loader_close() failed!");
-			}
-		} else {
-			debug0 (DEBUG_UPDATE, "gdk_pixbuf_loader_write() failed!");
-			gdk_pixbuf_loader_close (loader, NULL);
-		}
-
-		if (err) {
-			g_warning ("%s\n", err->message);
-			g_error_free (err);
-		}
-
-		g_object_unref (loader);
+		/* favicon_decode_finished() continues */
+		favicon_decode_queue (ctxt->id, result->data, result->size, ctxt);
 	} else {
 		debug1 (DEBUG_UPDATE, "No data in download result for favicon %s!", ctxt->id);
-	}
-	
-	if (!success) {
 		favicon_download_run (ctxt);	/* try next... */
-	} else {
-		favicon_download_ctxt_free (ctxt);
 	}
 }
 
@@ -198,6 +319,7 @@ favicon_download_html_cb (const struct updateResult * const result, gpointer use
 			request = update_request_new ();
 			request->source = iconUri;
 			request->options = update_options_copy (ctxt->options);
+			request->useCache = TRUE;
 			update_execute_request (ctxt->user_data, request, favicon_download_icon_cb, ctxt, flags);
 			
 			return;
@@ -225,6 +347,7 @@ favicon_download_run (faviconDownloadCtxtPtr ctxt)
 		request = update_request_new ();
 		request->source = url;
 		request->options = update_options_copy (ctxt->options);
+		request->useCache = TRUE;
 
 		if (strstr (url, "/favicon.ico"))
 			callback = favicon_download_icon_cb;	
@@ -28,7 +28,10 @@
 #include "update.h"
 
 /**
- * Tries to load a given favicon from cache.
+ * Tries to load a given favicon from cache. If the favicon
+ * is not in the favicon atlas yet NULL is returned and the node
+ * icon is set once the cached icon file is decoded. Nodes without
+ * a usable cached icon are noted in the atlas and not decoded again.
  *
  * @param id		the favicon id
  *
@@ -36,6 +39,11 @@
  */
 GdkPixbuf * favicon_load_from_cache(const gchar *id);
 
+/**
+ * Stops decoding favicons and saves the favicon atlas.
+ */
+void favicon_deinit (void);
+
 /**
  * Removes a given favicon from the favicon cache.
  *
@@ -0,0 +1,326 @@
+/**
+ * @file favicon_atlas.c  memory mapped favicon atlas
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "favicon_atlas.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "debug.h"
+
+/* Atlas file layout (native byte order, it is a local cache only):
+
+   header
+   icons		count x faviconAtlasRecord
+
+   Node ids are NUL padded, nodes with longer ids are not stored.
+   Records of nodes without icon have the FAVICON_ATLAS_NO_ICON flag
+   and zeroed pixels. */
+
+#define FAVICON_ATLAS_MAGIC	"LIFICO01"
+#define FAVICON_ATLAS_VERSION	2
+#define FAVICON_ATLAS_ID_LENGTH	32
+#define FAVICON_ATLAS_PIXELS	(FAVICON_ATLAS_ICON_SIZE * FAVICON_ATLAS_ICON_SIZE * 4)
+
+#define FAVICON_ATLAS_NO_ICON	(1<<0)
+
+/* changes are written after this delay (in s) to save them in batches */
+#define FAVICON_ATLAS_SAVE_DELAY	5
+
+typedef struct faviconAtlasHeader {
+	gchar		magic[8];
+	guint32		version;
+	guint32		iconSize;
+	guint32		count;
+	guint32		reserved;
+} faviconAtlasHeader;
+
+typedef struct faviconAtlasRecord {
+	gchar		id[FAVICON_ATLAS_ID_LENGTH];
+	guint32		flags;
+	guchar		pixels[FAVICON_ATLAS_PIXELS];	/**< RGBA, no row padding */
+} faviconAtlasRecord;
+
+typedef struct faviconAtlasIcon {
+	guchar		*pixels;	/**< icon pixels in the mapped file or in a copy (or NULL if the node has no icon) */
+	gboolean	mapped;		/**< TRUE if the pixels are in the mapped file */
+} *faviconAtlasIconPtr;
+
+static GMappedFile	*mappedFile = NULL;
+static GHashTable	*icons = NULL;	/**< node id -> faviconAtlasIcon */
+static gboolean		dirty = FALSE;
+static guint		saveTimer = 0;
+
+static gchar *
+favicon_atlas_get_filename (void)
+{
+	return common_create_cache_filename ("cache" G_DIR_SEPARATOR_S "favicons", "favicons", "atlas");
+}
+
+static void
+favicon_atlas_icon_free (faviconAtlasIconPtr icon)
+{
+	if (!icon->mapped)
+		g_free (icon->pixels);
+	g_free (icon);
+}
+
+static void
+favicon_atlas_load (void)
+{
+	const faviconAtlasHeader	*header;
+	faviconAtlasRecord		*records;
+	gchar				*filename, *contents;
+	GError				*error = NULL;
+	gsize				length;
+	guint				i;
+
+	icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)favicon_atlas_icon_free);
+
+	filename = favicon_atlas_get_filename ();
+	mappedFile = g_mapped_file_new (filename, FALSE, &error);
+	if (!mappedFile) {
+		debug2 (DEBUG_CACHE, "No favicon atlas %s (%s)", filename, error->message);
+		g_error_free (error);
+		g_free (filename);
+		return;
+	}
+	g_free (filename);
+
+	contents = g_mapped_file_get_contents (mappedFile);
+	length = g_mapped_file_get_length (mappedFile);
+	header = (const faviconAtlasHeader *)contents;
+
+	if ((length < sizeof (faviconAtlasHeader)) ||
+	    strncmp (header->magic, FAVICON_ATLAS_MAGIC, 8) ||
+	    (header->version != FAVICON_ATLAS_VERSION) ||
+	    (header->iconSize != FAVICON_ATLAS_ICON_SIZE) ||
+	    (length != sizeof (faviconAtlasHeader) + (gsize)header->count * sizeof (faviconAtlasRecord))) {
+		debug0 (DEBUG_CACHE, "Favicon atlas has an unknown format or is truncated, ignoring it.");
+		g_mapped_file_free (mappedFile);
+		mappedFile = NULL;
+		return;
+	}
+
+	records = (faviconAtlasRecord *)(contents + sizeof (faviconAtlasHeader));
+	for (i = 0; i < header->count; i++) {
+		faviconAtlasIconPtr icon;
+
+		if (records[i].id[FAVICON_ATLAS_ID_LENGTH - 1])
+			continue;	/* corrupt id */
+
+		icon = g_new0 (struct faviconAtlasIcon, 1);
+		if (!(records[i].flags & FAVICON_ATLAS_NO_ICON)) {
+			icon->pixels = records[i].pixels;
+			icon->mapped = TRUE;
+		}
+		g_hash_table_replace (icons, g_strdup (records[i].id), icon);
+	}
+
+	debug1 (DEBUG_CACHE, "Mapped favicon atlas with %u icons", header->count);
+}
+
+static gboolean
+favicon_atlas_save_cb (gpointer user_data)
+{
+	saveTimer = 0;
+	favicon_atlas_save ();
+
+	return FALSE;
+}
+
+static void
+favicon_atlas_changed (void)
+{
+	dirty = TRUE;
+	if (!saveTimer)
+		saveTimer = g_timeout_add_seconds (FAVICON_ATLAS_SAVE_DELAY, favicon_atlas_save_cb, NULL);
+}
+
+GdkPixbuf *
+favicon_atlas_lookup (const gchar *id)
+{
+	faviconAtlasIconPtr	icon;
+
+	if (!icons)
+		favicon_atlas_load ();
+
+	icon = g_hash_table_lookup (icons, id);
+	if (!icon || !icon->pixels)
+		return NULL;
+
+	/* The pixbuf gets a copy as the mapped file is replaced on save */
+	return gdk_pixbuf_new_from_data (g_memdup (icon->pixels, FAVICON_ATLAS_PIXELS),
+	                                 GDK_COLORSPACE_RGB, TRUE, 8,
+	                                 FAVICON_ATLAS_ICON_SIZE, FAVICON_ATLAS_ICON_SIZE,
+	                                 FAVICON_ATLAS_ICON_SIZE * 4,
+	                                 (GdkPixbufDestroyNotify)g_free, NULL);
+}
+
+gboolean
+favicon_atlas_contains (const gchar *id)
+{
+	if (!icons)
+		favicon_atlas_load ();
+
+	return NULL != g_hash_table_lookup (icons, id);
+}
+
+void
+favicon_atlas_set (const gchar *id, GdkPixbuf *pixbuf)
+{
+	faviconAtlasIconPtr	icon;
+	GdkPixbuf		*rgba;
+	const guchar		*src;
+	gint			rowstride, y;
+
+	if (strlen (id) >= FAVICON_ATLAS_ID_LENGTH) {
+		debug1 (DEBUG_CACHE, "Node id %s is too long for the favicon atlas", id);
+		return;
+	}
+
+	g_return_if_fail (gdk_pixbuf_get_width (pixbuf) == FAVICON_ATLAS_ICON_SIZE);
+	g_return_if_fail (gdk_pixbuf_get_height (pixbuf) == FAVICON_ATLAS_ICON_SIZE);
+	g_return_if_fail (gdk_pixbuf_get_bits_per_sample (pixbuf) == 8);
+
+	if (!icons)
+		favicon_atlas_load ();
+
+	rgba = gdk_pixbuf_add_alpha (pixbuf, FALSE, 0, 0, 0);
+	src = gdk_pixbuf_get_pixels (rgba);
+	rowstride = gdk_pixbuf_get_rowstride (rgba);
+
+	icon = g_new0 (struct faviconAtlasIcon, 1);
+	icon->pixels = g_malloc (FAVICON_ATLAS_PIXELS);
+	for (y = 0; y < FAVICON_ATLAS_ICON_SIZE; y++)
+		memcpy (icon->pixels + y * FAVICON_ATLAS_ICON_SIZE * 4, src + y * rowstride, FAVICON_ATLAS_ICON_SIZE * 4);
+	g_object_unref (rgba);
+
+	g_hash_table_replace (icons, g_strdup (id), icon);
+	favicon_atlas_changed ();
+}
+
+void
+favicon_atlas_set_none (const gchar *id)
+{
+	if (strlen (id) >= FAVICON_ATLAS_ID_LENGTH)
+		return;
+
+	if (!icons)
+		favicon_atlas_load ();
+
+	g_hash_table_replace (icons, g_strdup (id), g_new0 (struct faviconAtlasIcon, 1));
+	favicon_atlas_changed ();
+}
+
+void
+favicon_atlas_remove (const gchar *id)
+{
+	if (!icons)
+		favicon_atlas_load ();
+
+	if (g_hash_table_remove (icons, id))
+		favicon_atlas_changed ();
+}
+
+static void
+favicon_atlas_add_record (gpointer key, gpointer value, gpointer user_data)
+{
+	faviconAtlasRecord	*record = g_new0 (faviconAtlasRecord, 1);
+	faviconAtlasIconPtr	icon = (faviconAtlasIconPtr)value;
+	FILE			*file = (FILE *)user_data;
+
+	strncpy (record->id, (const gchar *)key, FAVICON_ATLAS_ID_LENGTH - 1);
+	if (icon->pixels)
+		memcpy (record->pixels, icon->pixels, FAVICON_ATLAS_PIXELS);
+	else
+		record->flags = FAVICON_ATLAS_NO_ICON;
+	fwrite (record, sizeof (faviconAtlasRecord), 1, file);
+	g_free (record);
+}
+
+void
+favicon_atlas_save (void)
+{
+	faviconAtlasHeader	header;
+	FILE			*file;
+	gchar			*filename, *tmpFilename;
+	gboolean		success;
+
+	if (!dirty)
+		return;
+
+	filename = favicon_atlas_get_filename ();
+	tmpFilename = g_strdup_printf ("%s~", filename);
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, FAVICON_ATLAS_MAGIC, 8);
+	header.version = FAVICON_ATLAS_VERSION;
+	header.iconSize = FAVICON_ATLAS_ICON_SIZE;
+	header.count = g_hash_table_size (icons);
+
+	/* The mapped file stays valid when it is replaced */
+	file = g_fopen (tmpFilename, "wb");
+	if (file) {
+		fwrite (&header, sizeof (header), 1, file);
+		g_hash_table_foreach (icons, favicon_atlas_add_record, file);
+		success = !ferror (file);
+		success = (0 == fclose (file)) && success;
+		if (success)
+			success = (0 == g_rename (tmpFilename, filename));
+	} else {
+		success = FALSE;
+	}
+
+	if (success) {
+		debug1 (DEBUG_CACHE, "Saved favicon atlas with %u icons", header.count);
+		dirty = FALSE;
+	} else {
+		g_warning ("Could not write favicon atlas %s!", filename);
+		g_unlink (tmpFilename);
+	}
+
+	g_free (tmpFilename);
+	g_free (filename);
+}
+
+void
+favicon_atlas_free (void)
+{
+	if (saveTimer) {
+		g_source_remove (saveTimer);
+		saveTimer = 0;
+	}
+
+	if (!icons)
+		return;
+
+	favicon_atlas_save ();
+
+	g_hash_table_destroy (icons);
+	icons = NULL;
+
+	if (mappedFile) {
+		g_mapped_file_free (mappedFile);
+		mappedFile = NULL;
+	}
+}
@@ -0,0 +1,88 @@
+/**
+ * @file favicon_atlas.h  memory mapped favicon atlas
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _FAVICON_ATLAS_H
+#define _FAVICON_ATLAS_H
+
+#include <gtk/gtk.h>
+
+/* The scaled favicons of all nodes are kept in a single file
+   (cache/favicons/favicons.atlas) of fixed size records holding
+   the node id and the RGBA pixels of the 16x16 icon. Nodes known
+   to have no usable icon get a record without pixels. The file is
+   mapped at the first lookup so loading all node icons at startup
+   does not decode a single PNG file. Changes are collected in memory
+   and written back by favicon_atlas_save(). */
+
+#define FAVICON_ATLAS_ICON_SIZE	16
+
+/**
+ * Looks up the icon of the given node.
+ *
+ * @param id		the node id
+ *
+ * @returns new pixbuf (or NULL if the node has no icon in the atlas)
+ */
+GdkPixbuf * favicon_atlas_lookup (const gchar *id);
+
+/**
+ * Checks whether the atlas has a record for the given node,
+ * either with an icon or noting that the node has none.
+ *
+ * @param id		the node id
+ *
+ * @returns TRUE if the node is known to the atlas
+ */
+gboolean favicon_atlas_contains (const gchar *id);
+
+/**
+ * Adds or replaces the icon of the given node.
+ *
+ * @param id		the node id
+ * @param icon		icon of FAVICON_ATLAS_ICON_SIZE x FAVICON_ATLAS_ICON_SIZE pixels
+ */
+void favicon_atlas_set (const gchar *id, GdkPixbuf *icon);
+
+/**
+ * Notes that the given node has no usable icon, so that it is
+ * not looked for again on each startup.
+ *
+ * @param id		the node id
+ */
+void favicon_atlas_set_none (const gchar *id);
+
+/**
+ * Removes the icon of the given node.
+ *
+ * @param id		the node id
+ */
+void favicon_atlas_remove (const gchar *id);
+
+/**
+ * Writes the atlas file if it was changed.
+ */
+void favicon_atlas_save (void);
+
+/**
+ * Saves and frees the atlas.
+ */
+void favicon_atlas_free (void);
+
+#endif
@@ -31,15 +31,14 @@
 #include "feedlist.h"
 #include "itemlist.h"
 #include "metadata.h"
+#include "metrics.h"
 #include "node.h"
 #include "render.h"
+#include "ui_observer.h"
 #include "update.h"
 #include "xml.h"
-#include "ui/auth_dialog.h"
 #include "ui/icons.h"
-#include "ui/liferea_shell.h"
 #include "ui/ui_subscription.h"
-#include "ui/ui_node.h"
 #include "notification/notification.h"
 
 feedPtr
@@ -234,19 +233,29 @@ feed_process_update_result (subscriptionPtr subscription, const struct updateRes
 	feedParserCtxtPtr	ctxt;
 	nodePtr			node = subscription->node;
 	feedPtr			feed = (feedPtr)node->data;
+	gint64			start;
+	gchar			*host;
 
 	debug_enter ("feed_process_update_result");
 	
-	if (result->data) {
+	if (result->data || result->doc || result->docErrors) {
+		host = metrics_host_label (subscription->source);
+
 		/* parse the new downloaded feed into feed and itemSet */
 		ctxt = feed_create_parser_ctxt ();
 		ctxt->feed = feed;
 		ctxt->data = result->data;
 		ctxt->dataLength = result->size;
+		ctxt->doc = result->doc;
+		ctxt->docErrors = result->docErrors;
+		ctxt->stream = (feedParserCtxtPtr)result->elementData;
+		ctxt->streamShared = result->shared;
 		ctxt->subscription = subscription;
 
 		/* try to parse the feed */
+		start = metrics_now ();
 		feed_parse (ctxt);
+		metrics_observe_since ("feed.parse_time", host, start);
 		
 		if (ctxt->failed) {
 			/* No feed found, display an error */
@@ -268,7 +277,10 @@ feed_process_update_result (subscriptionPtr subscription, const struct updateRes
 			
 			/* merge the resulting items into the node's item set */
 			itemSet = node_get_itemset (node);
+			start = metrics_now ();
 			newCount = itemset_merge_items (itemSet, ctxt->items, ctxt->feed->valid, ctxt->feed->markAsRead);
+			metrics_observe_since ("feed.merge_time", host, start);
+			metrics_count ("feed.items_added", host, newCount);
 			itemlist_merge_itemset (itemSet);
 			itemset_free (itemSet);
 
@@ -281,17 +293,18 @@ feed_process_update_result (subscriptionPtr subscription, const struct updateRes
 			if (flags > 0)
 				db_subscription_update (subscription);
 
-			liferea_shell_set_status_bar (_("\"%s\" updated..."), node_get_title (node));
+			ui_observer_set_status_bar (_("\"%s\" updated..."), node_get_title (node));
 
 			if (!feed->preventPopup)
 				notification_node_has_new_items (node, feed->enforcePopup);
 		}
 
 		feed_free_parser_ctxt (ctxt);
+		g_free (host);
 	} else {
 		node->available = FALSE;
 
-		liferea_shell_set_status_bar (_("\"%s\" is not available"), node_get_title (node));
+		ui_observer_set_status_bar (_("\"%s\" is not available"), node_get_title (node));
 	}
 
 	debug_exit ("feed_process_update_result");
@@ -300,7 +313,15 @@ feed_process_update_result (subscriptionPtr subscription, const struct updateRes
 static gboolean
 feed_prepare_update_request (subscriptionPtr subscription, struct updateRequest *request)
 {
-	/* Nothing to do. Feeds require no subscription extra handling. */
+	/* Feeds require no subscription extra handling. Unfiltered
+	   downloads can be parsed while downloading, items are
+	   taken out of the document as soon as they are complete. */
+	request->parseXml = (NULL == request->filtercmd);
+	if (request->parseXml) {
+		request->elementFunc = feed_parse_element;
+		request->elementData = feed_create_stream_parser_ctxt (subscription);
+		request->elementDataFree = (GDestroyNotify)feed_free_stream_parser_ctxt;
+	}
 	
 	return TRUE;
 }
@@ -329,7 +350,7 @@ feed_update_counters (nodePtr node)
 static void
 feed_remove (nodePtr node)
 {
-	ui_node_remove_node (node);
+	ui_observer_node_removed (node);
 	
 	favicon_remove_from_cache (node->id);
 	db_subscription_remove (node->id);
@@ -23,7 +23,9 @@
 #include "common.h"
 #include "debug.h"
 #include "html.h"
+#include "item.h"
 #include "metadata.h"
+#include "subscription.h"
 #include "xml.h"
 #include "parsers/cdf_channel.h"
 #include "parsers/rss_channel.h"
@@ -101,6 +103,104 @@ feed_free_parser_ctxt (feedParserCtxtPtr ctxt)
 	}
 }
 
+feedParserCtxtPtr
+feed_create_stream_parser_ctxt (subscriptionPtr subscription)
+{
+	feedParserCtxtPtr ctxt;
+
+	/* Item parsers resolve relative links using the homepage. The
+	   item parsers take the new one from the feed header elements as
+	   soon as they are complete, until then (or if the feed has none)
+	   the current one is used. */
+	ctxt = feed_create_parser_ctxt ();
+	ctxt->subscription = subscription_new (NULL, NULL, NULL);
+	if (subscription_get_homepage (subscription))
+		metadata_list_set (&ctxt->subscription->metadata, "homepage", subscription_get_homepage (subscription));
+	ctxt->feed = feed_new ();
+
+	return ctxt;
+}
+
+void
+feed_free_stream_parser_ctxt (feedParserCtxtPtr ctxt)
+{
+	GList	*iter;
+
+	for (iter = ctxt->items; iter; iter = g_list_next (iter))
+		item_unload ((itemPtr)iter->data);
+	g_list_free (ctxt->items);
+
+	subscription_free (ctxt->subscription);
+	if (ctxt->feed->parseErrors)
+		g_string_free (ctxt->feed->parseErrors, TRUE);
+	g_free (ctxt->feed);
+
+	feed_free_parser_ctxt (ctxt);
+}
+
+/* Copies an item parsed while downloading for another subscription
+   sharing the download. Unlike item_copy() the copy is no search
+   folder item but a new feed item. */
+static itemPtr
+feed_parser_copy_stream_item (itemPtr item)
+{
+	itemPtr copy = item_new ();
+
+	copy->title = g_strdup (item->title);
+	copy->source = g_strdup (item->source);
+	copy->sourceId = g_strdup (item->sourceId);
+	copy->validGuid = item->validGuid;
+	copy->description = g_strdup (item->description);
+	copy->readStatus = item->readStatus;
+	copy->updateStatus = item->updateStatus;
+	copy->popupStatus = item->popupStatus;
+	copy->flagStatus = item->flagStatus;
+	copy->hasEnclosure = item->hasEnclosure;
+	copy->time = item->time;
+	copy->commentFeedId = g_strdup (item->commentFeedId);
+	copy->isComment = item->isComment;
+	copy->metadata = metadata_list_copy (item->metadata);
+
+	return copy;
+}
+
+gboolean
+feed_parse_element (xmlNodePtr cur, gpointer user_data)
+{
+	feedParserCtxtPtr	ctxt = (feedParserCtxtPtr)user_data;
+	itemPtr			item;
+
+	/* the format is known once the root element was parsed */
+	if (!ctxt->streamChecked) {
+		xmlNodePtr	root = xmlDocGetRootElement (cur->doc);
+		GSList		*iter;
+
+		for (iter = feed_parsers_get_list (); iter; iter = iter->next) {
+			feedHandlerPtr handler = (feedHandlerPtr)iter->data;
+			if (handler->checkFormat && root->name && (*(handler->checkFormat)) (cur->doc, root)) {
+				ctxt->streamHandler = handler;
+				break;
+			}
+		}
+		ctxt->streamChecked = TRUE;
+	}
+
+	if (!ctxt->streamHandler || !ctxt->streamHandler->itemParser || !cur->name)
+		return FALSE;
+
+	ctxt->doc = cur->doc;
+	item = (*(ctxt->streamHandler->itemParser)) (ctxt, cur);
+	ctxt->doc = NULL;
+	ctxt->item = NULL;
+	if (!item)
+		return FALSE;
+
+	/* prepended for speed, feed_parse() reverses the list */
+	ctxt->items = g_list_prepend (ctxt->items, item);
+
+	return TRUE;
+}
+
 /**
  * This function tries to find a feed link for a given HTTP URI. It
  * tries to download it. If it finds a valid feed source it parses
@@ -118,6 +218,11 @@ feed_parser_auto_discover (feedParserCtxtPtr ctxt)
 		ctxt->feed->parseErrors = g_string_new(NULL);
 		
 	debug1 (DEBUG_UPDATE, "Starting feed auto discovery (%s)", subscription_get_source (ctxt->subscription));
+
+	if (!ctxt->data) {
+		debug0 (DEBUG_UPDATE, "No data for auto discovery!");
+		return;
+	}
 	
 	source = html_auto_discover_feed (ctxt->data, subscription_get_source (ctxt->subscription));
 
@@ -152,6 +257,10 @@ feed_parse (feedParserCtxtPtr ctxt)
 {
 	xmlNodePtr	cur;
 	gboolean	success = FALSE;
+	gboolean	preparsed = (NULL != ctxt->doc);
+	xmlChar		*dump = NULL;
+	GList		*iter;
+	guint		streamed = 0;
 
 	debug_enter("feed_parse");
 
@@ -206,14 +315,44 @@ feed_parse (feedParserCtxtPtr ctxt)
 				ctxt->failed = FALSE;
 
 				ctxt->feed->fhp = handler;
+
+				/* items parsed while downloading come first, they are not in the document anymore */
+				if (ctxt->stream && (ctxt->stream->streamHandler == handler)) {
+					if (ctxt->streamShared) {
+						for (iter = ctxt->stream->items; iter; iter = g_list_next (iter))
+							ctxt->items = g_list_prepend (ctxt->items, feed_parser_copy_stream_item ((itemPtr)iter->data));
+					} else {
+						ctxt->items = g_list_reverse (ctxt->stream->items);
+						ctxt->stream->items = NULL;
+					}
+					streamed = g_list_length (ctxt->items);
+				}
+
 				(*(handler->feedParser))(ctxt, cur);		/* parse it */
 
+				/* the feed date only known now is the fallback for undated items */
+				for (iter = ctxt->items; iter && streamed > 0; iter = g_list_next (iter), streamed--) {
+					itemPtr item = (itemPtr)iter->data;
+					if (0 == item->time)
+						item->time = ctxt->feed->time;
+				}
+
 				break;
 			}
 			handlerIter = handlerIter->next;
 		}
 	} while(0);
 	
+	/* A document parsed while downloading comes without data,
+	   serialize it for auto discovery (e.g. of XHTML pages) */
+	if(ctxt->failed && !ctxt->data && ctxt->doc) {
+		int len;
+
+		xmlDocDumpMemory (ctxt->doc, &dump, &len);
+		ctxt->data = (gchar *)dump;
+		ctxt->dataLength = len;
+	}
+
 	/* if the given URI isn't valid we need to start auto discovery */
 	if(ctxt->failed)
 		feed_parser_auto_discover (ctxt);
@@ -221,7 +360,8 @@ feed_parse (feedParserCtxtPtr ctxt)
 	if(ctxt->failed) {
 		/* Autodiscovery failed */
 		/* test if we have a HTML page */
-		if((strstr(ctxt->data, "<html>") || strstr(ctxt->data, "<HTML>") ||
+		if(ctxt->data &&
+		   (strstr(ctxt->data, "<html>") || strstr(ctxt->data, "<HTML>") ||
 		    strstr(ctxt->data, "<html ") || strstr(ctxt->data, "<HTML "))) {
 			debug0(DEBUG_UPDATE, "HTML document detected!");
 			g_string_append(ctxt->feed->parseErrors, _("Source points to HTML document."));
@@ -234,9 +374,14 @@ feed_parse (feedParserCtxtPtr ctxt)
 		success = TRUE;
 	}
 	
-	if(ctxt->doc) {
+	if(ctxt->doc && !preparsed)
 		xmlFreeDoc(ctxt->doc);
-		ctxt->doc = NULL;
+	ctxt->doc = NULL;
+
+	if(dump) {
+		xmlFree(dump);
+		ctxt->data = NULL;
+		ctxt->dataLength = 0;
 	}
 		
 	debug_exit("feed_parse");
@@ -40,8 +40,14 @@ typedef struct feedParserCtxt {
 	gchar		*data;		/**< data buffer to parse */
 	gsize		dataLength;	/**< length of the data buffer */
 
-	xmlDocPtr	doc;		/**< the parsed data buffer */
+	xmlDocPtr	doc;		/**< the parsed data buffer (or a document parsed while downloading, not owned) */
+	GString		*docErrors;	/**< parser errors of a document parsed while downloading (or NULL) */
 	gboolean	failed;		/**< TRUE if parsing failed because feed type could not be detected */
+
+	struct feedParserCtxt	*stream;	/**< context that parsed items while downloading (or NULL, not owned) */
+	gboolean		streamShared;	/**< TRUE if the stream items are needed by another parse and are copied */
+	struct feedHandler	*streamHandler;	/**< handler of the items parsed while downloading (or NULL) */
+	gboolean		streamChecked;	/**< TRUE if the document format was checked for streaming */
 } *feedParserCtxtPtr;
 
 
@@ -63,11 +69,26 @@ typedef void 	(*feedParserFunc)	(feedParserCtxtPtr ctxt, xmlNodePtr cur);
  */
 typedef gboolean (*checkFormatFunc)	(xmlDocPtr doc, xmlNodePtr cur);
 
+/**
+ * Function type which parses a single completed element of a feed
+ * document that is still being downloaded, if it is an item. Feed
+ * header elements needed for parsing the items (like the homepage
+ * for relative links) are evaluated too, but not consumed.
+ *
+ * @param ctxt	feed parsing context
+ * @param cur	the XML element
+ *
+ * @return new item or NULL if the element is not an item
+ */
+typedef struct item * (*itemParserFunc)	(feedParserCtxtPtr ctxt, xmlNodePtr cur);
+
 /** feed handler interface */
 typedef struct feedHandler {
 	const gchar	*typeStr;	/**< string representation of the feed type */
 	feedParserFunc	feedParser;	/**< feed type parse function */
 	checkFormatFunc	checkFormat;	/**< Parser for the feed type*/
+	itemParserFunc	itemParser;	/**< parses items while downloading (optional), the
+					     feedParser then only gets the remaining document */
 } *feedHandlerPtr;
 
 /**
@@ -85,6 +106,39 @@ feedParserCtxtPtr feed_create_parser_ctxt (void);
  */
 void feed_free_parser_ctxt (feedParserCtxtPtr ctxt);
 
+/**
+ * Creates a context for parsing the items of a feed document
+ * while it is being downloaded (see feed_parse_element()). It
+ * does not reference the subscription, so it stays valid when
+ * the subscription is removed during the download.
+ *
+ * @param subscription	the subscription to be updated
+ *
+ * @returns a new feed parsing context
+ */
+feedParserCtxtPtr feed_create_stream_parser_ctxt (subscriptionPtr subscription);
+
+/**
+ * Frees a context created with feed_create_stream_parser_ctxt()
+ * including all items not taken by feed_parse().
+ *
+ * @param ctxt		the feed parsing context
+ */
+void feed_free_stream_parser_ctxt (feedParserCtxtPtr ctxt);
+
+/**
+ * Parses a completed element of a feed document being downloaded
+ * if it is an item. The items are taken over by feed_parse() if
+ * the stream context is passed as ctxt->stream, or copied if
+ * ctxt->streamShared is set.
+ *
+ * @param cur		the XML element
+ * @param user_data	a context created with feed_create_stream_parser_ctxt()
+ *
+ * @returns TRUE if the element was parsed and is not needed anymore
+ */
+gboolean feed_parse_element (xmlNodePtr cur, gpointer user_data);
+
 /**
  * Lookup a feed type string from the feed type id.
  *
@@ -31,14 +31,9 @@
 #include "itemlist.h"
 #include "net_monitor.h"
 #include "node.h"
+#include "ui_observer.h"
 #include "update.h"
 #include "vfolder.h"
-#include "ui/feed_list_view.h"
-#include "ui/itemview.h"
-#include "ui/liferea_shell.h"
-#include "ui/ui_node.h"
-#include "ui/ui_subscription.h"
-#include "ui/ui_tray.h"
 #include "fl_sources/node_source.h"
 
 static void feedlist_class_init	(FeedListClass *klass);
@@ -56,6 +51,8 @@ struct FeedListPrivate {
 					     display enabled) */
 
 	guint		saveTimer;	/**< timer id for delayed feed list saving */
+	gboolean	structureChanged; /**< TRUE if the feed list OPML file needs to be written */
+	GHashTable	*changedNodes;	/**< ids of nodes to be written to the DB */
 	guint		autoUpdateTimer; /**< timer id for auto update */
 
 	gboolean	loading;	/**< prevents the feed list being saved before it is completely loaded */
@@ -116,6 +113,7 @@ feedlist_finalize (GObject *object)
 
 	/* Enforce synchronous save upon exit */
 	feedlist_save ();		
+	g_hash_table_destroy (feedlist->priv->changedNodes);
 	
 	/* And destroy everything */
 	feedlist_foreach (feedlist_free_node);
@@ -162,14 +160,11 @@ on_network_status_changed (gpointer instance, gboolean online, gpointer data)
 static void
 feedlist_init_node (nodePtr node) 
 {
-	if (node->expanded)
-		ui_node_set_expansion (node, TRUE);
-	
 	if (node->subscription)
 		db_subscription_load (node->subscription);
 		
 	node_update_counters (node);
-	ui_node_update (node->id);	/* Necessary to initially set folder unread counters */
+	ui_observer_node_changed (node);	/* Necessary to initially set folder unread counters */
 	
 	node_foreach_child (node, feedlist_init_node);
 }
@@ -187,16 +182,17 @@ feedlist_init (FeedList *fl)
 	
 	feedlist->priv = FEEDLIST_GET_PRIVATE (fl);
 	feedlist->priv->loading = TRUE;
+	feedlist->priv->changedNodes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	
 	/* 2. Set up a root node and import the feed list source structure. */
 	debug0 (DEBUG_CACHE, "Setting up root node");
 	ROOTNODE = node_source_setup_root ();
 
-	/* 3. Ensure folder expansion and unread count*/
+	/* 3. Ensure unread count */
 	debug0 (DEBUG_CACHE, "Initializing node state");
 	feedlist_foreach (feedlist_init_node);
 
-	ui_tray_update ();
+	ui_observer_update_stats ();
 
 	/* 4. Check if feeds do need updating. */
 	debug0 (DEBUG_UPDATE, "Performing initial feed update");
@@ -273,7 +269,7 @@ feedlist_update_node_counters (nodePtr node)
 	node_update_counters (node);	/* update with parent propagation */
 
 	if (node->needsUpdate)
-		ui_node_update (node->id);
+		ui_observer_node_changed (node);
 	if (node->children)
 		node_foreach_child (node, feedlist_update_node_counters);
 }
@@ -292,8 +288,8 @@ feedlist_mark_all_read (nodePtr node)
 		node_foreach_child (ROOTNODE, node_mark_all_read);
 		
 	feedlist_foreach (feedlist_update_node_counters);
-	itemview_update_all_items ();
-	itemview_update ();
+	ui_observer_all_items_updated ();
+	ui_observer_items_changed ();
 }
 
 /* statistic handling methods */
@@ -328,8 +324,7 @@ feedlist_update_new_item_count (guint addValue)
 	if (feedlist->priv->newCount > ROOTNODE->unreadCount)
 		feedlist->priv->newCount = ROOTNODE->unreadCount;
 		
-	ui_tray_update ();
-	liferea_shell_update_unread_stats ();
+	ui_observer_update_stats ();
 }
 
 void
@@ -337,8 +332,7 @@ feedlist_reset_new_item_count (void)
 {
 	if (feedlist->priv->newCount) {
 		feedlist->priv->newCount = 0;
-		ui_tray_update ();
-		liferea_shell_update_unread_stats ();
+		ui_observer_update_stats ();
 	}
 }
 
@@ -384,7 +378,7 @@ feedlist_add_subscription (const gchar *source, const gchar *filter, updateOptio
 void
 feedlist_node_imported (nodePtr node)
 {
-	ui_node_add (node);	
+	ui_observer_node_added (node);	
 	feedlist_schedule_save ();
 }
 
@@ -410,7 +404,40 @@ feedlist_node_added (nodePtr node)
 
 	feedlist_node_imported (node);
 	
-	feed_list_view_select (node);
+	ui_observer_node_selected (node);
+}
+
+static void
+feedlist_node_hide (nodePtr node)
+{
+	node_foreach_child (node, feedlist_node_hide);
+	ui_observer_node_removed (node);
+}
+
+static void
+feedlist_node_show (nodePtr node)
+{
+	ui_observer_node_added (node);
+	node_foreach_child (node, feedlist_node_show);
+}
+
+void
+feedlist_move_node (nodePtr node, nodePtr newParent, gint position)
+{
+	nodePtr	oldParent = node->parent;
+
+	g_assert (NULL != oldParent);
+
+	feedlist_node_hide (node);
+	oldParent->children = g_slist_remove (oldParent->children, node);
+	node_set_parent (node, newParent, position);
+	feedlist_node_show (node);
+
+	node_update_counters (oldParent);
+	node_update_counters (node);
+
+	feedlist_node_changed (node);
+	feedlist_schedule_save ();
 }
 
 void
@@ -433,7 +460,7 @@ feedlist_node_removed (nodePtr node)
 
 	node_remove (node);
 
-	ui_node_remove_node (node);
+	ui_observer_node_removed (node);
 
 	node->parent->children = g_slist_remove (node->parent->children, node);
 
@@ -526,13 +553,13 @@ feedlist_unselect (void)
 {
 	SELECTED = NULL;
 
-	itemview_set_displayed_node (NULL);
-	itemview_update ();
+	ui_observer_node_displayed (NULL);
+	ui_observer_items_changed ();
 		
 	itemlist_unload (FALSE /* mark all read */);
-	feed_list_view_select (NULL);
-	liferea_shell_update_feed_menu (TRUE, FALSE, FALSE);
-	liferea_shell_update_allitems_actions (FALSE, FALSE);
+	ui_observer_node_selected (NULL);
+	ui_observer_update_feed_menu (TRUE, FALSE, FALSE);
+	ui_observer_update_allitems_actions (FALSE, FALSE);
 }
 
 void
@@ -558,15 +585,48 @@ feedlist_selection_changed (nodePtr node)
 			itemlist_set_view_mode (node_get_view_mode (SELECTED));		
 			itemlist_load (SELECTED);
 		} else {
-			itemview_clear ();
+			ui_observer_items_cleared ();
 		}
 	}
 
 	debug_exit ("feedlist_selection_changed");
 }
 
-static gboolean
-feedlist_schedule_save_cb (gpointer user_data)
+static void
+feedlist_collect_changed_node (gpointer key, gpointer value, gpointer user_data)
+{
+	GSList	**nodes = (GSList **)user_data;
+	nodePtr	node = node_from_id ((const gchar *)key);
+
+	/* removed nodes are skipped */
+	if (node && node->parent)
+		*nodes = g_slist_prepend (*nodes, node);
+}
+
+void
+feedlist_save_changed_nodes (void)
+{
+	GSList	*nodes = NULL;
+
+	if (!feedlist || 0 == g_hash_table_size (feedlist->priv->changedNodes))
+		return;
+
+	if (!db_is_open ()) {
+		debug1 (DEBUG_CONF, "DB already closed, dropping %u changed nodes", g_hash_table_size (feedlist->priv->changedNodes));
+		g_hash_table_remove_all (feedlist->priv->changedNodes);
+		return;
+	}
+
+	g_hash_table_foreach (feedlist->priv->changedNodes, feedlist_collect_changed_node, &nodes);
+	g_hash_table_remove_all (feedlist->priv->changedNodes);
+
+	debug1 (DEBUG_CONF, "Saving %u changed nodes", g_slist_length (nodes));
+	db_nodes_update (nodes);
+	g_slist_free (nodes);
+}
+
+static void
+feedlist_save_structure (void)
 {
 	/* step 1: request each node to save its state */
 	feedlist_foreach (node_save);
@@ -574,16 +634,27 @@ feedlist_schedule_save_cb (gpointer user_data)
 	/* step 2: request saving for the root node and thereby
 	   forcing the root plugin to save the feed list structure */
 	NODE_SOURCE_TYPE (ROOTNODE)->source_export (ROOTNODE);
+
+	feedlist->priv->structureChanged = FALSE;
+}
+
+static gboolean
+feedlist_schedule_save_cb (gpointer user_data)
+{
+	feedlist_save_changed_nodes ();
+
+	if (feedlist->priv->structureChanged)
+		feedlist_save_structure ();
 	
 	feedlist->priv->saveTimer = 0;
 	
 	return FALSE;
 }
 
-void
-feedlist_schedule_save (void)
+static void
+feedlist_schedule_save_timer (void)
 {
-	if (feedlist->priv->loading || feedlist->priv->saveTimer)
+	if (feedlist->priv->saveTimer)
 		return;
 		
 	debug0 (DEBUG_CONF, "Scheduling feedlist save");
@@ -594,12 +665,36 @@ feedlist_schedule_save (void)
 	feedlist->priv->saveTimer = g_timeout_add_seconds (5, feedlist_schedule_save_cb, NULL);
 }
 
+void
+feedlist_schedule_save (void)
+{
+	if (feedlist->priv->loading)
+		return;
+
+	feedlist->priv->structureChanged = TRUE;
+	feedlist_schedule_save_timer ();
+}
+
+void
+feedlist_node_changed (nodePtr node)
+{
+	/* new subscriptions are saved when they are added */
+	if (!feedlist || feedlist->priv->loading || !node || !node->parent)
+		return;
+
+	g_hash_table_replace (feedlist->priv->changedNodes, g_strdup (node->id), NULL);
+	feedlist_schedule_save_timer ();
+}
+
 /* This method is only to be used when exiting the program! */
 static void
 feedlist_save (void)
 {
 	debug0 (DEBUG_CONF, "Forced feed list save");
-	feedlist_schedule_save_cb (NULL);
+
+	/* the OPML file is always written to keep it in sync with the DB */
+	feedlist_save_changed_nodes ();
+	feedlist_save_structure ();
 }
 
 void
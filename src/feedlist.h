@@ -166,6 +166,17 @@ void feedlist_node_added (nodePtr node);
  */
 void feedlist_node_imported (nodePtr node);
 
+/**
+ * Moves an existing node (including its children) to another
+ * parent node, keeping the feed list view, the unread counters
+ * and the saved feed list in sync.
+ *
+ * @param node		the node to move
+ * @param newParent	the new parent node
+ * @param position	insert position (-1 to append)
+ */
+void feedlist_move_node (nodePtr node, nodePtr newParent, gint position);
+
 /**
  * Removes the given node from the feed list.
  *
@@ -185,10 +196,29 @@ void feedlist_node_removed (nodePtr node);
 
 /**
  * Schedules a save requests for the feed list within the next 5s.
- * Triggers state saving for all feed list sources.
+ * Triggers state saving for all feed list sources. To be used
+ * when the feed list structure or node properties that are only
+ * kept in the feed list OPML file were changed.
  */
 void feedlist_schedule_save (void);
 
+/**
+ * Schedules saving the properties of the given node (title, view
+ * mode, sorting and subscription source, filter and update interval)
+ * to the DB within the next 5s. Only the changed nodes are written,
+ * the feed list OPML file is not written.
+ *
+ * @param node		the changed node
+ */
+void feedlist_node_changed (nodePtr node);
+
+/**
+ * Writes the pending node property changes (see feedlist_node_changed())
+ * to the DB. To be called on exit before the DB is closed. Does
+ * nothing once the DB is closed.
+ */
+void feedlist_save_changed_nodes (void);
+
 /**
  * Resets the update counter of all childs of the given node
  *
@@ -32,9 +32,9 @@
 #include "item_state.h"
 #include "node.h"
 #include "subscription.h"
+#include "ui_observer.h"
 #include "update.h"
 #include "xml.h"
-#include "ui/auth_dialog.h"
 #include "ui/liferea_dialog.h"
 #include "ui/ui_common.h"
 #include "fl_sources/node_source.h"
@@ -54,6 +54,7 @@ google_source_new (nodePtr node)
 	source->actionQueue = g_queue_new (); 
 	source->loginState = GOOGLE_SOURCE_STATE_NONE; 
 	source->lastTimestampMap = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+	source->editGuids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	
 	return source;
 }
@@ -67,11 +68,32 @@ google_source_free (GoogleSourcePtr gsource)
 	update_job_cancel_by_owner (gsource);
 	
 	g_free (gsource->authHeaderValue);
+	g_free (gsource->editToken);
 	g_queue_free (gsource->actionQueue) ;
 	g_hash_table_unref (gsource->lastTimestampMap);
+	g_hash_table_unref (gsource->editGuids);
 	g_free (gsource);
 }
 
+gchar *
+google_source_get_api_url (const gchar *url)
+{
+	const gchar	*base = g_getenv ("LIFEREA_GOOGLE_READER_URL");
+	const gchar	*path;
+
+	if (!base || !*base)
+		return g_strdup (url);
+
+	if (g_str_has_prefix (url, "http://www.google.com"))
+		path = url + strlen ("http://www.google.com");
+	else if (g_str_has_prefix (url, "https://www.google.com"))
+		path = url + strlen ("https://www.google.com");
+	else
+		return g_strdup (url);
+
+	return g_strconcat (base, path, NULL);
+}
+
 nodePtr
 google_source_get_root_from_node (nodePtr node)
 { 
@@ -92,6 +114,10 @@ google_source_login_cb (const struct updateResult * const result, gpointer userd
 	
 	g_assert (!gsource->authHeaderValue);
 	
+	/* edit tokens are bound to the session */
+	g_free (gsource->editToken);
+	gsource->editToken = NULL;
+	
 	if (result->data && result->httpstatus == 200)
 		tmp = strstr (result->data, "Auth=");
 		
@@ -119,7 +145,7 @@ google_source_login_cb (const struct updateResult * const result, gpointer userd
 		subscription->updateError = g_strdup (_("Google Reader login failed!"));
 		gsource->loginState = GOOGLE_SOURCE_STATE_NONE;
 		
-		auth_dialog_new (subscription, flags);
+		ui_observer_auth_required (subscription, flags);
 	}
 }
 
@@ -131,7 +157,7 @@ google_source_login_cb (const struct updateResult * const result, gpointer userd
 void
 google_source_login (GoogleSourcePtr gsource, guint32 flags) 
 { 
-	gchar			*username, *password;
+	gchar			*username, *password, *url;
 	updateRequestPtr	request;
 	subscriptionPtr		subscription = gsource->root->subscription;
 	
@@ -143,7 +169,9 @@ google_source_login (GoogleSourcePtr gsource, guint32 flags)
 
 	request = update_request_new ();
 
-	update_request_set_source (request, GOOGLE_READER_LOGIN_URL);
+	url = google_source_get_api_url (GOOGLE_READER_LOGIN_URL);
+	update_request_set_source (request, url);
+	g_free (url);
 
 	/* escape user and password as both are passed using an URI */
 	username = g_uri_escape_string (subscription->updateOptions->username, NULL, TRUE);
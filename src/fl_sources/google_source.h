@@ -33,6 +33,16 @@ typedef struct GoogleSource {
 	GQueue          *actionQueue;
 	int             loginState; /**< The current login state */
 
+	gchar           *editToken;	/**< cached edit token (or NULL) */
+	GTimeVal        editTokenTime;	/**< when the edit token was fetched */
+	gboolean        editInProgress;	/**< TRUE while an edit or token request is running */
+
+	/**
+	 * A map from item guids to the number of queued or running edit
+	 * actions for the item.
+	 */
+	GHashTable      *editGuids;
+
 	/**
 	 * A map from a subscription source to a timestamp when it was last 
 	 * updated (provided by Google).
@@ -95,11 +105,17 @@ enum  {
 #define GOOGLE_READER_SUBSCRIPTION_LIST_URL "http://www.google.com/reader/api/0/subscription/list"
 
 /**
- * Get a token for an edit operation. (@todo A token can actually be used
- * for multiple transactions.)
+ * Get a token for an edit operation. A token can be used for multiple
+ * edits until it expires.
  */
 #define GOOGLE_READER_TOKEN_URL "http://www.google.com/reader/api/0/token"
 
+/**
+ * Time (in seconds) an edit token is reused. Google Reader tokens
+ * expire after about 30 minutes.
+ */
+#define GOOGLE_READER_TOKEN_LIFETIME (25*60)
+
 /**
  * Add a subscription
  * @param URL The feed URL, or the page URL for feed autodiscovery.
@@ -129,43 +145,36 @@ enum  {
 #define GOOGLE_READER_EDIT_TAG_URL "http://www.google.com/reader/api/0/edit-tag?client=liferea"
 
 /**
- * Postdata for adding a tag when using GOOGLE_READER_EDIT_TAG_URL.
+ * Postdata for GOOGLE_READER_EDIT_TAG_URL is composed of one
+ * GOOGLE_READER_EDIT_TAG_ITEM for each item to edit (the same tags
+ * are changed for all of them), one GOOGLE_READER_EDIT_TAG_ADD and/or
+ * GOOGLE_READER_EDIT_TAG_REMOVE and a final GOOGLE_READER_EDIT_TAG_POST.
+ *
+ * GOOGLE_READER_EDIT_TAG_ITEM:
  * @param i The guid of the item.
  * @param prefix The prefix to 's'. For normal feeds this will be "feed", for
  *          links etc, this should be "user".
  * @param s The URL of the subscription containing the item. (Note that the 
- *          following string adds the "feed/" prefix to this.)
+ *          final value of s is prefix + "/" + this string)
+ *
+ * GOOGLE_READER_EDIT_TAG_ADD:
  * @param a The tag to add. 
- * @param T a token obtained using GOOGLE_READER_TOKEN_URL
- */
-#define GOOGLE_READER_EDIT_TAG_ADD_TAG "i=%s&s=%s%%2F%s&a=%s&ac=edit-tags&T=%s&async=true"
-
-/**
- * Postdata for removing  a tag, when using GOOGLE_READER_EDIT_TAG_URL. Do
- * not use for removing the "read" tag, see GOOGLE_READER_EDIT_TAG_AR_TAG 
- * for that.
  *
- * @param i The guid of the item.
- * @param prefix The prefix to 's'. @see GOOGLE_READER_EDIT_TAG_ADD_TAG
- * @param s The URL of the subscription containing the item. (Note that the 
- *          final value of s is feed + "/" + this string)
+ * GOOGLE_READER_EDIT_TAG_REMOVE:
  * @param r The tag to remove
+ *
+ * GOOGLE_READER_EDIT_TAG_POST:
  * @param T a token obtained using GOOGLE_READER_TOKEN_URL
  */
-#define GOOGLE_READER_EDIT_TAG_REMOVE_TAG "i=%s&s=%s%%2F%s&r=%s&ac=edit-tags&T=%s&async=true"
+#define GOOGLE_READER_EDIT_TAG_ITEM "i=%s&s=%s%%2F%s&"
+#define GOOGLE_READER_EDIT_TAG_ADD "a=%s&"
+#define GOOGLE_READER_EDIT_TAG_REMOVE "r=%s&"
+#define GOOGLE_READER_EDIT_TAG_POST "ac=edit-tags&T=%s&async=true"
 
 /**
- * Postdata for adding a tag, and removing another tag at the same time, 
- * when using GOOGLE_READER_EDIT_TAG_URL.
- * @param i The guid of the item.
- * @param prefix The prefix to 's'. @see GOOGLE_READER_EDIT_TAG_ADD_TAG
- * @param s The URL of the subscription containing the item. (Note that the 
- *          final value of s is feed + "/" + this string)
- * @param a The tag to add. 
- * @param r The tag to remove
- * @param T a token obtained using GOOGLE_READER_TOKEN_URL
+ * Maximum number of items changed with a single edit-tag request.
  */
-#define GOOGLE_READER_EDIT_TAG_AR_TAG "i=%s&s=%s%%2F%s&a=%s&r=%s&ac=edit-tags&T=%s&async=true"
+#define GOOGLE_READER_EDIT_TAG_MAX_ITEMS 100
 
 /**
  * Postdata for adding a tag, and removing another tag at the same time, for a 
@@ -262,4 +271,16 @@ google_source_migrate_node(nodePtr node);
 
 void google_source_login (GoogleSourcePtr gsource, guint32 flags);
 
+/**
+ * Returns the URL to request for the given Google Reader API URL. To
+ * test against a local Reader compatible server the environment variable
+ * LIFEREA_GOOGLE_READER_URL can be set to a replacement for the
+ * "http(s)://www.google.com" part of all API URLs.
+ *
+ * @param url	one of the GOOGLE_READER_*_URL API URLs
+ *
+ * @returns a new URL (to be free'd using g_free())
+ */
+gchar * google_source_get_api_url (const gchar *url);
+
 #endif
@@ -87,9 +87,15 @@ enum {
 
 typedef struct GoogleSourceAction* editPtr ;
 
+/**
+ * Context of a running edit request. Item edits of the same type
+ * are combined into a single request, so a request can complete
+ * several actions at once.
+ */
 typedef struct GoogleSourceActionCtxt { 
 	gchar   *nodeId ;
-	GoogleSourceActionPtr action; 
+	GSList  *actions;	/**< list of GoogleSourceActionPtr in queue order */
+	gboolean freshToken;	/**< TRUE if the edit token was just requested */
 } *GoogleSourceActionCtxtPtr; 
 
 
@@ -111,12 +117,28 @@ google_source_action_free (GoogleSourceActionPtr action)
 	g_slice_free (struct GoogleSourceAction, action);
 }
 
+/* Frees a queued or running action and drops it from the guid map */
+static void
+google_source_action_release (GoogleSourcePtr gsource, GoogleSourceActionPtr action)
+{
+	if (action->guid) {
+		guint count = GPOINTER_TO_UINT (g_hash_table_lookup (gsource->editGuids, action->guid));
+
+		if (count > 1)
+			g_hash_table_insert (gsource->editGuids, g_strdup (action->guid), GUINT_TO_POINTER (count - 1));
+		else
+			g_hash_table_remove (gsource->editGuids, action->guid);
+	}
+	google_source_action_free (action);
+}
+
 static GoogleSourceActionCtxtPtr
-google_source_action_context_new(GoogleSourcePtr gsource, GoogleSourceActionPtr action)
+google_source_action_context_new(GoogleSourcePtr gsource, GSList *actions, gboolean freshToken)
 {
 	GoogleSourceActionCtxtPtr ctxt = g_slice_new0(struct GoogleSourceActionCtxt);
 	ctxt->nodeId = g_strdup(gsource->root->id);
-	ctxt->action = action;
+	ctxt->actions = actions;
+	ctxt->freshToken = freshToken;
 	return ctxt;
 }
 
@@ -127,46 +149,94 @@ google_source_action_context_free(GoogleSourceActionCtxtPtr ctxt)
 	g_slice_free(struct GoogleSourceActionCtxt, ctxt);
 }
 
+static gboolean
+google_source_action_is_item_edit (GoogleSourceActionPtr action)
+{
+	return (action->actionType != EDIT_ACTION_ADD_SUBSCRIPTION &&
+	        action->actionType != EDIT_ACTION_REMOVE_SUBSCRIPTION);
+}
+
+/* Returns the key used to keep the order of conflicting item edits:
+   all read state changes of an item conflict with each other, and so
+   do all flag changes. */
+static gchar *
+google_source_action_conflict_key (GoogleSourceActionPtr action)
+{
+	gboolean starred = (action->actionType == EDIT_ACTION_MARK_STARRED ||
+	                    action->actionType == EDIT_ACTION_MARK_UNSTARRED);
+
+	return g_strdup_printf ("%s:%s", starred ? "starred" : "read", action->guid);
+}
+
 static void
 google_source_edit_action_complete (const struct updateResult* const result, gpointer userdata, updateFlags flags) 
 { 
 	GoogleSourceActionCtxtPtr     editCtxt = (GoogleSourceActionCtxtPtr) userdata; 
 	nodePtr                       node = node_from_id (editCtxt->nodeId);
 	GoogleSourcePtr               gsource; 
-	GoogleSourceActionPtr         action = editCtxt->action ;
+	GSList                        *actions = editCtxt->actions, *iter;
+	gboolean                      freshToken = editCtxt->freshToken;
 	
 	google_source_action_context_free (editCtxt);
 
 	if (!node) {
-		google_source_action_free (action);
-		return; /* probably got deleted before this callback */
+		/* probably got deleted before this callback */
+		for (iter = actions; iter; iter = g_slist_next (iter))
+			google_source_action_free ((GoogleSourceActionPtr) iter->data);
+		g_slist_free (actions);
+		return;
 	} 
 	gsource = (GoogleSourcePtr) node->data;
+	gsource->editInProgress = FALSE;
 		
 	if (result->data == NULL || !g_str_equal (result->data, "OK")) {
-		if (action->callback) 
-			(*action->callback) (gsource, action, FALSE);
-		debug1 (DEBUG_UPDATE, "The edit action failed with result: %s\n", result->data);
-		google_source_action_free (action);
+		debug2 (DEBUG_UPDATE, "The edit action failed with result: %s (%d actions)\n", result->data, g_slist_length (actions));
+
+		/* The cached token might have expired, so drop it. If it
+		   was not just requested retry once with a new token. */
+		g_free (gsource->editToken);
+		gsource->editToken = NULL;
+
+		if (!freshToken) {
+			actions = g_slist_reverse (actions);
+			for (iter = actions; iter; iter = g_slist_next (iter))
+				g_queue_push_head (gsource->actionQueue, iter->data);
+			g_slist_free (actions);
+			google_source_edit_process (gsource);
+			return;
+		}
+
+		for (iter = actions; iter; iter = g_slist_next (iter)) {
+			GoogleSourceActionPtr action = (GoogleSourceActionPtr) iter->data;
+			if (action->callback) 
+				(*action->callback) (gsource, action, FALSE);
+			google_source_action_release (gsource, action);
+		}
+		g_slist_free (actions);
 		return; /** @todo start a timer for next processing */
 	}
 	
-	if (action->callback)
-		action->callback (gsource, action, TRUE);
-
-	google_source_action_free (action);
+	for (iter = actions; iter; iter = g_slist_next (iter)) {
+		GoogleSourceActionPtr action = (GoogleSourceActionPtr) iter->data;
+		if (action->callback)
+			action->callback (gsource, action, TRUE);
+		google_source_action_release (gsource, action);
+	}
+	g_slist_free (actions);
 
 	/* process anything else waiting on the edit queue */
 	google_source_edit_process (gsource);
 }
 
 /* the following google_source_api_* functions are simply funtions that 
-   convert a GoogleSourceActionPtr to a updateRequestPtr */
+   convert GoogleSourceActionPtrs to a updateRequestPtr */
  
 static void
 google_source_api_add_subscription (GoogleSourceActionPtr action, updateRequestPtr request, const gchar* token) 
 {
-	update_request_set_source (request, GOOGLE_READER_ADD_SUBSCRIPTION_URL);
+	gchar* url = google_source_get_api_url (GOOGLE_READER_ADD_SUBSCRIPTION_URL);
+	update_request_set_source (request, url);
+	g_free (url);
 	gchar* s_escaped = g_uri_escape_string (action->feedUrl, NULL, TRUE) ;
 	gchar* postdata = g_strdup_printf (GOOGLE_READER_ADD_SUBSCRIPTION_POST, s_escaped, token);
 	g_free (s_escaped);
@@ -178,76 +248,171 @@ google_source_api_add_subscription (GoogleSourceActionPtr action, updateRequestP
 static void
 google_source_api_remove_subscription (GoogleSourceActionPtr action, updateRequestPtr request, const gchar* token) 
 {
-	update_request_set_source (request, GOOGLE_READER_REMOVE_SUBSCRIPTION_URL);
+	gchar* url = google_source_get_api_url (GOOGLE_READER_REMOVE_SUBSCRIPTION_URL);
+	update_request_set_source (request, url);
+	g_free (url);
 	gchar* s_escaped = g_uri_escape_string (action->feedUrl, NULL, TRUE);
 	g_assert (!request->postdata);
 	request->postdata = g_strdup_printf (GOOGLE_READER_REMOVE_SUBSCRIPTION_POST, s_escaped, token);
 	g_free (s_escaped);
 }
 
+/* Builds a single edit-tag request for a list of item actions of the same type */
 static void 
-google_source_api_edit_tag (GoogleSourceActionPtr action, updateRequestPtr request, const gchar*token) 
+google_source_api_edit_tag (GSList *actions, updateRequestPtr request, const gchar*token) 
 {
-	update_request_set_source (request, GOOGLE_READER_EDIT_TAG_URL); 
-
-	const gchar* prefix = "feed" ; 
-	gchar* s_escaped = g_uri_escape_string (action->feedUrl, NULL, TRUE);
-	gchar* a_escaped = NULL ;
-	gchar* i_escaped = g_uri_escape_string (action->guid, NULL, TRUE);
-	gchar* postdata = NULL ;
+	GoogleSourceActionPtr first = (GoogleSourceActionPtr) actions->data;
+	GHashTable* guids = g_hash_table_new (g_str_hash, g_str_equal);
+	GString* postdata = g_string_new (NULL);
+	const gchar* add = NULL;
+	const gchar* remove = NULL;
+	gchar* url;
+
+	url = google_source_get_api_url (GOOGLE_READER_EDIT_TAG_URL);
+	update_request_set_source (request, url); 
+	g_free (url);
+
+	for (; actions; actions = g_slist_next (actions)) {
+		GoogleSourceActionPtr action = (GoogleSourceActionPtr) actions->data;
+		const gchar* prefix = "feed" ; 
+		gchar* s_escaped;
+		gchar* i_escaped;
+
+		g_assert (action->actionType == first->actionType);
+		if (g_hash_table_lookup (guids, action->guid))
+			continue;
+		g_hash_table_insert (guids, action->guid, action);
 
-	/*
-	 * If the source of the item is a feed then the source *id* will be of
-	 * the form tag:google.com,2005:reader/feed/http://foo.com/bar
-	 * If the item is a shared link it is of the form
-	 * tag:google.com,2005:reader/user/<sharer's-id>/source/com.google/link
-	 * It is possible that there are items other thank link that has
-	 * the ../user/.. id. The GR API requires the strings after ..:reader/
-	 * while GoogleSourceAction only gives me after :reader/feed/ (or 
-	 * :reader/user/ as the case might be). I therefore need to guess
-	 * the prefix ('feed/' or 'user/') from just this information. 
-	 */
+		/*
+		 * If the source of the item is a feed then the source *id* will be of
+		 * the form tag:google.com,2005:reader/feed/http://foo.com/bar
+		 * If the item is a shared link it is of the form
+		 * tag:google.com,2005:reader/user/<sharer's-id>/source/com.google/link
+		 * It is possible that there are items other thank link that has
+		 * the ../user/.. id. The GR API requires the strings after ..:reader/
+		 * while GoogleSourceAction only gives me after :reader/feed/ (or 
+		 * :reader/user/ as the case might be). I therefore need to guess
+		 * the prefix ('feed/' or 'user/') from just this information. 
+		 */
 
-	if (strstr(action->feedUrl, "://") == NULL) 
-		prefix = "user" ;
+		if (strstr(action->feedUrl, "://") == NULL) 
+			prefix = "user" ;
 
-	if (action->actionType == EDIT_ACTION_MARK_UNREAD) {
-		a_escaped = g_uri_escape_string (GOOGLE_READER_TAG_KEPT_UNREAD, NULL, TRUE);
-		gchar *r_escaped = g_uri_escape_string (GOOGLE_READER_TAG_READ, NULL, TRUE);
-		postdata = g_strdup_printf (GOOGLE_READER_EDIT_TAG_AR_TAG, i_escaped, prefix, s_escaped, a_escaped, r_escaped, token);
-		g_free (r_escaped);
+		s_escaped = g_uri_escape_string (action->feedUrl, NULL, TRUE);
+		i_escaped = g_uri_escape_string (action->guid, NULL, TRUE);
+		g_string_append_printf (postdata, GOOGLE_READER_EDIT_TAG_ITEM, i_escaped, prefix, s_escaped);
+		g_free (s_escaped);
+		g_free (i_escaped);
 	}
-	else if (action->actionType == EDIT_ACTION_MARK_READ) { 
-		a_escaped = g_uri_escape_string (GOOGLE_READER_TAG_READ, NULL, TRUE);
-		postdata = g_strdup_printf (GOOGLE_READER_EDIT_TAG_ADD_TAG, i_escaped, prefix, s_escaped, a_escaped, token);
+	g_hash_table_destroy (guids);
+
+	switch (first->actionType) {
+		case EDIT_ACTION_MARK_UNREAD:
+			add = GOOGLE_READER_TAG_KEPT_UNREAD;
+			remove = GOOGLE_READER_TAG_READ;
+			break;
+		case EDIT_ACTION_MARK_READ:
+			add = GOOGLE_READER_TAG_READ;
+			break;
+		case EDIT_ACTION_TRACKING_MARK_UNREAD:
+			add = GOOGLE_READER_TAG_TRACKING_KEPT_UNREAD;
+			break;
+		case EDIT_ACTION_MARK_STARRED:
+			add = GOOGLE_READER_TAG_STARRED;
+			break;
+		case EDIT_ACTION_MARK_UNSTARRED:
+			remove = GOOGLE_READER_TAG_STARRED;
+			break;
+		default:
+			g_assert_not_reached ();
 	}
-	else if (action->actionType == EDIT_ACTION_TRACKING_MARK_UNREAD) {
-		a_escaped = g_uri_escape_string (GOOGLE_READER_TAG_TRACKING_KEPT_UNREAD, NULL, TRUE);
-		postdata = g_strdup_printf (GOOGLE_READER_EDIT_TAG_ADD_TAG, i_escaped, prefix, s_escaped, a_escaped, token);
-	}  
-	else if (action->actionType == EDIT_ACTION_MARK_STARRED) { 
-		a_escaped = g_uri_escape_string (GOOGLE_READER_TAG_STARRED, NULL, TRUE) ;
-		postdata = g_strdup_printf (
-			GOOGLE_READER_EDIT_TAG_ADD_TAG, i_escaped, prefix,
-			s_escaped, a_escaped, token);
+
+	if (add) {
+		gchar* a_escaped = g_uri_escape_string (add, NULL, TRUE);
+		g_string_append_printf (postdata, GOOGLE_READER_EDIT_TAG_ADD, a_escaped);
+		g_free (a_escaped);
 	}
-	else if (action->actionType == EDIT_ACTION_MARK_UNSTARRED) {
-		gchar* r_escaped = g_uri_escape_string(GOOGLE_READER_TAG_STARRED, NULL, TRUE);
-		postdata = g_strdup_printf (
-			GOOGLE_READER_EDIT_TAG_REMOVE_TAG, i_escaped, prefix,
-			s_escaped, r_escaped, token);
+	if (remove) {
+		gchar* r_escaped = g_uri_escape_string (remove, NULL, TRUE);
+		g_string_append_printf (postdata, GOOGLE_READER_EDIT_TAG_REMOVE, r_escaped);
+		g_free (r_escaped);
 	}
+	g_string_append_printf (postdata, GOOGLE_READER_EDIT_TAG_POST, token);
 	
-	else g_assert (FALSE);
-	
-	g_free (s_escaped);
-	g_free (a_escaped); 
-	g_free (i_escaped);
-	
-	debug1 (DEBUG_UPDATE, "google_source: postdata [%s]", postdata);
+	debug1 (DEBUG_UPDATE, "google_source: postdata [%s]", postdata->str);
+
+	request->postdata = g_string_free (postdata, FALSE);
+}
+
+/* Removes the next batch of actions from the queue. Subscription edits
+   are sent alone. Item edits of the type of the first queued action are
+   collected up to the next subscription edit, skipping those that
+   conflict with a preceding edit of another type. */
+static GSList *
+google_source_edit_next_batch (GoogleSourcePtr gsource)
+{
+	GoogleSourceActionPtr	first = g_queue_pop_head (gsource->actionQueue);
+	GSList			*actions = g_slist_prepend (NULL, first);
+	GHashTable		*blocked;
+	GList			*iter, *next;
+	guint			count = 1;
+
+	if (!google_source_action_is_item_edit (first))
+		return actions;
+
+	blocked = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (iter = gsource->actionQueue->head; iter && count < GOOGLE_READER_EDIT_TAG_MAX_ITEMS; iter = next) {
+		GoogleSourceActionPtr action = (GoogleSourceActionPtr) iter->data;
+		gchar *key;
+
+		next = g_list_next (iter);
+		if (!google_source_action_is_item_edit (action))
+			break;
+
+		key = google_source_action_conflict_key (action);
+		if (action->actionType == first->actionType && !g_hash_table_lookup (blocked, key)) {
+			g_queue_delete_link (gsource->actionQueue, iter);
+			actions = g_slist_prepend (actions, action);
+			count++;
+			g_free (key);
+		} else {
+			g_hash_table_insert (blocked, key, GINT_TO_POINTER (TRUE));
+		}
+	}
+	g_hash_table_destroy (blocked);
+
+	return g_slist_reverse (actions);
+}
 
+static void
+google_source_edit_send (GoogleSourcePtr gsource, gboolean freshToken)
+{
+	GoogleSourceActionPtr	action;
+	GSList			*actions;
+	updateRequestPtr	request; 
+
+	if (g_queue_is_empty (gsource->actionQueue))
+		return;
+
+	actions = google_source_edit_next_batch (gsource);
+	action = (GoogleSourceActionPtr) actions->data;
+
+	request = update_request_new ();
+	request->updateState = update_state_copy (gsource->root->subscription->updateState);
+	request->options = update_options_copy (gsource->root->subscription->updateOptions) ;
+	update_request_set_auth_value (request, gsource->authHeaderValue);
 
-	request->postdata = postdata;
+	if (google_source_action_is_item_edit (action))
+		google_source_api_edit_tag (actions, request, gsource->editToken);
+	else if (action->actionType == EDIT_ACTION_ADD_SUBSCRIPTION ) 
+		google_source_api_add_subscription (action, request, gsource->editToken);
+	else if (action->actionType == EDIT_ACTION_REMOVE_SUBSCRIPTION )
+		google_source_api_remove_subscription (action, request, gsource->editToken) ;
+
+	debug2 (DEBUG_UPDATE, "google_source: sending %d edit action(s), %d still queued", g_slist_length (actions), g_queue_get_length (gsource->actionQueue));
+
+	gsource->editInProgress = TRUE;
+	update_execute_request (gsource, request, google_source_edit_action_complete, google_source_action_context_new (gsource, actions, freshToken), 0);
 }
 
 static void
@@ -255,14 +420,6 @@ google_source_edit_token_cb (const struct updateResult * const result, gpointer
 { 
 	nodePtr          node;
 	GoogleSourcePtr  gsource;
-	const gchar*     token;
-	GoogleSourceActionPtr          action;
-	updateRequestPtr request; 
-
-	if (result->httpstatus != 200 || result->data == NULL) { 
-		/* FIXME: What is the behaviour that should go here? */
-		return;
-	}
 
 	node = node_from_id ((gchar*) userdata);
 	g_free (userdata);
@@ -271,57 +428,60 @@ google_source_edit_token_cb (const struct updateResult * const result, gpointer
 		return;
 	}
 	gsource = (GoogleSourcePtr) node->data;
-
-
-	token = result->data; 
-
-	if (!gsource || g_queue_is_empty (gsource->actionQueue))
+	if (!gsource)
 		return;
 
-	action = g_queue_peek_head (gsource->actionQueue);
+	gsource->editInProgress = FALSE;
 
-	request = update_request_new ();
-	request->updateState = update_state_copy (gsource->root->subscription->updateState);
-	request->options = update_options_copy (gsource->root->subscription->updateOptions) ;
-	update_request_set_auth_value (request, gsource->authHeaderValue);
-
-	if (action->actionType == EDIT_ACTION_MARK_READ || 
-	    action->actionType == EDIT_ACTION_MARK_UNREAD || 
-	    action->actionType == EDIT_ACTION_TRACKING_MARK_UNREAD ||
-	    action->actionType == EDIT_ACTION_MARK_STARRED || 
-	    action->actionType == EDIT_ACTION_MARK_UNSTARRED) 
-		google_source_api_edit_tag (action, request, token);
-	else if (action->actionType == EDIT_ACTION_ADD_SUBSCRIPTION ) 
-		google_source_api_add_subscription (action, request, token);
-	else if (action->actionType == EDIT_ACTION_REMOVE_SUBSCRIPTION )
-		google_source_api_remove_subscription (action, request, token) ;
+	if (result->httpstatus != 200 || result->data == NULL) { 
+		/* FIXME: What is the behaviour that should go here? */
+		return;
+	}
 
-	update_execute_request (gsource, request, google_source_edit_action_complete, google_source_action_context_new(gsource, action), 0);
+	g_free (gsource->editToken);
+	gsource->editToken = g_strstrip (g_strdup (result->data));
+	g_get_current_time (&gsource->editTokenTime);
 
-	action = g_queue_pop_head (gsource->actionQueue);
+	google_source_edit_send (gsource, TRUE);
 }
 
 void
 google_source_edit_process (GoogleSourcePtr gsource)
 { 
 	updateRequestPtr request; 
+	GTimeVal now;
 	
 	g_assert (gsource);
 	if (g_queue_is_empty (gsource->actionQueue))
 		return;
+
+	/* only one edit at a time, to keep the queue order */
+	if (gsource->editInProgress)
+		return;
 	
 	/*
  	* Google reader has a system of tokens. So first, I need to request a 
  	* token from google, before I can make the actual edit request. The
- 	* code here is the token code, the actual edit commands are in 
- 	* google_source_edit_token_cb
+ 	* token is reused for all following edits until it is about to expire.
+ 	* The actual edit commands are in google_source_edit_send
 	 */
+	g_get_current_time (&now);
+	if (gsource->editToken &&
+	    now.tv_sec - gsource->editTokenTime.tv_sec < GOOGLE_READER_TOKEN_LIFETIME) {
+		google_source_edit_send (gsource, FALSE);
+		return;
+	}
+
+	g_free (gsource->editToken);
+	gsource->editToken = NULL;
+
 	request = update_request_new ();
 	request->updateState = update_state_copy (gsource->root->subscription->updateState);
 	request->options = update_options_copy (gsource->root->subscription->updateOptions);
-	request->source = g_strdup (GOOGLE_READER_TOKEN_URL);
+	request->source = google_source_get_api_url (GOOGLE_READER_TOKEN_URL);
 	update_request_set_auth_value(request, gsource->authHeaderValue);
 
+	gsource->editInProgress = TRUE;
 	update_execute_request (gsource, request, google_source_edit_token_cb, 
 	                        g_strdup(gsource->root->id), 0);
 }
@@ -332,6 +492,11 @@ google_source_edit_push_ (GoogleSourcePtr gsource, GoogleSourceActionPtr action,
 	g_assert (gsource->actionQueue);
 	if (head) g_queue_push_head (gsource->actionQueue, action);
 	else      g_queue_push_tail (gsource->actionQueue, action);
+
+	if (action->guid) {
+		guint count = GPOINTER_TO_UINT (g_hash_table_lookup (gsource->editGuids, action->guid));
+		g_hash_table_insert (gsource->editGuids, g_strdup (action->guid), GUINT_TO_POINTER (count + 1));
+	}
 }
 
 static void 
@@ -475,12 +640,5 @@ void google_source_edit_remove_subscription (GoogleSourcePtr gsource, const gcha
 
 gboolean google_source_edit_is_in_queue (GoogleSourcePtr gsource, const gchar* guid) 
 {
-	/* this is inefficient, but works for the time being */
-	GList *cur = gsource->actionQueue->head; 
-	for(; cur; cur = g_list_next (cur)) { 
-		GoogleSourceActionPtr action = cur->data; 
-		if (action->guid && g_str_equal (action->guid, guid))
-			return TRUE;
-	}
-	return FALSE;
+	return NULL != g_hash_table_lookup (gsource->editGuids, guid);
 }
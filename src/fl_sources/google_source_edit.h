@@ -73,7 +73,7 @@ void google_source_edit_remove_subscription (GoogleSourcePtr gsource, const gcha
 
 /**
  * See if an item with give guid is being modified 
- * in the queue.
+ * in the queue (queued or currently being sent).
  *
  * @param GoogleSource the GoogleSource structure
  * @param guid the guid of the item
@@ -63,13 +63,13 @@ google_source_migrate_node(nodePtr node)
 {
 	/* scan the node for bad ID's, if so, brutally remove the node */
 	itemSetPtr itemset = node_get_itemset (node);
-	GList *iter = itemset->ids;
-	for (; iter; iter = g_list_next (iter)) {
-		itemPtr item = item_load (GPOINTER_TO_UINT (iter->data));
+	guint i;
+	for (i = 0; i < itemset_get_length (itemset); i++) {
+		itemPtr item = item_load (itemset_get_id (itemset, i));
 		if (item && item->sourceId) {
 			if (!g_str_has_prefix(item->sourceId, "tag:google.com")) {
 				debug1(DEBUG_UPDATE, "Item with sourceId [%s] will be deleted.", item->sourceId);
-				db_item_remove(GPOINTER_TO_UINT(iter->data));
+				db_item_remove(itemset_get_id (itemset, i));
 			} 
 		}
 		if (item) item_unload (item);
@@ -161,19 +161,16 @@ google_source_load_item_from_sourceid (nodePtr node, gchar *sourceId, GHashTable
 {
 	gpointer    ret = g_hash_table_lookup (cache, sourceId);
 	itemSetPtr  itemset;
-	int         num = g_hash_table_size (cache);
-	GList       *iter; 
+	guint       i = g_hash_table_size (cache);
 	itemPtr     item = NULL;
 
 	if (ret) return item_load (GPOINTER_TO_UINT (ret));
 
 	/* skip the top 'num' entries */
 	itemset = node_get_itemset (node);
-	iter = itemset->ids;
-	while (num--) iter = g_list_next (iter);
 
-	for (; iter; iter = g_list_next (iter)) {
-		item = item_load (GPOINTER_TO_UINT (iter->data));
+	for (; i < itemset_get_length (itemset); i++) {
+		item = item_load (itemset_get_id (itemset, i));
 		if (item && item->sourceId) {
 			/* save to cache */
 			g_hash_table_insert (cache, g_strdup(item->sourceId), (gpointer) item->id);
@@ -342,9 +339,15 @@ google_feed_subscription_prepare_update_request (subscriptionPtr subscription,
 	if (!g_str_equal (request->source, GOOGLE_READER_BROADCAST_FRIENDS_URL)) { 
 		gchar* source_escaped = g_uri_escape_string(request->source, NULL, TRUE);
 		gchar* newUrl = g_strdup_printf ("http://www.google.com/reader/atom/feed/%s", source_escaped);
-		update_request_set_source (request, newUrl);
+		gchar* apiUrl = google_source_get_api_url (newUrl);
+		update_request_set_source (request, apiUrl);
+		g_free (apiUrl);
 		g_free (newUrl);
 		g_free (source_escaped);
+	} else {
+		gchar* apiUrl = google_source_get_api_url (request->source);
+		update_request_set_source (request, apiUrl);
+		g_free (apiUrl);
 	}
 	update_request_set_auth_value (request, gsource->authHeaderValue);
 	return TRUE;
@@ -33,6 +33,7 @@
 #include "subscription.h"
 #include "xml.h"
 
+#include "fl_sources/opml_merge.h"
 #include "fl_sources/opml_source.h"
 #include "fl_sources/google_source.h"
 #include "fl_sources/google_source_edit.h"
@@ -93,70 +94,86 @@ google_source_add_broadcast_subscription (GoogleSourcePtr gsource)
 /* subscription list merging functions */
 
 static void
-google_source_check_for_removal (nodePtr node, gpointer user_data)
+google_source_index_subscription (xmlNodePtr match, gpointer user_data)
 {
-	gchar		*expr = NULL;
-
-	if (g_str_equal (node->subscription->source, GOOGLE_READER_BROADCAST_FRIENDS_URL)) 
-		return ; 
-
-	if (IS_FEED (node)) {
-		expr = g_strdup_printf ("/object/list[@name='subscriptions']/object/string[@name='id'][. = 'feed/%s']", node->subscription->source);
-	} else {
-		g_warning ("opml_source_check_for_removal(): This should never happen...");
-		return;
-	}
-	
-	if (!xpath_find ((xmlNodePtr)user_data, expr)) {
-		debug1 (DEBUG_UPDATE, "removing %s...", node_get_title (node));
-		feedlist_node_removed (node);
-	} else {
-		debug1 (DEBUG_UPDATE, "keeping %s...", node_get_title (node));
-	}
-	g_free (expr);
-}
-
-
-static void
-google_source_merge_feed (xmlNodePtr match, gpointer user_data)
-{
-	GoogleSourcePtr	gsource = (GoogleSourcePtr)user_data;
-	nodePtr		node;
-	GSList		*iter;
-	xmlNodePtr	xml;
-	xmlChar		*title = NULL, *id = NULL;
-	gchar           *url = NULL;
+	opmlMergeIndexPtr	index = (opmlMergeIndexPtr)user_data;
+	xmlNodePtr		xml;
+	xmlChar			*title = NULL, *id = NULL;
 
 	xml = xpath_find (match, "./string[@name='title']");
 	if (xml)
 		title = xmlNodeListGetString (xml->doc, xml->xmlChildrenNode, 1);
 		
 	xml = xpath_find (match, "./string[@name='id']");
-	if (xml) {
+	if (xml)
 		id = xmlNodeListGetString (xml->doc, xml->xmlChildrenNode, 1);
-		url = g_strdup(id + strlen ("feed/"));
-	}
 
 	/* Note: ids look like "feed/http://rss.slashdot.org" */
-	if (id && title) {	
-
-		/* check if node to be merged already exists */
-		iter = gsource->root->children;
-		while (iter) {
-			node = (nodePtr)iter->data;
-			if (g_str_equal (node->subscription->source, url)) {
-				node->subscription->type = &googleSourceFeedSubscriptionType;
-				goto cleanup ;
-			}
-			iter = g_slist_next (iter);
+	if (id && title && g_str_has_prefix (id, "feed/")) {
+		if (!g_hash_table_lookup (index->feeds, id + strlen ("feed/")))
+			opml_merge_index_add_feed (index, "", id + strlen ("feed/"), title, NULL);
+	} else 
+		g_warning("Unable to parse subscription information from Google");
+
+	if (id)
+		xmlFree (id);
+	if (title)
+		xmlFree (title);
+}
+
+/* Adds all subscriptions of the Google Reader subscription list that
+   are not yet in the feed list and removes those that were removed. */
+static void
+google_source_merge (GoogleSourcePtr gsource, xmlNodePtr root)
+{
+	opmlMergeIndexPtr	oldIndex, newIndex;
+	opmlMergeDiffPtr	diff;
+	GSList			*iter;
+
+	oldIndex = opml_merge_index_new ();
+	for (iter = gsource->root->children; iter; iter = g_slist_next (iter)) {
+		nodePtr node = (nodePtr)iter->data;
+
+		if (!IS_FEED (node)) {
+			g_warning ("google_source_merge(): This should never happen...");
+			continue;
 		}
-	
-		debug2 (DEBUG_UPDATE, "adding %s (%s)", title, url);
+		if (g_str_equal (node->subscription->source, GOOGLE_READER_BROADCAST_FRIENDS_URL))
+			continue;
+		opml_merge_index_add_feed (oldIndex, "", node->subscription->source, node_get_title (node), node);
+	}
+
+	newIndex = opml_merge_index_new ();
+	xpath_foreach_match (root, "/object/list[@name='subscriptions']/object",
+	                     google_source_index_subscription,
+	                     (gpointer)newIndex);
+
+	diff = opml_merge_diff (oldIndex, newIndex);
+
+	for (iter = diff->removed; iter; iter = g_slist_next (iter)) {
+		opmlMergeEntryPtr entry = (opmlMergeEntryPtr)iter->data;
+
+		debug1 (DEBUG_UPDATE, "removing %s...", entry->title);
+		feedlist_node_removed ((nodePtr)entry->data);
+	}
+
+	node_foreach_child (gsource->root, google_source_migrate_node);
+
+	for (iter = diff->kept; iter; iter = g_slist_next (iter)) {
+		nodePtr node = (nodePtr)((opmlMergeEntryPtr)iter->data)->data;
+		node->subscription->type = &googleSourceFeedSubscriptionType;
+	}
+
+	for (iter = diff->added; iter; iter = g_slist_next (iter)) {
+		opmlMergeEntryPtr	entry = (opmlMergeEntryPtr)iter->data;
+		nodePtr			node;
+
+		debug2 (DEBUG_UPDATE, "adding %s (%s)", entry->title, entry->url);
 		node = node_new (feed_get_node_type ());
-		node_set_title (node, title);
+		node_set_title (node, entry->title);
 		node_set_data (node, feed_new ());
 		
-		node_set_subscription (node, subscription_new (url, NULL, NULL));
+		node_set_subscription (node, subscription_new (entry->url, NULL, NULL));
 		node->subscription->type = &googleSourceFeedSubscriptionType;
 		node_set_parent (node, gsource->root, -1);
 		feedlist_node_imported (node);
@@ -168,15 +185,11 @@ google_source_merge_feed (xmlNodePtr match, gpointer user_data)
 		 */
 		subscription_update (node->subscription, FEED_REQ_RESET_TITLE | FEED_REQ_PRIORITY_HIGH);
 		subscription_update_favicon (node->subscription);
-	} else 
-		g_warning("Unable to parse subscription information from Google");
+	}
 
-cleanup:
-	if (id)
-		xmlFree (id);
-	if (title)
-		xmlFree (title);
-	g_free (url) ;
+	opml_merge_diff_free (diff);
+	opml_merge_index_free (newIndex);
+	opml_merge_index_free (oldIndex);
 }
 
 
@@ -192,19 +205,7 @@ google_subscription_opml_cb (subscriptionPtr subscription, const struct updateRe
 		if(doc) {		
 			xmlNodePtr root = xmlDocGetRootElement (doc);
 			
-			/* Go through all existing nodes and remove those whose
-			   URLs are not in new feed list. Also removes those URLs
-			   from the list that have corresponding existing nodes. */
-			node_foreach_child_data (subscription->node, google_source_check_for_removal, (gpointer)root);
-			node_foreach_child (subscription->node, google_source_migrate_node);
-						
-			opml_source_export (subscription->node);	/* save new feed list tree to disk 
-									   to ensure correct document in 
-									   next step */
-
-			xpath_foreach_match (root, "/object/list[@name='subscriptions']/object",
-			                     google_source_merge_feed,
-			                     (gpointer)gsource);
+			google_source_merge (gsource, root);
 			google_source_add_broadcast_subscription (gsource) ;
 
 			opml_source_export (subscription->node);	/* save new feeds to feed list */
@@ -303,10 +304,12 @@ gboolean
 google_source_quick_update(GoogleSourcePtr gsource) 
 {
 	updateRequestPtr request = update_request_new ();
+	gchar *url = google_source_get_api_url (GOOGLE_READER_UNREAD_COUNTS_URL);
 	request->updateState = update_state_copy (gsource->root->subscription->updateState);
 	request->options = update_options_copy (gsource->root->subscription->updateOptions);
-	update_request_set_source (request, GOOGLE_READER_UNREAD_COUNTS_URL);
+	update_request_set_source (request, url);
 	update_request_set_auth_value(request, gsource->authHeaderValue);
+	g_free (url);
 
 	update_execute_request (gsource, request, google_source_quick_update_cb,
 				gsource, 0);
@@ -325,6 +328,7 @@ static gboolean
 google_opml_subscription_prepare_update_request (subscriptionPtr subscription, struct updateRequest *request)
 {
 	GoogleSourcePtr	gsource = (GoogleSourcePtr)subscription->node->data;
+	gchar		*url;
 	
 	g_assert(gsource);
 	if (gsource->loginState == GOOGLE_SOURCE_STATE_NONE) {
@@ -334,7 +338,9 @@ google_opml_subscription_prepare_update_request (subscriptionPtr subscription, s
 	}
 	debug1 (DEBUG_UPDATE, "updating Google Reader subscription (node id %s)", subscription->node->id);
 	
-	update_request_set_source (request, GOOGLE_READER_SUBSCRIPTION_LIST_URL);
+	url = google_source_get_api_url (GOOGLE_READER_SUBSCRIPTION_LIST_URL);
+	update_request_set_source (request, url);
+	g_free (url);
 	
 	update_request_set_auth_value (request, gsource->authHeaderValue);
 	
@@ -32,6 +32,7 @@
 #include "item_state.h"
 #include "node.h"
 #include "node_type.h"
+#include "ui_observer.h"
 #include "ui/icons.h"
 #include "ui/liferea_dialog.h"
 #include "ui/ui_common.h"
@@ -357,7 +358,7 @@ node_source_remove (nodePtr node)
 	if (NULL != NODE_SOURCE_TYPE (node)->source_delete)
 		NODE_SOURCE_TYPE (node)->source_delete (node);
 		
-	ui_node_remove_node (node);
+	ui_observer_node_removed (node);
 }
 
 static void
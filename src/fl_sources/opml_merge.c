@@ -0,0 +1,218 @@
+/**
+ * @file opml_merge.c  subscription list diffing for feed list sources
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "fl_sources/opml_merge.h"
+
+#include <string.h>
+
+/* Folder titles are joined with a character that cannot
+   be part of an XML attribute value to build folder paths */
+#define OPML_MERGE_PATH_SEPARATOR "\x01"
+
+opmlMergeIndexPtr
+opml_merge_index_new (void)
+{
+	opmlMergeIndexPtr index = g_new0 (struct opmlMergeIndex, 1);
+
+	index->feeds = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify)g_slist_free);
+	index->folders = g_hash_table_new (g_str_hash, g_str_equal);
+
+	return index;
+}
+
+static void
+opml_merge_entry_free (opmlMergeEntryPtr entry)
+{
+	if (entry->key != entry->url)
+		g_free (entry->key);
+	g_free (entry->url);
+	g_free (entry->title);
+	g_free (entry->path);
+	g_free (entry);
+}
+
+void
+opml_merge_index_free (opmlMergeIndexPtr index)
+{
+	g_hash_table_destroy (index->feeds);
+	g_hash_table_destroy (index->folders);
+	g_slist_foreach (index->entries, (GFunc)opml_merge_entry_free, NULL);
+	g_slist_free (index->entries);
+	g_free (index);
+}
+
+gchar *
+opml_merge_folder_path (const gchar *path, const gchar *title)
+{
+	if (!path || !*path)
+		return g_strdup (title);
+
+	return g_strconcat (path, OPML_MERGE_PATH_SEPARATOR, title, NULL);
+}
+
+opmlMergeEntryPtr
+opml_merge_index_add_feed (opmlMergeIndexPtr index, const gchar *path, const gchar *url, const gchar *title, gpointer data)
+{
+	opmlMergeEntryPtr	entry;
+	GSList			*list;
+
+	entry = g_new0 (struct opmlMergeEntry, 1);
+	entry->url = g_strdup (url);
+	entry->key = entry->url;
+	entry->title = g_strdup (title);
+	entry->path = g_strdup (path);
+	entry->data = data;
+	index->entries = g_slist_prepend (index->entries, entry);
+
+	/* Keep duplicate URLs in document order. Appending is fine as
+	   duplicates are rare. */
+	list = g_hash_table_lookup (index->feeds, entry->url);
+	if (list) {
+		g_hash_table_steal (index->feeds, entry->url);
+		list = g_slist_append (list, entry);
+	} else {
+		list = g_slist_prepend (NULL, entry);
+	}
+	g_hash_table_insert (index->feeds, ((opmlMergeEntryPtr)list->data)->url, list);
+
+	return entry;
+}
+
+opmlMergeEntryPtr
+opml_merge_index_add_folder (opmlMergeIndexPtr index, const gchar *path, const gchar *title, gpointer data)
+{
+	opmlMergeEntryPtr	entry;
+	gchar			*key;
+
+	key = opml_merge_folder_path (path, title);
+	entry = g_hash_table_lookup (index->folders, key);
+	if (entry) {
+		g_free (key);
+		return entry;
+	}
+
+	entry = g_new0 (struct opmlMergeEntry, 1);
+	entry->key = key;
+	entry->title = g_strdup (title);
+	entry->path = g_strdup (path);
+	entry->data = data;
+	index->entries = g_slist_prepend (index->entries, entry);
+	g_hash_table_insert (index->folders, entry->key, entry);
+
+	return entry;
+}
+
+void
+opml_merge_index_add_outlines (opmlMergeIndexPtr index, const gchar *path, xmlNodePtr parent)
+{
+	xmlNodePtr	cur;
+
+	for (cur = parent->children; cur; cur = cur->next) {
+		xmlChar	*url, *title;
+
+		if (cur->type != XML_ELEMENT_NODE || !xmlStrEqual (cur->name, BAD_CAST "outline"))
+			continue;
+
+		url = xmlGetProp (cur, BAD_CAST "xmlUrl");
+		title = xmlGetProp (cur, BAD_CAST "title");
+		if (!title)
+			title = xmlGetProp (cur, BAD_CAST "description");
+		if (!title)
+			title = xmlGetProp (cur, BAD_CAST "text");
+
+		if (url) {
+			opml_merge_index_add_feed (index, path, (gchar *)url, (gchar *)title, cur);
+		} else if (title) {
+			opmlMergeEntryPtr folder = opml_merge_index_add_folder (index, path, (gchar *)title, cur);
+			opml_merge_index_add_outlines (index, folder->key, cur);
+		}
+
+		xmlFree (url);
+		xmlFree (title);
+	}
+}
+
+opmlMergeDiffPtr
+opml_merge_diff (opmlMergeIndexPtr oldIndex, opmlMergeIndexPtr newIndex)
+{
+	opmlMergeDiffPtr	diff = g_new0 (struct opmlMergeDiff, 1);
+	GHashTable		*unmatched;
+	GSList			*iter;
+
+	/* URL -> list of new feed entries not yet matched */
+	unmatched = g_hash_table_new (g_str_hash, g_str_equal);
+
+	/* Match old entries in document order (the entry list is in
+	   reverse order). Removals are collected in reverse document
+	   order which removes children before their parent folders. */
+	iter = g_slist_reverse (g_slist_copy (oldIndex->entries));
+	for (; iter; iter = g_slist_delete_link (iter, iter)) {
+		opmlMergeEntryPtr entry = (opmlMergeEntryPtr)iter->data;
+
+		if (entry->url) {
+			GSList *list;
+
+			if (!g_hash_table_lookup_extended (unmatched, entry->url, NULL, (gpointer *)&list))
+				list = g_hash_table_lookup (newIndex->feeds, entry->url);
+
+			if (list) {
+				entry->match = (opmlMergeEntryPtr)list->data;
+				entry->match->match = entry;
+				g_hash_table_insert (unmatched, entry->url, g_slist_next (list));
+			}
+		} else {
+			entry->match = g_hash_table_lookup (newIndex->folders, entry->key);
+			if (entry->match)
+				entry->match->match = entry;
+		}
+
+		if (!entry->match)
+			diff->removed = g_slist_prepend (diff->removed, entry);
+		else if (entry->url && !g_str_equal (entry->path, entry->match->path))
+			diff->moved = g_slist_prepend (diff->moved, entry);
+		else
+			diff->kept = g_slist_prepend (diff->kept, entry);
+	}
+	g_hash_table_destroy (unmatched);
+
+	/* prepending restores document order for the additions, which
+	   adds parent folders before their children */
+	for (iter = newIndex->entries; iter; iter = g_slist_next (iter)) {
+		opmlMergeEntryPtr entry = (opmlMergeEntryPtr)iter->data;
+
+		if (!entry->match)
+			diff->added = g_slist_prepend (diff->added, entry);
+	}
+
+	diff->moved = g_slist_reverse (diff->moved);
+	diff->kept = g_slist_reverse (diff->kept);
+
+	return diff;
+}
+
+void
+opml_merge_diff_free (opmlMergeDiffPtr diff)
+{
+	g_slist_free (diff->added);
+	g_slist_free (diff->removed);
+	g_slist_free (diff->moved);
+	g_slist_free (diff->kept);
+	g_free (diff);
+}
@@ -0,0 +1,136 @@
+/**
+ * @file opml_merge.h  subscription list diffing for feed list sources
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _OPML_MERGE_H
+#define _OPML_MERGE_H
+
+#include <glib.h>
+#include <libxml/tree.h>
+
+/* Remote subscription lists (OPML sources, Google Reader) are merged
+   into the local feed list by indexing both the local and the remote
+   list once and computing the difference. Feeds are identified by
+   their URL, folders by their folder title path. The merge is linear
+   in the size of both lists. */
+
+/** a feed or folder of a subscription list */
+typedef struct opmlMergeEntry {
+	gchar		*url;		/**< feed URL (NULL for folders) */
+	gchar		*title;		/**< feed or folder title */
+	gchar		*path;		/**< folder path of the parent folder ("" for top level) */
+	gchar		*key;		/**< folder path of a folder, URL of a feed */
+	gpointer	data;		/**< user data (e.g. the feed list node) */
+	struct opmlMergeEntry *match;	/**< the matching entry of the other list (or NULL) */
+} *opmlMergeEntryPtr;
+
+/** an indexed subscription list */
+typedef struct opmlMergeIndex {
+	GSList		*entries;	/**< all entries in reverse document order */
+	GHashTable	*feeds;		/**< URL -> GSList of opmlMergeEntryPtr in document order */
+	GHashTable	*folders;	/**< folder path -> opmlMergeEntryPtr */
+} *opmlMergeIndexPtr;
+
+/** the difference between two subscription lists */
+typedef struct opmlMergeDiff {
+	GSList		*added;		/**< new entries to add, parents before children */
+	GSList		*removed;	/**< old entries to remove, children before parents */
+	GSList		*moved;		/**< old feed entries whose folder changed */
+	GSList		*kept;		/**< old entries that are still in the new list */
+} *opmlMergeDiffPtr;
+
+/**
+ * Creates a new empty subscription list index.
+ *
+ * @returns new index
+ */
+opmlMergeIndexPtr opml_merge_index_new (void);
+
+/**
+ * Frees the given index and all its entries.
+ *
+ * @param index		the index
+ */
+void opml_merge_index_free (opmlMergeIndexPtr index);
+
+/**
+ * Adds a feed to the index.
+ *
+ * @param index		the index
+ * @param path		folder path of the parent folder ("" for top level)
+ * @param url		the feed URL
+ * @param title		the feed title (or NULL)
+ * @param data		user data
+ *
+ * @returns the new entry
+ */
+opmlMergeEntryPtr opml_merge_index_add_feed (opmlMergeIndexPtr index, const gchar *path, const gchar *url, const gchar *title, gpointer data);
+
+/**
+ * Adds a folder to the index. If a folder with the same
+ * path exists already, nothing is added.
+ *
+ * @param index		the index
+ * @param path		folder path of the parent folder ("" for top level)
+ * @param title		the folder title
+ * @param data		user data
+ *
+ * @returns the folder entry
+ */
+opmlMergeEntryPtr opml_merge_index_add_folder (opmlMergeIndexPtr index, const gchar *path, const gchar *title, gpointer data);
+
+/**
+ * Builds the folder path of a folder.
+ *
+ * @param path		folder path of the parent folder ("" for top level)
+ * @param title		the folder title
+ *
+ * @returns new folder path (to be free'd using g_free())
+ */
+gchar * opml_merge_folder_path (const gchar *path, const gchar *title);
+
+/**
+ * Adds all outlines found below the given OPML element
+ * (usually the OPML body) to the index.
+ *
+ * @param index		the index
+ * @param path		folder path of the element ("" for the body)
+ * @param parent	the element
+ */
+void opml_merge_index_add_outlines (opmlMergeIndexPtr index, const gchar *path, xmlNodePtr parent);
+
+/**
+ * Compares an old and a new subscription list. Matching
+ * entries of both lists are linked using the match field.
+ *
+ * @param oldIndex	index of the current subscription list
+ * @param newIndex	index of the new subscription list
+ *
+ * @returns new diff (to be free'd using opml_merge_diff_free())
+ */
+opmlMergeDiffPtr opml_merge_diff (opmlMergeIndexPtr oldIndex, opmlMergeIndexPtr newIndex);
+
+/**
+ * Frees the given diff. The entries are owned by the indices.
+ *
+ * @param diff		the diff
+ */
+void opml_merge_diff_free (opmlMergeDiffPtr diff);
+
+#endif
@@ -31,6 +31,7 @@
 #include "folder.h"
 #include "node.h"
 #include "xml.h"
+#include "fl_sources/opml_merge.h"
 #include "ui/icons.h"
 #include "ui/liferea_dialog.h"
 
@@ -39,103 +40,102 @@
 
 /* OPML subscription list helper functions */
 
-typedef struct mergeCtxt {
-	nodePtr		rootNode;	/**< root node of the OPML feed list source */
-	nodePtr		parent;		/**< currently processed feed list node */
-	xmlNodePtr	xmlNode;	/**< currently processed XML node of old OPML doc */
-} *mergeCtxtPtr;
+static void
+opml_source_index_nodes (opmlMergeIndexPtr index, const gchar *path, nodePtr parent)
+{
+	GSList	*iter;
+
+	for (iter = parent->children; iter; iter = g_slist_next (iter)) {
+		nodePtr node = (nodePtr)iter->data;
+
+		if (IS_FEED (node)) {
+			opml_merge_index_add_feed (index, path, subscription_get_source (node->subscription), node_get_title (node), node);
+		} else if (IS_FOLDER (node)) {
+			opmlMergeEntryPtr folder = opml_merge_index_add_folder (index, path, node_get_title (node), node);
+			opml_source_index_nodes (index, folder->key, node);
+		} else {
+			g_warning ("opml_source_index_nodes(): This should never happen...");
+		}
+	}
+}
 
+/* Applies the difference between the current feed list of the OPML
+   source and the downloaded OPML document: new feeds and folders are
+   added, feeds whose folder changed are moved and feeds and folders
+   no longer listed are removed. */
 static void
-opml_source_merge_feed (xmlNodePtr match, gpointer user_data)
+opml_source_merge (nodePtr root, xmlNodePtr body)
 {
-	mergeCtxtPtr	mergeCtxt = (mergeCtxtPtr)user_data;
-	xmlChar		*url, *title;
-	gchar		*expr;
-	nodePtr		node = NULL;
-
-	url = xmlGetProp (match, "xmlUrl");
-	title = xmlGetProp (match, "title");
-	if (!title)
-		title = xmlGetProp (match, "description");
-	if (!title)
-		title = xmlGetProp (match, "text");
-	if (!title && !url)
-		return;
-		
-	if (url)
-		expr = g_strdup_printf ("//outline[@xmlUrl = '%s']", url);
-	else			
-		expr = g_strdup_printf ("//outline[@title = '%s']", title);
-
-	if (!xpath_find (mergeCtxt->xmlNode, expr)) {
-		debug2(DEBUG_UPDATE, "adding %s (%s)", title, url);
-		if (url) {
+	opmlMergeIndexPtr	oldIndex, newIndex;
+	opmlMergeDiffPtr	diff;
+	GHashTable		*folders;
+	GSList			*iter;
+
+	oldIndex = opml_merge_index_new ();
+	opml_source_index_nodes (oldIndex, "", root);
+	newIndex = opml_merge_index_new ();
+	opml_merge_index_add_outlines (newIndex, "", body);
+
+	diff = opml_merge_diff (oldIndex, newIndex);
+	debug4 (DEBUG_UPDATE, "OPML merge: %d added, %d moved, %d removed, %d kept",
+	        g_slist_length (diff->added), g_slist_length (diff->moved),
+	        g_slist_length (diff->removed), g_slist_length (diff->kept));
+
+	/* folder path -> folder node */
+	folders = g_hash_table_new (g_str_hash, g_str_equal);
+	g_hash_table_insert (folders, "", root);
+	for (iter = diff->kept; iter; iter = g_slist_next (iter)) {
+		opmlMergeEntryPtr entry = (opmlMergeEntryPtr)iter->data;
+		if (!entry->url)
+			g_hash_table_insert (folders, entry->match->key, entry->data);
+	}
+
+	for (iter = diff->added; iter; iter = g_slist_next (iter)) {
+		opmlMergeEntryPtr	entry = (opmlMergeEntryPtr)iter->data;
+		nodePtr			node, parent;
+
+		parent = g_hash_table_lookup (folders, entry->path);
+		g_assert (parent);
+
+		debug2 (DEBUG_UPDATE, "adding %s (%s)", entry->title, entry->url);
+		if (entry->url) {
 			node = node_new (feed_get_node_type ());
 			node_set_data (node, feed_new ());
-			node_set_subscription (node, subscription_new (url, NULL, NULL));
+			node_set_subscription (node, subscription_new (entry->url, NULL, NULL));
 		} else {
 			node = node_new (folder_get_node_type ());
+			g_hash_table_insert (folders, entry->key, node);
 		}
-		node_set_title (node, title);
-		node_set_parent (node, mergeCtxt->rootNode, -1);
+		node_set_title (node, entry->title);
+		node_set_parent (node, parent, -1);
 		feedlist_node_imported (node);
-		
-		subscription_update (node->subscription, FEED_REQ_RESET_TITLE | FEED_REQ_PRIORITY_HIGH);
-	}		
-	
-	/* Recursion if this is a folder */
-	if (!url) {
-		if (!node) {
-			/* if the folder node wasn't created above it
-			   must already exist and we search it in the 
-			   parents children list */
-			GSList	*iter = mergeCtxt->parent->children;
-			while (iter) {
-				if (g_str_equal (title, node_get_title (iter->data)))
-					node = iter->data;
-				iter = g_slist_next (iter);
-			}
-		}
-		
-		if (node) {
-			mergeCtxtPtr mc = g_new0 (struct mergeCtxt, 1);
-			mc->rootNode = mergeCtxt->rootNode;
-			mc->parent = node;
-			mc->xmlNode = mergeCtxt->xmlNode;	// FIXME: must be correct child!
-			xpath_foreach_match (match, "./outline", opml_source_merge_feed, (gpointer)mc);
-			g_free (mc);
-		} else {
-			g_warning ("opml_source_merge_feed(): bad! bad! very bad!");
-		}
-	}
 
-	g_free (expr);
-	xmlFree (title);
-	xmlFree (url);
-}
+		if (node->subscription)
+			subscription_update (node->subscription, FEED_REQ_RESET_TITLE | FEED_REQ_PRIORITY_HIGH);
+	}
 
-static void
-opml_source_check_for_removal (nodePtr node, gpointer user_data)
-{
-	gchar		*expr = NULL;
+	for (iter = diff->moved; iter; iter = g_slist_next (iter)) {
+		opmlMergeEntryPtr	entry = (opmlMergeEntryPtr)iter->data;
+		nodePtr			node = (nodePtr)entry->data;
 
-	if (IS_FEED (node)) {
-		expr = g_strdup_printf ("//outline[ @xmlUrl='%s' ]", subscription_get_source (node->subscription));
-	} else if (IS_FOLDER (node)) {
-		node_foreach_child_data (node, opml_source_check_for_removal, user_data);
-		expr = g_strdup_printf ("//outline[ (@title='%s') or (@text='%s') or (@description='%s')]", node->title, node->title, node->title);
-	} else {
-		g_warning ("opml_source_check_for_removal(): This should never happen...");
-		return;
+		debug1 (DEBUG_UPDATE, "moving %s...", node_get_title (node));
+		feedlist_move_node (node, g_hash_table_lookup (folders, entry->match->path), -1);
 	}
-	
-	if (!xpath_find ((xmlNodePtr)user_data, expr)) {
-		debug1 (DEBUG_UPDATE, "removing %s...", node_get_title (node));
-		feedlist_node_removed (node);
-	} else {
-		debug1 (DEBUG_UPDATE, "keeping %s...", node_get_title (node));
+
+	for (iter = diff->removed; iter; iter = g_slist_next (iter)) {
+		opmlMergeEntryPtr entry = (opmlMergeEntryPtr)iter->data;
+
+		debug1 (DEBUG_UPDATE, "removing %s...", entry->title);
+		feedlist_node_removed ((nodePtr)entry->data);
 	}
-	g_free (expr);
+
+	if (diff->added || diff->moved || diff->removed)
+		feedlist_schedule_save ();
+
+	g_hash_table_destroy (folders);
+	opml_merge_diff_free (diff);
+	opml_merge_index_free (newIndex);
+	opml_merge_index_free (oldIndex);
 }
 
 /* OPML subscription type implementation */
@@ -151,9 +151,8 @@ static void
 opml_subscription_process_update_result (subscriptionPtr subscription, const struct updateResult * const result, updateFlags flags)
 {
 	nodePtr		node = subscription->node;
-	mergeCtxtPtr	mergeCtxt;
-	xmlDocPtr	doc, oldDoc;
-	xmlNodePtr	root, title;
+	xmlDocPtr	doc;
+	xmlNodePtr	root, title, body;
 	
 	debug1 (DEBUG_UPDATE, "OPML download finished data=%d", result->data);
 
@@ -162,29 +161,8 @@ opml_subscription_process_update_result (subscriptionPtr subscription, const str
 	if (result->data) {
 		doc = xml_parse (result->data, result->size, NULL);
 		if (doc) {
-			gchar *filename;
-			
 			root = xmlDocGetRootElement (doc);
 			
-			/* Go through all existing nodes and remove those whose
-			   URLs are not in new feed list. Also removes those URLs
-			   from the list that have corresponding existing nodes. */
-			node_foreach_child_data (node, opml_source_check_for_removal, (gpointer)root);
-						
-			opml_source_export (node);	/* save new feed list tree to disk 
-			                                   to ensure correct document in 
-							   next step */
-			
-			/* Merge up-to-date OPML feed list. */
-			filename = opml_source_get_feedlist (node);
-			oldDoc = xmlParseFile (filename);
-			g_free (filename);
-			
-			mergeCtxt = g_new0 (struct mergeCtxt, 1);
-			mergeCtxt->rootNode = node;
-			mergeCtxt->parent = node;
-			mergeCtxt->xmlNode = xmlDocGetRootElement (oldDoc);
-			
 			if (g_str_equal (node_get_title (node), OPML_SOURCE_DEFAULT_TITLE)) {
 				title = xpath_find (root, "/opml/head/title"); 
 				if (title) {
@@ -196,11 +174,10 @@ opml_subscription_process_update_result (subscriptionPtr subscription, const str
 				}
 			}
 			
-			xpath_foreach_match (root, "/opml/body/outline",
-			                     opml_source_merge_feed,
-			                     (gpointer)mergeCtxt);
-			g_free (mergeCtxt);
-			xmlFreeDoc (oldDoc);			
+			/* Merge up-to-date OPML feed list. */
+			body = xpath_find (root, "/opml/body");
+			if (body)
+				opml_source_merge (node, body);
 			xmlFreeDoc (doc);
 			
 			opml_source_export (node);	/* save new feed list tree to disk */
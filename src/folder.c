@@ -44,8 +44,7 @@ folder_merge_child_items (nodePtr node, gpointer user_data)
 	itemSetPtr	nodeItemSet;
 
 	nodeItemSet = node_get_itemset (node);
-	folderItemSet->ids = g_list_concat (folderItemSet->ids, nodeItemSet->ids);
-	nodeItemSet->ids = NULL;
+	itemset_union (folderItemSet, nodeItemSet);
 	itemset_free (nodeItemSet);
 }
 
@@ -54,8 +53,7 @@ folder_load (nodePtr node)
 {
 	itemSetPtr	itemSet;
 	
-	itemSet = g_new0 (struct itemSet, 1);
-	itemSet->nodeId = node->id;
+	itemSet = itemset_new (node->id);
 
 	node_foreach_child_data (node, folder_merge_child_items, itemSet);
 	return itemSet;
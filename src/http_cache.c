@@ -0,0 +1,347 @@
+/**
+ * @file http_cache.c  persistent HTTP response cache
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "http_cache.h"
+
+#include <glib/gstdio.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "debug.h"
+
+#define HTTP_CACHE_DIR		"cache" G_DIR_SEPARATOR_S "http"
+#define HTTP_CACHE_GROUP	"entry"
+
+/* entries not stored or revalidated for this long are removed
+   (longer than the favicon update interval) */
+#define HTTP_CACHE_MAX_UNUSED	(60 * 24 * 60 * 60)
+
+/* larger bodies are not cached */
+#define HTTP_CACHE_MAX_BODY	(512 * 1024)
+
+/* Each entry consists of a key file "<md5 of URL>.meta" with
+   the URL, the validators, the expiry time and the body checksum
+   and an optional "<md5 of URL>.data" file with the body. */
+
+static gchar *
+http_cache_get_filename (const gchar *url, const gchar *extension)
+{
+	gchar	*id, *filename;
+
+	id = g_compute_checksum_for_string (G_CHECKSUM_MD5, url, -1);
+	filename = common_create_cache_filename (HTTP_CACHE_DIR, id, extension);
+	g_free (id);
+
+	return filename;
+}
+
+static GKeyFile *
+http_cache_load_meta (const gchar *url)
+{
+	GKeyFile	*meta;
+	gchar		*filename, *cachedUrl;
+
+	filename = http_cache_get_filename (url, "meta");
+	meta = g_key_file_new ();
+	if (!g_key_file_load_from_file (meta, filename, G_KEY_FILE_NONE, NULL)) {
+		g_key_file_free (meta);
+		g_free (filename);
+		return NULL;
+	}
+	g_free (filename);
+
+	/* paranoia check for checksum collisions */
+	cachedUrl = g_key_file_get_string (meta, HTTP_CACHE_GROUP, "url", NULL);
+	if (!cachedUrl || !g_str_equal (cachedUrl, url)) {
+		g_free (cachedUrl);
+		g_key_file_free (meta);
+		return NULL;
+	}
+	g_free (cachedUrl);
+
+	return meta;
+}
+
+static void
+http_cache_save_meta (const gchar *url, GKeyFile *meta)
+{
+	gchar	*filename, *data;
+	gsize	length;
+
+	filename = http_cache_get_filename (url, "meta");
+	data = g_key_file_to_data (meta, &length, NULL);
+	if (!g_file_set_contents (filename, data, length, NULL))
+		debug1 (DEBUG_CACHE, "could not write HTTP cache entry %s", filename);
+	g_free (data);
+	g_free (filename);
+}
+
+static glong
+http_cache_get_long (GKeyFile *meta, const gchar *key)
+{
+	gchar	*value;
+	glong	result;
+
+	value = g_key_file_get_string (meta, HTTP_CACHE_GROUP, key, NULL);
+	result = common_parse_long (value, 0);
+	g_free (value);
+
+	return result;
+}
+
+static void
+http_cache_set_long (GKeyFile *meta, const gchar *key, glong value)
+{
+	gchar	*tmp = g_strdup_printf ("%ld", value);
+
+	g_key_file_set_string (meta, HTTP_CACHE_GROUP, key, tmp);
+	g_free (tmp);
+}
+
+static void
+http_cache_remove (const gchar *url)
+{
+	gchar	*filename;
+
+	filename = http_cache_get_filename (url, "meta");
+	g_unlink (filename);
+	g_free (filename);
+
+	filename = http_cache_get_filename (url, "data");
+	g_unlink (filename);
+	g_free (filename);
+}
+
+/* Copies the cached body to the result. Returns FALSE if the
+   entry has a body that cannot be loaded. */
+static gboolean
+http_cache_load_body (const gchar *url, GKeyFile *meta, updateResultPtr result)
+{
+	gchar	*filename, *data;
+	gsize	length;
+
+	if (!g_key_file_has_key (meta, HTTP_CACHE_GROUP, "body-checksum", NULL))
+		return TRUE;	/* validators only */
+
+	filename = http_cache_get_filename (url, "data");
+	if (!g_file_get_contents (filename, &data, &length, NULL)) {
+		g_free (filename);
+		return FALSE;
+	}
+	g_free (filename);
+
+	g_free (result->data);
+	result->data = data;
+	result->size = length;
+
+	g_free (result->contentType);
+	result->contentType = g_key_file_get_string (meta, HTTP_CACHE_GROUP, "content-type", NULL);
+
+	return TRUE;
+}
+
+void
+http_cache_init (void)
+{
+	GDir		*dir;
+	const gchar	*name;
+	gchar		*path;
+	time_t		now = time (NULL);
+
+	path = common_create_cache_filename (HTTP_CACHE_DIR, "", NULL);
+	dir = g_dir_open (path, 0, NULL);
+	if (!dir) {
+		g_free (path);
+		return;
+	}
+
+	/* The .meta file is rewritten on every store and revalidation, so
+	   its age decides about the entry. The .data file goes with it,
+	   .data files without a .meta file are leftovers. */
+	while (NULL != (name = g_dir_read_name (dir))) {
+		struct stat	info;
+		gchar		*filename, *id, *other;
+
+		if (g_str_has_suffix (name, ".meta")) {
+			id = g_strndup (name, strlen (name) - strlen (".meta"));
+			other = g_strdup_printf ("%s" G_DIR_SEPARATOR_S "%s.data", path, id);
+		} else if (g_str_has_suffix (name, ".data")) {
+			id = g_strndup (name, strlen (name) - strlen (".data"));
+			other = g_strdup_printf ("%s" G_DIR_SEPARATOR_S "%s.meta", path, id);
+		} else {
+			continue;
+		}
+		filename = g_build_filename (path, name, NULL);
+
+		if (g_str_has_suffix (name, ".meta")) {
+			if (0 == g_stat (filename, &info) && info.st_mtime + HTTP_CACHE_MAX_UNUSED < now) {
+				debug1 (DEBUG_CACHE, "removing unused HTTP cache entry %s", id);
+				g_unlink (filename);
+				g_unlink (other);
+			}
+		} else if (!g_file_test (other, G_FILE_TEST_EXISTS)) {
+			debug1 (DEBUG_CACHE, "removing orphaned HTTP cache file %s", name);
+			g_unlink (filename);
+		}
+
+		g_free (filename);
+		g_free (other);
+		g_free (id);
+	}
+
+	g_dir_close (dir);
+	g_free (path);
+}
+
+gboolean
+http_cache_lookup (updateRequestPtr request, updateResultPtr result)
+{
+	GKeyFile	*meta;
+	gchar		*etag;
+	glong		lastModified;
+
+	meta = http_cache_load_meta (request->source);
+	if (!meta)
+		return FALSE;
+
+	if (http_cache_get_long (meta, "expires") > time (NULL)) {
+		if (http_cache_load_body (request->source, meta, result)) {
+			debug1 (DEBUG_CACHE, "using fresh HTTP cache entry for %s", request->source);
+			result->source = g_strdup (request->source);
+			result->httpstatus = 304;
+			result->cached = TRUE;
+			g_key_file_free (meta);
+			return TRUE;
+		}
+
+		/* The body is gone, so a revalidation would not help */
+		http_cache_remove (request->source);
+		g_key_file_free (meta);
+		return FALSE;
+	}
+
+	/* stale: let the server decide using the validators */
+	if (!request->updateState)
+		request->updateState = update_state_new ();
+
+	lastModified = http_cache_get_long (meta, "last-modified");
+	if (lastModified && !update_state_get_lastmodified (request->updateState))
+		update_state_set_lastmodified (request->updateState, lastModified);
+
+	etag = g_key_file_get_string (meta, HTTP_CACHE_GROUP, "etag", NULL);
+	if (etag && !update_state_get_etag (request->updateState))
+		update_state_set_etag (request->updateState, etag);
+	g_free (etag);
+
+	g_key_file_free (meta);
+	return FALSE;
+}
+
+gboolean
+http_cache_store (updateRequestPtr request, updateResultPtr result)
+{
+	GKeyFile	*meta;
+	gchar		*checksum = NULL, *oldChecksum = NULL, *filename;
+	const gchar	*etag = update_state_get_etag (result->updateState);
+	glong		lastModified = update_state_get_lastmodified (result->updateState);
+
+	if (result->cached || result->returncode)
+		return TRUE;
+
+	if (304 == result->httpstatus) {
+		meta = http_cache_load_meta (request->source);
+		if (!meta)
+			return TRUE;
+
+		/* a bodiless response comes with data "" (see net.c) */
+		if (0 == result->size && !http_cache_load_body (request->source, meta, result)) {
+			/* The body is gone, without it the answer is useless */
+			debug1 (DEBUG_CACHE, "HTTP cache entry for %s lost its body", request->source);
+			http_cache_remove (request->source);
+			g_key_file_free (meta);
+			return FALSE;
+		}
+
+		/* revalidated: renew freshness and validators, take the body from the cache */
+		debug1 (DEBUG_CACHE, "HTTP cache entry for %s is still valid", request->source);
+		http_cache_set_long (meta, "expires", MAX (result->expires, 0));
+		if (etag)
+			g_key_file_set_string (meta, HTTP_CACHE_GROUP, "etag", etag);
+		if (lastModified)
+			http_cache_set_long (meta, "last-modified", lastModified);
+		http_cache_save_meta (request->source, meta);
+
+		g_key_file_free (meta);
+		return TRUE;
+	}
+
+	/* Only successful responses that can be reused or
+	   revalidated later are worth to be kept */
+	if (200 != result->httpstatus ||
+	    result->expires < 0 ||
+	    (!etag && !lastModified && result->expires <= time (NULL)) ||
+	    (result->data && result->size > HTTP_CACHE_MAX_BODY)) {
+		http_cache_remove (request->source);
+		return TRUE;
+	}
+
+	meta = http_cache_load_meta (request->source);
+	if (meta) {
+		oldChecksum = g_key_file_get_string (meta, HTTP_CACHE_GROUP, "body-checksum", NULL);
+		g_key_file_free (meta);
+	}
+
+	meta = g_key_file_new ();
+	g_key_file_set_string (meta, HTTP_CACHE_GROUP, "url", request->source);
+	http_cache_set_long (meta, "expires", result->expires);
+	if (etag)
+		g_key_file_set_string (meta, HTTP_CACHE_GROUP, "etag", etag);
+	if (lastModified)
+		http_cache_set_long (meta, "last-modified", lastModified);
+	if (result->contentType)
+		g_key_file_set_string (meta, HTTP_CACHE_GROUP, "content-type", result->contentType);
+
+	filename = http_cache_get_filename (request->source, "data");
+	if (result->data) {
+		checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA1, (guchar *)result->data, result->size);
+		g_key_file_set_string (meta, HTTP_CACHE_GROUP, "body-checksum", checksum);
+
+		/* rewrite the body only if it changed */
+		if (!oldChecksum || !g_str_equal (oldChecksum, checksum) ||
+		    !g_file_test (filename, G_FILE_TEST_EXISTS)) {
+			debug2 (DEBUG_CACHE, "storing %d bytes for %s in HTTP cache", result->size, request->source);
+			if (!g_file_set_contents (filename, result->data, result->size, NULL))
+				g_key_file_remove_key (meta, HTTP_CACHE_GROUP, "body-checksum", NULL);
+		}
+	} else {
+		g_unlink (filename);
+	}
+	g_free (filename);
+
+	http_cache_save_meta (request->source, meta);
+
+	g_key_file_free (meta);
+	g_free (checksum);
+	g_free (oldChecksum);
+
+	return TRUE;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file http_cache.h  persistent HTTP response cache
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _HTTP_CACHE_H
+#define _HTTP_CACHE_H
+
+#include <glib.h>
+
+#include "update.h"
+
+/* Secondary downloads that have no update state of their own (favicon
+   discovery, comment feeds) set the useCache flag of their update
+   request. For those the validators (ETag, Last-Modified), the freshness
+   lifetime and the body of successful responses are kept in the
+   cache/http directory, keyed by URL. Fresh responses are served
+   without network access, stale ones are revalidated with a
+   conditional request. Responses that were parsed while downloading
+   have no body, only their validators are kept. */
+
+/**
+ * Removes cache entries that were not used for a long time.
+ */
+void http_cache_init (void);
+
+/**
+ * Looks up the cache entry for the given request. If the entry is
+ * fresh its response is copied to the given result (the HTTP status
+ * is 304 and if a body is cached the data is set). Otherwise the
+ * validators of the entry are added to the request.
+ *
+ * @param request	the update request
+ * @param result	the result to fill
+ *
+ * @returns TRUE if the result was filled from the cache
+ */
+gboolean http_cache_lookup (updateRequestPtr request, updateResultPtr result);
+
+/**
+ * Updates the cache with a downloaded result. For a "304 Not
+ * Modified" response the cached body is added to the result.
+ * If that body cannot be loaded the entry is removed and the
+ * resource has to be fetched again without validators.
+ *
+ * @param request	the update request
+ * @param result	the download result
+ *
+ * @returns FALSE if a "304 Not Modified" response lacks its cached body
+ */
+gboolean http_cache_store (updateRequestPtr request, updateResultPtr result);
+
+#endif
@@ -275,13 +275,13 @@ item_to_xml (itemPtr item, xmlNodePtr parentNode)
 	g_free (tmp);
 
 	if (item->validGuid) {
-		GSList	*iter, *duplicates;
+		itemSetPtr	duplicates;
+		guint		i;
 		
 		duplicatesNode = xmlNewChild(itemNode, NULL, "duplicates", NULL);
-		duplicates = iter = db_item_get_duplicates(item->sourceId);
-		while (iter) {
-			gulong id = GPOINTER_TO_UINT (iter->data);
-			itemPtr duplicate = item_load (id);
+		duplicates = db_item_get_duplicates(item->sourceId);
+		for (i = 0; i < itemset_get_length (duplicates); i++) {
+			itemPtr duplicate = item_load (itemset_get_id (duplicates, i));
 			if (duplicate) {
 				nodePtr duplicateNode = node_from_id (duplicate->nodeId);
 				if (duplicateNode && (item->id != duplicate->id))
@@ -289,9 +289,8 @@ item_to_xml (itemPtr item, xmlNodePtr parentNode)
 					                 node_get_title (duplicateNode));
 				item_unload (duplicate);
 			}
-			iter = g_slist_next (iter);
 		}
-		g_slist_free (duplicates);
+		itemset_free (duplicates);
 	}
 		
 	xmlNewTextChild (itemNode, NULL, "sourceId", item->nodeId);
@@ -58,7 +58,7 @@ typedef struct item {
 	gboolean	validGuid;		/**< TRUE if id of this item is a GUID and can be used for duplicate detection */
 	gchar		*description;		/**< XHTML string containing the item's description */
 	
-	GSList		*metadata;		/**< Metadata of this item */
+	struct metadataList *metadata;		/**< Metadata of this item */
 	GHashTable	*tmpdata;		/**< Temporary data hash used during stateful parsing */
 	time_t		time;			/**< Last modified date of the headline */
 
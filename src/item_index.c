@@ -0,0 +1,413 @@
+/**
+ * @file item_index.c  memory mapped item index snapshot
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "item_index.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "debug.h"
+
+/* Snapshot file layout (native byte order, it is a local cache only):
+
+   header
+   node table		nodeCount x itemIndexNode
+   dates		itemCount x gint64
+   ids			itemCount x guint32
+   flags		itemCount x guint8
+   node ids		NUL terminated strings
+
+   The items of a node are stored consecutively in all three item
+   columns starting at itemIndexNode.first and sorted by item id. */
+
+#define ITEM_INDEX_MAGIC	"LIFIDX01"
+#define ITEM_INDEX_VERSION	1
+
+typedef struct itemIndexHeader {
+	gchar		magic[8];
+	guint32		version;
+	guint32		nodeCount;
+	guint32		itemCount;
+	guint32		namesLength;
+	gint64		generation;
+} itemIndexHeader;
+
+typedef struct itemIndexNode {
+	guint32		nameOffset;	/**< offset of the node id in the node id section */
+	guint32		first;		/**< index of the first item of the node */
+	guint32		count;		/**< number of items */
+	guint32		unreadCount;	/**< number of unread items */
+} itemIndexNode;
+
+struct itemIndexWriter {
+	GArray		*nodes;		/**< itemIndexNode table */
+	GArray		*dates;		/**< item dates */
+	GArray		*ids;		/**< item ids */
+	GByteArray	*flags;		/**< item state flags */
+	GString		*names;		/**< node id section */
+	itemIndexNode	*current;	/**< the node items are currently added to */
+	gchar		*currentId;	/**< the id of this node */
+};
+
+static GMappedFile	*mappedFile = NULL;
+static const itemIndexHeader	*header = NULL;
+static const itemIndexNode	*nodes = NULL;
+static const gint64	*dates = NULL;
+static const guint32	*ids = NULL;
+static const guint8	*flags = NULL;
+static const gchar	*names = NULL;
+
+static GHashTable	*nodeIndex = NULL;	/**< node id -> itemIndexNode */
+static GHashTable	*dirtyNodes = NULL;	/**< node ids of changed nodes */
+
+static gchar *
+item_index_get_filename (void)
+{
+	return common_create_cache_filename (NULL, "liferea", "idx");
+}
+
+static void
+item_index_unmap (void)
+{
+	if (nodeIndex) {
+		g_hash_table_destroy (nodeIndex);
+		nodeIndex = NULL;
+	}
+
+	if (mappedFile) {
+		g_mapped_file_free (mappedFile);
+		mappedFile = NULL;
+	}
+
+	header = NULL;
+	nodes = NULL;
+	dates = NULL;
+	ids = NULL;
+	flags = NULL;
+	names = NULL;
+}
+
+static gboolean
+item_index_map (gint64 generation)
+{
+	gchar		*filename, *contents;
+	GError		*error = NULL;
+	gsize		length, expected;
+	guint		i;
+
+	filename = item_index_get_filename ();
+	mappedFile = g_mapped_file_new (filename, FALSE, &error);
+	if (!mappedFile) {
+		debug2 (DEBUG_CACHE, "No item index snapshot %s (%s)", filename, error->message);
+		g_error_free (error);
+		g_free (filename);
+		return FALSE;
+	}
+	g_free (filename);
+
+	contents = g_mapped_file_get_contents (mappedFile);
+	length = g_mapped_file_get_length (mappedFile);
+	header = (const itemIndexHeader *)contents;
+
+	if ((length < sizeof (itemIndexHeader)) ||
+	    strncmp (header->magic, ITEM_INDEX_MAGIC, 8) ||
+	    (header->version != ITEM_INDEX_VERSION)) {
+		debug0 (DEBUG_CACHE, "Item index snapshot has an unknown format, ignoring it.");
+		item_index_unmap ();
+		return FALSE;
+	}
+
+	if (header->generation != generation) {
+		debug2 (DEBUG_CACHE, "Item index snapshot is outdated (generation %" G_GINT64_FORMAT " != %" G_GINT64_FORMAT "), ignoring it.", header->generation, generation);
+		item_index_unmap ();
+		return FALSE;
+	}
+
+	expected = sizeof (itemIndexHeader) +
+	           (gsize)header->nodeCount * sizeof (itemIndexNode) +
+	           (gsize)header->itemCount * (sizeof (gint64) + sizeof (guint32) + sizeof (guint8)) +
+	           header->namesLength;
+	if ((length != expected) || (header->namesLength && contents[length - 1])) {
+		debug0 (DEBUG_CACHE, "Item index snapshot is truncated, ignoring it.");
+		item_index_unmap ();
+		return FALSE;
+	}
+
+	nodes = (const itemIndexNode *)(contents + sizeof (itemIndexHeader));
+	dates = (const gint64 *)(nodes + header->nodeCount);
+	ids = (const guint32 *)(dates + header->itemCount);
+	flags = (const guint8 *)(ids + header->itemCount);
+	names = (const gchar *)(flags + header->itemCount);
+
+	nodeIndex = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; i < header->nodeCount; i++) {
+		if ((nodes[i].nameOffset >= header->namesLength) ||
+		    ((guint64)nodes[i].first + nodes[i].count > header->itemCount)) {
+			debug0 (DEBUG_CACHE, "Item index snapshot is corrupt, ignoring it.");
+			item_index_unmap ();
+			return FALSE;
+		}
+		g_hash_table_insert (nodeIndex, (gpointer)(names + nodes[i].nameOffset), (gpointer)&nodes[i]);
+	}
+
+	debug2 (DEBUG_CACHE, "Mapped item index snapshot (%u nodes, %u items)", header->nodeCount, header->itemCount);
+	return TRUE;
+}
+
+gboolean
+item_index_open (gint64 generation)
+{
+	item_index_close ();
+
+	dirtyNodes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	return item_index_map (generation);
+}
+
+void
+item_index_close (void)
+{
+	item_index_unmap ();
+
+	if (dirtyNodes) {
+		g_hash_table_destroy (dirtyNodes);
+		dirtyNodes = NULL;
+	}
+}
+
+gboolean
+item_index_is_valid (void)
+{
+	return (NULL != nodeIndex);
+}
+
+void
+item_index_invalidate_node (const gchar *nodeId)
+{
+	if (!dirtyNodes || !nodeId)
+		return;
+
+	if (!g_hash_table_lookup (dirtyNodes, nodeId))
+		g_hash_table_insert (dirtyNodes, g_strdup (nodeId), GINT_TO_POINTER (1));
+}
+
+GSList *
+item_index_get_dirty_nodes (void)
+{
+	GHashTableIter	iter;
+	gpointer	key;
+	GSList		*list = NULL;
+
+	if (!dirtyNodes)
+		return NULL;
+
+	g_hash_table_iter_init (&iter, dirtyNodes);
+	while (g_hash_table_iter_next (&iter, &key, NULL))
+		list = g_slist_prepend (list, key);
+
+	return list;
+}
+
+static const itemIndexNode *
+item_index_lookup (const gchar *nodeId, gboolean *found)
+{
+	*found = FALSE;
+
+	if (!nodeIndex || !nodeId)
+		return NULL;
+
+	if (g_hash_table_lookup (dirtyNodes, nodeId))
+		return NULL;
+
+	/* A valid snapshot contains all items, so a node that
+	   is not listed simply has no items. */
+	*found = TRUE;
+	return (const itemIndexNode *)g_hash_table_lookup (nodeIndex, nodeId);
+}
+
+gboolean
+item_index_get_counts (const gchar *nodeId, guint *itemCount, guint *unreadCount)
+{
+	const itemIndexNode	*node;
+	gboolean		found;
+
+	node = item_index_lookup (nodeId, &found);
+	if (!found)
+		return FALSE;
+
+	*itemCount = node?node->count:0;
+	*unreadCount = node?node->unreadCount:0;
+	return TRUE;
+}
+
+gboolean
+item_index_get_ids (const gchar *nodeId, const guint32 **result, guint *count)
+{
+	const itemIndexNode	*node;
+	gboolean		found;
+
+	node = item_index_lookup (nodeId, &found);
+	if (!found)
+		return FALSE;
+
+	*result = node?&ids[node->first]:NULL;
+	*count = node?node->count:0;
+	return TRUE;
+}
+
+/* snapshot writing */
+
+itemIndexWriterPtr
+item_index_writer_new (void)
+{
+	itemIndexWriterPtr	writer;
+
+	writer = g_new0 (struct itemIndexWriter, 1);
+	writer->nodes = g_array_new (FALSE, FALSE, sizeof (itemIndexNode));
+	writer->dates = g_array_new (FALSE, FALSE, sizeof (gint64));
+	writer->ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+	writer->flags = g_byte_array_new ();
+	writer->names = g_string_new (NULL);
+
+	return writer;
+}
+
+static itemIndexNode *
+item_index_writer_add_node (itemIndexWriterPtr writer, const gchar *nodeId)
+{
+	itemIndexNode	node;
+
+	node.nameOffset = writer->names->len;
+	node.first = writer->ids->len;
+	node.count = 0;
+	node.unreadCount = 0;
+	g_string_append_len (writer->names, nodeId, strlen (nodeId) + 1);
+	g_array_append_val (writer->nodes, node);
+
+	g_free (writer->currentId);
+	writer->currentId = g_strdup (nodeId);
+	writer->current = &g_array_index (writer->nodes, itemIndexNode, writer->nodes->len - 1);
+
+	return writer->current;
+}
+
+void
+item_index_writer_copy_clean (itemIndexWriterPtr writer)
+{
+	itemIndexNode	*node;
+	guint		i;
+
+	if (!nodeIndex)
+		return;
+
+	for (i = 0; i < header->nodeCount; i++) {
+		const gchar *nodeId = names + nodes[i].nameOffset;
+
+		if (g_hash_table_lookup (dirtyNodes, nodeId))
+			continue;
+
+		node = item_index_writer_add_node (writer, nodeId);
+		node->count = nodes[i].count;
+		node->unreadCount = nodes[i].unreadCount;
+		g_array_append_vals (writer->dates, &dates[nodes[i].first], nodes[i].count);
+		g_array_append_vals (writer->ids, &ids[nodes[i].first], nodes[i].count);
+		g_byte_array_append (writer->flags, &flags[nodes[i].first], nodes[i].count);
+	}
+}
+
+void
+item_index_writer_add (itemIndexWriterPtr writer, const gchar *nodeId, guint32 id, gint64 date, guint8 itemFlags)
+{
+	if (!nodeId)
+		return;
+
+	if (!writer->current || !g_str_equal (writer->currentId, nodeId))
+		item_index_writer_add_node (writer, nodeId);
+
+	writer->current->count++;
+	if (!(itemFlags & ITEM_INDEX_FLAG_READ))
+		writer->current->unreadCount++;
+
+	g_array_append_val (writer->dates, date);
+	g_array_append_val (writer->ids, id);
+	g_byte_array_append (writer->flags, &itemFlags, 1);
+}
+
+static void
+item_index_writer_free (itemIndexWriterPtr writer)
+{
+	g_array_free (writer->nodes, TRUE);
+	g_array_free (writer->dates, TRUE);
+	g_array_free (writer->ids, TRUE);
+	g_byte_array_free (writer->flags, TRUE);
+	g_string_free (writer->names, TRUE);
+	g_free (writer->currentId);
+	g_free (writer);
+}
+
+void
+item_index_writer_commit (itemIndexWriterPtr writer, gint64 generation)
+{
+	itemIndexHeader	newHeader;
+	gchar		*filename, *tmpfilename;
+	FILE		*f;
+	gboolean	success;
+
+	memset (&newHeader, 0, sizeof (itemIndexHeader));
+	memcpy (newHeader.magic, ITEM_INDEX_MAGIC, 8);
+	newHeader.version = ITEM_INDEX_VERSION;
+	newHeader.nodeCount = writer->nodes->len;
+	newHeader.itemCount = writer->ids->len;
+	newHeader.namesLength = writer->names->len;
+	newHeader.generation = generation;
+
+	filename = item_index_get_filename ();
+	tmpfilename = g_strdup_printf ("%s~", filename);
+
+	success = FALSE;
+	f = fopen (tmpfilename, "wb");
+	if (f) {
+		success = (1 == fwrite (&newHeader, sizeof (itemIndexHeader), 1, f));
+		success &= (writer->nodes->len == fwrite (writer->nodes->data, sizeof (itemIndexNode), writer->nodes->len, f));
+		success &= (writer->dates->len == fwrite (writer->dates->data, sizeof (gint64), writer->dates->len, f));
+		success &= (writer->ids->len == fwrite (writer->ids->data, sizeof (guint32), writer->ids->len, f));
+		success &= (writer->flags->len == fwrite (writer->flags->data, sizeof (guint8), writer->flags->len, f));
+		success &= (writer->names->len == fwrite (writer->names->str, 1, writer->names->len, f));
+		success &= (0 == fclose (f));
+	}
+
+	/* unmap before replacing the file the mapping refers to */
+	item_index_unmap ();
+	g_hash_table_remove_all (dirtyNodes);
+
+	if (success && (0 == g_rename (tmpfilename, filename))) {
+		debug2 (DEBUG_CACHE, "Wrote item index snapshot (%u nodes, %u items)", newHeader.nodeCount, newHeader.itemCount);
+		item_index_map (generation);
+	} else {
+		g_warning ("Could not write item index snapshot %s!", tmpfilename);
+		g_unlink (tmpfilename);
+	}
+
+	g_free (tmpfilename);
+	g_free (filename);
+	item_index_writer_free (writer);
+}
@@ -0,0 +1,146 @@
+/**
+ * @file item_index.h  memory mapped item index snapshot
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _ITEM_INDEX_H
+#define _ITEM_INDEX_H
+
+#include <glib.h>
+
+/* The item index is a read-only snapshot of the items table holding
+   for each node id a sorted array of item ids along with the item
+   dates and state flags. It is memory mapped on startup and allows
+   item counting and item set loading without querying the DB.
+
+   The snapshot is tagged with the DB generation counter it was
+   written for. The DB layer bumps the counter on the first item
+   change of a session and marks changed nodes as dirty. Lookups
+   for dirty nodes fail, so the caller has to fall back to the DB.
+   Rewriting the snapshot copies all clean nodes and only reloads
+   the dirty ones. */
+
+/** item state flags stored in the index */
+#define ITEM_INDEX_FLAG_READ		(1<<0)
+#define ITEM_INDEX_FLAG_MARKED		(1<<1)
+#define ITEM_INDEX_FLAG_POPUP		(1<<2)
+#define ITEM_INDEX_FLAG_UPDATED		(1<<3)
+
+/**
+ * Maps the item index snapshot file. The index is only used
+ * if the snapshot generation matches the given DB generation.
+ *
+ * @param generation	the current DB generation counter
+ *
+ * @returns TRUE if a valid snapshot was loaded
+ */
+gboolean item_index_open (gint64 generation);
+
+/**
+ * Unmaps the item index and drops all dirty node information.
+ */
+void item_index_close (void);
+
+/**
+ * Returns whether there is a valid snapshot to copy from.
+ *
+ * @returns TRUE if the snapshot is valid
+ */
+gboolean item_index_is_valid (void);
+
+/**
+ * Marks the given node as changed. All lookups for this node
+ * will fail until the snapshot is rewritten.
+ *
+ * @param nodeId	the node id
+ */
+void item_index_invalidate_node (const gchar *nodeId);
+
+/**
+ * Returns the list of dirty node ids.
+ *
+ * @returns a list of node ids (to be free'd using g_slist_free(),
+ *          the node ids are owned by the index)
+ */
+GSList * item_index_get_dirty_nodes (void);
+
+/**
+ * Looks up the item counters of the given node.
+ *
+ * @param nodeId	the node id
+ * @param itemCount	location for the number of items
+ * @param unreadCount	location for the number of unread items
+ *
+ * @returns FALSE if there is no valid information for the node
+ */
+gboolean item_index_get_counts (const gchar *nodeId, guint *itemCount, guint *unreadCount);
+
+/**
+ * Looks up the item ids of the given node. The returned
+ * array is sorted in ascending id order and points into
+ * the mapped snapshot. It is valid until the next call of
+ * item_index_writer_commit() or item_index_close().
+ *
+ * @param nodeId	the node id
+ * @param ids		location for the id array
+ * @param count		location for the number of ids
+ *
+ * @returns FALSE if there is no valid information for the node
+ */
+gboolean item_index_get_ids (const gchar *nodeId, const guint32 **ids, guint *count);
+
+/* snapshot writing */
+
+typedef struct itemIndexWriter *itemIndexWriterPtr;
+
+/**
+ * Creates a new snapshot writer.
+ *
+ * @returns a new writer (to be free'd by item_index_writer_commit())
+ */
+itemIndexWriterPtr item_index_writer_new (void);
+
+/**
+ * Copies all clean nodes of the currently mapped snapshot.
+ *
+ * @param writer	the writer
+ */
+void item_index_writer_copy_clean (itemIndexWriterPtr writer);
+
+/**
+ * Adds an item to the snapshot. Items must be added grouped
+ * by node id and in ascending item id order per node.
+ *
+ * @param writer	the writer
+ * @param nodeId	the node id of the item
+ * @param id		the item id
+ * @param date		the item date
+ * @param flags		item state flags (ITEM_INDEX_FLAG_*)
+ */
+void item_index_writer_add (itemIndexWriterPtr writer, const gchar *nodeId, guint32 id, gint64 date, guint8 flags);
+
+/**
+ * Writes the snapshot to disk, maps it as the new item index
+ * and frees the writer. Clears all dirty node information.
+ *
+ * @param writer	the writer
+ * @param generation	the DB generation the snapshot corresponds to
+ */
+void item_index_writer_commit (itemIndexWriterPtr writer, gint64 generation);
+
+#endif
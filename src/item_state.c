@@ -112,11 +112,12 @@ item_read_state_changed (itemPtr item, gboolean newState)
 
 	/* 7. duplicate state propagation */
 	if (item->validGuid) {
-		GSList *duplicates, *iter;
+		itemSetPtr	duplicates;
+		guint		i;
 
-		duplicates = iter = db_item_get_duplicates (item->sourceId);
-		while (iter) {
-			itemPtr duplicate = item_load (GPOINTER_TO_UINT (iter->data));
+		duplicates = db_item_get_duplicates (item->sourceId);
+		for (i = 0; i < itemset_get_length (duplicates); i++) {
+			itemPtr duplicate = item_load (itemset_get_id (duplicates, i));
 
 			/* The check on node_from_id() is an evil workaround
 			   to handle "lost" items in the DB that have no 
@@ -127,14 +128,102 @@ item_read_state_changed (itemPtr item, gboolean newState)
 				item_set_read_state (duplicate, newState);
 			}
 			if (duplicate) item_unload (duplicate);
-			iter = g_slist_next (iter);
 		}
-		g_slist_free (duplicates);
+		itemset_free (duplicates);
 	}
 
 	debug_end_measurement (DEBUG_GUI, "set read status");
 }
 
+static void
+item_state_update_node_counters (gpointer key, gpointer value, gpointer user_data)
+{
+	node_update_counters ((nodePtr)value);
+}
+
+void
+items_set_read_state (GSList *items, gboolean newState)
+{
+	GSList		*todo, *changed = NULL, *loaded = NULL, *iter;
+	GHashTable	*seen, *nodes;
+
+	debug_start_measurement (DEBUG_GUI);
+
+	seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+	nodes = g_hash_table_new (g_str_hash, g_str_equal);
+
+	todo = g_slist_copy (items);
+	for (iter = todo; iter; iter = g_slist_next (iter))
+		g_hash_table_insert (seen, GUINT_TO_POINTER (((itemPtr)iter->data)->id), iter->data);
+
+	/* 1. set values in memory, duplicates are appended to the list */
+	for (iter = todo; iter; iter = g_slist_next (iter)) {
+		itemPtr	item = (itemPtr)iter->data;
+		nodePtr	node = node_from_id (item->nodeId);
+
+		if (!node || (newState == item->readStatus && !item->updateStatus))
+			continue;
+
+		if (NODE_SOURCE_TYPE (node)->item_mark_read) {
+			node_source_item_mark_read (node, item, newState);
+			continue;
+		}
+
+		item->readStatus = newState;
+		item->updateStatus = FALSE;
+		vfolder_foreach_data (vfolder_check_item, item);
+
+		changed = g_slist_prepend (changed, item);
+		g_hash_table_insert (nodes, node->id, node);
+
+		if (item->validGuid) {
+			itemSetPtr	duplicates;
+			guint		i;
+
+			duplicates = db_item_get_duplicates (item->sourceId);
+			for (i = 0; i < itemset_get_length (duplicates); i++) {
+				gulong id = itemset_get_id (duplicates, i);
+				itemPtr duplicate;
+
+				if (g_hash_table_lookup (seen, GUINT_TO_POINTER (id)))
+					continue;
+
+				duplicate = item_load (id);
+				if (!duplicate)
+					continue;
+
+				g_hash_table_insert (seen, GUINT_TO_POINTER (id), duplicate);
+				loaded = g_slist_prepend (loaded, duplicate);
+				iter->next = g_slist_prepend (iter->next, duplicate);
+			}
+			itemset_free (duplicates);
+		}
+	}
+
+	/* 2. apply to DB */
+	db_items_state_update (changed);
+
+	/* 3. update item list GUI state */
+	for (iter = changed; iter; iter = g_slist_next (iter))
+		itemlist_update_item ((itemPtr)iter->data);
+
+	/* 4. update search folder and feed list unread counters once */
+	if (changed) {
+		vfolder_foreach (node_update_counters);
+		g_hash_table_foreach (nodes, item_state_update_node_counters, NULL);
+		feedlist_reset_new_item_count ();
+	}
+
+	g_slist_foreach (loaded, (GFunc)item_unload, NULL);
+	g_slist_free (loaded);
+	g_slist_free (changed);
+	g_slist_free (todo);
+	g_hash_table_destroy (nodes);
+	g_hash_table_destroy (seen);
+
+	debug_end_measurement (DEBUG_GUI, "set read status of many items");
+}
+
 /**
  * In difference to all the other item state handling methods
  * item_state_set_all_read does not immediately apply the 
@@ -152,10 +241,9 @@ itemset_mark_read (nodePtr node)
 		return;
 	
 	itemSet = node_get_itemset (node);
-	GList *iter = itemSet->ids;
-	while (iter) {
-		gulong id = GPOINTER_TO_UINT (iter->data);
-		itemPtr item = item_load (id);
+	guint i;
+	for (i = 0; i < itemset_get_length (itemSet); i++) {
+		itemPtr item = item_load (itemset_get_id (itemSet, i));
 		if (item) {
 			if (!item->readStatus) {
 				nodePtr node;
@@ -186,8 +274,8 @@ itemset_mark_read (nodePtr node)
 			}
 			item_unload (item);
 		}
-		iter = g_list_next (iter);
 	}
+	itemset_free (itemSet);
 }
 
 void
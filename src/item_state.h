@@ -58,6 +58,18 @@ void item_set_read_state (itemPtr item, gboolean newState);
  */
 void item_read_state_changed (itemPtr item, gboolean newState);
 
+/**
+ * Changes the read state of many items at once. Unlike calling
+ * item_set_read_state() for each item, the DB is updated in a single
+ * transaction and the counters of each affected node are updated
+ * only once. Items of node sources that sync the read state (e.g.
+ * Google Reader) are still passed to the source one by one.
+ *
+ * @param items		list of items (not free'd)
+ * @param newState	new read state
+ */
+void items_set_read_state (GSList *items, gboolean newState);
+
 /**
  * Requests to mark read all items in the given nodes item list.
  *
@@ -35,13 +35,8 @@
 #include "metadata.h"
 #include "node.h"
 #include "rule.h"
+#include "ui_observer.h"
 #include "vfolder.h"
-#include "ui/item_list_view.h"
-#include "ui/itemview.h"
-#include "ui/liferea_shell.h"
-#include "ui/feed_list_view.h"
-#include "ui/liferea_htmlview.h"
-#include "ui/ui_node.h"
 
 /* This is a simple controller implementation for itemlist handling. 
    It manages the currently displayed itemset, realizes filtering,
@@ -67,6 +62,8 @@ static struct itemlist_priv
 	gboolean	searchResultComplete;	/**< TRUE if search result merging is complete */
 } itemlist_priv;
 
+static void itemlist_drop_item (itemPtr item, gboolean retire);
+
 static void
 itemlist_duplicate_list_remove_item (itemPtr item)
 {
@@ -150,15 +147,15 @@ itemlist_check_for_deferred_action (void)
 		if(itemlist_priv.deferredFilter) {
 			itemlist_priv.deferredFilter = FALSE;
 			item = item_load(id);
-			itemview_remove_item(item);
-			ui_node_update(item->nodeId);
+			ui_observer_item_removed (item);
+			ui_observer_node_changed (node_from_id (item->nodeId));
 		}
 
 		/* check for removals caused by vfolder rules */
 		if(itemlist_priv.deferredRemove) {
 			itemlist_priv.deferredRemove = FALSE;
 			item = item_load(id);
-			itemlist_remove_item(item);
+			itemlist_drop_item(item, TRUE);
 		}
 	}
 }
@@ -191,7 +188,7 @@ itemlist_merge_item (itemPtr item)
 		return;
 		
 	itemlist_duplicate_list_add_item (item);
-	itemview_add_item (item);
+	ui_observer_item_added (item);
 }
 
 /**
@@ -238,7 +235,7 @@ itemlist_merge_itemset (itemSetPtr itemSet)
 	/* merge items into item view */
 	itemset_foreach (itemSet, itemlist_merge_item);
 	
-	itemview_update ();
+	ui_observer_items_changed ();
 	
 	debug_end_measurement (DEBUG_GUI, "itemlist merge");
 
@@ -248,7 +245,7 @@ itemlist_merge_itemset (itemSetPtr itemSet)
 void
 itemlist_load_search_result (itemSetPtr itemSet)
 {
-	itemview_set_mode (ITEMVIEW_SINGLE_ITEM);
+	ui_observer_set_item_view_mode (ITEMVIEW_SINGLE_ITEM);
 	
 	itemlist_priv.isSearchResult = TRUE;
 	itemlist_priv.searchResultComplete = FALSE;	/* enable result merging */
@@ -283,7 +280,7 @@ itemlist_load (nodePtr node)
 
 	/* for folders and other heirarchic nodes do filtering */
 	if (IS_FOLDER (node) || node->children) {
-		liferea_shell_update_allitems_actions (FALSE, 0 != node->unreadCount);
+		ui_observer_update_allitems_actions (FALSE, 0 != node->unreadCount);
 
 		conf_get_int_value (FOLDER_DISPLAY_MODE, &folder_display_mode);
 		if (!folder_display_mode)
@@ -291,26 +288,26 @@ itemlist_load (nodePtr node)
 	
 		conf_get_bool_value (FOLDER_DISPLAY_HIDE_READ, &folder_display_hide_read);
 		if (folder_display_hide_read) {
-			itemlist_priv.filter = g_new0(struct itemSet, 1);
+			itemlist_priv.filter = itemset_new (NULL);
 			itemlist_priv.filter->anyMatch = TRUE;
 			itemset_add_rule (itemlist_priv.filter, "unread", "", TRUE);
 		}
 	} else {
-		liferea_shell_update_allitems_actions (0 != node->itemCount, 0 != node->unreadCount);
+		ui_observer_update_allitems_actions (0 != node->itemCount, 0 != node->unreadCount);
 	}
 
 	itemlist_priv.loading++;
 	itemlist_priv.viewMode = node_get_view_mode (node);
-	itemview_set_layout (itemlist_priv.viewMode);
+	ui_observer_set_item_view_layout (itemlist_priv.viewMode);
 
 	/* Set the new displayed node... */
 	itemlist_priv.currentNode = node;
-	itemview_set_displayed_node (itemlist_priv.currentNode);
+	ui_observer_node_displayed (itemlist_priv.currentNode);
 
 	if (NODE_VIEW_MODE_COMBINED != node_get_view_mode (node))
-		itemview_set_mode (ITEMVIEW_NODE_INFO);
+		ui_observer_set_item_view_mode (ITEMVIEW_NODE_INFO);
 	else
-		itemview_set_mode (ITEMVIEW_ALL_ITEMS);
+		ui_observer_set_item_view_mode (ITEMVIEW_ALL_ITEMS);
 	
 	itemSet = node_get_itemset (itemlist_priv.currentNode);
 	itemlist_merge_itemset (itemSet);
@@ -326,8 +323,8 @@ void
 itemlist_unload (gboolean markRead) 
 {
 	if (itemlist_priv.currentNode) {
-		itemview_clear ();
-		itemview_set_displayed_node (NULL);
+		ui_observer_items_cleared ();
+		ui_observer_node_displayed (NULL);
 		
 		/* 1. Postprocessing for previously selected node, this is necessary
 		   to realize reliable read marking when using condensed mode. It's
@@ -363,7 +360,7 @@ itemlist_select_next_unread (void)
 
 	/* before scanning the feed list, we test if there is a unread 
 	   item in the currently selected feed! */
-	result = itemview_find_unread_item (itemlist_priv.selectedId);
+	result = ui_observer_find_unread_item (itemlist_priv.selectedId);
 	
 	/* If none is found we continue searching in the feed list */
 	if (!result) {
@@ -373,20 +370,20 @@ itemlist_select_next_unread (void)
 		node = feedlist_find_unread_feed (feedlist_get_root ());
 		if (node) {
 			/* load found feed */
-			feed_list_view_select (node);
+			ui_observer_node_selected (node);
 
 			if (NODE_VIEW_MODE_COMBINED != node_get_view_mode (node))
-				result = itemview_find_unread_item (0);	/* find first unread item */
+				result = ui_observer_find_unread_item (0);	/* find first unread item */
 		} else {
 			/* if we don't find a feed with unread items do nothing */
-			liferea_shell_set_status_bar (_("There are no unread items"));
+			ui_observer_set_status_bar (_("There are no unread items"));
 		}
 	}
 
 	itemlist_priv.loading--;
 	
 	if (result)
-		itemview_select_item (result);
+		ui_observer_item_selected (result);
 }
 
 /* menu commands */
@@ -395,14 +392,14 @@ void
 itemlist_toggle_flag (itemPtr item) 
 {
 	item_set_flag_state (item, !(item->flagStatus));
-	itemview_update ();
+	ui_observer_items_changed ();
 }
 
 void
 itemlist_toggle_read_status (itemPtr item) 
 {
 	item_set_read_state (item, !(item->readStatus));
-	itemview_update ();
+	ui_observer_items_changed ();
 }
 
 /* function to remove items due to item list filtering */
@@ -412,13 +409,13 @@ itemlist_hide_item (itemPtr item)
 	/* if the currently selected item should be removed we
 	   don't do it and set a flag to do it when unselecting */
 	if (itemlist_priv.selectedId != item->id) {
-		itemview_remove_item (item);
-		ui_node_update (item->nodeId);
+		ui_observer_item_removed (item);
+		ui_observer_node_changed (node_from_id (item->nodeId));
 	} else {
 		itemlist_priv.deferredFilter = TRUE;
 		/* update the item to show new state that forces
 		   later removal */
-		itemview_update_item (item);
+		ui_observer_item_updated (item);
 	}
 }
 
@@ -431,10 +428,13 @@ itemlist_unhide_item (itemPtr item)
 
 /* functions to remove items on remove requests */
 
-/* hard unconditional item remove */
-void
-itemlist_remove_item (itemPtr item) 
+/* hard unconditional item remove, items dropped because of
+   the cache limit are retired to allow archiving them */
+static void
+itemlist_drop_item (itemPtr item, gboolean retire) 
 {
+	itemSetPtr	retired;
+
 	/* update search folder counters */
 	vfolder_foreach_data (vfolder_remove_item, item);
 	
@@ -446,10 +446,17 @@ itemlist_remove_item (itemPtr item)
 
 	itemlist_duplicate_list_remove_item (item);
 		
-	itemview_remove_item (item);
-	itemview_update ();
-
-	db_item_remove (item->id);
+	ui_observer_item_removed (item);
+	ui_observer_items_changed ();
+
+	if (retire) {
+		retired = itemset_new (item->nodeId);
+		itemset_add_id (retired, item->id);
+		db_itemset_retire (retired);
+		itemset_free (retired);
+	} else {
+		db_item_remove (item->id);
+	}
 	
 	/* update feed list */
 	node_update_counters (node_from_id (item->nodeId));
@@ -457,6 +464,12 @@ itemlist_remove_item (itemPtr item)
 	item_unload (item);
 }
 
+void
+itemlist_remove_item (itemPtr item) 
+{
+	itemlist_drop_item (item, FALSE);
+}
+
 /* soft possibly delayed item remove */
 void
 itemlist_request_remove_item (itemPtr item) 
@@ -464,12 +477,12 @@ itemlist_request_remove_item (itemPtr item)
 	/* if the currently selected item should be removed we
 	   don't do it and set a flag to do it when unselecting */
 	if (itemlist_priv.selectedId != item->id) {
-		itemlist_remove_item (item);
+		itemlist_drop_item (item, TRUE);
 	} else {
 		itemlist_priv.deferredRemove = TRUE;
 		/* update the item to show new state that forces
 		   later removal */
-		itemview_update_item (item);
+		ui_observer_item_updated (item);
 	}
 }
 
@@ -477,51 +490,50 @@ void
 itemlist_remove_items (itemSetPtr itemSet, GList *items)
 {
 	GList		*iter = items;
-	
+	itemSetPtr	retired;
+
+	retired = itemset_new (itemSet->nodeId);
 	while (iter) {
 		itemPtr item = (itemPtr) iter->data;
 
-		vfolder_foreach_data (vfolder_remove_item, item);
-
 		if (itemlist_priv.selectedId != item->id) {
 			/* don't call itemlist_remove_item() here, because it's to slow */
-			itemview_remove_item (item);
-			db_item_remove (item->id);
+			ui_observer_item_removed (item);
+			itemset_add_id (retired, item->id);
 		} else {
 			/* go the normal and selection-safe way to avoid disturbing the user */
+			vfolder_foreach_data (vfolder_remove_item, item);
 			itemlist_request_remove_item (item);
 		}
 		item_unload (item);
 		iter = g_list_next (iter);
 	}
 
-	itemview_update ();
+	/* remove (or archive) all other items at once */
+	vfolder_remove_items (retired);
+	db_itemset_retire (retired);
+	itemset_free (retired);
+
+	ui_observer_items_changed ();
 	node_update_counters (node_from_id (itemSet->nodeId));
 }
 
 void
 itemlist_remove_all_items (nodePtr node)
 {	
-	GList		*iter;
 	itemSetPtr	itemset;
 	
 	if (node == itemlist_priv.currentNode)
-		itemview_clear ();
+		ui_observer_items_cleared ();
 
 	itemset = db_itemset_load (node->id);
-	iter = itemset->ids;
-	while (iter) {
-		itemPtr item = item_load ((gulong)iter->data);
-		vfolder_foreach_data (vfolder_remove_item, item);
-		item_unload (item);
-		iter = g_list_next (iter);
-	}
+	vfolder_remove_items (itemset);
 	itemset_free (itemset);
 		
 	db_itemset_remove_all (node->id);
 	
 	if (node == itemlist_priv.currentNode) {
-		itemview_update ();
+		ui_observer_items_changed ();
 		itemlist_duplicate_list_free ();
 	}
 
@@ -546,7 +558,7 @@ itemlist_update_item (itemPtr item)
 	 * turn red. So how to know whether the itemview contains
 	 * the item?
 	 */
-	itemview_update_item (item);
+	ui_observer_item_updated (item);
 }
 
 /* mouse/keyboard interaction callbacks */
@@ -577,14 +589,14 @@ itemlist_selection_changed (itemPtr item)
 			if (node->loadItemLink) {
 				gchar* link = item_make_link (item);
 
-				itemview_launch_URL (link, TRUE /* force internal */);
+				ui_observer_launch_url (link, TRUE /* force internal */);
 				g_free (link);
 			} else {
-				itemview_set_mode (ITEMVIEW_SINGLE_ITEM);
-				itemview_select_item (item);
-				itemview_update ();
+				ui_observer_set_item_view_mode (ITEMVIEW_SINGLE_ITEM);
+				ui_observer_item_selected (item);
+				ui_observer_items_changed ();
 			}
-			ui_node_update (item->nodeId);
+			ui_observer_node_changed (node);
 		}
 
 		feedlist_reset_new_item_count ();
@@ -620,14 +632,15 @@ itemlist_set_view_mode (guint newMode)
 		itemlist_unload (FALSE);
 
 		node_set_view_mode (node, itemlist_priv.viewMode);
-		itemview_set_layout (itemlist_priv.viewMode);
+		feedlist_node_changed (node);
+		ui_observer_set_item_view_layout (itemlist_priv.viewMode);
 		itemlist_load (node);
 
 		/* If there was an item selected, select it again since
 		 * itemlist_unload() unselects it.
 		 */
 		if (item && itemlist_priv.viewMode != NODE_VIEW_MODE_COMBINED)
-			itemview_select_item (item);
+			ui_observer_item_selected (item);
 	}
 
 	if (item)
@@ -112,6 +112,13 @@ void on_view_activate(GtkRadioAction *action, GtkRadioAction *current, gpointer
 
 void itemlist_update_item(itemPtr item);
 
+/**
+ * To be called when an item is dropped because of the cache
+ * limit. The item is retired (and archived if enabled). If it
+ * is selected this is deferred until it is unselected.
+ *
+ * @param item	the item
+ */
 void itemlist_request_remove_item(itemPtr item);
 
 /**
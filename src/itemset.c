@@ -33,18 +33,175 @@
 #include "rule.h"
 #include "vfolder.h"
 
+itemSetPtr
+itemset_new (const gchar *nodeId)
+{
+	itemSetPtr	itemSet;
+
+	itemSet = g_new0 (struct itemSet, 1);
+	itemSet->ids = g_array_new (FALSE, FALSE, sizeof (guint32));
+	itemSet->nodeId = (gchar *)nodeId;
+
+	return itemSet;
+}
+
+guint
+itemset_get_length (itemSetPtr itemSet)
+{
+	return itemSet->ids->len;
+}
+
+gulong
+itemset_get_id (itemSetPtr itemSet, guint index)
+{
+	return g_array_index (itemSet->ids, guint32, index);
+}
+
+/* Returns the position of the given id or the position
+   it would have to be inserted at when it is not found. */
+static guint
+itemset_find_id (itemSetPtr itemSet, guint32 id, gboolean *found)
+{
+	const guint32	*ids = (const guint32 *)itemSet->ids->data;
+	guint		low = 0, high = itemSet->ids->len;
+
+	*found = FALSE;
+
+	/* fast path for appending new (ever increasing) ids */
+	if (!high || ids[high - 1] < id)
+		return high;
+
+	while (low < high) {
+		guint mid = low + (high - low) / 2;
+
+		if (ids[mid] < id) {
+			low = mid + 1;
+		} else if (ids[mid] > id) {
+			high = mid;
+		} else {
+			*found = TRUE;
+			return mid;
+		}
+	}
+
+	return low;
+}
+
+gboolean
+itemset_contains (itemSetPtr itemSet, gulong id)
+{
+	gboolean	found;
+
+	itemset_find_id (itemSet, id, &found);
+	return found;
+}
+
+gboolean
+itemset_add_id (itemSetPtr itemSet, gulong id)
+{
+	guint32		value = id;
+	gboolean	found;
+	guint		pos;
+
+	pos = itemset_find_id (itemSet, value, &found);
+	if (found)
+		return FALSE;
+
+	if (pos == itemSet->ids->len)
+		g_array_append_val (itemSet->ids, value);
+	else
+		g_array_insert_val (itemSet->ids, pos, value);
+
+	return TRUE;
+}
+
+gboolean
+itemset_remove_id (itemSetPtr itemSet, gulong id)
+{
+	gboolean	found;
+	guint		pos;
+
+	pos = itemset_find_id (itemSet, id, &found);
+	if (found)
+		g_array_remove_index (itemSet->ids, pos);
+
+	return found;
+}
+
+void
+itemset_union (itemSetPtr itemSet, itemSetPtr other)
+{
+	const guint32	*a, *b;
+	GArray		*result;
+	guint		i = 0, j = 0;
+
+	if (!other->ids->len)
+		return;
+
+	a = (const guint32 *)itemSet->ids->data;
+	b = (const guint32 *)other->ids->data;
+
+	/* disjoint ranges can simply be appended */
+	if (!itemSet->ids->len || a[itemSet->ids->len - 1] < b[0]) {
+		g_array_append_vals (itemSet->ids, b, other->ids->len);
+		return;
+	}
+
+	result = g_array_sized_new (FALSE, FALSE, sizeof (guint32), itemSet->ids->len + other->ids->len);
+	while (i < itemSet->ids->len && j < other->ids->len) {
+		if (a[i] < b[j]) {
+			g_array_append_val (result, a[i]);
+			i++;
+		} else if (a[i] > b[j]) {
+			g_array_append_val (result, b[j]);
+			j++;
+		} else {
+			g_array_append_val (result, a[i]);
+			i++;
+			j++;
+		}
+	}
+	g_array_append_vals (result, a + i, itemSet->ids->len - i);
+	g_array_append_vals (result, b + j, other->ids->len - j);
+
+	g_array_free (itemSet->ids, TRUE);
+	itemSet->ids = result;
+}
+
+void
+itemset_difference (itemSetPtr itemSet, itemSetPtr other)
+{
+	guint32		*a;
+	const guint32	*b;
+	guint		i = 0, j = 0, k = 0;
+
+	a = (guint32 *)itemSet->ids->data;
+	b = (const guint32 *)other->ids->data;
+
+	/* compact the remaining ids in place */
+	while (i < itemSet->ids->len) {
+		while (j < other->ids->len && b[j] < a[i])
+			j++;
+
+		if (j == other->ids->len || b[j] != a[i])
+			a[k++] = a[i];
+		i++;
+	}
+
+	g_array_set_size (itemSet->ids, k);
+}
+
 void
 itemset_foreach (itemSetPtr itemSet, itemActionFunc callback)
 {
-	GList	*iter = itemSet->ids;
+	guint	i;
 	
-	while(iter) {
-		itemPtr item = item_load (GPOINTER_TO_UINT (iter->data));
+	for (i = 0; i < itemSet->ids->len; i++) {
+		itemPtr item = item_load (itemset_get_id (itemSet, i));
 		if (item) {
 			(*callback) (item);
 			item_unload (item);
 		}
-		iter = g_list_next (iter);
 	}
 }
 
@@ -191,32 +348,33 @@ itemset_merge_item (itemSetPtr itemSet, GList *items, itemPtr item, gint maxChec
 		db_item_update (item);
 		
 		/* step 2: add to itemset */
-		itemSet->ids = g_list_prepend (itemSet->ids, GUINT_TO_POINTER (item->id));
+		itemset_add_id (itemSet, item->id);
 				
 		debug3 (DEBUG_UPDATE, "-> added \"%s\" (id=%d) to item set %p...", item_get_title (item), item->id, itemSet);
 		
 		/* step 3: duplicate detection, mark read if it is a duplicate */
 		if (item->validGuid) {
-			GSList	*iter, *duplicates;
+			itemSetPtr	duplicates;
+			guint		i;
 
-			duplicates = iter = db_item_get_duplicates (item->sourceId);
-			while (iter) {
-				debug1 (DEBUG_UPDATE, "-> duplicate guid exists: #%lu", GPOINTER_TO_UINT (iter->data));
-				iter = g_slist_next (iter);
-			}
+			duplicates = db_item_get_duplicates (item->sourceId);
+			for (i = 0; i < itemset_get_length (duplicates); i++)
+				debug1 (DEBUG_UPDATE, "-> duplicate guid exists: #%lu", itemset_get_id (duplicates, i));
 			
-			if (g_slist_length (duplicates) > 1) {
+			if (itemset_get_length (duplicates) > 1) {
 				item->readStatus = TRUE;	/* no unread counting... */
 				item->popupStatus = FALSE;	/* no notification... */
 			}
 			
-			g_slist_free (duplicates);
+			itemset_free (duplicates);
 		}
 
 		/* step 4: Check item for new enclosures to download */
 		node = node_from_id (itemSet->nodeId);
 		if (node && (((feedPtr)node->data)->encAutoDownload)) {
-			GSList *iter = metadata_list_get_values (item->metadata, "enclosure");
+			GSList *iter, *values;
+			
+			iter = values = metadata_list_get_values (item->metadata, "enclosure");
 			while (iter) {
 				enclosurePtr enc = enclosure_from_string (iter->data);
 				debug1 (DEBUG_UPDATE, "download enclosure (%s)", (gchar *)iter->data);
@@ -224,6 +382,7 @@ itemset_merge_item (itemSetPtr itemSet, GList *items, itemPtr item, gint maxChec
 				iter = g_slist_next (iter);
 				enclosure_free (enc);
 			}
+			g_slist_free (values);
 		}
 	} else {
 		debug2 (DEBUG_UPDATE, "-> not adding \"%s\" to node id \"%s\"...", item_get_title (item), itemSet->nodeId);
@@ -267,7 +426,7 @@ guint
 itemset_merge_items (itemSetPtr itemSet, GList *list, gboolean allowUpdates, gboolean markAsRead)
 {
 	GList	*iter, *droppedItems = NULL, *items = NULL;
-	guint	max, length, toBeDropped, newCount = 0, flagCount = 0;
+	guint	i, max, length, toBeDropped, newCount = 0, flagCount = 0;
 
 	debug_start_measurement (DEBUG_UPDATE);
 	
@@ -283,17 +442,16 @@ itemset_merge_items (itemSetPtr itemSet, GList *list, gboolean allowUpdates, gbo
 	max = itemset_get_max_item_count (itemSet);
 
 	/* Preload all items for flag counting and later merging comparison */
-	iter = itemSet->ids;
-	while (iter) {
-		itemPtr item = item_load (GPOINTER_TO_UINT (iter->data));
+	for (i = 0; i < itemset_get_length (itemSet); i++) {
+		itemPtr item = item_load (itemset_get_id (itemSet, i));
 		if (item) {
-			items = g_list_append (items, item);
+			items = g_list_prepend (items, item);
 			if (item->flagStatus)
 				flagCount++;
 		}
-		iter = g_list_next (iter);
 	}
-	debug1(DEBUG_UPDATE, "current cache size: %d", g_list_length(itemSet->ids));
+	items = g_list_reverse (items);
+	debug1(DEBUG_UPDATE, "current cache size: %d", itemset_get_length (itemSet));
 	debug1(DEBUG_UPDATE, "current cache limit: %d", max);
 	debug1(DEBUG_UPDATE, "downloaded feed size: %d", g_list_length(list));
 	debug1(DEBUG_UPDATE, "flag count: %d", flagCount);
@@ -353,7 +511,6 @@ itemset_merge_items (itemSetPtr itemSet, GList *list, gboolean allowUpdates, gbo
 			item->readStatus = TRUE;
 			
 		if (itemset_merge_item (itemSet, items, item, length, allowUpdates)) {
-		g_print("merging item %s %lu\n", item->title, item->id);
 			vfolder_foreach_data (vfolder_check_item, item);
 			newCount++;
 			items = g_list_prepend (items, iter->data);
@@ -390,7 +547,7 @@ itemset_merge_items (itemSetPtr itemSet, GList *list, gboolean allowUpdates, gbo
 		itemPtr item = (itemPtr) iter->data;
 		if (toBeDropped > 0 && !item->flagStatus) {
 			debug2 (DEBUG_UPDATE, "dropping item nr %u (%s)....", item->id, item_get_title (item));
-			droppedItems = g_list_append (droppedItems, item);
+			droppedItems = g_list_prepend (droppedItems, item);
 			/* no unloading here, it's done in itemlist_remove_items() */
 			toBeDropped--;
 		} else {
@@ -400,6 +557,7 @@ itemset_merge_items (itemSetPtr itemSet, GList *list, gboolean allowUpdates, gbo
 	}
 	
 	if (droppedItems) {
+		droppedItems = g_list_reverse (droppedItems);
 		itemlist_remove_items (itemSet, droppedItems);
 		g_list_free (droppedItems);
 	}
@@ -466,6 +624,6 @@ itemset_free (itemSetPtr itemSet)
 		rule = g_slist_next (rule);
 	}
 	g_slist_free (itemSet->rules);
-	g_list_free (itemSet->ids);
+	g_array_free (itemSet->ids, TRUE);
 	g_free (itemSet);
 }
@@ -37,10 +37,89 @@ typedef struct itemSet {
 	GSList		*rules;		/**< list of rules each item matches */
 	gboolean	anyMatch;	/**< TRUE means only one of the rules must match for item inclusion */
 	
-	GList		*ids;		/**< the list of item ids */
+	GArray		*ids;		/**< the item ids (guint32) in ascending order */
 	gchar		*nodeId;	/**< the feed list node id this item set belongs to */
 } *itemSetPtr;
 
+/**
+ * Creates a new empty item set.
+ *
+ * @param nodeId	the node id the item set belongs to (not copied, can be NULL)
+ *
+ * @returns a new item set (to be free'd using itemset_free())
+ */
+itemSetPtr itemset_new (const gchar *nodeId);
+
+/* item id access */
+
+/**
+ * Returns the number of items in the given item set.
+ *
+ * @param itemSet	the item set
+ *
+ * @returns the number of item ids
+ */
+guint itemset_get_length (itemSetPtr itemSet);
+
+/**
+ * Returns the item id at the given position. Item
+ * ids are sorted in ascending order.
+ *
+ * @param itemSet	the item set
+ * @param index		the position (0 <= index < length)
+ *
+ * @returns the item id
+ */
+gulong itemset_get_id (itemSetPtr itemSet, guint index);
+
+/**
+ * Checks if the given item id is part of the item set
+ * using binary search.
+ *
+ * @param itemSet	the item set
+ * @param id		the item id
+ *
+ * @returns TRUE if the item set contains the id
+ */
+gboolean itemset_contains (itemSetPtr itemSet, gulong id);
+
+/**
+ * Adds an item id to the item set. Adding ids in ascending
+ * order is done in constant time.
+ *
+ * @param itemSet	the item set
+ * @param id		the item id
+ *
+ * @returns FALSE if the id was already in the item set
+ */
+gboolean itemset_add_id (itemSetPtr itemSet, gulong id);
+
+/**
+ * Removes an item id from the item set.
+ *
+ * @param itemSet	the item set
+ * @param id		the item id
+ *
+ * @returns FALSE if the id was not in the item set
+ */
+gboolean itemset_remove_id (itemSetPtr itemSet, gulong id);
+
+/**
+ * Adds all item ids of the second item set to the first one.
+ *
+ * @param itemSet	the item set to change
+ * @param other		the item set whose ids are to be added
+ */
+void itemset_union (itemSetPtr itemSet, itemSetPtr other);
+
+/**
+ * Removes all item ids of the second item set from the first one.
+ *
+ * @param itemSet	the item set to change
+ * @param other		the item set whose ids are to be removed
+ */
+void itemset_difference (itemSetPtr itemSet, itemSetPtr other);
+
 /* item set iterating interface */
 
 typedef void 	(*itemActionFunc)	(itemPtr item);
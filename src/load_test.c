@@ -0,0 +1,192 @@
+/**
+ * @file load_test.c  update load test mode
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include "load_test.h"
+
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "db.h"
+#include "debug.h"
+#include "feedlist.h"
+#include "metrics.h"
+#include "node.h"
+#include "update.h"
+#include "ui/liferea_shell.h"
+
+/* interval (in ms) of the timer sampling the main loop and the update jobs */
+#define LOAD_TEST_TICK		10
+
+/* main loop stalls longer than this (in ms) are counted */
+#define LOAD_TEST_STALL		50
+
+typedef struct loadTestStats {
+	gint64		start;		/**< start time (monotonic, in us) */
+	guint64		requests;	/**< number of started update jobs */
+	guint64		samples;	/**< number of timer ticks */
+	guint64		jobSum;		/**< sum of active jobs over all ticks */
+	gint64		maxJobs;	/**< maximum number of active jobs */
+	gint64		maxStall;	/**< longest main loop stall (in us) */
+	guint		stalls;		/**< number of stalls longer than LOAD_TEST_STALL */
+	gint		dbChanges;	/**< number of changed DB rows */
+	gint64		dbSize;		/**< DB file size */
+} loadTestStats;
+
+static guint		rounds = 0;
+static guint		currentRound = 0;
+static gint64		lastTick = 0;
+static loadTestStats	roundStats, totalStats;
+
+static guint64
+load_test_get_requests (void)
+{
+	guint64	count = 0;
+
+	/* every job leaving the queue is observed once */
+	metrics_lookup ("update.queue_wait", NULL, &count, NULL, NULL);
+	return count;
+}
+
+static gint64
+load_test_get_db_size (void)
+{
+	struct stat	st;
+	gchar		*filename;
+	gint64		size = 0;
+
+	filename = common_create_cache_filename (NULL, "liferea", "db");
+	if (0 == g_stat (filename, &st))
+		size = st.st_size;
+	g_free (filename);
+
+	return size;
+}
+
+static void
+load_test_stats_start (loadTestStats *stats)
+{
+	memset (stats, 0, sizeof (loadTestStats));
+	stats->start = metrics_now ();
+	stats->requests = load_test_get_requests ();
+	stats->dbChanges = db_get_total_changes ();
+	stats->dbSize = load_test_get_db_size ();
+}
+
+static void
+load_test_stats_print (const gchar *title, loadTestStats *stats)
+{
+	gdouble	seconds = (metrics_now () - stats->start) / (gdouble)G_USEC_PER_SEC;
+	guint64	requests = load_test_get_requests () - stats->requests;
+
+	g_print ("%-9s %6" G_GUINT64_FORMAT " requests in %7.2fs (%7.1f/s)  "
+	         "in flight: max %2" G_GINT64_FORMAT " avg %5.2f  "
+	         "stalls: max %4" G_GINT64_FORMAT "ms, %u > %dms  "
+	         "DB: %d rows, %+" G_GINT64_FORMAT "kB\n",
+	         title, requests, seconds, seconds > 0?requests / seconds:0.0,
+	         stats->maxJobs, stats->samples?(gdouble)stats->jobSum / stats->samples:0.0,
+	         stats->maxStall / 1000, stats->stalls, LOAD_TEST_STALL,
+	         db_get_total_changes () - stats->dbChanges,
+	         (load_test_get_db_size () - stats->dbSize) / 1024);
+}
+
+static void
+load_test_stats_sample (loadTestStats *stats, gint64 stall, gint64 activeJobs)
+{
+	stats->samples++;
+	stats->jobSum += activeJobs;
+	stats->maxJobs = MAX (stats->maxJobs, activeJobs);
+	stats->maxStall = MAX (stats->maxStall, stall);
+	if (stall > LOAD_TEST_STALL * 1000)
+		stats->stalls++;
+}
+
+static void
+load_test_start_round (void)
+{
+	currentRound++;
+	load_test_stats_start (&roundStats);
+	debug1 (DEBUG_UPDATE, "load test: starting round %u", currentRound);
+
+	node_update_subscription (feedlist_get_root (), GUINT_TO_POINTER (0));
+}
+
+static gboolean
+load_test_tick (gpointer user_data)
+{
+	gint64	now = metrics_now ();
+	gint64	stall, activeJobs = 0;
+	gchar	*title;
+
+	/* a tick that comes late was blocked by other main loop work */
+	stall = MAX (0, now - lastTick - LOAD_TEST_TICK * 1000);
+	lastTick = now;
+	metrics_observe ("loadtest.stall", NULL, stall);
+
+	metrics_lookup ("update.active_jobs", NULL, NULL, &activeJobs, NULL);
+	load_test_stats_sample (&roundStats, stall, activeJobs);
+	load_test_stats_sample (&totalStats, stall, activeJobs);
+
+	if (update_get_job_count () > 0)
+		return TRUE;
+
+	title = g_strdup_printf ("round %u", currentRound);
+	load_test_stats_print (title, &roundStats);
+	g_free (title);
+
+	if (currentRound < rounds) {
+		load_test_start_round ();
+		return TRUE;
+	}
+
+	load_test_stats_print ("total", &totalStats);
+	if (metrics_dump ())
+		g_print ("metrics written to %s" G_DIR_SEPARATOR_S "metrics.json\n", common_get_cache_path ());
+
+	liferea_shutdown ();
+	return FALSE;
+}
+
+static gboolean
+load_test_start_cb (gpointer user_data)
+{
+	load_test_stats_start (&totalStats);
+	load_test_start_round ();
+
+	lastTick = metrics_now ();
+	g_timeout_add (LOAD_TEST_TICK, load_test_tick, NULL);
+
+	return FALSE;
+}
+
+void
+load_test_start (guint count)
+{
+	g_return_if_fail (count > 0);
+
+	rounds = count;
+	g_print ("load test: updating all subscriptions %u times\n", rounds);
+
+	/* start when the main loop runs */
+	g_idle_add (load_test_start_cb, NULL);
+}
@@ -0,0 +1,41 @@
+/**
+ * @file load_test.h  update load test mode
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _LOAD_TEST_H
+#define _LOAD_TEST_H
+
+#include <glib.h>
+
+/* In load test mode (--load-test=N, used by bench/update_load)
+   all subscriptions are updated N times in a row. A round ends
+   when no update job is left. For each round the wall time, the
+   number of update jobs in flight, the main loop stalls and the
+   DB write volume are printed. Afterwards the metrics are dumped
+   to metrics.json and Liferea quits. */
+
+/**
+ * Starts the load test. The feed list must be loaded.
+ *
+ * @param rounds	number of times all subscriptions are updated
+ */
+void load_test_start (guint rounds);
+
+#endif
@@ -29,22 +29,30 @@
 #endif
 
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
 #include <unique/unique.h>
 
 #include <string.h>
 #include <stdlib.h>
 #include <signal.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 
 #include "conf.h"
 #include "common.h"
 #include "db.h"
 #include "dbus.h"
 #include "debug.h"
+#include "enclosure_download.h"
+#include "favicon.h"
 #include "feedlist.h"
 #include "itemlist.h"
+#include "load_test.h"
+#include "metrics.h"
 #include "social.h"
 #include "update.h"
+#include "watchdog.h"
 #include "xml.h"
 #include "ui/ui_session.h"
 #include "ui/liferea_shell.h"
@@ -57,6 +65,13 @@ static enum {
 	STATE_SHUTDOWN
 } runState = STATE_STARTING;
 
+/* Headless mode (--daemon): only the update engine runs, feeds
+   are fetched, parsed, merged and saved to the DB without creating
+   the main window. A D-Bus client can read the results. */
+static gboolean	daemonMode = FALSE;
+static GMainLoop	*daemonLoop = NULL;
+static FeedList		*daemonFeedlist = NULL;
+
 enum {
 	COMMAND_0 = 0, /* 0 is not a valid command */
 	COMMAND_ADD_FEED
@@ -118,6 +133,85 @@ signal_handler (int sig)
 	liferea_shutdown ();
 }
 
+#ifndef G_OS_WIN32
+/* GLib functions are not async-signal-safe, so SIGUSR1 only writes
+   a byte into a pipe which wakes up a main loop watch doing the dump */
+static int metricsDumpPipe[2] = { -1, -1 };
+
+static gboolean
+metrics_dump_cb (GIOChannel *source, GIOCondition condition, gpointer user_data)
+{
+	gchar	buf[16];
+
+	while (read (metricsDumpPipe[0], buf, sizeof (buf)) > 0)
+		;
+
+	metrics_dump ();
+	db_write_sql_profile ();
+	watchdog_dump ();
+
+	return TRUE;
+}
+
+static void
+metrics_signal_handler (int sig)
+{
+	int savedErrno = errno;
+
+	if (write (metricsDumpPipe[1], "", 1) < 0)
+		;	/* pipe full, a dump is pending anyway */
+
+	errno = savedErrno;
+}
+
+static void
+metrics_signal_init (void)
+{
+	GIOChannel	*channel;
+
+	if (0 != pipe (metricsDumpPipe)) {
+		g_warning ("Could not create metrics dump pipe: %s", g_strerror (errno));
+		return;
+	}
+
+	fcntl (metricsDumpPipe[0], F_SETFL, O_NONBLOCK);
+	fcntl (metricsDumpPipe[1], F_SETFL, O_NONBLOCK);
+
+	channel = g_io_channel_unix_new (metricsDumpPipe[0]);
+	g_io_add_watch (channel, G_IO_IN, metrics_dump_cb, NULL);
+	g_io_channel_unref (channel);
+
+	signal (SIGUSR1, metrics_signal_handler);
+}
+#endif
+
+/* Only one instance may use a cache directory. The lock file stays
+   open until the process exits, so the OS releases the lock even
+   after a crash. Returns FALSE if another instance holds it. */
+static gboolean
+liferea_lock_cache_dir (void)
+{
+#ifndef G_OS_WIN32
+	gchar	*filename;
+	gint	fd;
+
+	filename = g_build_filename (common_get_cache_path (), "liferea.lock", NULL);
+	fd = g_open (filename, O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		g_warning ("Could not open lock file %s!", filename);
+		g_free (filename);
+		return TRUE;
+	}
+	g_free (filename);
+
+	if (0 != lockf (fd, F_TLOCK, 0)) {
+		close (fd);
+		return FALSE;
+	}
+#endif
+	return TRUE;
+}
+
 static gboolean
 debug_entries_parse_callback (const gchar *option_name,
 			      const gchar *value,
@@ -148,6 +242,8 @@ debug_entries_parse_callback (const gchar *option_name,
 		*debug_flags |= DEBUG_TRACE;
 	} else if (g_str_equal (option_name, "--debug-update")) {
 		*debug_flags |= DEBUG_UPDATE;
+	} else if (g_str_equal (option_name, "--debug-sql")) {
+		*debug_flags |= DEBUG_SQL;
 	} else if (g_str_equal (option_name, "--debug-vfolder")) {
 		*debug_flags |= DEBUG_VFOLDER;
 	} else if (g_str_equal (option_name, "--debug-verbose")) {
@@ -181,6 +277,8 @@ main (int argc, char *argv[])
 	LifereaDBus	*dbus = NULL;
 	const gchar	*initial_state = "shown";
 	gchar		*feed = NULL;
+	gchar		*cacheDir = NULL;
+	gint		loadTestRounds = 0;
 	int		initialState;
 	gboolean	show_tray_icon, start_in_tray;
 
@@ -195,6 +293,9 @@ main (int argc, char *argv[])
 #endif
 		{ "version", 'v', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, show_version, N_("Show version information and exit"), NULL },
 		{ "add-feed", 'a', 0, G_OPTION_ARG_STRING, &feed, N_("Add a new subscription"), N_("uri") },
+		{ "daemon", 'd', 0, G_OPTION_ARG_NONE, &daemonMode, N_("Update feeds without user interface"), NULL },
+		{ "cache-dir", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &cacheDir, NULL, NULL },
+		{ "load-test", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_INT, &loadTestRounds, NULL, NULL },
 		{ NULL }
 	};
 
@@ -208,6 +309,7 @@ main (int argc, char *argv[])
 		{ "debug-net", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, debug_entries_parse_callback, N_("Print debugging messages of all network activity"), NULL },
 		{ "debug-parsing", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, debug_entries_parse_callback, N_("Print debugging messages of all parsing functions"), NULL },
 		{ "debug-performance", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, debug_entries_parse_callback, N_("Print debugging messages when a function takes too long to process"), NULL },
+		{ "debug-sql", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, debug_entries_parse_callback, N_("Profile all SQL statements and print a report on exit"), NULL },
 		{ "debug-trace", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, debug_entries_parse_callback, N_("Print debugging messages when entering/leaving functions"), NULL },
 		{ "debug-update", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, debug_entries_parse_callback, N_("Print debugging messages of the feed update processing"), NULL },
 		{ "debug-vfolder", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, debug_entries_parse_callback, N_("Print debugging messages of the search folder matching"), NULL },
@@ -247,6 +349,13 @@ main (int argc, char *argv[])
 
 	set_debug_level (debug_flags);
 
+	/* For load tests (see bench/update_load.c) the feed list and
+	   the DB are kept in a temporary directory */
+	if (cacheDir)
+		common_set_cache_path (cacheDir);
+	if (loadTestRounds > 0)
+		daemonMode = TRUE;
+
 	/* Configuration necessary for network options, so it
 	   has to be initialized before update_init() */
 	conf_init ();
@@ -259,13 +368,20 @@ main (int argc, char *argv[])
 	   network-manager to be setup before gtk_init() */
 	update_init ();
 
-	gtk_init (&argc, &argv);
+	if (daemonMode) {
+		/* No display is needed, so GTK+ is not initialized */
+		g_type_init ();
+	} else {
+		gtk_init (&argc, &argv);
+	}
 
 	/* Single instance checks */
-	app = unique_app_new_with_commands ("net.sourceforge.liferea", NULL,
+	app = daemonMode?NULL:unique_app_new_with_commands ("net.sourceforge.liferea", NULL,
 					    "add_feed", COMMAND_ADD_FEED,
 					    NULL);
-	if (unique_app_is_running (app)) {
+	if (!app) {
+		/* headless, the cache directory lock below prevents a second instance */
+	} else if (unique_app_is_running (app)) {
 		g_print ("Liferea is already running\n");
 		unique_app_send_message (app, UNIQUE_ACTIVATE, NULL);
 		if (feed) {
@@ -278,9 +394,15 @@ main (int argc, char *argv[])
 		g_signal_connect (app, "message-received", G_CALLBACK (message_received_cb), NULL);
 	}
 
+	if (!liferea_lock_cache_dir ()) {
+		g_print ("Liferea is already running with %s\n", common_get_cache_path ());
+		return 1;
+	}
+
 	/* GTK theme support */
 	g_set_application_name (_("Liferea"));
-	gtk_window_set_default_icon_name ("liferea");
+	if (!daemonMode)
+		gtk_window_set_default_icon_name ("liferea");
 
 	debug_start_measurement (DEBUG_DB);
 
@@ -288,7 +410,8 @@ main (int argc, char *argv[])
 	db_init ();			/* initialize sqlite */
 	xml_init ();			/* initialize libxml2 */
 #ifdef HAVE_LIBNOTIFY
-	notification_plugin_register (&libnotify_plugin);
+	if (!daemonMode)
+		notification_plugin_register (&libnotify_plugin);
 #endif
 	social_init ();			/* initialize social bookmarking */
 #ifdef USE_DBUS	
@@ -323,7 +446,12 @@ main (int argc, char *argv[])
 		initialState = MAINWINDOW_SHOWN;
 	}
 
-	liferea_shell_create (initialState);
+	if (daemonMode) {
+		debug0 (DEBUG_UPDATE, "Running headless, loading feed list");
+		daemonFeedlist = feedlist_create ();
+	} else {
+		liferea_shell_create (initialState);
+	}
 	g_set_prgname ("liferea");
 	
 #ifdef USE_SM
@@ -331,14 +459,17 @@ main (int argc, char *argv[])
 	   managers will tell Liferea to exit if Liferea does not
 	   respond to SM requests within a minute or two. This starts
 	   the main loop soon after opening the SM connection. */
-	session_init (BIN_DIR G_DIR_SEPARATOR_S "liferea", opt_session_arg);
-	session_set_cmd (NULL, initialState);
+	if (!daemonMode) {
+		session_init (BIN_DIR G_DIR_SEPARATOR_S "liferea", opt_session_arg);
+		session_set_cmd (NULL, initialState);
+	}
 #endif
 	signal (SIGTERM, signal_handler);
 	signal (SIGINT, signal_handler);
 	signal (SIGHUP, signal_handler);
 
 #ifndef G_OS_WIN32
+	metrics_signal_init ();
 	signal (SIGBUS, fatal_signal_handler);
 	signal (SIGSEGV, fatal_signal_handler);
 #endif
@@ -354,9 +485,23 @@ main (int argc, char *argv[])
 	if (feed)
 		feedlist_add_subscription (feed, NULL, NULL, 0);
 
-	gtk_main ();
+	if (loadTestRounds > 0)
+		load_test_start (loadTestRounds);
+
+	/* started late to not report the startup as a stall */
+	if (debug_level & DEBUG_PERF)
+		watchdog_start ();
+
+	if (daemonMode) {
+		daemonLoop = g_main_loop_new (NULL, FALSE);
+		g_main_loop_run (daemonLoop);
+		g_main_loop_unref (daemonLoop);
+	} else {
+		gtk_main ();
+	}
 	
-	g_object_unref (G_OBJECT (dbus));
+	if (dbus)
+		g_object_unref (G_OBJECT (dbus));
 	return 0;
 }
 
@@ -371,20 +516,38 @@ on_shutdown (gpointer user_data)
 		
 	runState = STATE_SHUTDOWN;
 
+	watchdog_stop ();
+
 	/* order is important ! */
 	itemlist_free ();
+	enclosure_download_deinit ();
+	favicon_deinit ();
 	update_deinit ();
+	/* the feed list is freed after the DB is closed, so pending
+	   node changes have to be written now */
+	feedlist_save_changed_nodes ();
 	db_deinit ();
 	social_free ();
 
-	liferea_shell_destroy ();
+	/* keep the numbers of a performance debugging session */
+	if (debug_level & DEBUG_PERF)
+		metrics_dump ();
+	metrics_free ();
+
+	if (daemonMode) {
+		g_object_unref (daemonFeedlist);
+		conf_deinit ();
+		g_main_loop_quit (daemonLoop);
+	} else {
+		liferea_shell_destroy ();
 #ifdef USE_SM
-	/* unplug */
-	session_end ();
+		/* unplug */
+		session_end ();
 #endif
-	conf_deinit ();
-	
-	gtk_main_quit ();
+		conf_deinit ();
+
+		gtk_main_quit ();
+	}
 	
 	debug_exit ("liferea_shutdown");
 	return FALSE;
@@ -30,7 +30,12 @@
 /* Metadata in Liferea are ordered lists of key/value list pairs. Both 
    feed list nodes and items can have a list of metadata assigned. Metadata
    date values are always text values but maybe of different type depending
-   on their usage type. */
+   on their usage type. 
+
+   Keys are interned to small integer type ids on registration (or on 
+   first use for unregistered keys). A metadata list is a single array 
+   of (type id, value) pairs sorted by type id, values of the same type
+   are kept in insertion order. */
 
 /** Metadata value types */
 enum {
@@ -39,20 +44,56 @@ enum {
 	METADATA_TYPE_HTML = 3		/**< metadata is XHTML content and valid to be embedded in XML */
 };
 
-static GHashTable *metadataTypes = NULL;	/**< hash table with all registered meta data types */
+typedef struct metadataType {
+	gchar		*name;		/**< metadata type identifier */
+	guint		id;		/**< interned type id (index into metadataTypeList) */
+	gint		format;		/**< value type (METADATA_TYPE_*) or 0 if unregistered */
+} *metadataTypePtr;
+
+static GHashTable *metadataTypes = NULL;	/**< hash table with all known meta data types (by identifier) */
+static GPtrArray  *metadataTypeList = NULL;	/**< array of all known meta data types (by type id) */
 
-struct pair {
-	gchar		*strid;		/** metadata type id */
-	GSList		*data;		/** list of metadata values */
+typedef struct metadataValue {
+	guint		type;		/**< metadata type id */
+	gchar		*value;		/**< metadata value */
+} metadataValue;
+
+struct metadataList {
+	guint		length;		/**< number of values */
+	guint		size;		/**< number of allocated values */
+	metadataValue	*values;	/**< values ordered by type id */
 };
 
+static metadataTypePtr
+metadata_type_intern (const gchar *name, gint format)
+{
+	metadataTypePtr	type;
+
+	if (!metadataTypes) {
+		metadataTypes = g_hash_table_new (g_str_hash, g_str_equal);
+		metadataTypeList = g_ptr_array_new ();
+		g_ptr_array_add (metadataTypeList, NULL);	/* type id 0 is invalid */
+	}
+
+	type = (metadataTypePtr) g_hash_table_lookup (metadataTypes, name);
+	if (!type) {
+		type = g_new0 (struct metadataType, 1);
+		type->name = g_strdup (name);
+		type->id = metadataTypeList->len;
+		g_ptr_array_add (metadataTypeList, type);
+		g_hash_table_insert (metadataTypes, type->name, type);
+	}
+
+	if (format)
+		type->format = format;
+
+	return type;
+}
+
 static void
 metadata_type_register (const gchar *name, gint type)
 {
-	if (!metadataTypes)
-		metadataTypes = g_hash_table_new (g_str_hash, g_str_equal);
-		
-	g_hash_table_insert (metadataTypes, (gpointer)name, GINT_TO_POINTER (type));
+	metadata_type_intern (name, type);
 }
 
 static void
@@ -124,51 +165,123 @@ metadata_init (void)
 	return;
 }
 
+static metadataTypePtr
+metadata_type_lookup (const gchar *name)
+{
+	if (!metadataTypes)
+		metadata_init ();
+
+	return (metadataTypePtr) g_hash_table_lookup (metadataTypes, name);
+}
+
 gboolean
 metadata_is_type_registered (const gchar *strid)
 {
+	metadataTypePtr	type = metadata_type_lookup (strid);
+
+	return (type && type->format);
+}
+
+guint
+metadata_type_get_id (const gchar *strid)
+{
+	metadataTypePtr	type = metadata_type_lookup (strid);
+
+	if (!type)
+		type = metadata_type_intern (strid, 0);
+
+	return type->id;
+}
+
+const gchar *
+metadata_type_get_name (guint id)
+{
+	metadataTypePtr	type;
+
 	if (!metadataTypes)
 		metadata_init ();
 
-	if (g_hash_table_lookup (metadataTypes, strid))
-		return TRUE;
-	else
-		return FALSE;
+	if (!id || id >= metadataTypeList->len)
+		return NULL;
+
+	type = g_ptr_array_index (metadataTypeList, id);
+	return type->name;
 }
 
 static gint
 metadata_get_type (const gchar *name)
 {
-	gint	type;
-	
-	if (!metadataTypes)
-		metadata_init ();
+	metadataTypePtr	type = metadata_type_lookup (name);
 
-	type = GPOINTER_TO_INT (g_hash_table_lookup (metadataTypes, (gpointer)name));
-	if (0 == type)
+	if (!type || !type->format) {
 		g_warning ("Unknown metadata type: %s, please report this Liferea bug!", name);
-	
-	return type;
+		return 0;
+	}
+
+	return type->format;
 }
 
-GSList * metadata_list_append(GSList *metadata, const gchar *strid, const gchar *data) {
-	GSList		*iter = metadata;
+/* Returns the index of the first value with the given type id or, if
+   there is none, the index at which such a value would be inserted. */
+static guint
+metadata_list_find (metadataListPtr metadata, guint type)
+{
+	guint	low = 0, high = metadata->length;
+
+	while (low < high) {
+		guint mid = (low + high) / 2;
+		if (metadata->values[mid].type < type)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static metadataListPtr
+metadata_list_insert (metadataListPtr metadata, guint type, gchar *value)
+{
+	guint	pos;
+
+	if (!metadata)
+		metadata = g_new0 (struct metadataList, 1);
+
+	if (metadata->length == metadata->size) {
+		metadata->size = metadata->size?(2 * metadata->size):4;
+		metadata->values = g_renew (metadataValue, metadata->values, metadata->size);
+	}
+
+	/* insert behind all existing values of the same type */
+	pos = metadata_list_find (metadata, type + 1);
+	if (pos < metadata->length)
+		memmove (&metadata->values[pos + 1], &metadata->values[pos], (metadata->length - pos) * sizeof (metadataValue));
+
+	metadata->values[pos].type = type;
+	metadata->values[pos].value = value;
+	metadata->length++;
+
+	return metadata;
+}
+
+metadataListPtr
+metadata_list_append (metadataListPtr metadata, const gchar *strid, const gchar *data)
+{
 	gchar		*tmp, *checked_data = NULL;
-	struct pair 	*p;
 	
-	if(NULL == data)
+	if (NULL == data)
 		return metadata;
 	
 	/* lookup type and check format */
-	switch(metadata_get_type(strid)) {
+	switch (metadata_get_type (strid)) {
 		case METADATA_TYPE_ASCII:
 			/* No check because renderer will process further */
-			checked_data = g_strdup(data);
+			checked_data = g_strdup (data);
 			break;
 		case METADATA_TYPE_URL:
 			/* Simple sanity check to see if it doesn't break XML */
-			if(!strchr(data, '<') && !(strchr(data, '>')) && !(strchr(data, '&'))) {
-				checked_data = g_strdup(data);
+			if (!strchr (data, '<') && !(strchr (data, '>')) && !(strchr (data, '&'))) {
+				checked_data = g_strdup (data);
 			} else {
 				checked_data = common_uri_escape (data);
 			}
@@ -192,152 +305,151 @@ GSList * metadata_list_append(GSList *metadata, const gchar *strid, const gchar
 			g_free (tmp);
 			break;
 	}
-	
-	while(iter) {
-		p = (struct pair*)iter->data; 
-		if(g_str_equal(p->strid, strid)) {
-			p->data = g_slist_append(p->data, checked_data);
-			return metadata;
-		}
-		iter = iter->next;
-	}
-	p = g_new(struct pair, 1);
-	p->strid = g_strdup(strid);
-	p->data = g_slist_append(NULL, checked_data);
-	metadata = g_slist_append(metadata, p);
-	return metadata;
+
+	return metadata_list_insert (metadata, metadata_type_get_id (strid), checked_data);
 }
 
-void metadata_list_set(GSList **metadata, const gchar *strid, const gchar *data) {
-	GSList	*iter = *metadata;
-	struct pair *p;
-	
-	while(iter) {
-		p = (struct pair*)iter->data; 
-		if(g_str_equal(p->strid, strid)) {
-			if(p->data) {
-				/* exchange old value */
-				g_free(((GSList *)p->data)->data);
-				((GSList *)p->data)->data = g_strdup(data);
-			} else {
-				p->data = g_slist_append(p->data, g_strdup(data));
-			}
+void
+metadata_list_set (metadataListPtr *metadata, const gchar *strid, const gchar *data)
+{
+	guint	type, pos;
+
+	type = metadata_type_get_id (strid);
+	if (*metadata) {
+		pos = metadata_list_find (*metadata, type);
+		if ((pos < (*metadata)->length) && ((*metadata)->values[pos].type == type)) {
+			/* exchange old value */
+			g_free ((*metadata)->values[pos].value);
+			(*metadata)->values[pos].value = g_strdup (data);
 			return;
 		}
-		iter = iter->next;
 	}
-	p = g_new(struct pair, 1);
-	p->strid = g_strdup(strid);
-	p->data = g_slist_append(NULL, g_strdup(data));
-	*metadata = g_slist_append(*metadata, p);
+
+	*metadata = metadata_list_insert (*metadata, type, g_strdup (data));
 }
 
-void metadata_list_foreach(GSList *metadata, metadataForeachFunc func, gpointer user_data) {
-	GSList	*list = metadata;
-	guint	index = 0;
-	
-	while(list) {
-		struct pair *p = (struct pair*)list->data; 
-		GSList *values = (GSList *)p->data;
-		while(values) {
-			index++;
-			(*func)(p->strid, values->data, index, user_data);
-			values = g_slist_next(values);
-		}
-		list = list->next;
-	}
+void
+metadata_list_foreach (metadataListPtr metadata, metadataForeachFunc func, gpointer user_data)
+{
+	guint	i;
+
+	if (!metadata)
+		return;
+
+	for (i = 0; i < metadata->length; i++)
+		(*func) (metadata_type_get_name (metadata->values[i].type), metadata->values[i].value, i + 1, user_data);
 }
 
-GSList * metadata_list_get_values(GSList *metadata, const gchar *strid) {
-	GSList *list = metadata;
-	
-	while(list) {
-		struct pair *p = (struct pair*)list->data; 
-		if(g_str_equal(p->strid, strid))
-			return p->data;
-		list = list->next;
-	}
-	return NULL;
+GSList *
+metadata_list_get_values (metadataListPtr metadata, const gchar *strid)
+{
+	GSList		*values = NULL;
+	metadataTypePtr	type;
+	guint		pos;
+
+	if (!metadata)
+		return NULL;
+
+	type = metadata_type_lookup (strid);
+	if (!type)
+		return NULL;
+
+	/* collect backwards so prepending keeps the value order */
+	pos = metadata_list_find (metadata, type->id + 1);
+	while ((pos > 0) && (metadata->values[pos - 1].type == type->id))
+		values = g_slist_prepend (values, metadata->values[--pos].value);
+
+	return values;
 }
 
-const gchar * metadata_list_get(GSList *metadata, const gchar *strid) {
-	GSList	*values;
-	
-	values = metadata_list_get_values(metadata, strid);
-	return values?values->data:NULL;
+const gchar *
+metadata_list_get (metadataListPtr metadata, const gchar *strid)
+{
+	metadataTypePtr	type;
+	guint		pos;
+
+	if (!metadata)
+		return NULL;
 
+	type = metadata_type_lookup (strid);
+	if (!type)
+		return NULL;
+
+	pos = metadata_list_find (metadata, type->id);
+	if ((pos < metadata->length) && (metadata->values[pos].type == type->id))
+		return metadata->values[pos].value;
+
+	return NULL;
 }
 
-GSList * metadata_list_copy(GSList *list) {
-	GSList		*copy = NULL;
-	GSList		*iter2, *iter = list;
-	struct pair	*p;
-	
-	while(iter) {
-		p = (struct pair*)iter->data;
-		iter2 = p->data;
-		while(iter2) {
-			copy = metadata_list_append(copy, p->strid, iter2->data);
-			iter2 = iter2->next;
-		}
-		iter = iter->next;
+metadataListPtr
+metadata_list_copy (metadataListPtr metadata)
+{
+	metadataListPtr	copy;
+	guint		i;
+
+	if (!metadata || !metadata->length)
+		return NULL;
+
+	/* values are already checked, so copy them verbatim */
+	copy = g_new0 (struct metadataList, 1);
+	copy->length = copy->size = metadata->length;
+	copy->values = g_new (metadataValue, copy->size);
+	for (i = 0; i < metadata->length; i++) {
+		copy->values[i].type = metadata->values[i].type;
+		copy->values[i].value = g_strdup (metadata->values[i].value);
 	}
-	
+
 	return copy;
 }
 
-void metadata_list_free(GSList *metadata) {
-	GSList		*list2, *iter2, *iter = metadata;
-	struct pair	*p;
-	
-	while(iter != NULL) {
-		p = (struct pair*)iter->data;
-		list2 = p->data;
-		iter2 = list2;
-		while(iter2 != NULL) {
-			g_free(iter2->data);
-			iter2 = iter2->next;
-		}
-		g_slist_free(list2);
-		g_free(p->strid);
-		g_free(p);
-		iter = iter->next;
-	}
-	g_slist_free(metadata);
+void
+metadata_list_free (metadataListPtr metadata)
+{
+	guint	i;
+
+	if (!metadata)
+		return;
+
+	for (i = 0; i < metadata->length; i++)
+		g_free (metadata->values[i].value);
+	g_free (metadata->values);
+	g_free (metadata);
 }
 
-void metadata_add_xml_nodes(GSList *metadata, xmlNodePtr parentNode) {
-	GSList *list = metadata;
-	xmlNodePtr attribute;
-	xmlNodePtr metadataNode = xmlNewChild(parentNode, NULL, "attributes", NULL);
-	
-	while(list) {
-		struct pair *p = (struct pair*)list->data; 
-		GSList *list2 = p->data;
-		while(list2) {
-			attribute = xmlNewTextChild(metadataNode, NULL, "attribute", list2->data);
-			xmlNewProp(attribute, "name", p->strid);
-			list2 = list2->next;
-		}
-		list = list->next;
+void
+metadata_add_xml_nodes (metadataListPtr metadata, xmlNodePtr parentNode)
+{
+	xmlNodePtr	attribute;
+	xmlNodePtr	metadataNode = xmlNewChild (parentNode, NULL, "attributes", NULL);
+	guint		i;
+
+	if (!metadata)
+		return;
+
+	for (i = 0; i < metadata->length; i++) {
+		attribute = xmlNewTextChild (metadataNode, NULL, "attribute", metadata->values[i].value);
+		xmlNewProp (attribute, "name", metadata_type_get_name (metadata->values[i].type));
 	}
 }
 
-GSList * metadata_parse_xml_nodes(xmlNodePtr cur) {
+metadataListPtr
+metadata_parse_xml_nodes (xmlNodePtr cur)
+{
 	xmlNodePtr	attribute = cur->xmlChildrenNode;
-	GSList 		*metadata = NULL;
+	metadataListPtr	metadata = NULL;
 	
-	while(attribute) {
-		if(attribute->type == XML_ELEMENT_NODE &&
-		    !xmlStrcmp(attribute->name, BAD_CAST"attribute")) {
-			xmlChar *name = xmlGetProp(attribute, BAD_CAST"name");
-			if(name) {
-				gchar *value = xmlNodeListGetString(cur->doc, attribute->xmlChildrenNode, TRUE);
-				if(value) {
-					metadata = metadata_list_append(metadata, name, value);
-					xmlFree(value);
+	while (attribute) {
+		if (attribute->type == XML_ELEMENT_NODE &&
+		    !xmlStrcmp (attribute->name, BAD_CAST"attribute")) {
+			xmlChar *name = xmlGetProp (attribute, BAD_CAST"name");
+			if (name) {
+				gchar *value = xmlNodeListGetString (cur->doc, attribute->xmlChildrenNode, TRUE);
+				if (value) {
+					metadata = metadata_list_append (metadata, name, value);
+					xmlFree (value);
 				}
-				xmlFree(name);
+				xmlFree (name);
 			}
 		}
 		attribute = attribute->next;
@@ -46,6 +46,13 @@ typedef struct NsHandler {
 	parseChannelTagFunc	parseChannelTag;	/**< channel tag parsing method */
 } NsHandler;
 
+/**
+ * Metadata lists are compact arrays of (type id, value) pairs kept
+ * ordered by type id. Type ids are small integers interned from the
+ * metadata type registry, so key lookups never compare strings.
+ */
+typedef struct metadataList *metadataListPtr;
+
 /**
  * Checks whether a metadata type is registered
  *
@@ -55,6 +62,27 @@ typedef struct NsHandler {
  */
 gboolean metadata_is_type_registered (const gchar *strid);
 
+/**
+ * Returns the interned type id of the given metadata type identifier.
+ * Unregistered identifiers are interned too (as untyped), so that
+ * every key used in a metadata list has a stable id for the lifetime
+ * of the process.
+ *
+ * @param strid		the metadata type identifier
+ *
+ * @returns a type id > 0
+ */
+guint metadata_type_get_id (const gchar *strid);
+
+/**
+ * Returns the metadata type identifier for an interned type id.
+ *
+ * @param id		the type id
+ *
+ * @returns the metadata type identifier (or NULL for unknown ids)
+ */
+const gchar * metadata_type_get_name (guint id);
+
 /** 
  * Appends a value to the value list of a specific metadata type 
  * Don't mix this function with metadata_list_set() !
@@ -65,7 +93,7 @@ gboolean metadata_is_type_registered (const gchar *strid);
  *
  * @returns the changed meta data list
  */
-GSList * metadata_list_append(GSList *metadata, const gchar *strid, const gchar *data);
+metadataListPtr metadata_list_append (metadataListPtr metadata, const gchar *strid, const gchar *data);
 
 /** 
  * Sets (and overwrites if necessary) the value of a specific metadata type.
@@ -75,7 +103,7 @@ GSList * metadata_list_append(GSList *metadata, const gchar *strid, const gchar
  * @param strid		the metadata type identifier
  * @param data		data to add
  */
-void metadata_list_set(GSList **metadata, const gchar *strid, const gchar *data);
+void metadata_list_set (metadataListPtr *metadata, const gchar *strid, const gchar *data);
 
 /**
  * Returns the first value of a given type from a specified metadata list.
@@ -86,7 +114,7 @@ void metadata_list_set(GSList **metadata, const gchar *strid, const gchar *data)
  *
  * @returns the first value (or NULL)
  */
-const gchar * metadata_list_get(GSList *metadata, const gchar *strid);
+const gchar * metadata_list_get (metadataListPtr metadata, const gchar *strid);
 
 /** 
  * Definition of metadata foreach function 
@@ -105,7 +133,7 @@ typedef void	(*metadataForeachFunc)	(const gchar *key, const gchar *value, guint
  * @param func		callback function
  * @param user_data	data to be passed to func
  */
-void metadata_list_foreach(GSList *metadata, metadataForeachFunc func, gpointer user_data);
+void metadata_list_foreach (metadataListPtr metadata, metadataForeachFunc func, gpointer user_data);
 
 /**
  * Returns a list of all values of a given type from a specified metadata list.
@@ -113,9 +141,10 @@ void metadata_list_foreach(GSList *metadata, metadataForeachFunc func, gpointer
  * @param metadata	the metadata list
  * @param strid		the metadata type identifier
  *
- * @returns a list of values (or NULL)
+ * @returns a list of values (or NULL), the list is to be free'd 
+ *          using g_slist_free(), the values are owned by the metadata list
  */
-GSList * metadata_list_get_values(GSList *metadata, const gchar *strid);
+GSList * metadata_list_get_values (metadataListPtr metadata, const gchar *strid);
 
 /** 
  * Creates a copy of a given metadata list.
@@ -124,14 +153,14 @@ GSList * metadata_list_get_values(GSList *metadata, const gchar *strid);
  *
  * @returns the new list
  */
-GSList * metadata_list_copy(GSList *list);
+metadataListPtr metadata_list_copy (metadataListPtr metadata);
 
 /**
  * Frees all memory allocated by the given metadata list.
  *
  * @param metadata	the metadata list
  */
-void metadata_list_free(GSList *metadata);
+void metadata_list_free (metadataListPtr metadata);
 
 /**
  * Adds the given metadata list to a given XML document node.
@@ -140,7 +169,7 @@ void metadata_list_free(GSList *metadata);
  * @param metadata	the metadata list
  * @param parentNode	the XML node
  */
-void metadata_add_xml_nodes(GSList *metadata, xmlNodePtr parentNode);
+void metadata_add_xml_nodes (metadataListPtr metadata, xmlNodePtr parentNode);
 
 /**
  * Parses the given XML node and returns a new metadata attribute 
@@ -148,8 +177,8 @@ void metadata_add_xml_nodes(GSList *metadata, xmlNodePtr parentNode);
  *
  * @param cur	the XML node to parse
  *
- * @returns list of values
+ * @returns new metadata list
  */
-GSList * metadata_parse_xml_nodes(xmlNodePtr cur);
+metadataListPtr metadata_parse_xml_nodes (xmlNodePtr cur);
 
 #endif
@@ -0,0 +1,377 @@
+/**
+ * @file metrics.c  performance metrics registry
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "metrics.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "common.h"
+#include "debug.h"
+
+/* histogram buckets are powers of two, the last one takes all larger values */
+#define METRICS_BUCKETS	32
+
+typedef enum {
+	METRIC_COUNTER,
+	METRIC_HISTOGRAM,
+	METRIC_GAUGE
+} metricType;
+
+typedef struct metric {
+	gchar		*name;
+	gchar		*label;		/**< label or NULL */
+	metricType	type;
+	guint64		count;		/**< counter: number of updates, histogram: number of samples */
+	gint64		sum;		/**< counter: total, histogram: sum of samples */
+	gint64		min;		/**< histogram: minimum sample */
+	gint64		max;		/**< histogram: maximum sample, gauge: maximum value */
+	gint64		last;		/**< gauge: current value */
+	guint64		buckets[METRICS_BUCKETS];	/**< histogram: samples < 2^i */
+} *metricPtr;
+
+G_LOCK_DEFINE_STATIC (metrics);
+
+/** metric -> metric, hashed and compared by name and label */
+static GHashTable *metrics = NULL;
+
+gint64
+metrics_now (void)
+{
+	struct timespec	ts;
+
+	/* GLib 2.16 has no monotonic clock API */
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (gint64)ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+gchar *
+metrics_host_label (const gchar *url)
+{
+	gchar	*host = NULL;
+
+	if (url)
+		host = common_get_url_host (url);
+
+	return host?host:g_strdup ("local");
+}
+
+static void
+metric_free (metricPtr metric)
+{
+	g_free (metric->name);
+	g_free (metric->label);
+	g_free (metric);
+}
+
+static guint
+metric_hash (gconstpointer key)
+{
+	const struct metric	*metric = key;
+	guint			hash = g_str_hash (metric->name);
+
+	if (metric->label)
+		hash = hash * 31 + g_str_hash (metric->label);
+
+	return hash;
+}
+
+static gboolean
+metric_equal (gconstpointer a, gconstpointer b)
+{
+	const struct metric	*m1 = a;
+	const struct metric	*m2 = b;
+
+	if (strcmp (m1->name, m2->name))
+		return FALSE;
+
+	if (!m1->label || !m2->label)
+		return m1->label == m2->label;
+
+	return !strcmp (m1->label, m2->label);
+}
+
+/* Must be called with the lock held. The lookup key is a metric on
+   the stack with only name and label set so that observing a known
+   metric does not allocate. */
+static metricPtr
+metrics_find (const gchar *name, const gchar *label)
+{
+	struct metric	key;
+
+	if (!metrics)
+		return NULL;
+
+	key.name = (gchar *)name;
+	key.label = (gchar *)label;
+
+	return g_hash_table_lookup (metrics, &key);
+}
+
+/* Must be called with the lock held */
+static metricPtr
+metrics_get (const gchar *name, const gchar *label, metricType type)
+{
+	metricPtr	metric;
+
+	metric = metrics_find (name, label);
+	if (metric)
+		return metric;
+
+	if (!metrics)
+		metrics = g_hash_table_new_full (metric_hash, metric_equal, NULL, (GDestroyNotify)metric_free);
+
+	metric = g_new0 (struct metric, 1);
+	metric->name = g_strdup (name);
+	metric->label = g_strdup (label);
+	metric->type = type;
+	metric->min = G_MAXINT64;
+	metric->max = G_MININT64;
+	g_hash_table_insert (metrics, metric, metric);
+
+	return metric;
+}
+
+void
+metrics_count (const gchar *name, const gchar *label, gint64 value)
+{
+	metricPtr	metric;
+
+	G_LOCK (metrics);
+	metric = metrics_get (name, label, METRIC_COUNTER);
+	metric->count++;
+	metric->sum += value;
+	G_UNLOCK (metrics);
+}
+
+void
+metrics_observe (const gchar *name, const gchar *label, gint64 value)
+{
+	metricPtr	metric;
+	guint		bucket = 0;
+
+	while (bucket < METRICS_BUCKETS - 1 && value >= ((gint64)1 << bucket))
+		bucket++;
+
+	G_LOCK (metrics);
+	metric = metrics_get (name, label, METRIC_HISTOGRAM);
+	metric->count++;
+	metric->sum += value;
+	metric->min = MIN (metric->min, value);
+	metric->max = MAX (metric->max, value);
+	metric->buckets[bucket]++;
+	G_UNLOCK (metrics);
+}
+
+void
+metrics_observe_since (const gchar *name, const gchar *label, gint64 start)
+{
+	metrics_observe (name, label, metrics_now () - start);
+}
+
+void
+metrics_gauge (const gchar *name, gint64 value)
+{
+	metricPtr	metric;
+
+	G_LOCK (metrics);
+	metric = metrics_get (name, NULL, METRIC_GAUGE);
+	metric->count++;
+	metric->last = value;
+	metric->max = MAX (metric->max, value);
+	G_UNLOCK (metrics);
+}
+
+gboolean
+metrics_lookup (const gchar *name, const gchar *label, guint64 *count, gint64 *value, gint64 *max)
+{
+	metricPtr	metric;
+
+	G_LOCK (metrics);
+	metric = metrics_find (name, label);
+	if (metric) {
+		if (count)
+			*count = metric->count;
+		if (value)
+			*value = (metric->type == METRIC_GAUGE)?metric->last:metric->sum;
+		if (max)
+			*max = metric->max;
+	}
+	G_UNLOCK (metrics);
+
+	return (metric != NULL);
+}
+
+static void
+metrics_append_json_string (GString *json, const gchar *str)
+{
+	const gchar	*iter;
+
+	g_string_append_c (json, '"');
+	for (iter = str; *iter; iter++) {
+		switch (*iter) {
+			case '"':
+			case '\\':
+				g_string_append_c (json, '\\');
+				g_string_append_c (json, *iter);
+				break;
+			default:
+				if ((guchar)*iter < 0x20)
+					g_string_append_printf (json, "\\u%04x", (guchar)*iter);
+				else
+					g_string_append_c (json, *iter);
+				break;
+		}
+	}
+	g_string_append_c (json, '"');
+}
+
+static gint
+metrics_compare (gconstpointer a, gconstpointer b)
+{
+	metricPtr	m1 = *(metricPtr *)a;
+	metricPtr	m2 = *(metricPtr *)b;
+	gint		res;
+
+	res = strcmp (m1->name, m2->name);
+	if (res)
+		return res;
+
+	return strcmp (m1->label?m1->label:"", m2->label?m2->label:"");
+}
+
+static void
+metrics_add_to_array (gpointer key, gpointer value, gpointer user_data)
+{
+	g_ptr_array_add ((GPtrArray *)user_data, value);
+}
+
+static void
+metrics_append_json (GString *json, metricPtr metric)
+{
+	guint	i;
+	gboolean first = TRUE;
+
+	g_string_append (json, "{\"name\": ");
+	metrics_append_json_string (json, metric->name);
+	if (metric->label) {
+		g_string_append (json, ", \"label\": ");
+		metrics_append_json_string (json, metric->label);
+	}
+
+	switch (metric->type) {
+		case METRIC_COUNTER:
+			g_string_append_printf (json, ", \"type\": \"counter\", \"count\": %" G_GUINT64_FORMAT ", \"value\": %" G_GINT64_FORMAT,
+			                        metric->count, metric->sum);
+			break;
+		case METRIC_GAUGE:
+			g_string_append_printf (json, ", \"type\": \"gauge\", \"value\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT,
+			                        metric->last, metric->max);
+			break;
+		case METRIC_HISTOGRAM:
+			g_string_append_printf (json, ", \"type\": \"histogram\", \"count\": %" G_GUINT64_FORMAT ", \"sum\": %" G_GINT64_FORMAT
+			                              ", \"min\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT ", \"buckets\": {",
+			                        metric->count, metric->sum, metric->min, metric->max);
+			/* only non-empty buckets, keyed by their exclusive upper bound */
+			for (i = 0; i < METRICS_BUCKETS; i++) {
+				if (!metric->buckets[i])
+					continue;
+				if (i < METRICS_BUCKETS - 1)
+					g_string_append_printf (json, "%s\"%" G_GINT64_FORMAT "\": %" G_GUINT64_FORMAT,
+					                        first?"":", ", (gint64)1 << i, metric->buckets[i]);
+				else
+					g_string_append_printf (json, "%s\"inf\": %" G_GUINT64_FORMAT,
+					                        first?"":", ", metric->buckets[i]);
+				first = FALSE;
+			}
+			g_string_append (json, "}");
+			break;
+	}
+
+	g_string_append (json, "}");
+}
+
+gchar *
+metrics_to_json (void)
+{
+	GString		*json;
+	GPtrArray	*sorted;
+	guint		i;
+
+	json = g_string_new ("{\"version\": \"" VERSION "\", \"metrics\": [");
+
+	G_LOCK (metrics);
+	if (metrics) {
+		sorted = g_ptr_array_new ();
+		g_hash_table_foreach (metrics, metrics_add_to_array, sorted);
+		g_ptr_array_sort (sorted, metrics_compare);
+
+		for (i = 0; i < sorted->len; i++) {
+			g_string_append (json, i?",\n  ":"\n  ");
+			metrics_append_json (json, g_ptr_array_index (sorted, i));
+		}
+		g_ptr_array_free (sorted, TRUE);
+	}
+	G_UNLOCK (metrics);
+
+	g_string_append (json, "\n]}\n");
+
+	return g_string_free (json, FALSE);
+}
+
+gboolean
+metrics_dump (void)
+{
+	gchar		*filename, *json;
+	GError		*error = NULL;
+	gboolean	success;
+
+	filename = common_create_cache_filename (NULL, "metrics", "json");
+	json = metrics_to_json ();
+
+	success = g_file_set_contents (filename, json, -1, &error);
+	if (success) {
+		debug1 (DEBUG_PERF, "Metrics written to %s", filename);
+	} else {
+		g_warning ("Could not write metrics to %s (%s)", filename, error->message);
+		g_error_free (error);
+	}
+
+	g_free (json);
+	g_free (filename);
+
+	return success;
+}
+
+void
+metrics_free (void)
+{
+	G_LOCK (metrics);
+	if (metrics) {
+		g_hash_table_destroy (metrics);
+		metrics = NULL;
+	}
+	G_UNLOCK (metrics);
+}
@@ -0,0 +1,121 @@
+/**
+ * @file metrics.h  performance metrics registry
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#include <glib.h>
+
+/* The metrics registry collects counters, histograms and gauges
+   identified by a name and an optional label (e.g. the host of a
+   download or the prepared statement name). Labels must come from a
+   small set of values, every distinct label creates a new metric. Durations are measured with the
+   monotonic clock in microseconds. All functions are thread-safe,
+   the registry can be dumped as JSON at any time to compare the
+   performance of different releases. */
+
+/**
+ * Returns the current monotonic time.
+ *
+ * @returns time in microseconds
+ */
+gint64 metrics_now (void);
+
+/**
+ * Returns the label for metrics of a download, which is the host
+ * of the URL or "local" for files and commands.
+ *
+ * @param url		the URL
+ *
+ * @returns new label string
+ */
+gchar * metrics_host_label (const gchar *url);
+
+/**
+ * Adds a value to a counter.
+ *
+ * @param name		metric name (e.g. "update.bytes")
+ * @param label		label (or NULL)
+ * @param value		value to add
+ */
+void metrics_count (const gchar *name, const gchar *label, gint64 value);
+
+/**
+ * Adds a sample to a histogram. Samples are counted in
+ * power of two buckets.
+ *
+ * @param name		metric name (e.g. "feed.parse_time")
+ * @param label		label (or NULL)
+ * @param value		sample value (durations in microseconds)
+ */
+void metrics_observe (const gchar *name, const gchar *label, gint64 value);
+
+/**
+ * Adds the time since the given start time to a histogram.
+ *
+ * @param name		metric name
+ * @param label		label (or NULL)
+ * @param start		start time as returned by metrics_now()
+ */
+void metrics_observe_since (const gchar *name, const gchar *label, gint64 start);
+
+/**
+ * Sets a gauge. The registry keeps the last and the maximum value.
+ *
+ * @param name		metric name (e.g. "update.queue_length")
+ * @param value		current value
+ */
+void metrics_gauge (const gchar *name, gint64 value);
+
+/**
+ * Looks up the current values of a metric.
+ *
+ * @param name		metric name
+ * @param label		label (or NULL)
+ * @param count		returns the number of updates or samples (or NULL)
+ * @param value		returns the counter total, the histogram sum or the
+ *			current gauge value (or NULL)
+ * @param max		returns the maximum sample or gauge value (or NULL)
+ *
+ * @returns FALSE if the metric does not exist
+ */
+gboolean metrics_lookup (const gchar *name, const gchar *label, guint64 *count, gint64 *value, gint64 *max);
+
+/**
+ * Serializes all metrics.
+ *
+ * @returns new JSON string (to be free'd using g_free)
+ */
+gchar * metrics_to_json (void);
+
+/**
+ * Writes all metrics as JSON to metrics.json in the cache directory.
+ *
+ * @returns TRUE on success
+ */
+gboolean metrics_dump (void);
+
+/**
+ * Frees all metrics.
+ */
+void metrics_free (void);
+
+#endif
@@ -29,10 +29,42 @@
 #include <time.h>
 
 #include "common.h"
+#include "conf.h"
 #include "debug.h"
+#include "xml.h"
 
 #define HOMEPAGE	"http://liferea.sf.net/"
 
+/* connection pool defaults (used if the settings are 0) */
+#define NETWORK_DEFAULT_MAX_CONNS		10
+#define NETWORK_DEFAULT_MAX_CONNS_PER_HOST	2
+#define NETWORK_DEFAULT_IDLE_TIMEOUT		30
+
+/* Downloads parsed while downloading keep their data only up to this
+   size for HTML auto discovery, larger downloads only keep the document */
+#define NETWORK_PARSE_KEEP_DATA_MAX		(256 * 1024)
+
+/* maximum buffer size allocated in advance from the Content-Length */
+#define NETWORK_PREALLOC_MAX			(4 * 1024 * 1024)
+
+/** download state of a message */
+typedef struct networkTransfer {
+	GTimeVal		started;	/**< time the message was queued */
+	GString			*data;		/**< received data (NULL if not kept) */
+	gsize			size;		/**< number of received bytes */
+	xmlStreamParserPtr	parser;		/**< parser for the received data (or NULL) */
+} *networkTransferPtr;
+
+/** streamed download state */
+struct networkDownload {
+	SoupMessage			*msg;
+	const networkDownloadFuncs	*funcs;
+	gpointer			user_data;
+	gboolean			accepting;	/**< TRUE if the body of the current response is wanted */
+	gboolean			cancelled;	/**< TRUE if no callbacks are to be run anymore */
+	guint				resumeTimer;	/**< timer to unpause the message (or 0) */
+};
+
 static SoupSession *session = NULL;
 
 static gchar	*proxyname = NULL;
@@ -40,12 +72,133 @@ static gchar	*proxyusername = NULL;
 static gchar	*proxypassword = NULL;
 static int	proxyport = 0;
 
+static guint	maxConnsPerHost = NETWORK_DEFAULT_MAX_CONNS_PER_HOST;
+static networkStats stats;
+
+static void
+network_transfer_reset (networkTransferPtr transfer)
+{
+	if (transfer->data)
+		g_string_free (transfer->data, TRUE);
+	transfer->data = NULL;
+	transfer->size = 0;
+
+	if (transfer->parser) {
+		/* nothing is to be processed from an incomplete document */
+		xml_stream_parser_set_element_func (transfer->parser, NULL, NULL);
+		xmlFreeDoc (xml_stream_parser_finish (transfer->parser, NULL));
+		transfer->parser = NULL;
+	}
+}
+
+static void
+network_transfer_free (networkTransferPtr transfer)
+{
+	network_transfer_reset (transfer);
+	g_free (transfer);
+}
+
+/* Called for each response (also for redirects and authentication
+   retries), only the body of the last response is kept. */
+static void
+network_got_headers (SoupMessage *msg, gpointer user_data)
+{
+	updateJobPtr		job = (updateJobPtr)user_data;
+	networkTransferPtr	transfer = g_object_get_data (G_OBJECT (msg), "liferea-transfer");
+	goffset			length;
+
+	network_transfer_reset (transfer);
+
+	length = soup_message_headers_get_content_length (msg->response_headers);
+	transfer->data = g_string_sized_new (MIN (length, NETWORK_PREALLOC_MAX) + 1);
+
+	if (job->request->parseXml && SOUP_STATUS_IS_SUCCESSFUL (msg->status_code)) {
+		transfer->parser = xml_stream_parser_new ();
+		if (job->request->elementFunc)
+			xml_stream_parser_set_element_func (transfer->parser, job->request->elementFunc, job->request->elementData);
+	}
+}
+
+static void
+network_got_chunk (SoupMessage *msg, SoupBuffer *chunk, gpointer user_data)
+{
+	updateJobPtr		job = (updateJobPtr)user_data;
+	networkTransferPtr	transfer = g_object_get_data (G_OBJECT (msg), "liferea-transfer");
+	gboolean		parsing = FALSE;
+
+	transfer->size += chunk->length;
+
+	if (transfer->parser)
+		parsing = xml_stream_parser_push (transfer->parser, chunk->data, chunk->length);
+
+	if (!transfer->data)
+		return;
+
+	g_string_append_len (transfer->data, chunk->data, chunk->length);
+
+	/* Once a large document parses fine the data is not needed anymore */
+	if (parsing && transfer->data->len > NETWORK_PARSE_KEEP_DATA_MAX) {
+		debug1 (DEBUG_NET, "dropping data of %s, it is parsed while downloading", job->request->source);
+		g_string_free (transfer->data, TRUE);
+		transfer->data = NULL;
+	}
+}
+
+/* Returns the time until which the response may be used without
+   revalidation (0 if it must be revalidated, -1 if it must not be stored) */
+static glong
+network_get_expires (SoupMessage *msg)
+{
+	GHashTable	*params;
+	const gchar	*tmp;
+	glong		expires = 0;
+
+	tmp = soup_message_headers_get_list (msg->response_headers, "Cache-Control");
+	if (tmp) {
+		gchar *maxAge;
+
+		params = soup_header_parse_param_list (tmp);
+		if (g_hash_table_lookup_extended (params, "no-store", NULL, NULL)) {
+			soup_header_free_param_list (params);
+			return -1;
+		}
+		if (g_hash_table_lookup_extended (params, "no-cache", NULL, NULL)) {
+			soup_header_free_param_list (params);
+			return 0;
+		}
+		maxAge = g_hash_table_lookup (params, "max-age");
+		if (maxAge) {
+			glong seconds = common_parse_long (maxAge, 0);
+
+			soup_header_free_param_list (params);
+			return seconds > 0 ? time (NULL) + seconds : 0;
+		}
+		soup_header_free_param_list (params);
+	}
+
+	tmp = soup_message_headers_get_one (msg->response_headers, "Expires");
+	if (tmp) {
+		SoupDate *date = soup_date_new_from_string (tmp);
+
+		/* invalid dates mean "already expired" */
+		if (date) {
+			expires = soup_date_to_time_t (date);
+			soup_date_free (date);
+		}
+	}
+
+	return expires;
+}
+
 static void
 network_process_callback (SoupSession *session, SoupMessage *msg, gpointer user_data)
 {
-	updateJobPtr	job = (updateJobPtr)user_data;
-	SoupDate	*last_modified;
-	const gchar	*tmp = NULL;
+	updateJobPtr		job = (updateJobPtr)user_data;
+	networkTransferPtr	transfer = g_object_get_data (G_OBJECT (msg), "liferea-transfer");
+	SoupDate		*last_modified;
+	const gchar		*tmp = NULL;
+	GTimeVal		now;
+	gdouble			elapsed;
 
 	job->result->source = soup_uri_to_string (soup_message_get_uri(msg), FALSE);
 	if (SOUP_STATUS_IS_TRANSPORT_ERROR (msg->status_code)) {
@@ -59,9 +212,41 @@ network_process_callback (SoupSession *session, SoupMessage *msg, gpointer user_
 	debug1 (DEBUG_NET, "download status code: %d", msg->status_code);
 	debug1 (DEBUG_NET, "source after download: >>>%s<<<\n", job->result->source);
 
-	job->result->data = g_memdup (msg->response_body->data, msg->response_body->length+1);
-	job->result->size = (size_t)msg->response_body->length;
-	debug1 (DEBUG_NET, "%d bytes downloaded", job->result->size);
+	/* The body is not accumulated by libsoup, but collected
+	   and parsed chunk by chunk by the handlers above. */
+	if (transfer->parser) {
+		GString	*errors;
+
+		job->result->doc = xml_stream_parser_finish (transfer->parser, &errors);
+		transfer->parser = NULL;
+
+		/* If the data was kept it is parsed again (reporting
+		   the same errors) for the HTML auto discovery */
+		if (job->result->doc || !transfer->data)
+			job->result->docErrors = errors;
+		else if (errors)
+			g_string_free (errors, TRUE);
+	}
+
+	if (job->result->doc) {
+		if (transfer->data)
+			g_string_free (transfer->data, TRUE);
+	} else if (transfer->data) {
+		job->result->data = g_string_free (transfer->data, FALSE);
+	} else if (!job->result->docErrors) {
+		job->result->data = g_strdup ("");	/* no response body at all */
+	}
+	transfer->data = NULL;
+	job->result->size = transfer->size;
+	debug2 (DEBUG_NET, "%d bytes downloaded%s", job->result->size, job->result->doc ? " and parsed" : "");
+
+	g_get_current_time (&now);
+	elapsed = (now.tv_sec - transfer->started.tv_sec) + (now.tv_usec - transfer->started.tv_usec) / 1000000.0;
+	stats.fetchTime += elapsed;
+	if (elapsed > stats.maxFetchTime)
+		stats.maxFetchTime = elapsed;
+	stats.requests++;
+	stats.bytes += job->result->size;
 
 	job->result->contentType = g_strdup (soup_message_headers_get_content_type (msg->response_headers, NULL));
 
@@ -77,6 +262,11 @@ network_process_callback (SoupSession *session, SoupMessage *msg, gpointer user_
 		}
 	}
 
+	update_state_set_etag (job->result->updateState,
+	                       soup_message_headers_get_one (msg->response_headers, "ETag"));
+
+	job->result->expires = network_get_expires (msg);
+
 	update_process_finished_job (job);
 }
 
@@ -108,8 +298,9 @@ network_get_proxy_uri (void)
 void
 network_process_request (const updateJobPtr const job)
 {
-	SoupMessage	*msg;
-	SoupDate	*date;
+	SoupMessage		*msg;
+	SoupDate		*date;
+	networkTransferPtr	transfer;
 
 	g_assert (NULL != job->request);
 	debug1 (DEBUG_NET, "downloading %s", job->request->source);
@@ -145,6 +336,11 @@ network_process_request (const updateJobPtr const job)
 		soup_date_free (date);
 	}
 
+	/* Set the If-None-Match: header */
+	if (job->request->updateState && job->request->updateState->etag)
+		soup_message_headers_append (msg->request_headers, "If-None-Match",
+		                             job->request->updateState->etag);
+
 	/* Set the authentication */
 	if (!job->request->authValue &&
 	    job->request->options &&
@@ -181,9 +377,148 @@ network_process_request (const updateJobPtr const job)
 	    (network_get_proxy_host () == NULL))
 		soup_message_disable_feature (msg, SOUP_TYPE_PROXY_URI_RESOLVER);
 
+	/* Collect the body ourselves to avoid copying it and to
+	   parse it while downloading */
+	transfer = g_new0 (struct networkTransfer, 1);
+	g_get_current_time (&transfer->started);
+	g_object_set_data_full (G_OBJECT (msg), "liferea-transfer", transfer, (GDestroyNotify)network_transfer_free);
+	soup_message_body_set_accumulate (msg->response_body, FALSE);
+	g_signal_connect (msg, "got-headers", G_CALLBACK (network_got_headers), job);
+	g_signal_connect (msg, "got-chunk", G_CALLBACK (network_got_chunk), job);
+
 	soup_session_queue_message (session, msg, network_process_callback, job);
 }
 
+/* Like for update requests the got-headers signal is
+   emitted for each response, only successful ones count. */
+static void
+network_download_got_headers (SoupMessage *msg, gpointer user_data)
+{
+	networkDownloadPtr	download = (networkDownloadPtr)user_data;
+	goffset			start, end, total = -1;
+
+	download->accepting = SOUP_STATUS_IS_SUCCESSFUL (msg->status_code);
+	if (!download->accepting)
+		return;
+
+	if (SOUP_STATUS_PARTIAL_CONTENT == msg->status_code) {
+		if (!soup_message_headers_get_content_range (msg->response_headers, &start, &end, &total)) {
+			/* we cannot know where the data belongs to */
+			download->accepting = FALSE;
+			soup_session_cancel_message (session, msg, SOUP_STATUS_MALFORMED);
+			return;
+		}
+	} else {
+		start = 0;
+		if (SOUP_ENCODING_CONTENT_LENGTH == soup_message_headers_get_encoding (msg->response_headers))
+			total = soup_message_headers_get_content_length (msg->response_headers);
+	}
+
+	debug2 (DEBUG_NET, "download started at %" G_GINT64_FORMAT " (size %" G_GINT64_FORMAT ")",
+	        (gint64)start, (gint64)total);
+
+	download->funcs->started (download->user_data, start, total);
+}
+
+static void
+network_download_got_chunk (SoupMessage *msg, SoupBuffer *chunk, gpointer user_data)
+{
+	networkDownloadPtr	download = (networkDownloadPtr)user_data;
+
+	if (download->accepting && !download->cancelled)
+		download->funcs->received (download->user_data, chunk->data, chunk->length);
+}
+
+static void
+network_download_callback (SoupSession *session, SoupMessage *msg, gpointer user_data)
+{
+	networkDownloadPtr	download = (networkDownloadPtr)user_data;
+
+	if (download->resumeTimer)
+		g_source_remove (download->resumeTimer);
+
+	if (!download->cancelled) {
+		if (SOUP_STATUS_IS_TRANSPORT_ERROR (msg->status_code))
+			download->funcs->finished (download->user_data, msg->status_code, 0);
+		else
+			download->funcs->finished (download->user_data, 0, msg->status_code);
+	}
+
+	g_free (download);
+}
+
+networkDownloadPtr
+network_download_new (const gchar *url, goffset offset, const networkDownloadFuncs *funcs, gpointer user_data)
+{
+	networkDownloadPtr	download;
+	SoupMessage		*msg;
+
+	debug2 (DEBUG_NET, "downloading %s from offset %" G_GINT64_FORMAT, url, (gint64)offset);
+
+	msg = soup_message_new (SOUP_METHOD_GET, url);
+	if (!msg) {
+		g_warning ("The download of %s could not be parsed!", url);
+		return NULL;
+	}
+
+	/* Ranges refer to the encoded body, so resumable
+	   downloads must not be content encoded */
+	soup_message_disable_feature (msg, SOUP_TYPE_CONTENT_DECODER);
+	if (offset > 0)
+		soup_message_headers_set_range (msg->request_headers, offset, -1);
+
+	if (network_get_proxy_host () == NULL)
+		soup_message_disable_feature (msg, SOUP_TYPE_PROXY_URI_RESOLVER);
+
+	download = g_new0 (struct networkDownload, 1);
+	download->msg = msg;
+	download->funcs = funcs;
+	download->user_data = user_data;
+
+	soup_message_body_set_accumulate (msg->response_body, FALSE);
+	g_signal_connect (msg, "got-headers", G_CALLBACK (network_download_got_headers), download);
+	g_signal_connect (msg, "got-chunk", G_CALLBACK (network_download_got_chunk), download);
+
+	soup_session_queue_message (session, msg, network_download_callback, download);
+
+	return download;
+}
+
+static gboolean
+network_download_resume (gpointer user_data)
+{
+	networkDownloadPtr	download = (networkDownloadPtr)user_data;
+
+	download->resumeTimer = 0;
+	soup_session_unpause_message (session, download->msg);
+
+	return FALSE;
+}
+
+void
+network_download_pause (networkDownloadPtr download, guint delay)
+{
+	if (download->resumeTimer || download->cancelled)
+		return;
+
+	soup_session_pause_message (session, download->msg);
+	download->resumeTimer = g_timeout_add (delay, network_download_resume, download);
+}
+
+void
+network_download_cancel (networkDownloadPtr download)
+{
+	download->cancelled = TRUE;
+	if (download->resumeTimer) {
+		g_source_remove (download->resumeTimer);
+		download->resumeTimer = 0;
+		soup_session_unpause_message (session, download->msg);
+	}
+
+	/* network_download_callback() frees the download */
+	soup_session_cancel_message (session, download->msg, SOUP_STATUS_CANCELLED);
+}
+
 static void
 network_authenticate (
 	SoupSession *session,
@@ -199,6 +534,19 @@ network_authenticate (
 	// FIXME: Handle HTTP 401 too
 }
 
+/* Counts new and reused connections. Sockets are marked
+   when the first request is sent over them. */
+static void
+network_request_started (SoupSession *session, SoupMessage *msg, SoupSocket *socket, gpointer data)
+{
+	if (g_object_get_data (G_OBJECT (socket), "liferea-used")) {
+		stats.reusedConnections++;
+	} else {
+		stats.newConnections++;
+		g_object_set_data (G_OBJECT (socket), "liferea-used", GINT_TO_POINTER (1));
+	}
+}
+
 void
 network_init (void)
 {
@@ -207,6 +555,7 @@ network_init (void)
 	gchar		*filename;
 	SoupLogger	*logger;
 	SoupURI		*proxy;
+	gint		maxConns = 0, perHost = 0, idleTimeout = 0;
 
 	/* Set an appropriate user agent */
 	if (g_getenv ("LANG")) {
@@ -222,18 +571,32 @@ network_init (void)
 	cookies = soup_cookie_jar_text_new (filename, FALSE);
 	g_free (filename);
 
+	/* Connection pool settings */
+	if (!conf_get_int_value (NETWORK_MAX_CONNS, &maxConns) || maxConns <= 0)
+		maxConns = NETWORK_DEFAULT_MAX_CONNS;
+	if (!conf_get_int_value (NETWORK_MAX_CONNS_PER_HOST, &perHost) || perHost <= 0)
+		perHost = NETWORK_DEFAULT_MAX_CONNS_PER_HOST;
+	if (!conf_get_int_value (NETWORK_IDLE_TIMEOUT, &idleTimeout) || idleTimeout <= 0)
+		idleTimeout = NETWORK_DEFAULT_IDLE_TIMEOUT;
+	maxConnsPerHost = MIN (perHost, maxConns);
+	debug3 (DEBUG_NET, "connection pool: %d connections, %d per host, %ds idle timeout", maxConns, maxConnsPerHost, idleTimeout);
+
 	/* Initialize libsoup */
 	proxy = network_get_proxy_uri ();
 	session = soup_session_async_new_with_options (SOUP_SESSION_USER_AGENT, useragent,
 						       SOUP_SESSION_TIMEOUT, 120,
-						       SOUP_SESSION_IDLE_TIMEOUT, 30,
+						       SOUP_SESSION_IDLE_TIMEOUT, idleTimeout,
+						       SOUP_SESSION_MAX_CONNS, maxConns,
+						       SOUP_SESSION_MAX_CONNS_PER_HOST, maxConnsPerHost,
 						       SOUP_SESSION_PROXY_URI, proxy,
 						       SOUP_SESSION_ADD_FEATURE, cookies,
+						       SOUP_SESSION_ADD_FEATURE_BY_TYPE, SOUP_TYPE_CONTENT_DECODER,
 						       NULL);
 	if (proxy)
 		soup_uri_free (proxy);
 		
 	g_signal_connect (session, "authenticate", G_CALLBACK (network_authenticate), NULL);
+	g_signal_connect (session, "request-started", G_CALLBACK (network_request_started), NULL);
 
 	/* Soup debugging */
 	if (debug_level & DEBUG_NET) {
@@ -247,11 +610,27 @@ network_init (void)
 void 
 network_deinit (void)
 {
+	debug6 (DEBUG_NET, "%u requests, %u new and %u reused connections, %" G_GUINT64_FORMAT " bytes, fetch time avg %.0fms max %.0fms",
+	        stats.requests, stats.newConnections, stats.reusedConnections, stats.bytes,
+	        stats.requests ? stats.fetchTime * 1000 / stats.requests : 0.0, stats.maxFetchTime * 1000);
+
 	g_free (proxyname);
 	g_free (proxyusername);
 	g_free (proxypassword);
 }
 
+guint
+network_get_max_conns_per_host (void)
+{
+	return maxConnsPerHost;
+}
+
+const networkStats *
+network_get_stats (void)
+{
+	return &stats;
+}
+
 const gchar *
 network_get_proxy_host (void)
 {
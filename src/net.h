@@ -27,6 +27,40 @@
 
 /* Simple glue layer to abstract network code */
 
+/** HTTP connection reuse statistics */
+typedef struct networkStats {
+	guint	requests;		/**< number of finished requests */
+	guint	newConnections;		/**< number of requests sent over a new connection */
+	guint	reusedConnections;	/**< number of requests sent over a kept alive connection */
+	guint64	bytes;			/**< number of downloaded bytes */
+	gdouble	fetchTime;		/**< sum of the request durations in seconds */
+	gdouble	maxFetchTime;		/**< longest request duration in seconds */
+} networkStats;
+
+/** a streamed download to be saved to a file (see network_download_new()) */
+typedef struct networkDownload *networkDownloadPtr;
+
+/** callbacks of a streamed download */
+typedef struct networkDownloadFuncs {
+	/**
+	 * Called when a successful response starts. The offset is the
+	 * position of the first received byte in the file (0 unless a
+	 * Range request was answered with "206 Partial Content"), the
+	 * total size is -1 if the server did not tell.
+	 */
+	void	(*started)	(gpointer user_data, goffset offset, goffset total);
+
+	/** Called for each received chunk of the response body. */
+	void	(*received)	(gpointer user_data, const gchar *data, gsize length);
+
+	/**
+	 * Called once when the download is done, the download is
+	 * free'd afterwards. A successful download has a 2xx HTTP
+	 * status and a zero network status.
+	 */
+	void	(*finished)	(gpointer user_data, gint netstatus, gint httpstatus);
+} networkDownloadFuncs;
+
 /** 
  * Initialize HTTP client networking support.
  */
@@ -77,6 +111,21 @@ const gchar * network_get_proxy_username (void);
  */
 const gchar * network_get_proxy_password (void);
 
+/**
+ * Returns the maximum number of connections opened
+ * to a single host.
+ *
+ * @returns the connection limit per host
+ */
+guint network_get_max_conns_per_host (void);
+
+/**
+ * Returns the connection reuse statistics since startup.
+ *
+ * @returns the statistics
+ */
+const networkStats * network_get_stats (void);
+
 /**
  * Process the given update job.
  *
@@ -84,6 +133,36 @@ const gchar * network_get_proxy_password (void);
  */
 void network_process_request (const updateJobPtr const job);
 
+/**
+ * Starts downloading the given URL. The body is not collected
+ * but passed chunk by chunk to the given callbacks.
+ *
+ * @param url		the URL to download
+ * @param offset	position to resume the download from (0 for the whole file)
+ * @param funcs		the download callbacks (must stay valid until finished)
+ * @param user_data	data passed to the callbacks
+ *
+ * @returns new download or NULL if the URL is invalid
+ */
+networkDownloadPtr network_download_new (const gchar *url, goffset offset, const networkDownloadFuncs *funcs, gpointer user_data);
+
+/**
+ * Stops receiving data of the given download for a while.
+ * Used to limit the bandwidth of downloads.
+ *
+ * @param download	the download
+ * @param delay		pause duration in ms
+ */
+void network_download_pause (networkDownloadPtr download, guint delay);
+
+/**
+ * Cancels the given download. No more callbacks are run
+ * and the download is free'd.
+ *
+ * @param download	the download
+ */
+void network_download_cancel (networkDownloadPtr download);
+
 /**
  * Returns explanation string for the given network error code.
  *
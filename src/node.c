@@ -30,12 +30,10 @@
 #include "node.h"
 #include "node_view.h"
 #include "render.h"
+#include "ui_observer.h"
 #include "update.h"
 #include "vfolder.h"
 #include "fl_sources/node_source.h"
-#include "ui/liferea_shell.h"
-#include "ui/ui_node.h"
-#include "ui/ui_tray.h"
 
 static GHashTable *nodes = NULL;	/**< node id -> node lookup table */
 
@@ -223,9 +221,8 @@ node_update_parent_counters (nodePtr node)
 	NODE_TYPE (node)->update_counters (node);
 	
 	if (old != node->unreadCount) {
-		ui_node_update (node->id);
-		ui_tray_update ();
-		liferea_shell_update_unread_stats ();
+		ui_observer_node_changed (node);
+		ui_observer_update_stats ();
 	}
 	
 	if (node->parent)
@@ -238,17 +235,21 @@ node_update_counters (nodePtr node)
 	guint oldUnreadCount = node->unreadCount;
 	guint oldItemCount = node->itemCount;
 
+	debug_enter ("node_update_counters");
+
 	/* Update the node itself and its children */
 	node_calc_counters (node);
 	
 	if ((oldUnreadCount != node->unreadCount) ||
 	    (oldItemCount != node->itemCount))
-		ui_node_update (node->id);
+		ui_observer_node_changed (node);
 		
 	/* Update the unread count of the parent nodes,
 	   usually they just add all child unread counters */
 	if (!IS_VFOLDER (node))
 		node_update_parent_counters (node->parent);
+
+	debug_exit ("node_update_counters");
 }
 
 void
@@ -30,6 +30,7 @@
 
 #include "common.h"
 #include "conf.h"
+#include "db.h"
 #include "debug.h"
 #include "item.h"
 #include "item_state.h"
@@ -42,9 +43,18 @@
 
 #include "notification/notification.h"
 
+/* Feeds updated within this delay (in s) are notified together */
+#define NOTIF_BATCH_DELAY	3
+
+/* Number of headlines listed in a summary notification */
+#define NOTIF_MAX_TITLES	5
+
 static gboolean supports_actions = FALSE;
 static gboolean supports_append  = FALSE;
 
+static GSList	*pendingNodes = NULL;	/**< ids of updated nodes waiting for notification */
+static guint	batchTimer = 0;
+
 static void
 notif_libnotify_callback_open (NotifyNotification *n, gchar *action, gpointer user_data)
 {
@@ -91,7 +101,7 @@ notif_libnotify_callback_show_details (NotifyNotification *n, gchar *action, gpo
 {
 	nodePtr node_p;
 
-	GList *list_p;
+	guint i;
 	itemPtr item_p;
 
 	gchar *labelText_p;
@@ -113,9 +123,8 @@ notif_libnotify_callback_show_details (NotifyNotification *n, gchar *action, gpo
 		labelText_now_p = g_strdup ("");
 
 		/* Gather the feed's headlines */
-		list_p = itemSet->ids;
-		while (list_p) {
-			item_p = item_load (GPOINTER_TO_UINT (list_p->data));
+		for (i = 0; i < itemset_get_length (itemSet); i++) {
+			item_p = item_load (itemset_get_id (itemSet, i));
 			if (item_p->popupStatus && !item_p->readStatus) {
 				item_p->popupStatus = FALSE;
 				item_count += 1;
@@ -140,7 +149,6 @@ notif_libnotify_callback_show_details (NotifyNotification *n, gchar *action, gpo
 				g_free(labelText_prev_p);
 			}
 			item_unload (item_p);
-			list_p = g_list_next (list_p);
 		}
 		itemset_free (itemSet);
 
@@ -211,41 +219,24 @@ notif_libnotify_init (void)
 static void
 notif_libnotify_deinit (void)
 {
+	if (batchTimer) {
+		g_source_remove (batchTimer);
+		batchTimer = 0;
+	}
+
+	g_slist_foreach (pendingNodes, (GFunc)g_free, NULL);
+	g_slist_free (pendingNodes);
+	pendingNodes = NULL;
+
 	notify_uninit();
 }
 
 static void
-notif_libnotify_node_has_new_items (nodePtr node, gboolean enforced)
+notif_libnotify_show_node (nodePtr node, gint item_count)
 {
-	itemSetPtr	itemSet;
-	GList		*iter;
-
 	NotifyNotification *n;
 
 	gchar		*labelSummary_p;
-	gint		item_count = 0;
-
-	gboolean	show_popup_windows;
-
-	conf_get_bool_value(SHOW_POPUP_WINDOWS, &show_popup_windows);
-
-	if (!show_popup_windows && !enforced)
-		return;
-
-	/* Count updated feed */
-	itemSet = node_get_itemset (node);
-	iter = itemSet->ids;
-	while (iter) {
-		itemPtr item = item_load (GPOINTER_TO_UINT (iter->data));
-		if (item->popupStatus && !item->readStatus)
-			item_count++;
-		item_unload (item);
-		iter = g_list_next (iter);
-	}
-	itemset_free (itemSet);
-
-	if (item_count == 0)
-		return;
 
 	labelSummary_p = g_strdup_printf (ngettext ("<b>%s</b> has <b>%d</b> update", "<b>%s</b> has <b>%d</b> updates", item_count), 
 	                                  node_get_title (node), item_count);
@@ -278,6 +269,92 @@ notif_libnotify_node_has_new_items (nodePtr node, gboolean enforced)
 		g_warning ("notif_libnotify.c - failed to send notification via libnotify");
 }
 
+static void
+notif_libnotify_show_summary (popupStatsPtr stats)
+{
+	NotifyNotification *n;
+
+	GString		*label;
+	GSList		*iter;
+	gchar		*tmp;
+	guint		feed_count = g_hash_table_size (stats->nodeCounts);
+
+	label = g_string_new (NULL);
+	tmp = g_strdup_printf (ngettext ("<b>%d</b> update", "<b>%d</b> updates", stats->count), stats->count);
+	g_string_append (label, tmp);
+	g_free (tmp);
+	tmp = g_strdup_printf (ngettext (" in <b>%d</b> feed", " in <b>%d</b> feeds", feed_count), feed_count);
+	g_string_append (label, tmp);
+	g_free (tmp);
+
+	for (iter = stats->titles; iter; iter = g_slist_next (iter)) {
+		tmp = g_markup_escape_text ((gchar *)iter->data, -1);
+		g_string_append_printf (label, "\n%s", tmp);
+		g_free (tmp);
+	}
+
+	n = notify_notification_new (_("Feed Update"), label->str, "liferea", NULL);
+	g_string_free (label, TRUE);
+
+	notify_notification_set_timeout (n, NOTIFY_EXPIRES_DEFAULT);
+	notify_notification_set_category (n, "feed");
+	notify_notification_attach_to_status_icon (n, ui_tray_get_status_icon ());
+
+	if (!notify_notification_show (n, NULL))
+		g_warning ("notif_libnotify.c - failed to send notification via libnotify");
+}
+
+static gboolean
+notif_libnotify_batch_cb (gpointer user_data)
+{
+	popupStatsPtr	stats;
+	GList		*nodeIds;
+	nodePtr		node;
+
+	batchTimer = 0;
+
+	stats = db_itemset_get_popup_stats (pendingNodes, NOTIF_MAX_TITLES);
+
+	g_slist_foreach (pendingNodes, (GFunc)g_free, NULL);
+	g_slist_free (pendingNodes);
+	pendingNodes = NULL;
+
+	debug2 (DEBUG_GUI, "notifying %u new items in %u feeds", stats->count, g_hash_table_size (stats->nodeCounts));
+
+	if (1 == g_hash_table_size (stats->nodeCounts)) {
+		nodeIds = g_hash_table_get_keys (stats->nodeCounts);
+		node = node_from_id ((gchar *)nodeIds->data);
+		if (node)
+			notif_libnotify_show_node (node, stats->count);
+		g_list_free (nodeIds);
+	} else if (stats->count > 0) {
+		notif_libnotify_show_summary (stats);
+	}
+
+	db_popup_stats_free (stats);
+
+	return FALSE;
+}
+
+static void
+notif_libnotify_node_has_new_items (nodePtr node, gboolean enforced)
+{
+	gboolean	show_popup_windows;
+
+	conf_get_bool_value(SHOW_POPUP_WINDOWS, &show_popup_windows);
+
+	if (!show_popup_windows && !enforced)
+		return;
+
+	/* Counting is deferred so that feeds updated in the same
+	   batch are counted with one query and notified together */
+	if (!g_slist_find_custom (pendingNodes, node->id, (GCompareFunc)strcmp))
+		pendingNodes = g_slist_prepend (pendingNodes, g_strdup (node->id));
+
+	if (!batchTimer)
+		batchTimer = g_timeout_add_seconds (NOTIF_BATCH_DELAY, notif_libnotify_batch_cb, NULL);
+}
+
 struct notificationPlugin libnotify_plugin = {
 	"libnotify",
 	notif_libnotify_init,
@@ -42,5 +42,8 @@ notification_plugin_register (notificationPluginPtr plugin)
 void
 notification_node_has_new_items(nodePtr node, gboolean enforced)
 {
+	if (!notificationPlugin)
+		return;	/* not registered without libnotify or when running headless */
+
 	(notificationPlugin->node_has_new_items)(node, enforced);
 }
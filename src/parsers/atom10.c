@@ -805,6 +805,31 @@ atom10_parse_feed (feedParserCtxtPtr ctxt, xmlNodePtr cur)
 	}
 }
 
+/* Entries are parsed as soon as they are complete while downloading.
+   Undated entries get the feed date later (see feed_parse()). */
+static itemPtr
+atom10_parse_entry_element (feedParserCtxtPtr ctxt, xmlNodePtr cur)
+{
+	if (!cur->ns || !cur->ns->href || (cur->parent != xmlDocGetRootElement (cur->doc)))
+		return NULL;
+
+	if (!xmlStrEqual (cur->ns->href, ATOM10_NS))
+		return NULL;
+
+	/* The feed link provides the homepage and the default xml:base
+	   for relative entry links, so the following entries need it.
+	   It is kept in the document for the feed parser. */
+	if (xmlStrEqual (cur->name, BAD_CAST"link")) {
+		atom10_parse_feed_link (cur, ctxt, NULL);
+		return NULL;
+	}
+
+	if (!xmlStrEqual (cur->name, BAD_CAST"entry"))
+		return NULL;
+
+	return atom10_parse_entry (ctxt, cur);
+}
+
 static gboolean
 atom10_format_check (xmlDocPtr doc, xmlNodePtr cur)
 {
@@ -853,6 +878,7 @@ atom10_init_feed_handler (void)
 	fhp->typeStr = "atom";
 	fhp->feedParser	= atom10_parse_feed;
 	fhp->checkFormat = atom10_format_check;
+	fhp->itemParser = atom10_parse_entry_element;
 
 	return fhp;
 }
@@ -304,6 +304,52 @@ static void rss_parse(feedParserCtxtPtr ctxt, xmlNodePtr cur) {
 	}
 }
 
+/**
+ * Parses a completed item element of a RSS document that is still
+ * being downloaded. Items of RSS 0.9x/2.0 (inside the channel) and
+ * RSS 1.0 (next to the channel) are supported, RSS 1.1 items are
+ * parsed with the rest of the document. The channel link is taken
+ * as homepage but not consumed.
+ *
+ * @param ctxt		the feed parser context
+ * @param cur		the completed element
+ *
+ * @returns new item or NULL
+ */
+static itemPtr
+rss_parse_item_element (feedParserCtxtPtr ctxt, xmlNodePtr cur)
+{
+	xmlNodePtr	parent = cur->parent;
+	xmlNodePtr	root = xmlDocGetRootElement (cur->doc);
+
+	/* The channel link is the homepage relative item links are
+	   resolved against, so the following items need it. It is
+	   kept in the document for parseChannel(). */
+	if (!xmlStrcmp (cur->name, BAD_CAST"link") && (parent->parent == root) &&
+	    (!xmlStrcmp (parent->name, BAD_CAST"channel") || !xmlStrcmp (parent->name, BAD_CAST"Channel"))) {
+		gchar *tmp = unhtmlize ((gchar *)xmlNodeListGetString (cur->doc, cur->xmlChildrenNode, TRUE));
+		if (tmp) {
+			subscription_set_homepage (ctxt->subscription, tmp);
+			g_free (tmp);
+		}
+		return NULL;
+	}
+
+	if (xmlStrcmp (cur->name, BAD_CAST"item"))
+		return NULL;
+
+	if ((parent == root) &&
+	    (!xmlStrcmp (root->name, BAD_CAST"rdf") || !xmlStrcmp (root->name, BAD_CAST"RDF")))
+		return parseRSSItem (ctxt, cur);
+
+	if ((parent->parent == root) &&
+	    (!xmlStrcmp (parent->name, BAD_CAST"channel") || !xmlStrcmp (parent->name, BAD_CAST"Channel")) &&
+	    !xmlStrcmp (root->name, BAD_CAST"rss"))
+		return parseRSSItem (ctxt, cur);
+
+	return NULL;
+}
+
 static gboolean rss_format_check(xmlDocPtr doc, xmlNodePtr cur) {
 
 	if(!xmlStrcmp(cur->name, BAD_CAST"rss") ||
@@ -381,6 +427,7 @@ rss_init_feed_handler (void)
 	fhp->typeStr = "rss";
 	fhp->feedParser	= rss_parse;
 	fhp->checkFormat = rss_format_check;
+	fhp->itemParser = rss_parse_item_element;
 	
 	return fhp;
 }
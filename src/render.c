@@ -37,6 +37,7 @@
 #include "item.h"
 #include "itemlist.h"
 #include "itemset.h"
+#include "metrics.h"
 #include "render.h"
 #include "xml.h"
 #include "ui/liferea_htmlview.h"
@@ -330,6 +331,7 @@ render_xml (xmlDocPtr doc, const gchar *xsltName, renderParamPtr paramSet)
 	xmlDocPtr		resDoc;
 	xsltStylesheetPtr	xslt;
 	xmlOutputBufferPtr	buf;
+	gint64			start;
 	
 	xslt = render_load_stylesheet(xsltName);
 	if (!xslt)
@@ -339,7 +341,11 @@ render_xml (xmlDocPtr doc, const gchar *xsltName, renderParamPtr paramSet)
 		paramSet = render_parameter_new ();
 	render_parameter_add (paramSet, "pixmapsDir='file://" PACKAGE_DATA_DIR G_DIR_SEPARATOR_S PACKAGE G_DIR_SEPARATOR_S "pixmaps" G_DIR_SEPARATOR_S "'");
 
+	debug_enter ("render_xml");
+	start = metrics_now ();
 	resDoc = xsltApplyStylesheet (xslt, doc, (const gchar **)paramSet->params);
+	metrics_observe_since ("render.xslt_time", xsltName, start);
+	debug_exit ("render_xml");
 	if (!resDoc) {
 		g_warning ("fatal: applying rendering stylesheet (%s) failed!", xsltName);
 		return NULL;
@@ -39,6 +39,10 @@ typedef struct AsyncFile AsyncFile;
 typedef struct AsyncFileData AsyncFileData;
 typedef struct AsyncFileLock AsyncFileLock;
 typedef struct AsyncLock AsyncLock;
+typedef struct AsyncIndex AsyncIndex;
+typedef struct AsyncIndexEntry AsyncIndexEntry;
+typedef struct AsyncIndexRef AsyncIndexRef;
+typedef struct AsyncName AsyncName;
 
 /* Enable for debugging */
 #ifndef NDEBUG
@@ -207,12 +211,26 @@ static void asyncTrace(const char *zFormat, ...){
 ** CPU. The system will still work if this function is not implemented
 ** (it is not currently implemented for win32), but it might be marginally
 ** more efficient if it is.
+**
+** In addition to the three mutexes there is a single read/write lock
+** protecting the page index of queued writes (see AsyncIndex below). It
+** is taken shared by async_index_enter(0) and exclusively by
+** async_index_enter(1) and released by async_index_leave(). It may be
+** requested while holding ASYNC_MUTEX_QUEUE, but not while holding
+** ASYNC_MUTEX_LOCK, and no mutex may be requested while holding it.
+** The win32 build uses a plain critical section for it.
+**
+** The async_time() function returns the current time in microseconds.
+** It is only used for the queue latency statistics.
 */
 static void async_mutex_enter(int eMutex);
 static void async_mutex_leave(int eMutex);
 static void async_cond_wait(int eCond, int eMutex);
 static void async_cond_signal(int eCond);
 static void async_sched_yield(void);
+static void async_index_enter(int bExclusive);
+static void async_index_leave(void);
+static sqlite3_int64 async_time(void);
 
 /*
 ** There are also two definitions of the following. async_os_initialize()
@@ -258,6 +276,7 @@ static struct AsyncPrimitives {
   DWORD aHolder[3];
   CRITICAL_SECTION aMutex[3];
   HANDLE aCond[1];
+  CRITICAL_SECTION indexLock;
 } primitives = { 0 };
 
 static int async_os_initialize(void){
@@ -269,6 +288,7 @@ static int async_os_initialize(void){
     InitializeCriticalSection(&primitives.aMutex[0]);
     InitializeCriticalSection(&primitives.aMutex[1]);
     InitializeCriticalSection(&primitives.aMutex[2]);
+    InitializeCriticalSection(&primitives.indexLock);
     primitives.isInit = 1;
   }
   return 0;
@@ -278,6 +298,7 @@ static void async_os_shutdown(void){
     DeleteCriticalSection(&primitives.aMutex[0]);
     DeleteCriticalSection(&primitives.aMutex[1]);
     DeleteCriticalSection(&primitives.aMutex[2]);
+    DeleteCriticalSection(&primitives.indexLock);
     CloseHandle(primitives.aCond[0]);
     primitives.isInit = 0;
   }
@@ -311,11 +332,23 @@ static void async_cond_signal(int eCond){
 static void async_sched_yield(void){
   Sleep(0);
 }
+static void async_index_enter(int bExclusive){
+  UNUSED_PARAMETER(bExclusive);
+  assert( !mutex_held(ASYNC_MUTEX_LOCK) );
+  EnterCriticalSection(&primitives.indexLock);
+}
+static void async_index_leave(void){
+  LeaveCriticalSection(&primitives.indexLock);
+}
+static sqlite3_int64 async_time(void){
+  return (sqlite3_int64)GetTickCount() * 1000;
+}
 #else
 
 /* The following block contains the pthreads specific code. */
 #include <pthread.h>
 #include <sched.h>
+#include <sys/time.h>
 
 #define mutex_held(X) pthread_equal(primitives.aHolder[X], pthread_self())
 
@@ -326,13 +359,20 @@ static struct AsyncPrimitives {
   pthread_mutex_t aMutex[3];
   pthread_cond_t aCond[1];
   pthread_t aHolder[3];
+  pthread_rwlock_t indexLock;
 } primitives = {
   { PTHREAD_MUTEX_INITIALIZER, 
     PTHREAD_MUTEX_INITIALIZER, 
     PTHREAD_MUTEX_INITIALIZER
   } , {
     PTHREAD_COND_INITIALIZER
-  } , { 0, 0, 0 }
+  } , { 0, 0, 0 },
+  /* Prefer the writer thread over a stream of readers where possible */
+#ifdef PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
+  PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP
+#else
+  PTHREAD_RWLOCK_INITIALIZER
+#endif
 };
 
 static void async_mutex_enter(int eMutex){
@@ -363,6 +403,22 @@ static void async_cond_signal(int eCond){
 static void async_sched_yield(void){
   sched_yield();
 }
+static void async_index_enter(int bExclusive){
+  assert( !mutex_held(ASYNC_MUTEX_LOCK) );
+  if( bExclusive ){
+    pthread_rwlock_wrlock(&primitives.indexLock);
+  }else{
+    pthread_rwlock_rdlock(&primitives.indexLock);
+  }
+}
+static void async_index_leave(void){
+  pthread_rwlock_unlock(&primitives.indexLock);
+}
+static sqlite3_int64 async_time(void){
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return (sqlite3_int64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
 #endif
 /*
 ** End of OS specific code.
@@ -381,6 +437,7 @@ static void async_sched_yield(void){
 ** as the following structure.
 **
 ** Both async.ioError and async.nFile are protected by async.queueMutex.
+** So are async.iSeq, async.iBarrier and the statistics in async.stats.
 */
 static struct TestAsyncStaticData {
   AsyncWrite *pQueueFirst;     /* Next write operation to be processed */
@@ -391,6 +448,10 @@ static struct TestAsyncStaticData {
   volatile int bLockFiles;     /* Current value of "lockfiles" parameter */
   int ioError;                 /* True if an IO error has occurred */
   int nFile;                   /* Number of open files (from sqlite pov) */
+  sqlite3_int64 iSeq;          /* Sequence number of the last queued op */
+  sqlite3_int64 iBarrier;      /* Sequence number of the last non-write op */
+  AsyncName *pName;            /* Names with queued DELETE/OPENEXCLUSIVE ops */
+  sqlite3async_stats stats;    /* Queue statistics */
 } async = { 0,0,0,0,0,1,0,0 };
 
 /* Possible values of AsyncWrite.op */
@@ -450,7 +511,8 @@ static const char *azOpcodeName[] = {
 ** For an ASYNC_WRITE operation, zBuf points to the data to write to the file. 
 ** This space is sqlite3_malloc()d along with the AsyncWrite structure in a
 ** single blob, so is deleted when sqlite3_free() is called on the parent 
-** structure.
+** structure. The same blob holds the nRef AsyncIndexRef structures linking
+** the write into the page index of its file.
 */
 struct AsyncWrite {
   AsyncFileData *pFileData;    /* File to write data to or sync */
@@ -459,6 +521,75 @@ struct AsyncWrite {
   int nByte;          /* See above */
   char *zBuf;         /* Data to write to file (or NULL if op!=ASYNC_WRITE) */
   AsyncWrite *pNext;  /* Next write operation (to any file) */
+  int nRef;           /* Number of entries in aRef[] */
+  AsyncIndexRef *aRef;         /* Page index links, one per chunk written */
+  sqlite3_int64 iSeq;          /* Position in the write-op queue */
+  sqlite3_int64 iQueued;       /* Time the op was queued (microseconds) */
+};
+
+/*
+** Each file system entry has a page index of the ASYNC_WRITE operations
+** queued for it, so that asyncRead() does not need to walk the whole
+** write-op queue to overlay unwritten data. The file is split into
+** chunks of ASYNC_INDEX_CHUNK bytes and the index maps each chunk
+** number to the list of queued writes overlapping it, oldest first.
+** A write spanning several chunks is linked into every one of them.
+**
+** Entries are appended by addAsyncWrite() and, as the write-op queue
+** is processed in order, the write being removed by the writer thread
+** is always the first one in each of its chunks. A read starts with the
+** youngest write covering the whole part of a chunk it reads, so its
+** cost does not depend on the length of the queue but only on the number
+** of queued writes touching the chunks read after that one.
+**
+** The index of a named file lives in its AsyncLock structure, so it is
+** shared by all handles opened on the same file. Anonymous files use
+** AsyncFileData.index. All index data, including the data buffers of
+** indexed writes, is protected by the index read/write lock.
+**
+** The index also summarizes the queued operations changing the file size,
+** so that asyncFileSize() can usually avoid walking the write-op queue.
+** AsyncIndex.iWriteEnd is the largest end offset of the writes queued
+** since the last ASYNC_TRUNCATE or ASYNC_DELETE for the file. As long as
+** no ASYNC_TRUNCATE is queued, the file size is the larger one of the
+** size on disk and iWriteEnd, or just iWriteEnd if an ASYNC_DELETE is
+** queued. These two fields are protected by the queue mutex.
+*/
+#define ASYNC_INDEX_CHUNK 1024
+
+struct AsyncIndexRef {
+  AsyncWrite *pWrite;          /* Queued write overlapping the chunk */
+  AsyncIndexRef *pNext;        /* Next younger write for the same chunk */
+  AsyncIndexRef *pPrev;        /* Next older write for the same chunk */
+};
+struct AsyncIndexEntry {
+  sqlite3_int64 iChunk;        /* Chunk number (offset/ASYNC_INDEX_CHUNK) */
+  AsyncIndexRef *pFirst;       /* Oldest queued write for this chunk */
+  AsyncIndexRef *pLast;        /* Youngest queued write for this chunk */
+  AsyncIndexEntry *pNext;      /* Next entry in the same hash slot */
+};
+struct AsyncIndex {
+  int nSlot;                   /* Size of aSlot[], zero or a power of two */
+  int nEntry;                  /* Number of entries in the hash table */
+  AsyncIndexEntry **aSlot;     /* Hash table of chunk entries */
+  int nTruncate;               /* Number of queued ASYNC_TRUNCATE ops */
+  sqlite3_int64 iWriteEnd;     /* See above */
+};
+
+/*
+** ASYNC_DELETE and ASYNC_OPENEXCLUSIVE operations refer to files by
+** name. For each name with such operations in the write-op queue there
+** is an AsyncName structure in the async.pName list, which tells
+** asyncAccess() and asyncFileSize() about them without walking the
+** queue. There are only ever a few of these (SQLite deletes and creates
+** journal files), so a list is good enough. Protected by the queue mutex.
+*/
+struct AsyncName {
+  char *zName;                 /* File name */
+  int nOp;                     /* Queued DELETE and OPENEXCLUSIVE ops */
+  int nDelete;                 /* Queued DELETE ops */
+  int eLastOp;                 /* The youngest of these operations */
+  AsyncName *pNext;            /* Next in list headed by async.pName */
 };
 
 /*
@@ -487,6 +618,7 @@ struct AsyncLock {
   int eLock;
   AsyncFileLock *pList;
   AsyncLock *pNext;           /* Next in linked list headed by async.pLock */
+  AsyncIndex index;           /* Page index of queued writes to this file */
 };
 
 /*
@@ -523,8 +655,272 @@ struct AsyncFileData {
   AsyncFileLock lock;        /* Lock state for this handle */
   AsyncLock *pLock;          /* AsyncLock object for this file system entry */
   AsyncWrite closeOp;        /* Preallocated close operation */
+  AsyncIndex index;          /* Page index for anonymous files */
+  int nUnlock;               /* Number of queued ASYNC_UNLOCK ops */
 };
 
+static AsyncLock *findLock(const char *zName, int nName);
+
+/*
+** Return the page index used for writes to file pData.
+*/
+static AsyncIndex *asyncFileIndex(AsyncFileData *pData){
+  return pData->pLock ? &pData->pLock->index : &pData->index;
+}
+
+/*
+** Return the number of the first chunk touched by a write of nByte
+** bytes at offset iOffset and the number of chunks it touches.
+*/
+static sqlite3_int64 asyncIndexFirstChunk(sqlite3_int64 iOffset){
+  return iOffset / ASYNC_INDEX_CHUNK;
+}
+static int asyncIndexChunkCount(sqlite3_int64 iOffset, int nByte){
+  if( nByte<=0 ) return 0;
+  return (int)((iOffset + nByte - 1) / ASYNC_INDEX_CHUNK
+               - iOffset / ASYNC_INDEX_CHUNK + 1);
+}
+
+/*
+** Return a pointer to the hash slot pointer that points (or would point)
+** to the index entry for chunk iChunk. The index must have a hash table.
+*/
+static AsyncIndexEntry **asyncIndexSlot(AsyncIndex *pIndex, sqlite3_int64 iChunk){
+  AsyncIndexEntry **pp;
+  assert( pIndex->nSlot>0 );
+  pp = &pIndex->aSlot[(int)(iChunk & (pIndex->nSlot-1))];
+  while( *pp && (*pp)->iChunk!=iChunk ){
+    pp = &((*pp)->pNext);
+  }
+  return pp;
+}
+
+/*
+** Return the index entry for chunk iChunk, or NULL if there is none.
+*/
+static AsyncIndexEntry *asyncIndexFind(AsyncIndex *pIndex, sqlite3_int64 iChunk){
+  if( pIndex->nEntry==0 ) return 0;
+  return *asyncIndexSlot(pIndex, iChunk);
+}
+
+/*
+** Double the size of the hash table of pIndex. If the allocation fails
+** the old table is kept and SQLITE_NOMEM returned.
+*/
+static int asyncIndexGrow(AsyncIndex *pIndex){
+  int nNew = pIndex->nSlot ? pIndex->nSlot*2 : 64;
+  AsyncIndexEntry **aNew;
+  int i;
+
+  aNew = sqlite3_malloc(nNew * sizeof(AsyncIndexEntry *));
+  if( !aNew ){
+    return SQLITE_NOMEM;
+  }
+  memset(aNew, 0, nNew * sizeof(AsyncIndexEntry *));
+  for(i=0; i<pIndex->nSlot; i++){
+    AsyncIndexEntry *pEntry = pIndex->aSlot[i];
+    while( pEntry ){
+      AsyncIndexEntry *pNext = pEntry->pNext;
+      int iSlot = (int)(pEntry->iChunk & (nNew-1));
+      pEntry->pNext = aNew[iSlot];
+      aNew[iSlot] = pEntry;
+      pEntry = pNext;
+    }
+  }
+  sqlite3_free(pIndex->aSlot);
+  pIndex->aSlot = aNew;
+  pIndex->nSlot = nNew;
+  return SQLITE_OK;
+}
+
+/*
+** Link the ASYNC_WRITE operation pWrite into the index, appending it to
+** the write lists of all chunks it touches. All entries are created before
+** anything is linked, so on failure (SQLITE_IOERR, see addNewAsyncWrite())
+** the index is left unchanged apart from possibly some empty entries.
+*/
+static int asyncIndexInsert(AsyncIndex *pIndex, AsyncWrite *pWrite){
+  sqlite3_int64 iFirst = asyncIndexFirstChunk(pWrite->iOffset);
+  int i;
+
+  for(i=0; i<pWrite->nRef; i++){
+    AsyncIndexEntry **pp;
+    if( pIndex->nEntry>=pIndex->nSlot 
+     && asyncIndexGrow(pIndex)!=SQLITE_OK && pIndex->nSlot==0 
+    ){
+      return SQLITE_IOERR;
+    }
+    pp = asyncIndexSlot(pIndex, iFirst+i);
+    if( !*pp ){
+      AsyncIndexEntry *pEntry = sqlite3_malloc(sizeof(AsyncIndexEntry));
+      if( !pEntry ){
+        return SQLITE_IOERR;
+      }
+      memset(pEntry, 0, sizeof(AsyncIndexEntry));
+      pEntry->iChunk = iFirst+i;
+      *pp = pEntry;
+      pIndex->nEntry++;
+    }
+  }
+
+  for(i=0; i<pWrite->nRef; i++){
+    AsyncIndexEntry *pEntry = *asyncIndexSlot(pIndex, iFirst+i);
+    AsyncIndexRef *pRef = &pWrite->aRef[i];
+    pRef->pWrite = pWrite;
+    pRef->pNext = 0;
+    pRef->pPrev = pEntry->pLast;
+    if( pEntry->pLast ){
+      pEntry->pLast->pNext = pRef;
+    }else{
+      pEntry->pFirst = pRef;
+    }
+    pEntry->pLast = pRef;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Unlink pWrite from the index. pWrite must be the oldest write in each
+** of its chunks, which is always true for the head of the write-op queue.
+*/
+static void asyncIndexRemove(AsyncIndex *pIndex, AsyncWrite *pWrite){
+  sqlite3_int64 iFirst = asyncIndexFirstChunk(pWrite->iOffset);
+  int i;
+
+  for(i=0; i<pWrite->nRef; i++){
+    AsyncIndexEntry **pp = asyncIndexSlot(pIndex, iFirst+i);
+    AsyncIndexEntry *pEntry = *pp;
+    assert( pEntry && pEntry->pFirst==&pWrite->aRef[i] );
+    pEntry->pFirst = pEntry->pFirst->pNext;
+    if( pEntry->pFirst ){
+      pEntry->pFirst->pPrev = 0;
+    }else{
+      *pp = pEntry->pNext;
+      sqlite3_free(pEntry);
+      pIndex->nEntry--;
+    }
+  }
+  pWrite->nRef = 0;
+}
+
+/*
+** Free all memory used by the index of a file that is being closed.
+*/
+static void asyncIndexClear(AsyncIndex *pIndex){
+  int i;
+  for(i=0; i<pIndex->nSlot; i++){
+    AsyncIndexEntry *pEntry = pIndex->aSlot[i];
+    while( pEntry ){
+      AsyncIndexEntry *pNext = pEntry->pNext;
+      assert( !pEntry->pFirst );
+      sqlite3_free(pEntry);
+      pEntry = pNext;
+    }
+  }
+  sqlite3_free(pIndex->aSlot);
+  memset(pIndex, 0, sizeof(AsyncIndex));
+}
+
+/*
+** Check whether the ASYNC_WRITE operation pWrite can be merged into an
+** already queued write. This is the case if the youngest write in every
+** chunk touched by pWrite is one and the same write covering exactly the
+** same byte range, and if no other kind of operation (a sync, unlock,
+** truncate, ...) has been queued since. The writer thread might be working
+** on the head of the queue without holding any lock, so that one is never
+** used. Returns the write to merge into or NULL.
+**
+** The caller must hold the queue mutex and the exclusive index lock.
+*/
+static AsyncWrite *asyncIndexCoalesce(AsyncIndex *pIndex, AsyncWrite *pWrite){
+  sqlite3_int64 iFirst = asyncIndexFirstChunk(pWrite->iOffset);
+  AsyncIndexEntry *pEntry;
+  AsyncWrite *pPrev;
+  int i;
+
+  pEntry = asyncIndexFind(pIndex, iFirst);
+  if( !pEntry || !pEntry->pLast ) return 0;
+  pPrev = pEntry->pLast->pWrite;
+  if( pPrev==async.pQueueFirst
+   || pPrev->op!=ASYNC_WRITE
+   || pPrev->iSeq<=async.iBarrier
+   || pPrev->iOffset!=pWrite->iOffset
+   || pPrev->nByte!=pWrite->nByte
+  ){
+    return 0;
+  }
+  for(i=1; i<pWrite->nRef; i++){
+    pEntry = asyncIndexFind(pIndex, iFirst+i);
+    if( !pEntry || !pEntry->pLast || pEntry->pLast->pWrite!=pPrev ) return 0;
+  }
+  return pPrev;
+}
+
+/*
+** Return the name the ASYNC_DELETE or ASYNC_OPENEXCLUSIVE operation pWrite
+** refers to, or NULL if it does not refer to a named file. The op is passed
+** separately, as the writer thread might have replaced it by ASYNC_NOOP.
+*/
+static const char *asyncNameOf(AsyncWrite *pWrite, int op){
+  if( op==ASYNC_DELETE ) return pWrite->zBuf;
+  return pWrite->pFileData->zName;
+}
+
+/*
+** Return the AsyncName structure for file zName, or NULL if there are no
+** queued ASYNC_DELETE or ASYNC_OPENEXCLUSIVE operations for it.
+*/
+static AsyncName *asyncNameFind(const char *zName){
+  AsyncName *p = async.pName;
+  while( p && strcmp(p->zName, zName) ){
+    p = p->pNext;
+  }
+  return p;
+}
+
+/*
+** Record the ASYNC_DELETE or ASYNC_OPENEXCLUSIVE operation op on file
+** zName being queued. Returns SQLITE_IOERR if memory is short.
+*/
+static int asyncNameAdd(const char *zName, int op){
+  AsyncName *p = asyncNameFind(zName);
+  if( !p ){
+    int nName = (int)strlen(zName)+1;
+    p = sqlite3_malloc(sizeof(AsyncName) + nName);
+    if( !p ){
+      return SQLITE_IOERR;
+    }
+    memset(p, 0, sizeof(AsyncName));
+    p->zName = (char *)&p[1];
+    memcpy(p->zName, zName, nName);
+    p->pNext = async.pName;
+    async.pName = p;
+  }
+  p->nOp++;
+  if( op==ASYNC_DELETE ) p->nDelete++;
+  p->eLastOp = op;
+  return SQLITE_OK;
+}
+
+/*
+** Record the ASYNC_DELETE or ASYNC_OPENEXCLUSIVE operation op on file
+** zName being removed from the queue.
+*/
+static void asyncNameRemove(const char *zName, int op){
+  AsyncName **pp;
+  for(pp=&async.pName; *pp && strcmp((*pp)->zName, zName); pp=&((*pp)->pNext));
+  assert( *pp && (*pp)->nOp>0 );
+  if( *pp ){
+    AsyncName *p = *pp;
+    p->nOp--;
+    if( op==ASYNC_DELETE ) p->nDelete--;
+    if( p->nOp==0 ){
+      *pp = p->pNext;
+      sqlite3_free(p);
+    }
+  }
+}
+
 /*
 ** Add an entry to the end of the global write-op list. pWrite should point 
 ** to an AsyncWrite structure allocated using sqlite3_malloc().  The writer
@@ -534,13 +930,92 @@ struct AsyncFileData {
 ** Once an AsyncWrite structure has been added to the list, it becomes the
 ** property of the writer thread and must not be read or modified by the
 ** caller.  
+**
+** ASYNC_WRITE operations are also added to the page index of their file.
+** If the data can be merged into an already queued write pWrite is freed
+** instead of being added. If the index cannot be updated pWrite is freed
+** and SQLITE_IOERR returned. The same happens if there is no memory to
+** record an ASYNC_DELETE or ASYNC_OPENEXCLUSIVE operation.
 */
-static void addAsyncWrite(AsyncWrite *pWrite){
+static int addAsyncWrite(AsyncWrite *pWrite){
+  int rc = SQLITE_OK;
+
   /* We must hold the queue mutex in order to modify the queue pointers */
   if( pWrite->op!=ASYNC_UNLOCK ){
     async_mutex_enter(ASYNC_MUTEX_QUEUE);
   }
 
+  if( pWrite->op==ASYNC_WRITE && pWrite->nRef>0 ){
+    AsyncIndex *pIndex = asyncFileIndex(pWrite->pFileData);
+    AsyncWrite *pPrev;
+
+    async_index_enter(1);
+    async.stats.nWrite++;
+    pPrev = asyncIndexCoalesce(pIndex, pWrite);
+    if( pPrev ){
+      memcpy(pPrev->zBuf, pWrite->zBuf, pWrite->nByte);
+      async.stats.nCoalesced++;
+    }else{
+      rc = asyncIndexInsert(pIndex, pWrite);
+    }
+    async_index_leave();
+
+    if( pPrev || rc!=SQLITE_OK ){
+      ASYNC_TRACE(("%s %p (%s %d)\n", pPrev ? "COALESCE" : "DROP", pWrite,
+             pWrite->pFileData->zName, pWrite->iOffset));
+      sqlite3_free(pWrite);
+      async_mutex_leave(ASYNC_MUTEX_QUEUE);
+      return rc;
+    }
+  }
+
+  switch( pWrite->op ){
+    case ASYNC_WRITE: {
+      AsyncIndex *pIndex = asyncFileIndex(pWrite->pFileData);
+      pIndex->iWriteEnd = MAX(pIndex->iWriteEnd,
+                              pWrite->iOffset + (sqlite3_int64)pWrite->nByte);
+      break;
+    }
+    case ASYNC_TRUNCATE: {
+      AsyncIndex *pIndex = asyncFileIndex(pWrite->pFileData);
+      pIndex->nTruncate++;
+      pIndex->iWriteEnd = 0;
+      break;
+    }
+    case ASYNC_UNLOCK:
+      pWrite->pFileData->nUnlock++;
+      break;
+    case ASYNC_DELETE:
+    case ASYNC_OPENEXCLUSIVE: {
+      const char *zName = asyncNameOf(pWrite, pWrite->op);
+      if( zName && asyncNameAdd(zName, pWrite->op)!=SQLITE_OK ){
+        sqlite3_free(pWrite);
+        async_mutex_leave(ASYNC_MUTEX_QUEUE);
+        return SQLITE_IOERR;
+      }
+      if( pWrite->op==ASYNC_DELETE ){
+        AsyncLock *pLock;
+        async_mutex_enter(ASYNC_MUTEX_LOCK);
+        pLock = findLock(pWrite->zBuf, pWrite->nByte);
+        if( pLock ){
+          pLock->index.iWriteEnd = 0;
+        }
+        async_mutex_leave(ASYNC_MUTEX_LOCK);
+      }
+      break;
+    }
+  }
+
+  pWrite->iSeq = ++async.iSeq;
+  if( pWrite->op!=ASYNC_WRITE ){
+    async.iBarrier = pWrite->iSeq;
+  }
+  pWrite->iQueued = async_time();
+  async.stats.nQueue++;
+  if( async.stats.nQueue>async.stats.nQueueMax ){
+    async.stats.nQueueMax = async.stats.nQueue;
+  }
+
   /* Add the record to the end of the write-op queue */
   assert( !pWrite->pNext );
   if( async.pQueueLast ){
@@ -565,6 +1040,7 @@ static void addAsyncWrite(AsyncWrite *pWrite){
   if( pWrite->op!=ASYNC_UNLOCK ){
     async_mutex_leave(ASYNC_MUTEX_QUEUE);
   }
+  return rc;
 }
 
 /*
@@ -592,10 +1068,16 @@ static int addNewAsyncWrite(
   const char *zByte
 ){
   AsyncWrite *p;
+  int nRef = 0;
   if( op!=ASYNC_CLOSE && async.ioError ){
     return async.ioError;
   }
-  p = sqlite3_malloc(sizeof(AsyncWrite) + (zByte?nByte:0));
+  if( op==ASYNC_WRITE ){
+    nRef = asyncIndexChunkCount(iOffset, nByte);
+  }
+  p = sqlite3_malloc(
+      sizeof(AsyncWrite) + nRef*sizeof(AsyncIndexRef) + (zByte?nByte:0)
+  );
   if( !p ){
     /* The upper layer does not expect operations like OsWrite() to
     ** return SQLITE_NOMEM. This is partly because under normal conditions
@@ -610,14 +1092,15 @@ static int addNewAsyncWrite(
   p->nByte = nByte;
   p->pFileData = pFileData;
   p->pNext = 0;
+  p->nRef = nRef;
+  p->aRef = (AsyncIndexRef *)&p[1];
   if( zByte ){
-    p->zBuf = (char *)&p[1];
+    p->zBuf = (char *)&p->aRef[nRef];
     memcpy(p->zBuf, zByte, nByte);
   }else{
     p->zBuf = 0;
   }
-  addAsyncWrite(p);
-  return SQLITE_OK;
+  return addAsyncWrite(p);
 }
 
 /*
@@ -655,9 +1138,10 @@ static int asyncWrite(
 /*
 ** Read data from the file. First we read from the filesystem, then adjust 
 ** the contents of the buffer based on ASYNC_WRITE operations in the 
-** write-op queue.
+** page index of the file.
 **
-** This method holds the mutex from start to finish.
+** This method holds the shared index lock from start to finish. It does
+** not need the queue mutex.
 */
 static int asyncRead(
   sqlite3_file *pFile, 
@@ -671,8 +1155,8 @@ static int asyncRead(
   sqlite3_file *pBase = p->pBaseRead;
   sqlite3_int64 iAmt64 = (sqlite3_int64)iAmt;
 
-  /* Grab the write queue mutex for the duration of the call */
-  async_mutex_enter(ASYNC_MUTEX_QUEUE);
+  /* Grab the index lock for the duration of the call */
+  async_index_enter(0);
 
   /* If an I/O error has previously occurred in this virtual file 
   ** system, then all subsequent operations fail.
@@ -695,39 +1179,51 @@ static int asyncRead(
     }
   }
 
-  if( rc==SQLITE_OK ){
-    AsyncWrite *pWrite;
-    char *zName = p->zName;
-
-    for(pWrite=async.pQueueFirst; pWrite; pWrite = pWrite->pNext){
-      if( pWrite->op==ASYNC_WRITE && (
-        (pWrite->pFileData==p) ||
-        (zName && pWrite->pFileData->zName==zName)
-      )){
-        sqlite3_int64 nCopy;
-        sqlite3_int64 nByte64 = (sqlite3_int64)pWrite->nByte;
-
-        /* Set variable iBeginIn to the offset in buffer pWrite->zBuf[] from
-        ** which data should be copied. Set iBeginOut to the offset within
-        ** the output buffer to which data should be copied. If either of
-        ** these offsets is a negative number, set them to 0.
-        */
-        sqlite3_int64 iBeginOut = (pWrite->iOffset-iOffset);
-        sqlite3_int64 iBeginIn = -iBeginOut;
-        if( iBeginIn<0 ) iBeginIn = 0;
-        if( iBeginOut<0 ) iBeginOut = 0;
-
-        nCopy = MIN(nByte64-iBeginIn, iAmt64-iBeginOut);
-        if( nCopy>0 ){
-          memcpy(&((char *)zOut)[iBeginOut], &pWrite->zBuf[iBeginIn], nCopy);
-          ASYNC_TRACE(("OVERREAD %d bytes at %d\n", nCopy, iBeginOut+iOffset));
+  if( rc==SQLITE_OK && iAmt>0 ){
+    AsyncIndex *pIndex = asyncFileIndex(p);
+    sqlite3_int64 iChunk = asyncIndexFirstChunk(iOffset);
+    sqlite3_int64 iEnd = iOffset + iAmt64;
+
+    for(; pIndex->nEntry>0 && iChunk*ASYNC_INDEX_CHUNK<iEnd; iChunk++){
+      AsyncIndexEntry *pEntry = asyncIndexFind(pIndex, iChunk);
+      AsyncIndexRef *pRef;
+
+      /* Only copy the part of each write falling into this chunk, so
+      ** that writes spanning several chunks do not overwrite younger
+      ** data in the other chunks. The writes of a chunk are applied
+      ** oldest first, the same order the writer thread will use, but
+      ** starting with the youngest one covering all of iLo..iHi.
+      */
+      sqlite3_int64 iLo = MAX(iChunk*ASYNC_INDEX_CHUNK, iOffset);
+      sqlite3_int64 iHi = MIN((iChunk+1)*ASYNC_INDEX_CHUNK, iEnd);
+
+      if( !pEntry ) continue;
+      for(pRef=pEntry->pLast; pRef->pPrev; pRef=pRef->pPrev){
+        AsyncWrite *pWrite = pRef->pWrite;
+        if( pWrite->op==ASYNC_WRITE && pWrite->iOffset<=iLo
+         && pWrite->iOffset + (sqlite3_int64)pWrite->nByte>=iHi
+        ){
+          break;
+        }
+      }
+      for(; pRef; pRef=pRef->pNext){
+        AsyncWrite *pWrite = pRef->pWrite;
+        sqlite3_int64 iBegin, iStop;
+        if( pWrite->op!=ASYNC_WRITE ) continue;
+
+        iBegin = MAX(pWrite->iOffset, iLo);
+        iStop = MIN(pWrite->iOffset + (sqlite3_int64)pWrite->nByte, iHi);
+        if( iStop>iBegin ){
+          memcpy(&((char *)zOut)[iBegin-iOffset],
+                 &pWrite->zBuf[iBegin-pWrite->iOffset], iStop-iBegin);
+          ASYNC_TRACE(("OVERREAD %d bytes at %d\n", iStop-iBegin, iBegin));
         }
       }
     }
   }
 
 asyncread_out:
-  async_mutex_leave(ASYNC_MUTEX_QUEUE);
+  async_index_leave();
   return rc;
 }
 
@@ -752,7 +1248,9 @@ static int asyncSync(sqlite3_file *pFile, int flags){
 /*
 ** Read the size of the file. First we read the size of the file system 
 ** entry, then adjust for any ASYNC_WRITE or ASYNC_TRUNCATE operations 
-** currently in the write-op list. 
+** currently in the write-op list. Unless there is a queued ASYNC_TRUNCATE
+** for the file, the summary kept in the page index is used instead of
+** walking the list.
 **
 ** This method holds the mutex from start to finish.
 */
@@ -775,8 +1273,18 @@ int asyncFileSize(sqlite3_file *pFile, sqlite3_int64 *piSize){
   }
 
   if( rc==SQLITE_OK ){
-    AsyncWrite *pWrite;
-    for(pWrite=async.pQueueFirst; pWrite; pWrite = pWrite->pNext){
+    AsyncIndex *pIndex = asyncFileIndex(p);
+    AsyncName *pName = p->zName ? asyncNameFind(p->zName) : 0;
+    AsyncWrite *pWrite = async.pQueueFirst;
+    if( pIndex->nTruncate==0 ){
+      if( pName && pName->nDelete>0 ){
+        s = pIndex->iWriteEnd;
+      }else{
+        s = MAX(pIndex->iWriteEnd, s);
+      }
+      pWrite = 0;
+    }
+    for(; pWrite; pWrite = pWrite->pNext){
       if( pWrite->op==ASYNC_DELETE 
        && p->zName 
        && strcmp(p->zName, pWrite->zBuf)==0 
@@ -939,7 +1447,9 @@ static int asyncFileControl(sqlite3_file *id, int op, void *pArg){
       return SQLITE_OK;
     }
   }
-  return SQLITE_ERROR;
+  /* Newer SQLite versions pass unknown opcodes (e.g. for each PRAGMA)
+  ** and expect SQLITE_NOTFOUND for those. */
+  return SQLITE_NOTFOUND;
 }
 
 /* 
@@ -975,6 +1485,7 @@ static int unlinkAsyncFile(AsyncFileData *pData){
       }
       for(pp=&async.pLock; *pp!=pLock; pp=&((*pp)->pNext));
       *pp = pLock->pNext;
+      asyncIndexClear(&pLock->index);
       sqlite3_free(pLock);
     }else{
       rc = getFileLock(pLock);
@@ -1180,7 +1691,7 @@ static int asyncAccess(
 ){
   int rc;
   int ret;
-  AsyncWrite *p;
+  AsyncName *p;
   sqlite3_vfs *pVfs = (sqlite3_vfs *)pAsyncVfs->pAppData;
 
   assert(flags==SQLITE_ACCESS_READWRITE 
@@ -1191,15 +1702,10 @@ static int asyncAccess(
   async_mutex_enter(ASYNC_MUTEX_QUEUE);
   rc = pVfs->xAccess(pVfs, zName, flags, &ret);
   if( rc==SQLITE_OK && flags==SQLITE_ACCESS_EXISTS ){
-    for(p=async.pQueueFirst; p; p = p->pNext){
-      if( p->op==ASYNC_DELETE && 0==strcmp(p->zBuf, zName) ){
-        ret = 0;
-      }else if( p->op==ASYNC_OPENEXCLUSIVE 
-             && p->pFileData->zName
-             && 0==strcmp(p->pFileData->zName, zName) 
-      ){
-        ret = 1;
-      }
+    /* The youngest queued ASYNC_DELETE or ASYNC_OPENEXCLUSIVE decides */
+    p = asyncNameFind(zName);
+    if( p ){
+      ret = (p->eLastOp==ASYNC_OPENEXCLUSIVE);
     }
   }
   ASYNC_TRACE(("ACCESS(%s): %s = %d\n", 
@@ -1337,6 +1843,10 @@ static void asyncWriterThread(void){
 
   while( async.eHalt!=SQLITEASYNC_HALT_NOW ){
     int doNotFree = 0;
+    int holdingIndex = 0;
+    int eOp;
+    sqlite3_int64 iQueued;
+    sqlite3_int64 iLatency;
     sqlite3_file *pBase = 0;
 
     if( !holdingMutex ){
@@ -1354,6 +1864,8 @@ static void asyncWriterThread(void){
     }
     if( p==0 ) break;
     holdingMutex = 1;
+    iQueued = p->iQueued;
+    eOp = p->op;
 
     /* Right now this thread is holding the mutex on the write-op queue.
     ** Variable 'p' points to the first entry in the write-op queue. In
@@ -1373,6 +1885,11 @@ static void asyncWriterThread(void){
     **     * ASYNC_SYNC and ASYNC_WRITE operations, if 
     **       SQLITE_ASYNC_TWO_FILEHANDLES was set at compile time and two
     **       file-handles are open for the particular file being "synced".
+    **
+    ** As asyncRead() does not take the queue mutex, ASYNC_WRITE, ASYNC_SYNC
+    ** and ASYNC_TRUNCATE operations performed while holding the mutex also
+    ** take the exclusive index lock, so that reads from the same handle
+    ** are serialized with them.
     */
     if( async.ioError!=SQLITE_OK && p->op!=ASYNC_CLOSE ){
       p->op = ASYNC_NOOP;
@@ -1390,6 +1907,12 @@ static void asyncWriterThread(void){
       if( !pBase->pMethods ){
         pBase = p->pFileData->pBaseRead;
       }
+      if( holdingMutex && (
+        p->op==ASYNC_WRITE || p->op==ASYNC_SYNC || p->op==ASYNC_TRUNCATE
+      )){
+        async_index_enter(1);
+        holdingIndex = 1;
+      }
     }
 
     switch( p->op ){
@@ -1440,13 +1963,15 @@ static void asyncWriterThread(void){
         }
         assert_mutex_is_held(ASYNC_MUTEX_QUEUE);
         async.pQueueFirst = p->pNext;
+        if( !pData->pLock ){
+          asyncIndexClear(&pData->index);
+        }
         sqlite3_free(pData);
         doNotFree = 1;
         break;
       }
 
       case ASYNC_UNLOCK: {
-        AsyncWrite *pIter;
         AsyncFileData *pData = p->pFileData;
         int eLock = p->nByte;
 
@@ -1478,14 +2003,13 @@ static void asyncWriterThread(void){
         **      of view, and
         **
         **   2) Only unlocks the file at all if this event is the last
-        **      ASYNC_UNLOCK event on this file in the write-queue.
+        **      ASYNC_UNLOCK event on this file in the write-queue, that
+        **      is if AsyncFileData.nUnlock only counts this event.
         */ 
         assert( holdingMutex==1 );
         assert( async.pQueueFirst==p );
-        for(pIter=async.pQueueFirst->pNext; pIter; pIter=pIter->pNext){
-          if( pIter->pFileData==pData && pIter->op==ASYNC_UNLOCK ) break;
-        }
-        if( !pIter ){
+        assert( pData->nUnlock>0 );
+        if( pData->nUnlock==1 ){
           async_mutex_enter(ASYNC_MUTEX_LOCK);
           pData->lock.eAsyncLock = MIN(
               pData->lock.eAsyncLock, MAX(pData->lock.eLock, eLock)
@@ -1525,6 +2049,48 @@ static void asyncWriterThread(void){
       async_mutex_enter(ASYNC_MUTEX_QUEUE);
       holdingMutex = 1;
     }
+
+    /* Only now that the data is on disk may a write be removed from the
+    ** page index, as readers take it from there until this point.
+    */
+    if( !doNotFree && p->nRef>0 ){
+      if( !holdingIndex ){
+        async_index_enter(1);
+        holdingIndex = 1;
+      }
+      asyncIndexRemove(asyncFileIndex(p->pFileData), p);
+    }
+    if( holdingIndex ){
+      async_index_leave();
+      holdingIndex = 0;
+    }
+
+    /* Update the other bookkeeping on queued operations. The original
+    ** op is used, as it might have been replaced by ASYNC_NOOP above.
+    */
+    switch( eOp ){
+      case ASYNC_TRUNCATE:
+        asyncFileIndex(p->pFileData)->nTruncate--;
+        break;
+      case ASYNC_UNLOCK:
+        p->pFileData->nUnlock--;
+        break;
+      case ASYNC_DELETE:
+      case ASYNC_OPENEXCLUSIVE:
+        if( asyncNameOf(p, eOp) ){
+          asyncNameRemove(asyncNameOf(p, eOp), eOp);
+        }
+        break;
+    }
+
+    iLatency = async_time() - iQueued;
+    async.stats.nQueue--;
+    async.stats.nOp++;
+    async.stats.iLatencyTotal += iLatency;
+    if( iLatency>async.stats.iLatencyMax ){
+      async.stats.iLatencyMax = iLatency;
+    }
+
     /* ASYNC_TRACE(("UNLINK %p\n", p)); */
     if( p==async.pQueueLast ){
       async.pQueueLast = 0;
@@ -1680,6 +2246,25 @@ int sqlite3async_control(int op, ...){
       break;
     }
 
+    case SQLITEASYNC_GET_STATS: {
+      sqlite3async_stats *pStats = va_arg(ap, sqlite3async_stats *);
+      async_mutex_enter(ASYNC_MUTEX_QUEUE);
+      *pStats = async.stats;
+      async_mutex_leave(ASYNC_MUTEX_QUEUE);
+      break;
+    }
+    case SQLITEASYNC_RESET_STATS: {
+      async_mutex_enter(ASYNC_MUTEX_QUEUE);
+      async.stats.nQueueMax = async.stats.nQueue;
+      async.stats.nOp = 0;
+      async.stats.nWrite = 0;
+      async.stats.nCoalesced = 0;
+      async.stats.iLatencyTotal = 0;
+      async.stats.iLatencyMax = 0;
+      async_mutex_leave(ASYNC_MUTEX_QUEUE);
+      break;
+    }
+
     default:
       return SQLITE_ERROR;
   }
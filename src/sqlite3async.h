@@ -2,6 +2,8 @@
 #ifndef __SQLITEASYNC_H_
 #define __SQLITEASYNC_H_ 1
 
+#include "sqlite3.h"
+
 /*
 ** Make sure we can call this stuff from C++.
 */
@@ -195,6 +197,18 @@ void sqlite3async_run();
 **   Alternatively, if this parameter is set to 1, then it is safe to access
 **   the database from multiple connections within multiple processes using
 **   either the asynchronous IO VFS or the parent VFS directly.
+**
+** SQLITEASYNC_GET_STATS:
+**
+**   The second argument must be of type (sqlite3async_stats *). A copy of
+**   the current write-queue statistics is stored in the structure pointed
+**   to (see below).
+**
+** SQLITEASYNC_RESET_STATS:
+**
+**   Resets the cumulative write-queue statistics and sets the maximum
+**   queue depth to the current queue depth. The second argument is
+**   ignored and should be passed as 0.
 */
 int sqlite3async_control(int op, ...);
 
@@ -207,6 +221,8 @@ int sqlite3async_control(int op, ...);
 #define SQLITEASYNC_GET_DELAY     4
 #define SQLITEASYNC_LOCKFILES     5
 #define SQLITEASYNC_GET_LOCKFILES 6
+#define SQLITEASYNC_GET_STATS     7
+#define SQLITEASYNC_RESET_STATS   8
 
 /*
 ** If the first argument to sqlite3async_control() is SQLITEASYNC_HALT,
@@ -216,6 +232,24 @@ int sqlite3async_control(int op, ...);
 #define SQLITEASYNC_HALT_NOW   1       /* Halt as soon as possible */
 #define SQLITEASYNC_HALT_IDLE  2       /* Halt when write-queue is empty */
 
+/*
+** Write-queue statistics as returned by SQLITEASYNC_GET_STATS. Latencies
+** are measured in microseconds from the time an operation is queued until
+** the writer thread has completed it. Writes merged into an already queued
+** write to the same file region are counted in nWrite and nCoalesced, but
+** they are never queued themselves.
+*/
+typedef struct sqlite3async_stats sqlite3async_stats;
+struct sqlite3async_stats {
+  int nQueue;                    /* Operations currently queued */
+  int nQueueMax;                 /* Maximum number of queued operations */
+  sqlite3_int64 nOp;             /* Operations completed by the writer */
+  sqlite3_int64 nWrite;          /* Write operations requested */
+  sqlite3_int64 nCoalesced;      /* Writes merged into a queued write */
+  sqlite3_int64 iLatencyTotal;   /* Sum of latencies of completed ops */
+  sqlite3_int64 iLatencyMax;     /* Maximum latency of a completed op */
+};
+
 #ifdef __cplusplus
 }  /* End of the 'extern "C"' block */
 #endif
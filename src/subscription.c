@@ -30,10 +30,7 @@
 #include "feedlist.h"
 #include "metadata.h"
 #include "net.h"
-#include "ui/auth_dialog.h"
-#include "ui/itemview.h"
-#include "ui/liferea_shell.h"
-#include "ui/ui_node.h"
+#include "ui_observer.h"
 
 /* The allowed feed protocol prefixes (see http://25hoursaday.com/draft-obasanjo-feed-URI-scheme-02.html) */
 #define FEED_PROTOCOL_PREFIX "feed://"
@@ -101,12 +98,12 @@ gboolean
 subscription_can_be_updated (subscriptionPtr subscription)
 {
 	if (subscription->updateJob) {
-		liferea_shell_set_status_bar (_("Subscription \"%s\" is already being updated!"), node_get_title (subscription->node));
+		ui_observer_set_status_bar (_("Subscription \"%s\" is already being updated!"), node_get_title (subscription->node));
 		return FALSE;
 	}
 	
 	if (subscription->discontinued) {
-		liferea_shell_set_status_bar (_("The subscription \"%s\" was discontinued. Liferea won't update it anymore!"), node_get_title (subscription->node));
+		ui_observer_set_status_bar (_("The subscription \"%s\" was discontinued. Liferea won't update it anymore!"), node_get_title (subscription->node));
 		return FALSE;
 	}
 
@@ -133,14 +130,14 @@ subscription_favicon_downloaded (gpointer user_data)
 	nodePtr	node = (nodePtr)user_data;
 
 	node_set_icon (node, favicon_load_from_cache (node->id));
-	ui_node_update (node->id);
+	ui_observer_node_changed (node);
 }
 
 void
 subscription_update_favicon (subscriptionPtr subscription)
 {
 	debug1 (DEBUG_UPDATE, "trying to download favicon.ico for \"%s\"", node_get_title (subscription->node));
-	liferea_shell_set_status_bar (_("Updating favicon for \"%s\""), node_get_title (subscription->node));
+	ui_observer_set_status_bar (_("Updating favicon for \"%s\""), node_get_title (subscription->node));
 	g_get_current_time (&subscription->updateState->lastFaviconPoll);
 	favicon_download (subscription,
 	                  node_get_base_url (subscription->node),
@@ -207,18 +204,18 @@ subscription_process_update_result (const struct updateResult * const result, gp
 	if (result->source && !g_str_equal (result->source, subscription->updateJob->request->source)) {
 		debug2 (DEBUG_UPDATE, "The URL of \"%s\" has changed permanently and was updated with \"%s\"", node_get_title(node), result->source);
 		subscription_set_source (subscription, result->source);
-		liferea_shell_set_status_bar (_("The URL of \"%s\" has changed permanently and was updated"), node_get_title(node));
+		ui_observer_set_status_bar (_("The URL of \"%s\" has changed permanently and was updated"), node_get_title(node));
 	}
 
 	if (401 == result->httpstatus) { /* unauthorized */
-		auth_dialog_new (subscription, flags);
+		ui_observer_auth_required (subscription, flags);
 	} else if (410 == result->httpstatus) { /* gone */
 		subscription->discontinued = TRUE;
 		node->available = TRUE;
-		liferea_shell_set_status_bar (_("\"%s\" is discontinued. Liferea won't updated it anymore!"), node_get_title (node));
+		ui_observer_set_status_bar (_("\"%s\" is discontinued. Liferea won't updated it anymore!"), node_get_title (node));
 	} else if (304 == result->httpstatus) {
 		node->available = TRUE;
-		liferea_shell_set_status_bar (_("\"%s\" has not changed since last update"), node_get_title(node));
+		ui_observer_set_status_bar (_("\"%s\" has not changed since last update"), node_get_title(node));
 	} else {
 		processing = TRUE;
 	}
@@ -243,10 +240,10 @@ subscription_process_update_result (const struct updateResult * const result, gp
 	update_state_set_cookies (subscription->updateState, update_state_get_cookies (result->updateState));
 	g_get_current_time (&subscription->updateState->lastPoll);
 	
-	itemview_update_node_info (subscription->node);
-	itemview_update ();
-	ui_node_update (subscription->node->id);
-	feedlist_schedule_save ();
+	ui_observer_node_info_changed (subscription->node);
+	ui_observer_items_changed ();
+	ui_observer_node_changed (subscription->node);
+	feedlist_node_changed (subscription->node);
 }
 
 void
@@ -264,7 +261,7 @@ subscription_update (subscriptionPtr subscription, guint flags)
 	debug1 (DEBUG_UPDATE, "Scheduling %s to be updated", node_get_title (subscription->node));
 	 
 	if (subscription_can_be_updated (subscription)) {
-		liferea_shell_set_status_bar (_("Updating \"%s\""), node_get_title (subscription->node));
+		ui_observer_set_status_bar (_("Updating \"%s\""), node_get_title (subscription->node));
 
 		g_get_current_time (&now);
 		subscription_reset_update_counter (subscription, &now);
@@ -334,7 +331,7 @@ subscription_set_update_interval (subscriptionPtr subscription, gint interval)
 				   interval... */
 	}
 	subscription->updateInterval = interval;
-	feedlist_schedule_save ();
+	feedlist_node_changed (subscription->node);
 }
 
 guint
@@ -378,7 +375,7 @@ subscription_set_orig_source (subscriptionPtr subscription, const gchar *source)
 {
 	g_free (subscription->origSource);
 	subscription->origSource = g_strchomp (g_strdup (source));
-	feedlist_schedule_save ();
+	feedlist_node_changed (subscription->node);
 }
 
 void
@@ -386,7 +383,7 @@ subscription_set_source (subscriptionPtr subscription, const gchar *source)
 {
 	g_free (subscription->source);
 	subscription->source = g_strchomp (g_strdup (source));
-	feedlist_schedule_save ();
+	feedlist_node_changed (subscription->node);
 
 	update_state_set_cookies (subscription->updateState, NULL);
 
@@ -426,7 +423,7 @@ subscription_set_filter (subscriptionPtr subscription, const gchar *filter)
 {
 	g_free (subscription->filtercmd);
 	subscription->filtercmd = g_strdup (filter);
-	feedlist_schedule_save ();
+	feedlist_node_changed (subscription->node);
 }
 
 subscriptionPtr
@@ -26,6 +26,7 @@
 #include "conf.h"
 #include "debug.h"
 #include "enclosure.h"
+#include "enclosure_download.h"
 #include "item.h"
 #include "metadata.h"
 #include "ui/liferea_dialog.h"
@@ -40,6 +41,9 @@ enum {
 	ES_DOWNLOADED,
 	ES_SIZE,
 	ES_SIZE_STR,
+	ES_PROGRESS,
+	ES_PROGRESS_STR,
+	ES_DOWNLOADING,
 	ES_PTR,
 	ES_LEN
 };
@@ -187,6 +191,9 @@ enclosure_list_view_new ()
 						   G_TYPE_BOOLEAN,	/* ES_DOWNLOADED */
 						   G_TYPE_ULONG,	/* ES_SIZE */
 						   G_TYPE_STRING,	/* ES_SIZE_STRING */
+						   G_TYPE_INT,		/* ES_PROGRESS */
+						   G_TYPE_STRING,	/* ES_PROGRESS_STR */
+						   G_TYPE_BOOLEAN,	/* ES_DOWNLOADING */
 						   G_TYPE_POINTER	/* ES_PTR */
 	                                           );
 	gtk_tree_view_set_model (GTK_TREE_VIEW (elv->priv->treeview), GTK_TREE_MODEL(elv->priv->treestore));
@@ -213,6 +220,14 @@ enclosure_list_view_new ()
 	                                                   "text", ES_MIME_STR,
 							   NULL);
 	gtk_tree_view_append_column (GTK_TREE_VIEW (elv->priv->treeview), column);
+
+	renderer = gtk_cell_renderer_progress_new ();
+	column = gtk_tree_view_column_new_with_attributes ("Download", renderer,
+	                                                   "value", ES_PROGRESS,
+	                                                   "text", ES_PROGRESS_STR,
+	                                                   "visible", ES_DOWNLOADING,
+							   NULL);
+	gtk_tree_view_append_column (GTK_TREE_VIEW (elv->priv->treeview), column);
 	
 	gtk_tree_view_set_headers_visible (GTK_TREE_VIEW (elv->priv->treeview), FALSE);
 
@@ -233,10 +248,57 @@ enclosure_list_view_get_widget (EnclosureListView *elv)
 	return elv->priv->container;
 }
 
+static void
+enclosure_list_view_set_progress (EnclosureListView *elv, GtkTreeIter *iter, const gchar *url)
+{
+	goffset		received, total;
+	gint		percent = 0;
+	gchar		*text;
+
+	if (!enclosure_download_get_progress (url, &received, &total)) {
+		gtk_tree_store_set (elv->priv->treestore, iter, ES_DOWNLOADING, FALSE, -1);
+		return;
+	}
+
+	/* The following literals are the download progress in percent
+	   and (for unknown file sizes) in kB */
+	if (total > 0) {
+		percent = (gint)(received * 100 / total);
+		text = g_strdup_printf (_("%d%%"), percent);
+	} else {
+		text = g_strdup_printf (_("%dkB"), (gint)(received / 1024));
+	}
+
+	gtk_tree_store_set (elv->priv->treestore, iter,
+	                    ES_PROGRESS, percent,
+	                    ES_PROGRESS_STR, text,
+	                    ES_DOWNLOADING, TRUE,
+	                    -1);
+	g_free (text);
+}
+
+void
+enclosure_list_view_update_download (EnclosureListView *elv, const gchar *url)
+{
+	GtkTreeModel	*model = GTK_TREE_MODEL (elv->priv->treestore);
+	GtkTreeIter	iter;
+	gboolean	valid;
+
+	valid = gtk_tree_model_get_iter_first (model, &iter);
+	while (valid) {
+		enclosurePtr enclosure;
+
+		gtk_tree_model_get (model, &iter, ES_PTR, &enclosure, -1);
+		if (g_str_equal (enclosure->url, url))
+			enclosure_list_view_set_progress (elv, &iter, url);
+		valid = gtk_tree_model_iter_next (model, &iter);
+	}
+}
+
 void
 enclosure_list_view_load (EnclosureListView *elv, itemPtr item)
 {
-	GSList		*list;
+	GSList		*list, *values;
 	guint		len;
 
 	/* cleanup old content */
@@ -250,7 +312,7 @@ enclosure_list_view_load (EnclosureListView *elv, itemPtr item)
 	elv->priv->enclosures = NULL;	
 	
 	/* decide visibility of the list */
-	list = metadata_list_get_values (item->metadata, "enclosure");
+	list = values = metadata_list_get_values (item->metadata, "enclosure");
 	len = g_slist_length (list);
 	if (len == 0) {
 		enclosure_list_view_hide (elv);
@@ -306,11 +368,14 @@ enclosure_list_view_load (EnclosureListView *elv, itemPtr item)
 					    -1);
 			g_free (sizeStr);
 
+			enclosure_list_view_set_progress (elv, &iter, enclosure->url);
+
 			elv->priv->enclosures = g_slist_append (elv->priv->enclosures, enclosure);
 		}
 		
 		list = list->next;
 	}
+	g_slist_free (values);
 }
 
 void
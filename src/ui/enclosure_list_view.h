@@ -79,6 +79,15 @@ GtkWidget * enclosure_list_view_get_widget (EnclosureListView *elv);
  */
 void enclosure_list_view_load (EnclosureListView *elv, itemPtr item);
 
+/**
+ * Updates the download progress of the given enclosure
+ * if it is listed.
+ *
+ * @param elv	the enclosure list view
+ * @param url	the enclosure URL
+ */
+void enclosure_list_view_update_download (EnclosureListView *elv, const gchar *url);
+
 /**
  * Hides the enclosure list view.
  *
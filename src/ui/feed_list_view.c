@@ -164,6 +164,29 @@ feed_list_view_restore_folder_expansion (nodePtr node)
 	node_foreach_child (node, feed_list_view_restore_folder_expansion);
 }
 
+void
+feed_list_view_restore_expansion (void)
+{
+	feedlist_foreach (feed_list_view_restore_folder_expansion);
+}
+
+/* keeps the node expansion state in sync for feed list export */
+static void
+feed_list_view_row_expansion_cb (GtkTreeView *treeview, GtkTreeIter *iter, GtkTreePath *path, gpointer expanded)
+{
+	nodePtr	node;
+
+	if (feedlist_reduced_unread)
+		return;
+
+	gtk_tree_model_get (gtk_tree_view_get_model (treeview), iter, FS_PTR, &node, -1);
+	if (!node || node->expanded == GPOINTER_TO_INT (expanded))
+		return;
+
+	node->expanded = GPOINTER_TO_INT (expanded);
+	feedlist_schedule_save ();
+}
+
 static void
 feed_list_view_reduce_mode_changed ()
 {
@@ -180,7 +203,7 @@ feed_list_view_reduce_mode_changed ()
 		gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (filter));
 		gtk_tree_view_set_model (treeview, GTK_TREE_MODEL (feedstore));
 		
-		feedlist_foreach (feed_list_view_restore_folder_expansion);
+		feed_list_view_restore_expansion ();
 	}
 }
 
@@ -207,7 +230,7 @@ feed_list_view_sort_folder (nodePtr folder)
 {
 	folder->children = g_slist_sort (folder->children, feed_list_view_sort_folder_compare);
 	ui_node_reload_feedlist ();
-	feedlist_foreach (feed_list_view_restore_folder_expansion);
+	feed_list_view_restore_expansion ();
 	feedlist_schedule_save ();
 }
 
@@ -260,6 +283,8 @@ feed_list_view_init (GtkTreeView *treeview)
 
 	g_signal_connect (G_OBJECT (treeview), "row-activated", G_CALLBACK (feed_list_view_row_activated_cb), NULL);
 	g_signal_connect (G_OBJECT (treeview), "key-press-event", G_CALLBACK (feed_list_view_key_press_cb), NULL);
+	g_signal_connect (G_OBJECT (treeview), "row-expanded", G_CALLBACK (feed_list_view_row_expansion_cb), GINT_TO_POINTER (TRUE));
+	g_signal_connect (G_OBJECT (treeview), "row-collapsed", G_CALLBACK (feed_list_view_row_expansion_cb), GINT_TO_POINTER (FALSE));
 
 	select = gtk_tree_view_get_selection (treeview);
 	gtk_tree_selection_set_mode (select, GTK_SELECTION_SINGLE);
@@ -45,6 +45,11 @@ extern gboolean		feedlist_reduced_unread;
  */
 void feed_list_view_select(nodePtr node);
 
+/**
+ * Expands all folders according to their saved expansion state.
+ */
+void feed_list_view_restore_expansion (void);
+
 /**
  * Initializes the feed list. For example, it creates the various
  * columns and renderers needed to show the list.
@@ -395,8 +395,10 @@ item_list_view_update (ItemListView *ilv, gboolean hasEnclosures)
 	gtk_tree_view_column_set_visible (gtk_tree_view_get_column (ilv->priv->treeview, 1), hasEnclosures);
 
 	if (ilv->priv->batch_mode) {
+		debug_enter ("item_list_view_update");
 		item_list_view_set_tree_store (ilv, ilv->priv->batch_itemstore);
 		ilv->priv->batch_mode = FALSE;
+		debug_exit ("item_list_view_update");
 	} else {
 		/* Nothing to do in non-batch mode as items were added
 		   and updated one-by-one in ui_itemlist_add_item() */
@@ -922,7 +924,7 @@ itemlist_sort_column_changed_cb (GtkTreeSortable *treesortable, gpointer user_da
 
 	changed = node_set_sort_column (feedlist_get_selected (), nodeSort, sortType == GTK_SORT_DESCENDING);
 	if (changed)
-		feedlist_schedule_save ();
+		feedlist_node_changed (feedlist_get_selected ());
 }
 
 /* needed because switching does sometimes returns to the tree 
@@ -237,6 +237,13 @@ itemview_update_item (itemPtr item)
 	htmlview_update_item (item);
 }
 
+void
+itemview_update_enclosure_download (const gchar *url)
+{
+	if (itemview && itemview->priv->enclosureView)
+		enclosure_list_view_update_download (itemview->priv->enclosureView, url);
+}
+
 void
 itemview_update_all_items (void)
 {
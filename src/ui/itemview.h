@@ -28,6 +28,7 @@
 #include "item.h"
 #include "itemset.h"
 #include "node.h"
+#include "ui_observer.h"
 #include "ui/enclosure_list_view.h"
 #include "ui/liferea_htmlview.h"
 
@@ -79,18 +80,10 @@ void itemview_clear (void);
  */
 void itemview_set_displayed_node (nodePtr node);
 
-/** item view display mode type */
-typedef enum {
-	ITEMVIEW_SINGLE_ITEM,	/**< 3 panes, item view shows the selected item only in HTML view */
-	ITEMVIEW_LOAD_LINK,	/**< 3 panes, item view loads the link of selected item into HTML view */
-	ITEMVIEW_ALL_ITEMS,	/**< 2 panes, item view shows all items combined in HTML view */
-	ITEMVIEW_NODE_INFO	/**< 3 panes, item view shows the selected node description in HTML view*/
-} itemViewMode;
-
 /**
  * Set/unset the display mode of the item view.
  *
- * @param mode		item view mode constant
+ * @param mode		item view mode constant (see ui_observer.h)
  */
 void itemview_set_mode (itemViewMode mode);
 
@@ -128,6 +121,14 @@ void itemview_select_item (itemPtr item);
  */
 void itemview_update_item (itemPtr item);
 
+/**
+ * Requests updating the download progress of the given
+ * enclosure in the enclosure list.
+ *
+ * @param url	the enclosure URL
+ */
+void itemview_update_enclosure_download (const gchar *url);
+
 /**
  * Requests updating the rendering of a all displayed items.
  */
@@ -37,6 +37,8 @@
 #include "htmlview.h"
 #include "itemlist.h"
 #include "net_monitor.h"
+#include "ui_observer.h"
+#include "ui/auth_dialog.h"
 #include "ui/browser_tabs.h"
 #include "ui/feed_list_view.h"
 #include "ui/icons.h"
@@ -45,6 +47,8 @@
 #include "ui/liferea_dialog.h"
 #include "ui/search_dialog.h"
 #include "ui/ui_common.h"
+#include "ui/ui_invalidate.h"
+#include "ui/ui_node.h"
 #include "ui/ui_prefs.h"
 #include "ui/ui_session.h"
 #include "ui/ui_tray.h"
@@ -1052,6 +1056,54 @@ liferea_shell_restore_state (void)
 		gtk_paned_set_position (GTK_PANED (liferea_shell_lookup ("wideViewPane")), last_wpane_pos);
 }
 
+static void
+liferea_shell_observe_status_bar (const gchar *text)
+{
+	liferea_shell_set_status_bar ("%s", text);
+}
+
+static void
+liferea_shell_observe_node_changed (nodePtr node)
+{
+	ui_invalidate_node (node->id);
+}
+
+static void
+liferea_shell_observe_auth_required (subscriptionPtr subscription, gint flags)
+{
+	auth_dialog_new (subscription, flags);
+}
+
+/* core notifications are passed on to the main window widgets */
+static struct uiObserver liferea_shell_observer = {
+	liferea_shell_observe_status_bar,
+	liferea_shell_present,
+	liferea_shell_set_toolbar_style,
+	liferea_shell_update_feed_menu,
+	liferea_shell_update_allitems_actions,
+	ui_invalidate_stats,
+	ui_tray_enable,
+	ui_node_add,
+	ui_node_remove_node,
+	liferea_shell_observe_node_changed,
+	itemview_update_node_info,
+	feed_list_view_select,
+	itemview_set_displayed_node,
+	itemview_set_mode,
+	itemview_set_layout,
+	itemview_clear,
+	itemview_add_item,
+	itemview_remove_item,
+	itemview_update_item,
+	itemview_select_item,
+	itemview_find_unread_item,
+	itemview_launch_URL,
+	itemview_update_enclosure_download,
+	itemview_update_all_items,
+	itemview_update,
+	liferea_shell_observe_auth_required
+};
+
 void
 liferea_shell_create (int initialState)
 {
@@ -1201,7 +1253,9 @@ liferea_shell_create (int initialState)
 	
 	liferea_shell_setup_URL_receiver (GTK_WIDGET (shell->priv->window));	/* setup URL dropping support */
 
+	ui_observer_register (&liferea_shell_observer);
 	shell->priv->feedlist = feedlist_create ();
+	feed_list_view_restore_expansion ();
 
 	conf_get_bool_value (SHOW_TRAY_ICON, &show_tray_icon);
 
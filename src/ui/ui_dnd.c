@@ -197,6 +197,7 @@ ui_dnd_feed_drag_data_received (GtkTreeDragDest *drag_dest, GtkTreePath *dest, G
 			
 			node_update_counters (newParent);
 			
+			feedlist_node_changed (node);	/* new parent_id */
 			feedlist_schedule_save ();
 			//ui_itemlist_prefocus ();
 			g_warning("FIXME: item list prefocus!");
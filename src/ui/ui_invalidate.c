@@ -0,0 +1,145 @@
+/**
+ * @file ui_invalidate.c  coalesced feed list and statistics redraws
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ui/ui_invalidate.h"
+
+#include "debug.h"
+#include "metrics.h"
+#include "node.h"
+#include "ui/liferea_shell.h"
+#include "ui/ui_node.h"
+#include "ui/ui_tray.h"
+
+/* flush before GTK+ resizes (G_PRIORITY_HIGH_IDLE + 10) and redraws (+ 20) */
+#define UI_INVALIDATE_PRIORITY	(G_PRIORITY_HIGH_IDLE + 5)
+
+/* maximum delay (in ms) when other sources keep the main loop busy */
+#define UI_INVALIDATE_MAX_DELAY	250
+
+static GHashTable	*dirtyNodes = NULL;	/**< ids of nodes to redraw */
+static gboolean		dirtyStats = FALSE;	/**< TRUE if tray and status bar need an update */
+static guint		idleId = 0;
+static guint		timeoutId = 0;
+
+static guint		requestedCount = 0;	/**< number of redraws requested since the last flush */
+
+static gboolean
+ui_invalidate_flush_cb (gpointer user_data)
+{
+	ui_invalidate_flush ();
+
+	return FALSE;
+}
+
+static void
+ui_invalidate_schedule (void)
+{
+	if (!idleId)
+		idleId = g_idle_add_full (UI_INVALIDATE_PRIORITY, ui_invalidate_flush_cb, NULL, NULL);
+	if (!timeoutId)
+		timeoutId = g_timeout_add (UI_INVALIDATE_MAX_DELAY, ui_invalidate_flush_cb, NULL);
+}
+
+void
+ui_invalidate_node (const gchar *nodeId)
+{
+	requestedCount++;
+
+	if (!dirtyNodes)
+		dirtyNodes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	if (!g_hash_table_lookup (dirtyNodes, nodeId))
+		g_hash_table_insert (dirtyNodes, g_strdup (nodeId), GINT_TO_POINTER (1));
+
+	ui_invalidate_schedule ();
+}
+
+void
+ui_invalidate_stats (void)
+{
+	requestedCount++;
+	dirtyStats = TRUE;
+
+	ui_invalidate_schedule ();
+}
+
+/* Collects the node and its parents, parents shared by
+   several dirty nodes are redrawn only once. */
+static void
+ui_invalidate_collect (gpointer key, gpointer value, gpointer user_data)
+{
+	GHashTable	*redraw = (GHashTable *)user_data;
+	nodePtr		node;
+
+	node = node_is_used_id ((const gchar *)key);
+	while (node && !g_hash_table_lookup (redraw, node->id)) {
+		g_hash_table_insert (redraw, node->id, node);
+		node = node->parent;
+	}
+}
+
+static void
+ui_invalidate_redraw_node (gpointer key, gpointer value, gpointer user_data)
+{
+	ui_node_redraw ((const gchar *)key);
+	(*(guint *)user_data)++;
+}
+
+void
+ui_invalidate_flush (void)
+{
+	GHashTable	*redraw;
+	guint		done = 0;
+
+	if (idleId) {
+		g_source_remove (idleId);
+		idleId = 0;
+	}
+	if (timeoutId) {
+		g_source_remove (timeoutId);
+		timeoutId = 0;
+	}
+
+	if (dirtyNodes && g_hash_table_size (dirtyNodes) > 0) {
+		redraw = g_hash_table_new (g_str_hash, g_str_equal);
+		g_hash_table_foreach (dirtyNodes, ui_invalidate_collect, redraw);
+		g_hash_table_remove_all (dirtyNodes);
+
+		g_hash_table_foreach (redraw, ui_invalidate_redraw_node, &done);
+		g_hash_table_destroy (redraw);
+	}
+
+	if (dirtyStats) {
+		dirtyStats = FALSE;
+		ui_tray_update ();
+		liferea_shell_update_unread_stats ();
+		done++;
+	}
+
+	if (!requestedCount)
+		return;
+
+	/* the difference is the number of coalesced redraws */
+	metrics_count ("ui.redraw_requests", NULL, requestedCount);
+	metrics_count ("ui.redraws", NULL, done);
+
+	debug2 (DEBUG_GUI, "UI invalidation flush: %u redraws for %u requests", done, requestedCount);
+	requestedCount = 0;
+}
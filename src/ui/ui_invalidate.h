@@ -0,0 +1,54 @@
+/**
+ * @file ui_invalidate.h  coalesced feed list and statistics redraws
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */ 
+
+#ifndef _UI_INVALIDATE_H
+#define _UI_INVALIDATE_H
+
+#include <glib.h>
+
+/* Counter changes during feed updates happen much more often than
+   the user can see them. Instead of redrawing immediately, code
+   that changes counters marks the affected feed list entries and the
+   global statistics (tray icon and status bar) as invalid. All pending
+   redraws are done once per main loop iteration before GTK+ redraws,
+   but at least every UI_INVALIDATE_MAX_DELAY ms if the main loop is
+   kept busy. */
+
+/**
+ * Queues a redraw of the feed list entry of the given
+ * node and all its parents.
+ *
+ * @param nodeId	the node id
+ */
+void ui_invalidate_node (const gchar *nodeId);
+
+/**
+ * Queues an update of the tray icon and the status bar statistics.
+ */
+void ui_invalidate_stats (void);
+
+/**
+ * Performs all pending redraws immediately. The number of requested
+ * and performed redraws is counted in the metrics registry as
+ * "ui.redraw_requests" and "ui.redraws".
+ */
+void ui_invalidate_flush (void);
+
+#endif
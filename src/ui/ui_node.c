@@ -278,7 +278,7 @@ ui_node_remove_node (nodePtr node)
 }
 
 void
-ui_node_update (const gchar *nodeId)
+ui_node_redraw (const gchar *nodeId)
 {
 	GtkTreeIter	*iter;
 	gchar		*label;
@@ -318,8 +318,17 @@ ui_node_update (const gchar *nodeId)
 	                                     FS_ICON, node->available?node_get_icon (node):icon_get (ICON_UNAVAILABLE),
 	                                     -1);
 	g_free (label);
+}
 
-	if (node->parent)
+void
+ui_node_update (const gchar *nodeId)
+{
+	nodePtr	node;
+
+	ui_node_redraw (nodeId);
+
+	node = node_from_id (nodeId);
+	if (node && node->parent)
 		ui_node_update (node->parent->id);
 }
 
@@ -334,7 +343,7 @@ on_nodenamedialog_response (GtkDialog *dialog, gint response_id, gpointer user_d
 		node_set_title (node, (gchar *) gtk_entry_get_text (GTK_ENTRY (liferea_dialog_lookup (GTK_WIDGET (dialog), "nameentry"))));
 
 		ui_node_update (node->id);
-		feedlist_schedule_save ();
+		feedlist_node_changed (node);
 	}
 	
 	gtk_widget_destroy (GTK_WIDGET (dialog));
@@ -111,6 +111,14 @@ void ui_node_set_expansion(nodePtr folder, gboolean expanded);
  */
 void ui_node_update(const gchar *nodeId);
 
+/**
+ * Updates the tree view entry of the given node
+ * without updating its parents.
+ *
+ * @param nodeId	the node id
+ */
+void ui_node_redraw(const gchar *nodeId);
+
 /**
  * Open dialog to rename a given node.
  *
@@ -0,0 +1,232 @@
+/**
+ * @file ui_observer.c  core to user interface notifications
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "ui_observer.h"
+
+#include "debug.h"
+
+static uiObserverPtr observer = NULL;	/**< NULL when running headless (--daemon) */
+
+void
+ui_observer_register (uiObserverPtr newObserver)
+{
+	g_return_if_fail (!observer);
+
+	observer = newObserver;
+}
+
+void
+ui_observer_set_status_bar (const gchar *format, ...)
+{
+	va_list		args;
+	gchar		*text;
+
+	g_return_if_fail (format != NULL);
+
+	va_start (args, format);
+	text = g_strdup_vprintf (format, args);
+	va_end (args);
+
+	if (observer)
+		(observer->set_status_bar) (text);
+	else
+		debug1 (DEBUG_GUI, "%s", text);
+
+	g_free (text);
+}
+
+void
+ui_observer_present (void)
+{
+	if (observer)
+		(observer->present) ();
+}
+
+void
+ui_observer_set_toolbar_style (const gchar *style)
+{
+	if (observer)
+		(observer->set_toolbar_style) (style);
+}
+
+void
+ui_observer_update_feed_menu (gboolean add, gboolean enabled, gboolean readWrite)
+{
+	if (observer)
+		(observer->update_feed_menu) (add, enabled, readWrite);
+}
+
+void
+ui_observer_update_allitems_actions (gboolean isNotEmpty, gboolean isRead)
+{
+	if (observer)
+		(observer->update_allitems_actions) (isNotEmpty, isRead);
+}
+
+void
+ui_observer_update_stats (void)
+{
+	if (observer)
+		(observer->update_stats) ();
+}
+
+void
+ui_observer_set_tray_icon (gboolean enabled)
+{
+	if (observer)
+		(observer->set_tray_icon) (enabled);
+}
+
+void
+ui_observer_node_added (nodePtr node)
+{
+	if (observer)
+		(observer->node_added) (node);
+}
+
+void
+ui_observer_node_removed (nodePtr node)
+{
+	if (observer)
+		(observer->node_removed) (node);
+}
+
+void
+ui_observer_node_changed (nodePtr node)
+{
+	if (observer && node)
+		(observer->node_changed) (node);
+}
+
+void
+ui_observer_node_info_changed (nodePtr node)
+{
+	if (observer)
+		(observer->node_info_changed) (node);
+}
+
+void
+ui_observer_node_selected (nodePtr node)
+{
+	if (observer)
+		(observer->node_selected) (node);
+}
+
+void
+ui_observer_node_displayed (nodePtr node)
+{
+	if (observer)
+		(observer->node_displayed) (node);
+}
+
+void
+ui_observer_set_item_view_mode (itemViewMode mode)
+{
+	if (observer)
+		(observer->set_item_view_mode) (mode);
+}
+
+void
+ui_observer_set_item_view_layout (nodeViewType layout)
+{
+	if (observer)
+		(observer->set_item_view_layout) (layout);
+}
+
+void
+ui_observer_items_cleared (void)
+{
+	if (observer)
+		(observer->items_cleared) ();
+}
+
+void
+ui_observer_item_added (itemPtr item)
+{
+	if (observer)
+		(observer->item_added) (item);
+}
+
+void
+ui_observer_item_removed (itemPtr item)
+{
+	if (observer)
+		(observer->item_removed) (item);
+}
+
+void
+ui_observer_item_updated (itemPtr item)
+{
+	if (observer)
+		(observer->item_updated) (item);
+}
+
+void
+ui_observer_item_selected (itemPtr item)
+{
+	if (observer)
+		(observer->item_selected) (item);
+}
+
+itemPtr
+ui_observer_find_unread_item (gulong startId)
+{
+	if (observer)
+		return (observer->find_unread_item) (startId);
+
+	return NULL;
+}
+
+void
+ui_observer_launch_url (const gchar *url, gboolean internal)
+{
+	if (observer)
+		(observer->launch_url) (url, internal);
+}
+
+void
+ui_observer_enclosure_download_progress (const gchar *url)
+{
+	if (observer)
+		(observer->enclosure_download_progress) (url);
+}
+
+void
+ui_observer_all_items_updated (void)
+{
+	if (observer)
+		(observer->all_items_updated) ();
+}
+
+void
+ui_observer_items_changed (void)
+{
+	if (observer)
+		(observer->items_changed) ();
+}
+
+void
+ui_observer_auth_required (subscriptionPtr subscription, gint flags)
+{
+	if (observer)
+		(observer->auth_required) (subscription, flags);
+	else
+		g_warning ("Authentication for \"%s\" failed, cannot ask for credentials without user interface.", subscription_get_source (subscription));
+}
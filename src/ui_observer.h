@@ -0,0 +1,175 @@
+/**
+ * @file ui_observer.h  core to user interface notifications
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _UI_OBSERVER_H
+#define _UI_OBSERVER_H
+
+#include <glib.h>
+
+#include "item.h"
+#include "node.h"
+#include "subscription.h"
+
+/* The feed list, item list and subscription code reports changes
+   the user interface has to show through a single observer. The
+   main window registers it, when running headless (--daemon) no
+   observer is registered and the notifications are dropped. */
+
+/** item view display mode type */
+typedef enum {
+	ITEMVIEW_SINGLE_ITEM,	/**< 3 panes, item view shows the selected item only in HTML view */
+	ITEMVIEW_LOAD_LINK,	/**< 3 panes, item view loads the link of selected item into HTML view */
+	ITEMVIEW_ALL_ITEMS,	/**< 2 panes, item view shows all items combined in HTML view */
+	ITEMVIEW_NODE_INFO	/**< 3 panes, item view shows the selected node description in HTML view*/
+} itemViewMode;
+
+typedef struct uiObserver {
+	void	(*set_status_bar)	(const gchar *text);
+	void	(*present)		(void);
+	void	(*set_toolbar_style)	(const gchar *style);
+	void	(*update_feed_menu)	(gboolean add, gboolean enabled, gboolean readWrite);
+	void	(*update_allitems_actions) (gboolean isNotEmpty, gboolean isRead);
+	void	(*update_stats)		(void);		/**< unread/new counts changed */
+	void	(*set_tray_icon)	(gboolean enabled);
+	void	(*node_added)		(nodePtr node);
+	void	(*node_removed)		(nodePtr node);
+	void	(*node_changed)		(nodePtr node);	/**< title, icon or counters changed */
+	void	(*node_info_changed)	(nodePtr node);
+	void	(*node_selected)	(nodePtr node);
+	void	(*node_displayed)	(nodePtr node);
+	void	(*set_item_view_mode)	(itemViewMode mode);
+	void	(*set_item_view_layout)	(nodeViewType layout);
+	void	(*items_cleared)	(void);
+	void	(*item_added)		(itemPtr item);
+	void	(*item_removed)		(itemPtr item);
+	void	(*item_updated)		(itemPtr item);
+	void	(*item_selected)	(itemPtr item);
+	itemPtr	(*find_unread_item)	(gulong startId);
+	void	(*launch_url)		(const gchar *url, gboolean internal);
+	void	(*enclosure_download_progress) (const gchar *url);
+	void	(*all_items_updated)	(void);
+	void	(*items_changed)	(void);		/**< item list changes are complete */
+	void	(*auth_required)	(subscriptionPtr subscription, gint flags);
+} *uiObserverPtr;
+
+/**
+ * Registers the user interface. All callbacks must be set.
+ *
+ * @param observer	the observer
+ */
+void ui_observer_register (uiObserverPtr observer);
+
+/**
+ * Sets the status bar text. Takes printf() like parameters.
+ */
+void ui_observer_set_status_bar (const gchar *format, ...);
+
+/** Raises the main window. */
+void ui_observer_present (void);
+
+/** Applies a changed toolbar style preference. */
+void ui_observer_set_toolbar_style (const gchar *style);
+
+/** Changes the sensitivity of the feed menu actions. */
+void ui_observer_update_feed_menu (gboolean add, gboolean enabled, gboolean readWrite);
+
+/** Changes the sensitivity of the "all items" actions. */
+void ui_observer_update_allitems_actions (gboolean isNotEmpty, gboolean isRead);
+
+/** Signals changed unread/new item counts. */
+void ui_observer_update_stats (void);
+
+/** Shows or hides the tray icon. */
+void ui_observer_set_tray_icon (gboolean enabled);
+
+/** Adds a new node to the feed list. */
+void ui_observer_node_added (nodePtr node);
+
+/** Removes a node from the feed list. */
+void ui_observer_node_removed (nodePtr node);
+
+/**
+ * Signals a changed title, icon or counters of a node. The feed
+ * list entry of the node and its parents are redrawn later.
+ *
+ * @param node	the node (or NULL)
+ */
+void ui_observer_node_changed (nodePtr node);
+
+/** Signals changed node information (e.g. after an update). */
+void ui_observer_node_info_changed (nodePtr node);
+
+/** Selects a node in the feed list, NULL unselects. */
+void ui_observer_node_selected (nodePtr node);
+
+/** Prepares the item view for the items of a node, NULL for none. */
+void ui_observer_node_displayed (nodePtr node);
+
+/** Changes the item view display mode. */
+void ui_observer_set_item_view_mode (itemViewMode mode);
+
+/** Changes the item view layout (see node_set_view_mode()). */
+void ui_observer_set_item_view_layout (nodeViewType layout);
+
+/** Clears the item list. */
+void ui_observer_items_cleared (void);
+
+/** Adds an item to the item list. */
+void ui_observer_item_added (itemPtr item);
+
+/** Removes an item from the item list. */
+void ui_observer_item_removed (itemPtr item);
+
+/** Signals a changed item. */
+void ui_observer_item_updated (itemPtr item);
+
+/** Selects and shows an item of the item list. */
+void ui_observer_item_selected (itemPtr item);
+
+/**
+ * Searches the item list for the next unread item.
+ *
+ * @param startId	the item id to start after, 0 for the first
+ *
+ * @returns the item or NULL (always NULL without user interface)
+ */
+itemPtr ui_observer_find_unread_item (gulong startId);
+
+/** Opens a URL in the internal or external browser. */
+void ui_observer_launch_url (const gchar *url, gboolean internal);
+
+/** Signals a progress or state change of an enclosure download. */
+void ui_observer_enclosure_download_progress (const gchar *url);
+
+/** Signals that all items might have changed. */
+void ui_observer_all_items_updated (void);
+
+/** Signals that a batch of item list changes is complete. */
+void ui_observer_items_changed (void);
+
+/**
+ * Asks the user for credentials of the given subscription.
+ *
+ * @param subscription	the subscription
+ * @param flags		the update flags
+ */
+void ui_observer_auth_required (subscriptionPtr subscription, gint flags);
+
+#endif
@@ -28,6 +28,10 @@
 #include <libxslt/transform.h>
 #include <libxslt/xsltutils.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <sys/wait.h>
@@ -35,16 +39,21 @@
 
 #include "common.h"
 #include "debug.h"
+#include "http_cache.h"
+#include "metrics.h"
 #include "net.h"
+#include "ui_observer.h"
+#include "update_queue.h"
 #include "xml.h"
-#include "ui/liferea_shell.h"
-#include "ui/ui_tray.h"
 
 /** global update job list, used for lookups when cancelling */
 static GSList	*jobs = NULL;
 
-static GAsyncQueue *pendingHighPrioJobs = NULL;
-static GAsyncQueue *pendingJobs = NULL;
+/** pending jobs grouped by host (see update_queue.h) */
+static updateQueuePtr pendingJobs = NULL;
+
+/** in-flight jobs by resource (see update_job_get_coalesce_key()) */
+static GHashTable *inflightJobs = NULL;
 static guint numberOfActiveJobs = 0;
 #define MAX_ACTIVE_JOBS	5
 
@@ -83,6 +92,19 @@ update_state_set_cookies (updateStatePtr state, const gchar *cookies)
 		state->cookies = g_strdup (cookies);
 }
 
+const gchar *
+update_state_get_etag (updateStatePtr state)
+{
+	return state->etag;
+}
+
+void
+update_state_set_etag (updateStatePtr state, const gchar *etag)
+{
+	g_free (state->etag);
+	state->etag = g_strdup (etag);
+}
+
 updateStatePtr
 update_state_copy (updateStatePtr state)
 {
@@ -91,6 +113,7 @@ update_state_copy (updateStatePtr state)
 	newState = update_state_new ();
 	update_state_set_lastmodified (newState, update_state_get_lastmodified (state));
 	update_state_set_cookies (newState, update_state_get_cookies (state));
+	update_state_set_etag (newState, update_state_get_etag (state));
 	
 	return newState;
 }
@@ -102,6 +125,7 @@ update_state_free (updateStatePtr updateState)
 		return;
 
 	g_free (updateState->cookies);
+	g_free (updateState->etag);
 	g_free (updateState);
 }
 
@@ -122,6 +146,9 @@ update_request_free (updateRequestPtr request)
 	update_state_free (request->updateState);
 	update_options_free (request->options);
 
+	if (request->elementDataFree)
+		(*request->elementDataFree) (request->elementData);
+
 	g_free (request->postdata);
 	g_free (request->source);
 	g_free (request->filtercmd);
@@ -162,6 +189,10 @@ update_result_free (updateResultPtr result)
 	update_state_free (result->updateState);
 
 	g_free (result->data);
+	if (result->doc)
+		xmlFreeDoc (result->doc);
+	if (result->docErrors)
+		g_string_free (result->docErrors, TRUE);
 	g_free (result->source);
 	g_free (result->contentType);
 	g_free (result->filterErrors);
@@ -221,6 +252,63 @@ update_job_get_state (updateJobPtr job)
 	return job->state;
 }
 
+static void
+update_job_set_state (updateJobPtr job, gint state)
+{
+	GSList	*iter;
+
+	job->state = state;
+	for (iter = job->followers; iter; iter = g_slist_next (iter))
+		((updateJobPtr)iter->data)->state = state;
+}
+
+/* Returns TRUE if any of the given jobs wants a result */
+static gboolean
+update_job_is_wanted_by (GSList *list)
+{
+	GSList	*iter;
+
+	for (iter = list; iter; iter = g_slist_next (iter))
+		if (((updateJobPtr)iter->data)->callback)
+			return TRUE;
+
+	return FALSE;
+}
+
+/* Returns TRUE if anyone is still interested in the result of the job */
+static gboolean
+update_job_is_wanted (updateJobPtr job)
+{
+	return job->callback || update_job_is_wanted_by (job->followers);
+}
+
+/* Requests for the same resource with the same credentials, filter
+   and update state produce the same result and can share one job.
+   POST requests may have side effects and are never shared. Elements
+   consumed while downloading are only available through the
+   elementData of the first request, so the element function must
+   match too. */
+static gchar *
+update_job_get_coalesce_key (updateRequestPtr request)
+{
+	if (request->postdata)
+		return NULL;
+
+	return g_strdup_printf ("%s\n%s\n%s\n%s\n%d\n%s\n%ld\n%s\n%s\n%d\n%d\n%p",
+	                        request->source,
+	                        request->authValue ? request->authValue : "",
+	                        request->options->username ? request->options->username : "",
+	                        request->options->password ? request->options->password : "",
+	                        request->options->dontUseProxy,
+	                        request->filtercmd ? request->filtercmd : "",
+	                        request->updateState ? request->updateState->lastModified : 0,
+	                        (request->updateState && request->updateState->cookies) ? request->updateState->cookies : "",
+	                        (request->updateState && request->updateState->etag) ? request->updateState->etag : "",
+	                        request->useCache,
+	                        request->parseXml,
+	                        (gpointer)request->elementFunc);
+}
+
 static void
 update_job_free (updateJobPtr job)
 {
@@ -228,6 +316,10 @@ update_job_free (updateJobPtr job)
 		return;
 		
 	jobs = g_slist_remove (jobs, job);
+
+	g_slist_foreach (job->followers, (GFunc)update_job_free, NULL);
+	g_slist_free (job->followers);
+	g_free (job->coalesceKey);
 	
 	update_request_free (job->request);
 	update_result_free (job->result);
@@ -236,67 +328,98 @@ update_job_free (updateJobPtr job)
 
 /* filter idea (and some of the code) was taken from Snownews */
 static gchar *
-update_exec_filter_cmd (gchar *cmd, gchar *data, gchar **errorOutput, size_t *size)
-{
-	int		fd, status;
-	gchar		*command;
-	const gchar	*tmpdir = g_get_tmp_dir();
-	char		*tmpfilename;
-	char		*out = NULL;
-	FILE		*file, *p;
-	
+update_exec_filter_cmd (gchar *cmd, gchar *data, size_t length, gchar **errorOutput, size_t *size)
+{
+	gchar		*argv[] = { "/bin/sh", "-c", cmd, NULL };
+	GError		*error = NULL;
+	GPid		pid;
+	gint		in, out, status;
+	size_t		written = 0;
+	GString		*output;
+	void		(*oldHandler) (int);
+
 	*errorOutput = NULL;
-	tmpfilename = g_build_filename (tmpdir, "liferea-XXXXXX", NULL);
-	
-	fd = g_mkstemp(tmpfilename);
-	
-	if(fd == -1) {
-		debug1(DEBUG_UPDATE, "Error opening temp file %s to use for filtering!", tmpfilename);
-		*errorOutput = g_strdup_printf(_("Error opening temp file %s to use for filtering!"), tmpfilename);
-		g_free(tmpfilename);
+	*size = 0;
+
+	/* The data is written to the filter through a pipe while reading
+	   its output so that no temporary file is needed. */
+	if (!g_spawn_async_with_pipes (NULL, argv, NULL, G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL,
+	                               &pid, &in, &out, NULL, &error)) {
+		g_warning (_("Error: Could not open pipe \"%s\""), cmd);
+		*errorOutput = g_strdup_printf (_("Error: Could not open pipe \"%s\""), cmd);
+		g_error_free (error);
 		return NULL;
-	}	
-		
-	file = fdopen(fd, "w");
-	fwrite(data, strlen(data), 1, file);
-	fclose(file);
+	}
 
-	*size = 0;
-	command = g_strdup_printf("%s < %s", cmd, tmpfilename);
-	p = popen(command, "r");
-	g_free(command);
-	if(NULL != p) {
-		while(!feof(p) && !ferror(p)) {
-			size_t len;
-			out = g_realloc(out, *size+1025);
-			len = fread(&out[*size], 1, 1024, p);
-			if(len > 0)
-				*size += len;
+	/* a filter exiting without reading all data must not kill us */
+	oldHandler = signal (SIGPIPE, SIG_IGN);
+	fcntl (in, F_SETFL, O_NONBLOCK);
+	if (0 == length) {
+		close (in);
+		in = -1;
+	}
+
+	output = g_string_sized_new (length + 1);
+	while (out != -1) {
+		struct pollfd	fds[2];
+		gchar		buffer[4096];
+		ssize_t		len;
+
+		fds[0].fd = out;
+		fds[0].events = POLLIN;
+		fds[1].fd = in;
+		fds[1].events = POLLOUT;
+		if (-1 == poll (fds, (-1 == in) ? 1 : 2, -1)) {
+			if (EINTR == errno)
+				continue;
+			break;
+		}
+
+		if (-1 != in && fds[1].revents) {
+			len = write (in, data + written, length - written);
+			if (len > 0)
+				written += len;
+			if ((len < 0 && EAGAIN != errno && EINTR != errno) || written == length) {
+				close (in);
+				in = -1;
+			}
 		}
-		status = pclose(p);
-		if(!(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
-			*errorOutput = g_strdup_printf(_("%s exited with status %d"),
-			                              cmd, WEXITSTATUS(status));
-			*size = 0;
+
+		if (fds[0].revents) {
+			len = read (out, buffer, sizeof (buffer));
+			if (len > 0) {
+				g_string_append_len (output, buffer, len);
+			} else if (0 == len || (EAGAIN != errno && EINTR != errno)) {
+				close (out);
+				out = -1;
+			}
 		}
-		out[*size] = '\0';
-	} else {
-		g_warning(_("Error: Could not open pipe \"%s\""), command);
-		*errorOutput = g_strdup_printf(_("Error: Could not open pipe \"%s\""), command);
 	}
-	/* Clean up. */
-	unlink (tmpfilename);
-	g_free (tmpfilename);
-	return out;
+	if (-1 != in)
+		close (in);
+	if (-1 != out)
+		close (out);
+	signal (SIGPIPE, oldHandler);
+
+	waitpid (pid, &status, 0);
+	g_spawn_close_pid (pid);
+	if (!(WIFEXITED (status) && WEXITSTATUS (status) == 0)) {
+		*errorOutput = g_strdup_printf (_("%s exited with status %d"),
+		                                cmd, WEXITSTATUS (status));
+		g_string_truncate (output, 0);
+	}
+
+	*size = output->len;
+	return g_string_free (output, FALSE);
 }
 
 static gchar *
-update_apply_xslt (updateJobPtr job)
+update_apply_xslt (updateJobPtr job, size_t *size)
 {
 	xsltStylesheetPtr	xslt = NULL;
-	xmlOutputBufferPtr	buf;
 	xmlDocPtr		srcDoc = NULL, resDoc = NULL;
-	gchar			*output = NULL;
+	xmlChar			*output = NULL;
+	int			len = 0;
 
 	g_assert (NULL != job->result);
 	
@@ -320,16 +443,19 @@ update_apply_xslt (updateJobPtr job)
 			break;
 		}
 
-		buf = xmlAllocOutputBuffer (NULL);
-		if (-1 == xsltSaveResultTo (buf, resDoc, xslt)) {
+		/* the source document is not needed for serializing */
+		xmlFreeDoc (srcDoc);
+		srcDoc = NULL;
+
+		if (-1 == xsltSaveResultToString (&output, &len, resDoc, xslt)) {
 			g_warning ("fatal: retrieving result of filter stylesheet failed (%s)!", job->request->filtercmd);
 			break;
 		}
 		
-		if (xmlBufferLength (buf->buffer) > 0)
-			output = xmlCharStrdup (xmlBufferContent (buf->buffer));
- 
-		xmlOutputBufferClose (buf);
+		if (output && 0 == len) {
+			xmlFree (output);
+			output = NULL;
+		}
 	} while (FALSE);
 
 	if (srcDoc)
@@ -339,7 +465,8 @@ update_apply_xslt (updateJobPtr job)
 	if (xslt)
 		xsltFreeStylesheet (xslt);
 	
-	return output;
+	*size = len;
+	return (gchar *)output;
 }
 
 static void
@@ -353,10 +480,9 @@ update_apply_filter (updateJobPtr job)
 	/* we allow two types of filters: XSLT stylesheets and arbitrary commands */
 	if ((strlen (job->request->filtercmd) > 4) &&
 	    (0 == strcmp (".xsl", job->request->filtercmd + strlen (job->request->filtercmd) - 4))) {
-		filterResult = update_apply_xslt (job);
-		len = strlen (filterResult);
+		filterResult = update_apply_xslt (job, &len);
 	} else {
-		filterResult = update_exec_filter_cmd (job->request->filtercmd, job->result->data, &(job->result->filterErrors), &len);
+		filterResult = update_exec_filter_cmd (job->request->filtercmd, job->result->data, job->result->size, &(job->result->filterErrors), &len);
 	}
 
 	if (filterResult) {
@@ -394,7 +520,7 @@ update_exec_cmd (updateJobPtr job)
 		if (job->result->data)
 			job->result->data[job->result->size] = '\0';
 	} else {
-		liferea_shell_set_status_bar (_("Error: Could not open pipe \"%s\""), (job->request->source) + 1);
+		ui_observer_set_status_bar (_("Error: Could not open pipe \"%s\""), (job->request->source) + 1);
 		job->result->httpstatus = 404;	/* FIXME: maybe setting request->returncode would be better */
 	}
 	
@@ -420,13 +546,13 @@ update_load_file (updateJobPtr job)
 		/* we have a file... */
 		if ((!g_file_get_contents (filename, &(job->result->data), &(job->result->size), NULL)) || (job->result->data[0] == '\0')) {
 			job->result->httpstatus = 403;	/* FIXME: maybe setting request->returncode would be better */
-			liferea_shell_set_status_bar (_("Error: Could not open file \"%s\""), filename);
+			ui_observer_set_status_bar (_("Error: Could not open file \"%s\""), filename);
 		} else {
 			job->result->httpstatus = 200;
 			debug2 (DEBUG_UPDATE, "Successfully read %d bytes from file %s.", job->result->size, filename);
 		}
 	} else {
-		liferea_shell_set_status_bar (_("Error: There is no file \"%s\""), filename);
+		ui_observer_set_status_bar (_("Error: There is no file \"%s\""), filename);
 		job->result->httpstatus = 404;	/* FIXME: maybe setting request->returncode would be better */
 	}
 	
@@ -450,6 +576,10 @@ update_job_run (updateJobPtr job)
 	
 	/* if it has a protocol "://" prefix, but not "file://" it is an URI */
 	if (strstr (job->request->source, "://") && strncmp (job->request->source, "file://", 7)) {
+		if (job->request->useCache && http_cache_lookup (job->request, job->result)) {
+			update_process_finished_job (job);
+			return;
+		}
 		network_process_request (job);
 		return;
 	}
@@ -462,6 +592,13 @@ update_job_run (updateJobPtr job)
 	}
 }
 
+static void
+update_metrics_queue (void)
+{
+	metrics_gauge ("update.queue_length", update_queue_length (pendingJobs));
+	metrics_gauge ("update.active_jobs", numberOfActiveJobs);
+}
+
 static gboolean
 update_dequeue_job (gpointer user_data)
 {
@@ -472,24 +609,26 @@ update_dequeue_job (gpointer user_data)
 		
 	if (numberOfActiveJobs >= MAX_ACTIVE_JOBS) 
 		return FALSE;	/* we'll be called again when a job finishes */
-	
 
-	job = (updateJobPtr)g_async_queue_try_pop(pendingHighPrioJobs);
-
-	if (!job)
-		job = (updateJobPtr)g_async_queue_try_pop(pendingJobs);
+	/* Do not start more jobs per host than the network code keeps
+	   connections per host, the remaining jobs would just wait for a
+	   free connection while jobs for other hosts could be processed. */
+	job = (updateJobPtr)update_queue_pop (pendingJobs, network_get_max_conns_per_host ());
 
 	if(!job)
-		return FALSE;	/* no request at the moment */
+		return FALSE;	/* no request at the moment or all hosts busy */
 
 	numberOfActiveJobs++;
+	update_metrics_queue ();
 
-	job->state = REQUEST_STATE_PROCESSING;
+	update_job_set_state (job, REQUEST_STATE_PROCESSING);
 
 	debug1 (DEBUG_UPDATE, "processing request (%s)", job->request->source);
-	if (job->callback == NULL) {
+	if (!update_job_is_wanted (job)) {
 		update_process_finished_job (job);
 	} else {
+		metrics_observe_since ("update.queue_wait", NULL, job->queueTime);
+		job->startTime = metrics_now ();
 		update_job_run (job);
 	}
 		
@@ -503,7 +642,8 @@ update_execute_request (gpointer owner,
 			gpointer user_data, 
 			updateFlags flags)
 {
-	updateJobPtr job;
+	updateJobPtr	job, primary;
+	gchar		*key;
 	
 	g_assert (request->options != NULL);
 	
@@ -511,12 +651,25 @@ update_execute_request (gpointer owner,
 	job->state = REQUEST_STATE_PENDING;	
 	jobs = g_slist_append (jobs, job);
 
-	if (flags & FEED_REQ_PRIORITY_HIGH) {
-		g_async_queue_push (pendingHighPrioJobs, (gpointer)job);
-	} else {
-		g_async_queue_push (pendingJobs, (gpointer)job);
+	/* Share the result of a job for the same resource in progress */
+	key = update_job_get_coalesce_key (request);
+	if (key) {
+		primary = g_hash_table_lookup (inflightJobs, key);
+		if (primary) {
+			debug1 (DEBUG_UPDATE, "sharing request in progress (%s)", request->source);
+			job->state = primary->state;
+			primary->followers = g_slist_append (primary->followers, job);
+			g_free (key);
+			return job;
+		}
+		job->coalesceKey = key;
+		g_hash_table_insert (inflightJobs, job->coalesceKey, job);
 	}
 
+	job->queueTime = metrics_now ();
+	update_queue_push (pendingJobs, request->source, (gpointer)job, flags & FEED_REQ_PRIORITY_HIGH);
+	update_metrics_queue ();
+
 	g_idle_add (update_dequeue_job, NULL);
 	return job;
 }
@@ -534,15 +687,38 @@ update_job_cancel_by_owner (gpointer owner)
 	}
 }
 
+guint
+update_get_job_count (void)
+{
+	return g_slist_length (jobs);
+}
+
 static gboolean
 update_process_result_idle_cb (gpointer user_data)
 {
-	updateJobPtr job = (updateJobPtr)user_data;
+	updateJobPtr	job = (updateJobPtr)user_data;
+	GSList		*iter;
+
+	debug_enter ("update_process_result_idle_cb");
 	
-	if (job->callback)
+	if (job->callback) {
+		job->result->shared = update_job_is_wanted_by (job->followers);
 		(job->callback) (job->result, job->user_data, job->flags);
+	}
+
+	/* every sharing job processes the same result on its own */
+	for (iter = job->followers; iter; iter = g_slist_next (iter)) {
+		updateJobPtr follower = (updateJobPtr)iter->data;
+
+		if (follower->callback) {
+			job->result->shared = update_job_is_wanted_by (g_slist_next (iter));
+			(follower->callback) (job->result, follower->user_data, follower->flags);
+		}
+	}
 
 	update_job_free (job);
+
+	debug_exit ("update_process_result_idle_cb");
 		
 	return FALSE;
 }
@@ -550,14 +726,49 @@ update_process_result_idle_cb (gpointer user_data)
 void
 update_process_finished_job (updateJobPtr job)
 {
-	job->state = REQUEST_STATE_DEQUEUE;
+	/* A "304 Not Modified" is useless if the cached body got lost,
+	   so the resource is fetched again without validators */
+	if (job->request->useCache && update_job_is_wanted (job) &&
+	    !http_cache_store (job->request, job->result)) {
+		debug1 (DEBUG_UPDATE, "refetching %s unconditionally", job->request->source);
+		update_state_set_etag (job->request->updateState, NULL);
+		update_state_set_lastmodified (job->request->updateState, 0);
+		update_result_free (job->result);
+		job->result = update_result_new ();
+		network_process_request (job);
+		return;
+	}
+
+	update_job_set_state (job, REQUEST_STATE_DEQUEUE);
+
+	/* later requests for the resource need a new job */
+	if (job->coalesceKey) {
+		g_hash_table_remove (inflightJobs, job->coalesceKey);
+		g_free (job->coalesceKey);
+		job->coalesceKey = NULL;
+	}
 	
 	g_assert(numberOfActiveJobs > 0);
 	numberOfActiveJobs--;
+	if (pendingJobs) {
+		update_queue_finished (pendingJobs, job);
+		update_metrics_queue ();
+	}
 	g_idle_add (update_dequeue_job, NULL);
 
+	if (job->startTime && job->request->source) {
+		gchar *host = metrics_host_label (job->request->source);
+
+		metrics_observe_since (job->result->cached?"update.cache_latency":"update.fetch_latency",
+		                       host, job->startTime);
+		/* streamed downloads have a size but no data */
+		if (job->result->size)
+			metrics_count ("update.bytes", host, job->result->size);
+		g_free (host);
+	}
+
 	/* Handling abandoned requests (e.g. after feed deletion) */
-	if (job->callback == NULL) {	
+	if (!update_job_is_wanted (job)) {	
 		debug1 (DEBUG_UPDATE, "freeing cancelled request (%s)", job->request->source);
 		update_job_free (job);
 		return;
@@ -566,6 +777,8 @@ update_process_finished_job (updateJobPtr job)
 	/* Finally execute the postfilter */
 	if (job->result->data && job->request->filtercmd) 
 		update_apply_filter (job);
+
+	job->result->elementData = job->request->elementData;
 		
 	g_idle_add (update_process_result_idle_cb, job);
 }
@@ -574,8 +787,9 @@ update_process_finished_job (updateJobPtr job)
 void
 update_init (void)
 {
-	pendingJobs = g_async_queue_new ();
-	pendingHighPrioJobs = g_async_queue_new ();
+	http_cache_init ();
+	pendingJobs = update_queue_new ();
+	inflightJobs = g_hash_table_new (g_str_hash, g_str_equal);
 }
 
 void
@@ -590,8 +804,10 @@ update_deinit (void)
 		iter = g_slist_next (iter);
 	}
 
-	g_async_queue_unref (pendingJobs);
-	g_async_queue_unref (pendingHighPrioJobs);
+	update_queue_free (pendingJobs);
+	pendingJobs = NULL;
+	g_hash_table_destroy (inflightJobs);
+	inflightJobs = NULL;
 	
 	g_slist_free (jobs);
 	jobs = NULL;
@@ -24,6 +24,7 @@
 
 #include <time.h>
 #include <glib.h>
+#include <libxml/tree.h>
 
 /* Update requests do represent feed updates, favicon and enclosure 
    downloads. A request can be started synchronously or asynchronously.
@@ -79,8 +80,20 @@ typedef struct updateState {
 	GTimeVal	lastPoll;		/**< time at which the feed was last updated */
 	GTimeVal	lastFaviconPoll;	/**< time at which the feeds favicon was last updated */
 	gchar		*cookies;		/**< cookies to be used */	
+	gchar		*etag;			/**< ETag as sent by the server (or NULL) */
 } *updateStatePtr;
 
+/**
+ * Function type called for each completed element of a download
+ * parsed while downloading (see updateRequest::elementFunc).
+ *
+ * @param node		the element
+ * @param user_data	the elementData of the request
+ *
+ * @returns TRUE if the element was consumed and can be freed
+ */
+typedef gboolean (*updateElementFunc) (xmlNodePtr node, gpointer user_data);
+
 /** structure describing a HTTP update request */
 typedef struct updateRequest {
 	gchar 		*source;	/**< Location of the source. If it starts with
@@ -93,6 +106,12 @@ typedef struct updateRequest {
 	updateOptionsPtr options;	/**< Update options for the request */
 	gchar		*filtercmd;	/**< Command will filter output of URL */
 	updateStatePtr	updateState;	/**< Update state of the requested object (etags, last modified...) */
+	gboolean	useCache;	/**< TRUE to use the HTTP response cache (see http_cache.h) */
+	gboolean	parseXml;	/**< TRUE if HTTP downloads should be parsed into an XML document while downloading */
+	updateElementFunc elementFunc;	/**< called for each completed element when parsing while downloading (or NULL).
+					     Jobs sharing a download all get the elementData of the first request. */
+	gpointer	elementData;	/**< user data for elementFunc, passed on with the result */
+	GDestroyNotify	elementDataFree;	/**< free function for elementData (or NULL) */
 } *updateRequestPtr;
 
 /** structure to store results of the processing of an update request */
@@ -106,8 +125,19 @@ typedef struct updateResult {
 	size_t		size;		/**< Size of downloaded data */
 	gchar		*contentType;	/**< Content type of received data */
 	gchar		*filterErrors;	/**< Error messages from filter execution */
+	xmlDocPtr	doc;		/**< XML document parsed while downloading (only if requested). If
+					     set, data is NULL and size is the number of downloaded bytes. */
+	GString		*docErrors;	/**< XML parser errors of doc or of a failed parse whose data was
+					     not kept (NULL if there were no errors) */
+	gpointer	elementData;	/**< the elementData of the first request (not owned). Elements consumed
+					     by the request elementFunc are missing in doc. */
 	
 	updateStatePtr	updateState;	/**< New update state of the requested object (etags, last modified...) */
+	glong		expires;	/**< Time until which the result may be used without revalidation
+					     (0 if unknown, -1 if the result must not be stored) */
+	gboolean	cached;		/**< TRUE if the result was taken from the HTTP cache without network access */
+	gboolean	shared;		/**< TRUE while the result is processed by a job that is followed by
+					     other jobs processing the same result (which must not consume elementData) */
 } *updateResultPtr;
 
 /** structure describing an HTTP update job */
@@ -119,6 +149,10 @@ typedef struct updateJob {
 	gpointer		user_data;	/**< result processing user data */
 	updateFlags		flags;		/**< request and result processing flags */
 	gint			state;		/**< State of the job (enum request_state) */
+	GSList			*followers;	/**< jobs for the same resource sharing the result of this job */
+	gchar			*coalesceKey;	/**< key of this job in the in-flight job table (or NULL) */
+	gint64			queueTime;	/**< monotonic time the job was queued (see metrics_now()) */
+	gint64			startTime;	/**< monotonic time the job was started (see metrics_now()) */
 } *updateJobPtr;
 
 /**
@@ -134,6 +168,9 @@ void update_state_set_lastmodified (updateStatePtr state, glong lastmodified);
 const gchar * update_state_get_cookies (updateStatePtr state);
 void update_state_set_cookies (updateStatePtr state, const gchar *cookies);
 
+const gchar * update_state_get_etag (updateStatePtr state);
+void update_state_set_etag (updateStatePtr state, const gchar *etag);
+
 /**
  * Copies the given update state.
  *
@@ -256,6 +293,14 @@ void update_process_finished_job (updateJobPtr job);
  */
 void update_job_cancel_by_owner (gpointer owner);
 
+/**
+ * Returns the number of update jobs that are queued, running
+ * or waiting for their result to be processed.
+ *
+ * @returns number of unfinished jobs
+ */
+guint update_get_job_count (void);
+
 /**
  * Method to query the update state of currently processed jobs.
  *
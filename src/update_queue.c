@@ -0,0 +1,190 @@
+/**
+ * @file update_queue.c  host grouping queue for pending update jobs
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include "update_queue.h"
+
+#include <string.h>
+
+#include "common.h"
+
+typedef struct updateQueueEntry {
+	gpointer	data;
+	gchar		*host;		/**< host name or NULL for local URLs */
+} *updateQueueEntryPtr;
+
+typedef struct updateQueueList {
+	GQueue		*entries;	/**< pending entries, same host entries are adjacent */
+	GHashTable	*lastByHost;	/**< host -> GList link of the last pending entry of the host */
+} updateQueueList;
+
+struct updateQueue {
+	updateQueueList	lists[2];	/**< high priority and normal priority entries */
+	GHashTable	*activeByHost;	/**< host -> number of active entries */
+	GHashTable	*active;	/**< data -> active entry */
+};
+
+updateQueuePtr
+update_queue_new (void)
+{
+	updateQueuePtr	queue = g_new0 (struct updateQueue, 1);
+	guint		i;
+
+	for (i = 0; i < 2; i++) {
+		queue->lists[i].entries = g_queue_new ();
+		queue->lists[i].lastByHost = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+	queue->activeByHost = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	queue->active = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	return queue;
+}
+
+static void
+update_queue_entry_free (updateQueueEntryPtr entry)
+{
+	g_free (entry->host);
+	g_free (entry);
+}
+
+static void
+update_queue_active_free (gpointer data, gpointer entry, gpointer user_data)
+{
+	update_queue_entry_free ((updateQueueEntryPtr)entry);
+}
+
+void
+update_queue_free (updateQueuePtr queue)
+{
+	guint	i;
+
+	for (i = 0; i < 2; i++) {
+		g_hash_table_destroy (queue->lists[i].lastByHost);
+		g_queue_foreach (queue->lists[i].entries, (GFunc)update_queue_entry_free, NULL);
+		g_queue_free (queue->lists[i].entries);
+	}
+	g_hash_table_foreach (queue->active, (GHFunc)update_queue_active_free, NULL);
+	g_hash_table_destroy (queue->active);
+	g_hash_table_destroy (queue->activeByHost);
+	g_free (queue);
+}
+
+void
+update_queue_push (updateQueuePtr queue, const gchar *url, gpointer data, gboolean highPrio)
+{
+	updateQueueList		*list = &queue->lists[highPrio ? 0 : 1];
+	updateQueueEntryPtr	entry;
+	GList			*last = NULL;
+
+	entry = g_new0 (struct updateQueueEntry, 1);
+	entry->data = data;
+	entry->host = common_get_url_host (url);
+
+	if (entry->host)
+		last = g_hash_table_lookup (list->lastByHost, entry->host);
+
+	if (last) {
+		g_queue_insert_after (list->entries, last, entry);
+		last = last->next;
+	} else {
+		g_queue_push_tail (list->entries, entry);
+		last = list->entries->tail;
+	}
+
+	/* The key is always the host of the entry the link points to */
+	if (entry->host)
+		g_hash_table_replace (list->lastByHost, entry->host, last);
+}
+
+static void
+update_queue_remove_link (updateQueueList *list, GList *link)
+{
+	updateQueueEntryPtr entry = (updateQueueEntryPtr)link->data;
+
+	if (entry->host && link == g_hash_table_lookup (list->lastByHost, entry->host)) {
+		updateQueueEntryPtr prev = link->prev ? (updateQueueEntryPtr)link->prev->data : NULL;
+
+		if (prev && prev->host && g_str_equal (prev->host, entry->host))
+			g_hash_table_replace (list->lastByHost, prev->host, link->prev);
+		else
+			g_hash_table_remove (list->lastByHost, entry->host);
+	}
+
+	g_queue_delete_link (list->entries, link);
+}
+
+gpointer
+update_queue_pop (updateQueuePtr queue, guint maxPerHost)
+{
+	guint	i;
+
+	for (i = 0; i < 2; i++) {
+		updateQueueList	*list = &queue->lists[i];
+		GList		*iter = list->entries->head;
+
+		while (iter) {
+			updateQueueEntryPtr	entry = (updateQueueEntryPtr)iter->data;
+			guint			active = 0;
+
+			if (entry->host && maxPerHost)
+				active = GPOINTER_TO_UINT (g_hash_table_lookup (queue->activeByHost, entry->host));
+
+			if (active < maxPerHost || !maxPerHost || !entry->host) {
+				update_queue_remove_link (list, iter);
+				if (entry->host)
+					g_hash_table_insert (queue->activeByHost, g_strdup (entry->host),
+					                     GUINT_TO_POINTER (GPOINTER_TO_UINT (g_hash_table_lookup (queue->activeByHost, entry->host)) + 1));
+				g_hash_table_insert (queue->active, entry->data, entry);
+				return entry->data;
+			}
+
+			/* host is busy, skip all of its entries */
+			iter = ((GList *)g_hash_table_lookup (list->lastByHost, entry->host))->next;
+		}
+	}
+
+	return NULL;
+}
+
+void
+update_queue_finished (updateQueuePtr queue, gpointer data)
+{
+	updateQueueEntryPtr	entry;
+
+	entry = g_hash_table_lookup (queue->active, data);
+	if (!entry)
+		return;
+
+	g_hash_table_remove (queue->active, data);
+	if (entry->host) {
+		guint active = GPOINTER_TO_UINT (g_hash_table_lookup (queue->activeByHost, entry->host));
+
+		if (active > 1)
+			g_hash_table_insert (queue->activeByHost, g_strdup (entry->host), GUINT_TO_POINTER (active - 1));
+		else
+			g_hash_table_remove (queue->activeByHost, entry->host);
+	}
+	update_queue_entry_free (entry);
+}
+
+guint
+update_queue_length (updateQueuePtr queue)
+{
+	return g_queue_get_length (queue->lists[0].entries) + g_queue_get_length (queue->lists[1].entries);
+}
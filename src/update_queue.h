@@ -0,0 +1,91 @@
+/**
+ * @file update_queue.h  host grouping queue for pending update jobs
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _UPDATE_QUEUE_H
+#define _UPDATE_QUEUE_H
+
+#include <glib.h>
+
+/* Pending update jobs are kept in two FIFO queues (high priority
+   and normal priority). Jobs for the same host are kept next to
+   each other so that all requests to a host are sent in a row
+   and can reuse the connections the HTTP session keeps alive.
+   The number of active jobs per host is limited to the number
+   of connections the HTTP session opens per host so that jobs
+   for other hosts do not wait for a busy host. */
+
+typedef struct updateQueue *updateQueuePtr;
+
+/**
+ * Creates a new empty update queue.
+ *
+ * @returns new queue
+ */
+updateQueuePtr update_queue_new (void);
+
+/**
+ * Frees the given queue. The queued data is not free'd.
+ *
+ * @param queue		the queue
+ */
+void update_queue_free (updateQueuePtr queue);
+
+/**
+ * Adds data to the queue. The data is queued after the last
+ * pending data for the same host or at the end of the queue.
+ *
+ * @param queue		the queue
+ * @param url		the URL the data is for (local URLs are not grouped)
+ * @param data		the data to add
+ * @param highPrio	TRUE to add to the high priority queue
+ */
+void update_queue_push (updateQueuePtr queue, const gchar *url, gpointer data, gboolean highPrio);
+
+/**
+ * Removes the first data from the queue whose host has less
+ * than the given number of active data. High priority data
+ * is returned first. The returned data stays active until
+ * update_queue_finished() is called.
+ *
+ * @param queue		the queue
+ * @param maxPerHost	maximum number of active data per host (0 for no limit)
+ *
+ * @returns data or NULL if no data can be processed now
+ */
+gpointer update_queue_pop (updateQueuePtr queue, guint maxPerHost);
+
+/**
+ * Marks data returned by update_queue_pop() as finished.
+ *
+ * @param queue		the queue
+ * @param data		the finished data
+ */
+void update_queue_finished (updateQueuePtr queue, gpointer data);
+
+/**
+ * Returns the number of pending data in the queue.
+ *
+ * @param queue		the queue
+ *
+ * @returns number of pending data
+ */
+guint update_queue_length (updateQueuePtr queue);
+
+#endif
@@ -43,9 +43,7 @@ vfolder_new (nodePtr node)
 	debug_enter ("vfolder_new");
 
 	vfolder = g_new0 (struct vfolder, 1);
-	vfolder->itemset = g_new0 (struct itemSet, 1);
-	vfolder->itemset->nodeId = node->id;
-	vfolder->itemset->ids = NULL;
+	vfolder->itemset = itemset_new (node->id);
 	vfolder->itemset->anyMatch = TRUE;
 	vfolder->node = node;
 	vfolders = g_slist_append (vfolders, vfolder);
@@ -144,22 +142,35 @@ vfolder_foreach_data (vfolderActionDataFunc func, itemPtr item)
 void
 vfolder_remove_item (vfolderPtr vfolder, itemPtr item)
 {
-	if (!vfolder->itemset->ids)
-		return;
-		
-	vfolder->itemset->ids = g_list_remove (vfolder->itemset->ids, GUINT_TO_POINTER (item->id));
-	vfolder->node->needsUpdate = TRUE;
+	if (itemset_remove_id (vfolder->itemset, item->id))
+		vfolder->node->needsUpdate = TRUE;
+}
+
+void
+vfolder_remove_items (itemSetPtr itemSet)
+{
+	GSList	*iter = vfolders;
+
+	while (iter) {
+		vfolderPtr vfolder = (vfolderPtr)iter->data;
+		guint length = itemset_get_length (vfolder->itemset);
+
+		itemset_difference (vfolder->itemset, itemSet);
+		if (length != itemset_get_length (vfolder->itemset))
+			vfolder->node->needsUpdate = TRUE;
+		iter = g_slist_next (iter);
+	}
 }
 
 void
 vfolder_check_item (vfolderPtr vfolder, itemPtr item)
 {
-	gboolean found = (NULL != g_list_find (vfolder->itemset->ids, GUINT_TO_POINTER (item->id)));
+	gboolean found = itemset_contains (vfolder->itemset, item->id);
 	
 	if (itemset_check_item (vfolder->itemset, item)) {
 		if (!found) {
 			debug3 (DEBUG_VFOLDER, "Item %lu added to search folder %s (%s)", item->id, vfolder->node->title, item->title);
-			vfolder->itemset->ids = g_list_append (vfolder->itemset->ids, GUINT_TO_POINTER (item->id));
+			itemset_add_id (vfolder->itemset, item->id);
 			vfolder->node->needsUpdate = TRUE;
 		}
 	} else {
@@ -178,8 +189,8 @@ vfolder_get_all_with_item_id (gulong id)
 	
 	while (iter) {
 		vfolderPtr vfolder = (vfolderPtr)iter->data;
-		if (g_list_find (vfolder->itemset->ids, GUINT_TO_POINTER (id)))
-			result = g_slist_append (result, vfolder);
+		if (itemset_contains (vfolder->itemset, id))
+			result = g_slist_prepend (result, vfolder);
 		iter = g_slist_next (iter);
 	}
 
@@ -274,7 +285,7 @@ vfolder_update_counters (nodePtr node)
 	   here and don't bother with GUI updates... */
 	vfolder->node->needsUpdate = TRUE;
 	vfolder->node->unreadCount = 0;
-	vfolder->node->itemCount = g_list_length (vfolder->itemset->ids);
+	vfolder->node->itemCount = itemset_get_length (vfolder->itemset);
 }
 
 static void
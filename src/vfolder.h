@@ -76,6 +76,13 @@ void vfolder_foreach_data (vfolderActionDataFunc func, itemPtr item);
  */
 void vfolder_remove_item (vfolderPtr vfolder, itemPtr item);
 
+/**
+ * Removes all items of the given item set from all search folders.
+ *
+ * @param itemSet	the item set with the items to remove
+ */
+void vfolder_remove_items (itemSetPtr itemSet);
+
 /**
  * Method to check if an item matches any search folder
  * or does not match some of the search folders anymore.
@@ -0,0 +1,432 @@
+/**
+ * @file watchdog.c  main loop stall watchdog
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include "watchdog.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_EXECINFO_H
+#include <execinfo.h>
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#include "common.h"
+#include "debug.h"
+#include "metrics.h"
+
+#define WATCHDOG_TICK		20	/* heartbeat and sampling interval (in ms) */
+#define WATCHDOG_STALLS		16	/* number of worst stalls kept */
+#define WATCHDOG_PHASES		16	/* phase nesting depth kept */
+#define WATCHDOG_STACKS		4	/* distinct phase stacks kept per stall */
+#define WATCHDOG_FRAMES		32	/* native stack frames per sample */
+
+typedef struct watchdogStall {
+	gint64		duration;			/**< in us */
+	time_t		time;				/**< end of the stall */
+	gchar		*stacks[WATCHDOG_STACKS];	/**< sampled phase stacks */
+	guint		samples[WATCHDOG_STACKS];	/**< number of samples per phase stack */
+	gchar		*backtrace;			/**< native stack of the first sample (or NULL) */
+} *watchdogStallPtr;
+
+G_LOCK_DEFINE_STATIC (watchdog);
+
+static volatile gboolean	running = FALSE;
+static GThread		*thread = NULL;
+static GThread		*mainThread = NULL;
+static guint		heartbeat = 0;
+static gint64		lastBeat = 0;
+
+/* phase stack of the main thread, protected by the lock */
+static const gchar	*phases[WATCHDOG_PHASES];
+static guint		phaseDepth = 0;
+
+/* the stall in progress, sampled by the watchdog thread, protected by the lock */
+static watchdogStallPtr	current = NULL;
+
+/* the worst stalls (unsorted), only used in the main thread */
+static watchdogStallPtr	stalls[WATCHDOG_STALLS];
+static guint		stallCount = 0;
+static gint64		stallTime = 0;
+
+#ifdef HAVE_EXECINFO_H
+static pthread_t		mainPthread;
+static void			*frames[WATCHDOG_FRAMES];
+static volatile sig_atomic_t	frameCount = -1;
+
+static void
+watchdog_sample_handler (int sig)
+{
+	frameCount = backtrace (frames, WATCHDOG_FRAMES);
+}
+#endif
+
+static void
+watchdog_stall_free (watchdogStallPtr stall)
+{
+	guint	i;
+
+	for (i = 0; i < WATCHDOG_STACKS; i++)
+		g_free (stall->stacks[i]);
+	g_free (stall->backtrace);
+	g_free (stall);
+}
+
+void
+watchdog_phase_enter (const gchar *name)
+{
+	guint	i;
+
+	if (!running || g_thread_self () != mainThread)
+		return;
+
+	G_LOCK (watchdog);
+	/* Entering a phase again means it was left without
+	   watchdog_phase_leave() (e.g. an early return) */
+	for (i = 0; i < MIN (phaseDepth, WATCHDOG_PHASES); i++) {
+		if (g_str_equal (phases[i], name)) {
+			phaseDepth = i;
+			break;
+		}
+	}
+	if (phaseDepth < WATCHDOG_PHASES)
+		phases[phaseDepth] = name;
+	phaseDepth++;
+	G_UNLOCK (watchdog);
+}
+
+void
+watchdog_phase_leave (const gchar *name)
+{
+	guint	i;
+
+	if (!running || g_thread_self () != mainThread)
+		return;
+
+	G_LOCK (watchdog);
+	for (i = MIN (phaseDepth, WATCHDOG_PHASES); i > 0; i--) {
+		if (g_str_equal (phases[i - 1], name)) {
+			phaseDepth = i - 1;
+			break;
+		}
+	}
+	if (0 == i && phaseDepth > WATCHDOG_PHASES)
+		phaseDepth--;	/* a phase nested too deep to be kept */
+	G_UNLOCK (watchdog);
+}
+
+/* Must be called with the lock held */
+static void
+watchdog_sample_phases (watchdogStallPtr stall)
+{
+	GString	*stack = g_string_new (NULL);
+	guint	i;
+
+	for (i = 0; i < MIN (phaseDepth, WATCHDOG_PHASES); i++) {
+		if (i > 0)
+			g_string_append (stack, " > ");
+		g_string_append (stack, phases[i]);
+	}
+	if (0 == stack->len)
+		g_string_append (stack, "(no phase)");
+
+	for (i = 0; i < WATCHDOG_STACKS; i++) {
+		if (!stall->stacks[i]) {
+			stall->stacks[i] = g_string_free (stack, FALSE);
+			stall->samples[i] = 1;
+			return;
+		}
+		if (g_str_equal (stall->stacks[i], stack->str)) {
+			stall->samples[i]++;
+			break;
+		}
+	}
+	g_string_free (stack, TRUE);
+}
+
+static gchar *
+watchdog_sample_backtrace (void)
+{
+#ifdef HAVE_EXECINFO_H
+	GString	*result;
+	gchar	**symbols;
+	gint	i;
+
+	frameCount = -1;
+	if (0 != pthread_kill (mainPthread, SIGUSR2))
+		return NULL;
+	for (i = 0; i < 10 && frameCount < 0; i++)
+		g_usleep (1000);
+	if (frameCount < 0)
+		return NULL;
+
+	symbols = backtrace_symbols (frames, frameCount);
+	if (!symbols)
+		return NULL;
+
+	/* skip the signal handler and the signal trampoline */
+	result = g_string_new (NULL);
+	for (i = 2; i < frameCount; i++)
+		g_string_append_printf (result, "\t\t%s\n", symbols[i]);
+	free (symbols);
+
+	return g_string_free (result, FALSE);
+#else
+	return NULL;
+#endif
+}
+
+static gpointer
+watchdog_thread (gpointer data)
+{
+	while (running) {
+		gboolean	sampleNative = FALSE;
+
+		g_usleep (WATCHDOG_TICK * 1000);
+
+		G_LOCK (watchdog);
+		if (metrics_now () - lastBeat > (WATCHDOG_TICK + WATCHDOG_THRESHOLD) * 1000) {
+			if (!current) {
+				current = g_new0 (struct watchdogStall, 1);
+				sampleNative = TRUE;
+			}
+			watchdog_sample_phases (current);
+		}
+		G_UNLOCK (watchdog);
+
+		if (sampleNative) {
+			gchar *backtrace = watchdog_sample_backtrace ();
+
+			/* only the heartbeat ends the stall in the meantime */
+			G_LOCK (watchdog);
+			if (current && !current->backtrace)
+				current->backtrace = backtrace;
+			else
+				g_free (backtrace);
+			G_UNLOCK (watchdog);
+		}
+	}
+
+	return NULL;
+}
+
+static void
+watchdog_add_stall (watchdogStallPtr stall)
+{
+	guint	i, slot = 0;
+
+	stallCount++;
+	stallTime += stall->duration;
+	metrics_observe ("mainloop.stall", NULL, stall->duration);
+	debug2 (DEBUG_PERF, "main loop stalled for %ldms (%s)", (long)(stall->duration / 1000),
+	        stall->stacks[0]?stall->stacks[0]:"not sampled");
+
+	/* replace the shortest stall if all slots are used */
+	for (i = 0; i < WATCHDOG_STALLS; i++) {
+		if (!stalls[i]) {
+			slot = i;
+			break;
+		}
+		if (stalls[i]->duration < stalls[slot]->duration)
+			slot = i;
+	}
+
+	if (!stalls[slot]) {
+		stalls[slot] = stall;
+	} else if (stalls[slot]->duration < stall->duration) {
+		watchdog_stall_free (stalls[slot]);
+		stalls[slot] = stall;
+	} else {
+		watchdog_stall_free (stall);
+	}
+}
+
+static gboolean
+watchdog_heartbeat (gpointer user_data)
+{
+	watchdogStallPtr	stall;
+	gint64			now = metrics_now ();
+	gint64			delay;
+
+	G_LOCK (watchdog);
+	delay = now - lastBeat - WATCHDOG_TICK * 1000;
+	lastBeat = now;
+	stall = current;
+	current = NULL;
+	G_UNLOCK (watchdog);
+
+	if (delay > WATCHDOG_THRESHOLD * 1000) {
+		if (!stall)
+			stall = g_new0 (struct watchdogStall, 1);
+		stall->duration = delay;
+		stall->time = time (NULL);
+		watchdog_add_stall (stall);
+	} else if (stall) {
+		watchdog_stall_free (stall);
+	}
+
+	return TRUE;
+}
+
+void
+watchdog_start (void)
+{
+	GError	*error = NULL;
+
+	if (running)
+		return;
+
+	mainThread = g_thread_self ();
+#ifdef HAVE_EXECINFO_H
+	{
+		struct sigaction	action;
+		void			*frame;
+
+		mainPthread = pthread_self ();
+
+		/* the first backtrace() call loads libgcc which
+		   must not happen in the signal handler */
+		backtrace (&frame, 1);
+
+		memset (&action, 0, sizeof (action));
+		action.sa_handler = watchdog_sample_handler;
+		action.sa_flags = SA_RESTART;
+		sigemptyset (&action.sa_mask);
+		sigaction (SIGUSR2, &action, NULL);
+	}
+#endif
+
+	lastBeat = metrics_now ();
+	running = TRUE;
+	heartbeat = g_timeout_add_full (G_PRIORITY_HIGH, WATCHDOG_TICK, watchdog_heartbeat, NULL, NULL);
+
+	thread = g_thread_create (watchdog_thread, NULL, TRUE, &error);
+	if (!thread) {
+		g_warning ("Could not start the watchdog thread (%s)!", error->message);
+		g_error_free (error);
+		running = FALSE;
+		g_source_remove (heartbeat);
+		heartbeat = 0;
+		return;
+	}
+
+	debug1 (DEBUG_PERF, "watchdog reports main loop stalls longer than %dms", WATCHDOG_THRESHOLD);
+}
+
+static gint
+watchdog_compare_stalls (gconstpointer a, gconstpointer b)
+{
+	gint64 da = (*(const watchdogStallPtr *)a)->duration;
+	gint64 db = (*(const watchdogStallPtr *)b)->duration;
+
+	return (da < db)?1:((da > db)?-1:0);
+}
+
+gchar *
+watchdog_get_report (void)
+{
+	watchdogStallPtr	sorted[WATCHDOG_STALLS];
+	GString			*report;
+	guint			i, j, count = 0;
+
+	for (i = 0; i < WATCHDOG_STALLS; i++) {
+		if (stalls[i])
+			sorted[count++] = stalls[i];
+	}
+	qsort (sorted, count, sizeof (watchdogStallPtr), watchdog_compare_stalls);
+
+	report = g_string_new (NULL);
+	g_string_append_printf (report, "%u main loop stalls longer than %dms, %ldms in total\n",
+	                        stallCount, WATCHDOG_THRESHOLD, (long)(stallTime / 1000));
+
+	for (i = 0; i < count; i++) {
+		gchar	timebuf[16];
+
+		strftime (timebuf, sizeof (timebuf), "%H:%M:%S", localtime (&sorted[i]->time));
+		g_string_append_printf (report, "\n%6ldms at %s\n", (long)(sorted[i]->duration / 1000), timebuf);
+
+		if (!sorted[i]->stacks[0])
+			g_string_append (report, "\tnot sampled\n");
+		for (j = 0; j < WATCHDOG_STACKS && sorted[i]->stacks[j]; j++)
+			g_string_append_printf (report, "\t%3u samples  %s\n", sorted[i]->samples[j], sorted[i]->stacks[j]);
+
+		if (sorted[i]->backtrace)
+			g_string_append_printf (report, "\tmain thread stack:\n%s", sorted[i]->backtrace);
+	}
+
+	return g_string_free (report, FALSE);
+}
+
+static void
+watchdog_write_report (void)
+{
+	gchar	*filename, *report;
+
+	filename = common_create_cache_filename (NULL, "stalls", "txt");
+	report = watchdog_get_report ();
+	if (!g_file_set_contents (filename, report, -1, NULL))
+		g_warning ("Could not write main loop stalls to %s", filename);
+	else
+		debug1 (DEBUG_PERF, "main loop stalls written to %s", filename);
+	g_free (report);
+	g_free (filename);
+}
+
+void
+watchdog_dump (void)
+{
+	if (running)
+		watchdog_write_report ();
+}
+
+void
+watchdog_stop (void)
+{
+	guint	i;
+
+	if (!running)
+		return;
+
+	running = FALSE;
+	g_thread_join (thread);
+	thread = NULL;
+	g_source_remove (heartbeat);
+	heartbeat = 0;
+
+	watchdog_write_report ();
+
+	for (i = 0; i < WATCHDOG_STALLS; i++) {
+		if (stalls[i])
+			watchdog_stall_free (stalls[i]);
+		stalls[i] = NULL;
+	}
+	if (current)
+		watchdog_stall_free (current);
+	current = NULL;
+	stallCount = 0;
+	stallTime = 0;
+	phaseDepth = 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file watchdog.h  main loop stall watchdog
+ *
+ * Copyright (C) 2010 Lars Lindner <lars.lindner@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#ifndef _WATCHDOG_H
+#define _WATCHDOG_H
+
+#include <glib.h>
+
+/* The watchdog (enabled with --debug-performance) detects when the
+   main loop does not iterate for longer than WATCHDOG_THRESHOLD ms.
+   A heartbeat timeout runs in the main loop, a watchdog thread checks
+   it and samples the phase stack of the main thread while the main
+   loop is blocked. Phases are the names of the running debug
+   measurements and debug_enter()/debug_exit() pairs. Where supported
+   the native stack of the main thread is sampled once per stall to
+   identify idle and timeout callbacks without a phase (the addresses
+   can be resolved with "addr2line -f -e liferea").
+
+   The worst stalls are kept with their samples and written to
+   stalls.txt in the cache directory on exit and on SIGUSR1. */
+
+#define WATCHDOG_THRESHOLD	100
+
+/**
+ * Starts the heartbeat and the watchdog thread. Must be
+ * called from the main thread.
+ */
+void watchdog_start (void);
+
+/**
+ * Marks the start of a named phase in the main thread.
+ * Does nothing in other threads or if the watchdog is
+ * not running.
+ *
+ * @param name		phase name (must be a static string)
+ */
+void watchdog_phase_enter (const gchar *name);
+
+/**
+ * Marks the end of a named phase. Phases entered after it
+ * and not left are ended too.
+ *
+ * @param name		phase name
+ */
+void watchdog_phase_leave (const gchar *name);
+
+/**
+ * Describes the worst main loop stalls.
+ *
+ * @returns new report text (to be free'd using g_free)
+ */
+gchar * watchdog_get_report (void);
+
+/**
+ * Writes the report to stalls.txt in the cache directory.
+ * Does nothing if the watchdog is not running.
+ */
+void watchdog_dump (void);
+
+/**
+ * Stops the watchdog, writes the report and frees all stalls.
+ */
+void watchdog_stop (void);
+
+#endif
@@ -28,6 +28,7 @@
 #include <libxml/xmlerror.h>
 #include <libxml/uri.h>
 #include <libxml/parser.h>
+#include <libxml/SAX2.h>
 #include <libxml/entities.h>
 #include <libxml/HTMLparser.h>
 #include <libxml/xpath.h>
@@ -549,15 +550,157 @@ xml_parse (gchar *data, size_t length, errorCtxtPtr errCtx)
 	return doc;
 }
 
+struct xmlStreamParser {
+	xmlParserCtxtPtr	ctxt;		/**< libxml2 push parser (created with the first chunk) */
+	errorCtxtPtr		errors;		/**< parser error messages */
+	gboolean		failed;		/**< TRUE if the document is not well-formed */
+	xmlStreamElementFunc	elementFunc;	/**< completed element callback (or NULL) */
+	gpointer		elementData;	/**< user data for elementFunc */
+};
+
+static void
+xml_stream_parser_end_element (void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI)
+{
+	xmlParserCtxtPtr	ctxt = (xmlParserCtxtPtr)ctx;
+	xmlStreamParserPtr	parser = (xmlStreamParserPtr)ctxt->_private;
+	xmlNodePtr		node = ctxt->node;
+	xmlNodePtr		blank = NULL, prev;
+
+	xmlSAX2EndElementNs (ctx, localname, prefix, URI);
+
+	/* the root element is never passed on */
+	if (!parser->elementFunc || !node || !node->parent || (node->parent->type != XML_ELEMENT_NODE))
+		return;
+
+	if (!(*parser->elementFunc) (node, parser->elementData))
+		return;
+
+	/* libxml2 appends following text to a text node that is the last
+	   child, assuming it is the node it created last. So the element
+	   can only be removed (together with its indentation) if that does
+	   not leave a text node at the end, otherwise its content is freed. */
+	prev = node->prev;
+	if (prev && xmlIsBlankNode (prev)) {
+		blank = prev;
+		prev = prev->prev;
+	}
+
+	if (prev && (prev->type == XML_TEXT_NODE)) {
+		xmlFreeNodeList (node->children);
+		node->children = node->last = NULL;
+		return;
+	}
+
+	if (blank) {
+		xmlUnlinkNode (blank);
+		xmlFreeNode (blank);
+	}
+	xmlUnlinkNode (node);
+	xmlFreeNode (node);
+}
+
+xmlStreamParserPtr
+xml_stream_parser_new (void)
+{
+	xmlStreamParserPtr parser = g_new0 (struct xmlStreamParser, 1);
+
+	parser->errors = g_new0 (struct errorCtxt, 1);
+	parser->errors->msg = g_string_new (NULL);
+
+	return parser;
+}
+
+gboolean
+xml_stream_parser_push (xmlStreamParserPtr parser, const gchar *data, gsize length)
+{
+	if (parser->failed)
+		return FALSE;
+
+	/* The error handler is global, so it is set for each chunk
+	   only, like xml_parse() does for the whole document. */
+	xmlSetGenericErrorFunc (parser->errors, (xmlGenericErrorFunc)xml_buffer_parse_error);
+
+	if (!parser->ctxt) {
+		/* the first chunk is used to detect the encoding */
+		parser->ctxt = xmlCreatePushParserCtxt (NULL, NULL, data, length, NULL);
+		if (parser->ctxt) {
+			parser->ctxt->_private = parser;
+			parser->ctxt->sax->getEntity = xml_process_entities;
+			parser->ctxt->sax->endElementNs = xml_stream_parser_end_element;
+			xmlCtxtUseOptions (parser->ctxt, XML_PARSE_COMPACT);
+		}
+	} else {
+		xmlParseChunk (parser->ctxt, data, length, 0);
+	}
+
+	xmlSetGenericErrorFunc (NULL, NULL);
+
+	if (!parser->ctxt || !parser->ctxt->wellFormed)
+		parser->failed = TRUE;
+
+	return !parser->failed;
+}
+
+void
+xml_stream_parser_set_element_func (xmlStreamParserPtr parser, xmlStreamElementFunc func, gpointer user_data)
+{
+	parser->elementFunc = func;
+	parser->elementData = user_data;
+}
+
+xmlDocPtr
+xml_stream_parser_finish (xmlStreamParserPtr parser, GString **errors)
+{
+	xmlDocPtr	doc = NULL;
+
+	if (parser->ctxt) {
+		if (!parser->failed) {
+			xmlSetGenericErrorFunc (parser->errors, (xmlGenericErrorFunc)xml_buffer_parse_error);
+			xmlParseChunk (parser->ctxt, NULL, 0, 1);
+			xmlSetGenericErrorFunc (NULL, NULL);
+		}
+
+		doc = parser->ctxt->myDoc;
+		parser->ctxt->myDoc = NULL;
+		if (doc && !parser->ctxt->wellFormed) {
+			xmlFreeDoc (doc);
+			doc = NULL;
+		}
+		xmlFreeParserCtxt (parser->ctxt);
+	}
+
+	if (errors && parser->errors->errorCount > 0)
+		*errors = parser->errors->msg;
+	else {
+		if (errors)
+			*errors = NULL;
+		g_string_free (parser->errors->msg, TRUE);
+	}
+	g_free (parser->errors);
+	g_free (parser);
+
+	return doc;
+}
+
 xmlDocPtr
 xml_parse_feed (feedParserCtxtPtr fpc)
 {
 	errorCtxtPtr	errors;
 		
-	g_assert (NULL != fpc->data);
 	g_assert (NULL != fpc->feed);
 	
 	fpc->feed->valid = FALSE;
+
+	/* parsed while downloading? */
+	if (fpc->doc || !fpc->data) {
+		if (fpc->docErrors) {
+			g_string_append (fpc->feed->parseErrors, fpc->docErrors->str);
+			if (!fpc->doc)
+				g_string_prepend (fpc->feed->parseErrors, _("XML Parser: Could not parse document:\n"));
+		}
+		fpc->feed->valid = (fpc->doc && !fpc->docErrors);
+		return fpc->doc;
+	}
 	
 	/* we don't like no data */
 	if (0 == fpc->dataLength) {
@@ -170,6 +170,62 @@ typedef struct errorCtxt {
  */
 xmlDocPtr xml_parse (gchar *data, size_t length, errorCtxtPtr errors);
 
+/** incremental XML parser state */
+typedef struct xmlStreamParser *xmlStreamParserPtr;
+
+/**
+ * Function type called for each completed element below the
+ * root element of a document parsed while downloading.
+ *
+ * @param node		the element (still part of the document)
+ * @param user_data	user data
+ *
+ * @returns TRUE if the element is not needed anymore, it is
+ *          then removed from the document and freed
+ */
+typedef gboolean (*xmlStreamElementFunc) (xmlNodePtr node, gpointer user_data);
+
+/**
+ * Creates an incremental XML parser to build a XML DOM
+ * object from data arriving in chunks (e.g. while downloading).
+ *
+ * @returns new parser (to be free'd using xml_stream_parser_finish())
+ */
+xmlStreamParserPtr xml_stream_parser_new (void);
+
+/**
+ * Passes the next chunk of data to the parser.
+ *
+ * @param parser	the parser
+ * @param data		the data chunk
+ * @param length	length of the data chunk
+ *
+ * @returns FALSE if the document is not well-formed (further chunks are ignored)
+ */
+gboolean xml_stream_parser_push (xmlStreamParserPtr parser, const gchar *data, gsize length);
+
+/**
+ * Sets a function to be called for each completed element. This
+ * allows processing large documents piece by piece without
+ * keeping the whole document in memory.
+ *
+ * @param parser	the parser
+ * @param func		the function (or NULL)
+ * @param user_data	user data for func
+ */
+void xml_stream_parser_set_element_func (xmlStreamParserPtr parser, xmlStreamElementFunc func, gpointer user_data);
+
+/**
+ * Finishes parsing and frees the parser.
+ *
+ * @param parser	the parser
+ * @param errors	returns the parser error messages (NULL if there
+ *			were no errors, to be free'd using g_string_free())
+ *
+ * @returns XML document or NULL if the document is not well-formed
+ */
+xmlDocPtr xml_stream_parser_finish (xmlStreamParserPtr parser, GString **errors);
+
 /**
  * Common function to create a XML DOM object from a given
  * XML buffer. This function sets up a parser context
@@ -178,7 +234,9 @@ xmlDocPtr xml_parse (gchar *data, size_t length, errorCtxtPtr errors);
  * The function returns a XML document pointer or NULL
  * if the document could not be read. It also sets 
  * errormsg to the last error messages on parsing
- * errors. 
+ * errors. If the document was already parsed while
+ * downloading (fpc->doc is set) only the errors are
+ * taken over.
  *
  * @param fpc	feed parsing context with valid data
  *